@@ -4731,7 +4731,7 @@ int do_init(int argc, char **argv)
 
 	ShowInfo("Initializing char server.\n");
 	auth_db = idb_alloc(DB_OPT_RELEASE_DATA);
-	online_char_db = idb_alloc(DB_OPT_RELEASE_DATA);
+	online_char_db = idb_alloc(DB_OPT_RELEASE_DATA|DB_OPT_OPEN_HASH);
 	mmo_char_init();
 	char_read_fame_list(); //Read fame lists.
 #ifdef ENABLE_SC_SAVING
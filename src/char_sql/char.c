@@ -1211,7 +1211,7 @@ int mmo_char_fromsql(int char_id, struct mmo_charstatus* p, bool load_everything
 int mmo_char_sql_init(void)
 {
 	ShowInfo("Begin Initializing.......\n");
-	char_db_= idb_alloc(DB_OPT_RELEASE_DATA);
+	char_db_= idb_alloc(DB_OPT_RELEASE_DATA|DB_OPT_OPEN_HASH);
 
 	if(char_per_account == 0){
 	  ShowStatus("Chars per Account: 'Unlimited'.......\n");
@@ -4532,7 +4532,7 @@ int do_init(int argc, char **argv)
 	
 	ShowInfo("Initializing char server.\n");
 	auth_db = idb_alloc(DB_OPT_RELEASE_DATA);
-	online_char_db = idb_alloc(DB_OPT_RELEASE_DATA);
+	online_char_db = idb_alloc(DB_OPT_RELEASE_DATA|DB_OPT_OPEN_HASH);
 	mmo_char_sql_init();
 	char_read_fame_list(); //Read fame lists.
 	ShowInfo("char server initialized.\n");
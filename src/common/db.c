@@ -10,6 +10,8 @@
  *  (5) Public functions
  *
  *  The databases are structured as a hashtable of RED-BLACK trees.
+ *  Databases created with DB_OPT_OPEN_HASH use a resizable open addressing
+ *  hashtable instead (see db_oa_* functions).
  *
  *  <B>Properties of the RED-BLACK trees being used:</B>
  *  1. The value of any node is greater than the value of its left child and
@@ -48,6 +50,7 @@
  *  - create a db that organizes itself by splaying
  *
  *  HISTORY:
+ *    2026/10/19 - Added open addressing databases (DB_OPT_OPEN_HASH).
  *    2008/02/19 - Fixed db_obj_get not handling deleted entries correctly.
  *    2007/11/09 - Added an iterator to the database.
  *    2006/12/21 - Added 1-node cache to the database.
@@ -82,6 +85,8 @@
  *  HASH_SIZE       - Define with the size of the hashtable.                 *
  *  DBNColor        - Enumeration of colors of the nodes.                    *
  *  DBNode          - Structure of a node in RED-BLACK trees.                *
+ *  struct db_entry - Structure of an entry in open addressing databases.    *
+ *  struct db_slot  - Structure of a slot of the open addressing index.      *
  *  struct db_free  - Structure that holds a deleted node to be freed.       *
  *  DBMap_impl      - Struture of the database.                              *
  *  stats           - Statistics about the database system.                  *
@@ -141,6 +146,52 @@ typedef struct dbn {
 	unsigned deleted : 1;
 } *DBNode;
 
+/**
+ * Minimum number of bits of the index of open addressing databases.
+ * @private
+ * @see DBMap_impl#oa_bits
+ */
+#define DB_OA_MIN_BITS 4
+
+/**
+ * Position of a deleted entry in the index of open addressing databases.
+ * @private
+ * @see struct db_slot
+ */
+#define DB_OA_DELETED UINT_MAX
+
+/**
+ * An entry of an open addressing database.
+ * Entries are kept in insertion order, removed entries stay in the array 
+ * (marked as deleted) until the database is compacted.
+ * @param key Key of this database entry
+ * @param data Data of this database entry
+ * @param hash Full hash of the key
+ * @param deleted If the entry is deleted
+ * @private
+ * @see DBMap_impl#oa_entries
+ * @see #db_oa_rehash(DBMap_impl*)
+ */
+struct db_entry {
+	DBKey key;
+	void *data;
+	unsigned int hash;
+	unsigned deleted : 1;
+};
+
+/**
+ * A slot of the index of an open addressing database.
+ * The hash is kept here so most mismatches don't need to look at the entry.
+ * @param pos Position of the entry +1, 0 if free or DB_OA_DELETED
+ * @param hash Full hash of the key
+ * @private
+ * @see DBMap_impl#oa_index
+ */
+struct db_slot {
+	unsigned int pos;
+	unsigned int hash;
+};
+
 /**
  * Structure that holds a deleted node.
  * @param node Deleted node
@@ -172,6 +223,12 @@ struct db_free {
  * @param item_count Number of items in the database
  * @param maxlen Maximum length of strings in DB_STRING and DB_ISTRING databases
  * @param global_lock Global lock of the database
+ * @param oa_entries Entries of an open addressing database
+ * @param oa_count Number of entries in oa_entries, including deleted ones
+ * @param oa_max Current maximum capacity of oa_entries
+ * @param oa_deleted Number of deleted entries in oa_entries
+ * @param oa_index Hashtable of positions in oa_entries
+ * @param oa_bits Size of oa_index in bits
  * @private
  * @see #db_alloc(const char*,int,DBType,DBOptions,unsigned short)
  */
@@ -199,6 +256,13 @@ typedef struct DBMap_impl {
 	uint32 item_count;
 	unsigned short maxlen;
 	unsigned global_lock : 1;
+	// Open addressing
+	struct db_entry *oa_entries;
+	unsigned int oa_count;
+	unsigned int oa_max;
+	unsigned int oa_deleted;
+	struct db_slot *oa_index;
+	unsigned int oa_bits;
 } DBMap_impl;
 
 /**
@@ -206,6 +270,7 @@ typedef struct DBMap_impl {
  * @param vtable Interface of the iterator
  * @param db Parent database
  * @param ht_index Current index of the hashtable
+ *          (current entry in open addressing databases)
  * @param node Current node
  * @private
  * @see #DBIterator
@@ -328,6 +393,10 @@ static struct db_stats {
  *  db_free_unlock     - Decrement the free_lock of a database.              *
  *         If it was the last lock, frees the nodes in free_list.            *
  *         NOTE: Keeps the database trees balanced.                          *
+ *  db_oa_find         - Find an entry of an open addressing database.       *
+ *  db_oa_rehash       - Rebuild the index of an open addressing database.   *
+ *  db_oa_insert       - Add an entry to an open addressing database.        *
+ *  db_oa_delete       - Remove an entry from an open addressing database.   *
 \*****************************************************************************/
 
 /**
@@ -639,7 +708,7 @@ static DBKey db_dup_key(DBMap_impl* db, DBKey key)
 		case DB_STRING:
 		case DB_ISTRING:
 			len = strnlen(key.str, db->maxlen);
-			str = (char*)aMalloc(len + 1);
+			str = (char*)aMallocTag(len + 1, MEMTAG_DB);
 			memcpy(str, key.str, len);
 			str[len] = '\0';
 			key.str = str;
@@ -713,7 +782,7 @@ static void db_free_add(DBMap_impl* db, DBNode node, DBNode *root)
 			}
 			db->free_max = (unsigned int)~0;
 		}
-		RECREATE(db->free_list, struct db_free, db->free_max);
+		RECREATE_TAG(db->free_list, struct db_free, db->free_max, MEMTAG_DB);
 	}
 	node->deleted = 1;
 	db->free_list[db->free_count].node = node;
@@ -811,6 +880,166 @@ static void db_free_unlock(DBMap_impl* db)
 	db->free_count = 0;
 }
 
+/**
+ * Position in the index of an open addressing database where the search for 
+ * a hash starts.
+ * Multiplicative hashing, so sequential and aligned keys are spread out.
+ * @private
+ */
+#define DB_OA_SLOT(db,hash) ( ((uint32)(hash)*2654435769U) >> (32 - (db)->oa_bits) )
+
+/**
+ * Find the entry identified by the key in an open addressing database.
+ * If out_slot is not NULL, it receives the index slot where the entry is or 
+ * where a new entry with this key can be put.
+ * @param db Target database
+ * @param key Key of the entry
+ * @param hash Hash of the key
+ * @param out_slot Slot of the index
+ * @return Entry or NULL if not found
+ * @private
+ * @see DBMap_impl#oa_index
+ */
+static struct db_entry* db_oa_find(DBMap_impl* db, DBKey key, unsigned int hash, unsigned int* out_slot)
+{
+	unsigned int mask;
+	unsigned int slot;
+	unsigned int pos;
+	bool reuse = false;
+
+	if (db->oa_index == NULL)
+		return NULL; // empty
+	mask = (1U<<db->oa_bits) - 1;
+	slot = DB_OA_SLOT(db, hash);
+	while ((pos = db->oa_index[slot].pos) != 0) {
+		if (pos == DB_OA_DELETED) {
+			if (!reuse && out_slot) { // first slot that can be reused
+				*out_slot = slot;
+				reuse = true;
+			}
+		} else if (db->oa_index[slot].hash == hash && db->cmp(key, db->oa_entries[pos-1].key, db->maxlen) == 0) {
+			if (out_slot)
+				*out_slot = slot;
+			return &db->oa_entries[pos-1];
+		}
+		slot = (slot+1)&mask;
+	}
+	if (!reuse && out_slot)
+		*out_slot = slot;
+	return NULL;
+}
+
+/**
+ * Rebuild the index of an open addressing database, with room for as many 
+ * entries as there are now.
+ * When the database is not locked, deleted entries are removed and the 
+ * remaining entries are moved to the start of the array (order is kept).
+ * @param db Target database
+ * @private
+ * @see DBMap_impl#oa_entries
+ * @see DBMap_impl#oa_index
+ */
+static void db_oa_rehash(DBMap_impl* db)
+{
+	unsigned int i;
+	unsigned int j;
+	unsigned int mask;
+	unsigned int slot;
+
+	if (db->free_lock == 0 && db->oa_deleted) { // compact
+		for (i = j = 0; i < db->oa_count; i++) {
+			if (db->oa_entries[i].deleted)
+				continue;
+			if (i != j)
+				memcpy(&db->oa_entries[j], &db->oa_entries[i], sizeof(struct db_entry));
+			j++;
+		}
+		db->oa_count = j;
+		db->oa_deleted = 0;
+		if (db->oa_max > 16 && db->oa_count < db->oa_max/4) {
+			db->oa_max = max(16, db->oa_count*2);
+			RECREATE_TAG(db->oa_entries, struct db_entry, db->oa_max, MEMTAG_DB);
+		}
+	}
+
+	// at most half full after rehashing
+	for (db->oa_bits = DB_OA_MIN_BITS; db->oa_bits < 31; db->oa_bits++)
+		if ((db->oa_count+1)*2 <= (1U<<db->oa_bits))
+			break;
+	mask = (1U<<db->oa_bits) - 1;
+	if (db->oa_index)
+		aFree(db->oa_index);
+	CREATE_TAG(db->oa_index, struct db_slot, mask+1, MEMTAG_DB);
+	for (i = 0; i < db->oa_count; i++) {
+		if (db->oa_entries[i].deleted)
+			continue;
+		slot = DB_OA_SLOT(db, db->oa_entries[i].hash);
+		while (db->oa_index[slot].pos)
+			slot = (slot+1)&mask;
+		db->oa_index[slot].pos = i+1;
+		db->oa_index[slot].hash = db->oa_entries[i].hash;
+	}
+}
+
+/**
+ * Add an entry to an open addressing database.
+ * The key must not exist in the database and is used as is.
+ * The index grows when it's more than 3/4 full.
+ * @param db Target database
+ * @param key Key of the entry
+ * @param hash Hash of the key
+ * @param data Data of the entry
+ * @return Position of the new entry
+ * @private
+ * @see #db_oa_rehash(DBMap_impl*)
+ */
+static unsigned int db_oa_insert(DBMap_impl* db, DBKey key, unsigned int hash, void* data)
+{
+	struct db_entry* entry;
+	unsigned int slot;
+
+	if (db->oa_index == NULL || db->oa_count+1 > ((1U<<db->oa_bits)>>2)*3)
+		db_oa_rehash(db);
+	db_oa_find(db, key, hash, &slot);
+	if (db->oa_count == db->oa_max) { // No more space, expand oa_entries
+		db->oa_max = (db->oa_max ? db->oa_max*2 : 16);
+		RECREATE_TAG(db->oa_entries, struct db_entry, db->oa_max, MEMTAG_DB);
+	}
+	entry = &db->oa_entries[db->oa_count];
+	entry->key = key;
+	entry->data = data;
+	entry->hash = hash;
+	entry->deleted = 0;
+	db->oa_index[slot].pos = ++db->oa_count;
+	db->oa_index[slot].hash = hash;
+	db->item_count++;
+	return db->oa_count-1;
+}
+
+/**
+ * Remove an entry from an open addressing database.
+ * Releases the key and the data, the entry is marked as deleted and stays 
+ * in the array until the database is compacted.
+ * @param db Target database
+ * @param entry Target entry
+ * @private
+ * @see #db_oa_rehash(DBMap_impl*)
+ */
+static void db_oa_delete(DBMap_impl* db, struct db_entry* entry)
+{
+	unsigned int mask = (1U<<db->oa_bits) - 1;
+	unsigned int pos = (unsigned int)(entry - db->oa_entries) + 1;
+	unsigned int slot = DB_OA_SLOT(db, entry->hash);
+
+	while (db->oa_index[slot].pos != pos)
+		slot = (slot+1)&mask;
+	db->oa_index[slot].pos = DB_OA_DELETED;
+	db->release(entry->key, entry->data, DB_RELEASE_BOTH);
+	entry->deleted = 1;
+	db->oa_deleted++;
+	db->item_count--;
+}
+
 /*****************************************************************************\
  *  (3) Section of protected functions used internally.                      *
  *  NOTE: the protected functions used in the database interface are in the  *
@@ -1096,6 +1325,8 @@ static void db_release_both(DBKey key, void *data, DBRelease which)
  *  db_obj_size     - Return the size of the database.                       *
  *  db_obj_type     - Return the type of the database.                       *
  *  db_obj_options  - Return the options of the database.                    *
+ *  dbit_oa_*, db_oa_* - Versions of the above for open addressing           *
+ *           databases (DB_OPT_OPEN_HASH).                                   *
 \*****************************************************************************/
 
 /**
@@ -2217,6 +2448,488 @@ static DBOptions db_obj_options(DBMap* self)
 	return options;
 }
 
+/**
+ * Fetches the first entry in an open addressing database.
+ * @param self Iterator
+ * @param out_key Key of the entry
+ * @return Data of the entry
+ * @protected
+ * @see DBIterator#first
+ */
+static void* dbit_oa_first(DBIterator* self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+
+	DB_COUNTSTAT(dbit_first);
+	it->ht_index = -1; // before the first entry
+	return self->next(self, out_key);
+}
+
+/**
+ * Fetches the last entry in an open addressing database.
+ * @param self Iterator
+ * @param out_key Key of the entry
+ * @return Data of the entry
+ * @protected
+ * @see DBIterator#last
+ */
+static void* dbit_oa_last(DBIterator* self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+
+	DB_COUNTSTAT(dbit_last);
+	it->ht_index = INT_MAX; // after the last entry
+	return self->prev(self, out_key);
+}
+
+/**
+ * Fetches the next entry in an open addressing database.
+ * Entries are fetched in insertion order.
+ * @param self Iterator
+ * @param out_key Key of the entry
+ * @return Data of the entry
+ * @protected
+ * @see DBIterator#next
+ */
+static void* dbit_oa_next(DBIterator* self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	DBMap_impl* db = it->db;
+	unsigned int i;
+
+	DB_COUNTSTAT(dbit_next);
+	for (i = (unsigned int)it->ht_index + 1; i < db->oa_count; i++) {
+		struct db_entry* entry = &db->oa_entries[i];
+		if (!entry->deleted) { // found next entry
+			it->ht_index = (int)i;
+			if (out_key)
+				memcpy(out_key, &entry->key, sizeof(DBKey));
+			return entry->data;
+		}
+	}
+	it->ht_index = INT_MAX;
+	return NULL; // not found
+}
+
+/**
+ * Fetches the previous entry in an open addressing database.
+ * @param self Iterator
+ * @param out_key Key of the entry
+ * @return Data of the entry
+ * @protected
+ * @see DBIterator#prev
+ */
+static void* dbit_oa_prev(DBIterator* self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	DBMap_impl* db = it->db;
+	unsigned int i;
+
+	DB_COUNTSTAT(dbit_prev);
+	i = (it->ht_index < 0 ? 0 : min((unsigned int)it->ht_index, db->oa_count));
+	while (i > 0) {
+		struct db_entry* entry = &db->oa_entries[--i];
+		if (!entry->deleted) { // found previous entry
+			it->ht_index = (int)i;
+			if (out_key)
+				memcpy(out_key, &entry->key, sizeof(DBKey));
+			return entry->data;
+		}
+	}
+	it->ht_index = -1;
+	return NULL; // not found
+}
+
+/**
+ * Returns true if the fetched entry of an open addressing database exists.
+ * @param self Iterator
+ * @return true is the entry exists
+ * @protected
+ * @see DBIterator#exists
+ */
+static bool dbit_oa_exists(DBIterator* self)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	DBMap_impl* db = it->db;
+
+	DB_COUNTSTAT(dbit_exists);
+	return (it->ht_index >= 0 && (unsigned int)it->ht_index < db->oa_count && !db->oa_entries[it->ht_index].deleted);
+}
+
+/**
+ * Removes the current entry from an open addressing database.
+ * @param self Iterator
+ * @return The data of the entry or NULL if not found
+ * @protected
+ * @see DBIterator#remove
+ */
+static void* dbit_oa_remove(DBIterator* self)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	void* data = NULL;
+
+	DB_COUNTSTAT(dbit_remove);
+	if (self->exists(self)) {
+		struct db_entry* entry = &it->db->oa_entries[it->ht_index];
+		data = entry->data;
+		db_oa_delete(it->db, entry);
+	}
+	return data;
+}
+
+/**
+ * Returns a new iterator for an open addressing database.
+ * The entries are not moved while the iterator exists.
+ * @param self Database
+ * @return New iterator
+ * @protected
+ * @see #db_obj_iterator(DBMap*)
+ */
+static DBIterator* db_oa_iterator(DBMap* self)
+{
+	DBIterator* it = db_obj_iterator(self);
+
+	it->first   = dbit_oa_first;
+	it->last    = dbit_oa_last;
+	it->next    = dbit_oa_next;
+	it->prev    = dbit_oa_prev;
+	it->exists  = dbit_oa_exists;
+	it->remove  = dbit_oa_remove;
+	return it;
+}
+
+/**
+ * Returns true if the entry exists in an open addressing database.
+ * @param self Interface of the database
+ * @param key Key that identifies the entry
+ * @return true is the entry exists
+ * @protected
+ * @see DBMap#exists
+ */
+static bool db_oa_exists(DBMap* self, DBKey key)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+
+	DB_COUNTSTAT(db_exists);
+	if (db == NULL) return false; // nullpo candidate
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		return false; // nullpo candidate
+	}
+
+	return (db_oa_find(db, key, db->hash(key, db->maxlen), NULL) != NULL);
+}
+
+/**
+ * Get the data of the entry identifid by the key in an open addressing
+ * database.
+ * @param self Interface of the database
+ * @param key Key that identifies the entry
+ * @return Data of the entry or NULL if not found
+ * @protected
+ * @see DBMap#get
+ */
+static void* db_oa_get(DBMap* self, DBKey key)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_entry* entry;
+
+	DB_COUNTSTAT(db_get);
+	if (db == NULL) return NULL; // nullpo candidate
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_get: Attempted to retrieve non-allowed NULL key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+
+	entry = db_oa_find(db, key, db->hash(key, db->maxlen), NULL);
+	return (entry ? entry->data : NULL);
+}
+
+/**
+ * Get the data of the entries matched by <code>match</code> in an open
+ * addressing database.
+ * @param self Interface of the database
+ * @param buf Buffer to put the data of the matched entries
+ * @param max Maximum number of data entries to be put into buf
+ * @param match Function that matches the database entries
+ * @param ... Extra arguments for match
+ * @return The number of entries that matched
+ * @protected
+ * @see DBMap#vgetall
+ */
+static unsigned int db_oa_vgetall(DBMap* self, void **buf, unsigned int max, DBMatcher match, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	unsigned int i;
+	unsigned int ret = 0;
+
+	DB_COUNTSTAT(db_vgetall);
+	if (db == NULL) return 0; // nullpo candidate
+	if (match == NULL) return 0; // nullpo candidate
+
+	db_free_lock(db);
+	for (i = 0; i < db->oa_count; i++) {
+		struct db_entry* entry = &db->oa_entries[i];
+		if (!(entry->deleted))
+		{
+			va_list argscopy;
+			va_copy(argscopy, args);
+			if (match(entry->key, entry->data, argscopy) == 0) {
+				if (buf && ret < max)
+					buf[ret] = db->oa_entries[i].data;
+				ret++;
+			}
+			va_end(argscopy);
+		}
+	}
+	db_free_unlock(db);
+	return ret;
+}
+
+/**
+ * Get the data of the entry identified by the key in an open addressing
+ * database, creating the entry if it doesn't exist.
+ * @param self Interface of the database
+ * @param key Key that identifies the entry
+ * @param create Function used to create the data if the entry doesn't exist
+ * @param args Extra arguments for create
+ * @return Data of the entry
+ * @protected
+ * @see DBMap#vensure
+ */
+static void *db_oa_vensure(DBMap* self, DBKey key, DBCreateData create, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_entry* entry;
+	unsigned int hash;
+	unsigned int pos;
+	void *data;
+
+	DB_COUNTSTAT(db_vensure);
+	if (db == NULL) return NULL; // nullpo candidate
+	if (create == NULL) {
+		ShowError("db_ensure: Create function is NULL for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_ensure: Attempted to use non-allowed NULL key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+
+	hash = db->hash(key, db->maxlen);
+	entry = db_oa_find(db, key, hash, NULL);
+	if (entry)
+		return entry->data;
+
+	if (db->item_count == UINT32_MAX) {
+		ShowError("db_vensure: item_count overflow, aborting item insertion.\n"
+				"Database allocated at %s:%d",
+				db->alloc_file, db->alloc_line);
+		return NULL;
+	}
+	db_free_lock(db);
+	pos = db_oa_insert(db, (db->options&DB_OPT_DUP_KEY) ? db_dup_key(db, key) : key, hash, NULL);
+	{
+		va_list argscopy;
+		va_copy(argscopy, args);
+		data = create(key, argscopy);
+		va_end(argscopy);
+	}
+	db->oa_entries[pos].data = data;
+	if ((db->options&(DB_OPT_DUP_KEY|DB_OPT_RELEASE_KEY)) == (DB_OPT_DUP_KEY|DB_OPT_RELEASE_KEY))
+		db->release(key, data, DB_RELEASE_KEY);
+	db_free_unlock(db);
+	return data;
+}
+
+/**
+ * Put the data identified by the key in an open addressing database.
+ * Returns the previous data if the entry exists or NULL.
+ * NOTE: Uses the new key, the old one is released.
+ * @param self Interface of the database
+ * @param key Key that identifies the data
+ * @param data Data to be put in the database
+ * @return The previous data if the entry exists or NULL
+ * @protected
+ * @see DBMap#put
+ */
+static void *db_oa_put(DBMap* self, DBKey key, void *data)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_entry* entry;
+	unsigned int hash;
+	void *old_data = NULL;
+
+	DB_COUNTSTAT(db_put);
+	if (db == NULL) return NULL; // nullpo candidate
+	if (db->global_lock) {
+		ShowError("db_put: Database is being destroyed, aborting entry insertion.\n"
+				"Database allocated at %s:%d\n",
+				db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_put: Attempted to use non-allowed NULL key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+	if (!(data || db->options&DB_OPT_ALLOW_NULL_DATA)) {
+		ShowError("db_put: Attempted to use non-allowed NULL data for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+
+	if (db->item_count == UINT32_MAX) {
+		ShowError("db_put: item_count overflow, aborting item insertion.\n"
+				"Database allocated at %s:%d",
+				db->alloc_file, db->alloc_line);
+		return NULL;
+	}
+	db_free_lock(db);
+	hash = db->hash(key, db->maxlen);
+	entry = db_oa_find(db, key, hash, NULL);
+	if (entry) { // equal entry, replace
+		db->release(entry->key, entry->data, DB_RELEASE_BOTH);
+		old_data = entry->data;
+		entry->key = (db->options&DB_OPT_DUP_KEY) ? db_dup_key(db, key) : key;
+		entry->data = data;
+	} else {
+		db_oa_insert(db, (db->options&DB_OPT_DUP_KEY) ? db_dup_key(db, key) : key, hash, data);
+	}
+	if ((db->options&(DB_OPT_DUP_KEY|DB_OPT_RELEASE_KEY)) == (DB_OPT_DUP_KEY|DB_OPT_RELEASE_KEY))
+		db->release(key, data, DB_RELEASE_KEY);
+	db_free_unlock(db);
+	return old_data;
+}
+
+/**
+ * Remove an entry from an open addressing database.
+ * The database is compacted when more than half of the entries are deleted.
+ * @param self Interface of the database
+ * @param key Key that identifies the entry
+ * @return The data of the entry or NULL if not found
+ * @protected
+ * @see DBMap#remove
+ */
+static void *db_oa_remove(DBMap* self, DBKey key)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_entry* entry;
+	void *data = NULL;
+
+	DB_COUNTSTAT(db_remove);
+	if (db == NULL) return NULL; // nullpo candidate
+	if (db->global_lock) {
+		ShowError("db_remove: Database is being destroyed. Aborting entry deletion.\n"
+				"Database allocated at %s:%d\n",
+				db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key))	{
+		ShowError("db_remove: Attempted to use non-allowed NULL key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+
+	db_free_lock(db);
+	entry = db_oa_find(db, key, db->hash(key, db->maxlen), NULL);
+	if (entry) {
+		data = entry->data;
+		db_oa_delete(db, entry);
+	}
+	db_free_unlock(db);
+	if (db->free_lock == 0 && db->oa_deleted > 16 && db->oa_deleted*2 > db->oa_count)
+		db_oa_rehash(db);
+	return data;
+}
+
+/**
+ * Apply <code>func</code> to every entry in an open addressing database.
+ * Returns the sum of values returned by func.
+ * @param self Interface of the database
+ * @param func Function to be applyed
+ * @param args Extra arguments for func
+ * @return Sum of the values returned by func
+ * @protected
+ * @see DBMap#vforeach
+ */
+static int db_oa_vforeach(DBMap* self, DBApply func, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	unsigned int i;
+	int sum = 0;
+
+	DB_COUNTSTAT(db_vforeach);
+	if (db == NULL) return 0; // nullpo candidate
+	if (func == NULL) {
+		ShowError("db_foreach: Passed function is NULL for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+
+	db_free_lock(db);
+	for (i = 0; i < db->oa_count; i++) {
+		struct db_entry* entry = &db->oa_entries[i];
+		if (!(entry->deleted))
+		{
+			va_list argscopy;
+			va_copy(argscopy, args);
+			sum += func(entry->key, entry->data, argscopy);
+			va_end(argscopy);
+		}
+	}
+	db_free_unlock(db);
+	return sum;
+}
+
+/**
+ * Removes all entries from an open addressing database.
+ * Before deleting an entry, func is applyed to it.
+ * Releases the key and the data.
+ * Returns the sum of values returned by func, if it exists.
+ * @param self Interface of the database
+ * @param func Function to be applyed to every entry before deleting
+ * @param args Extra arguments for func
+ * @return Sum of values returned by func
+ * @protected
+ * @see DBMap#vclear
+ */
+static int db_oa_vclear(DBMap* self, DBApply func, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_entry* entries;
+	unsigned int count;
+	unsigned int i;
+	int sum = 0;
+
+	DB_COUNTSTAT(db_vclear);
+	if (db == NULL) return 0; // nullpo candidate
+
+	db_free_lock(db);
+	// detach the entries, the database is empty from now on
+	entries = db->oa_entries;
+	count = db->oa_count;
+	if (db->oa_index)
+		aFree(db->oa_index);
+	db->oa_index = NULL;
+	db->oa_entries = NULL;
+	db->oa_count = 0;
+	db->oa_max = 0;
+	db->oa_deleted = 0;
+	db->item_count = 0;
+	for (i = 0; i < count; i++) {
+		if (entries[i].deleted)
+			continue;
+		if (func)
+		{
+			va_list argscopy;
+			va_copy(argscopy, args);
+			sum += func(entries[i].key, entries[i].data, argscopy);
+			va_end(argscopy);
+		}
+		db->release(entries[i].key, entries[i].data, DB_RELEASE_BOTH);
+	}
+	if (entries)
+		aFree(entries);
+	db_free_unlock(db);
+	return sum;
+}
+
 /*****************************************************************************\
  *  (5) Section with public functions.
  *  db_fix_options     - Apply database type restrictions to the options.
@@ -2390,7 +3103,7 @@ DBMap* db_alloc(const char *file, int line, DBType type, DBOptions options, unsi
 		case DB_ISTRING: DB_COUNTSTAT(db_istring_alloc); break;
 	}
 #endif /* DB_ENABLE_STATS */
-	CREATE(db, struct DBMap_impl, 1);
+	CREATE_TAG(db, struct DBMap_impl, 1, MEMTAG_DB);
 
 	options = db_fix_options(type, options);
 	/* Interface of the database */
@@ -2412,6 +3125,17 @@ DBMap* db_alloc(const char *file, int line, DBType type, DBOptions options, unsi
 	db->vtable.size     = db_obj_size;
 	db->vtable.type     = db_obj_type;
 	db->vtable.options  = db_obj_options;
+	if (options&DB_OPT_OPEN_HASH) { // Open addressing
+		db->vtable.iterator = db_oa_iterator;
+		db->vtable.exists   = db_oa_exists;
+		db->vtable.get      = db_oa_get;
+		db->vtable.vgetall  = db_oa_vgetall;
+		db->vtable.vensure  = db_oa_vensure;
+		db->vtable.put      = db_oa_put;
+		db->vtable.remove   = db_oa_remove;
+		db->vtable.vforeach = db_oa_vforeach;
+		db->vtable.vclear   = db_oa_vclear;
+	}
 	/* File and line of allocation */
 	db->alloc_file = file;
 	db->alloc_line = line;
@@ -2421,8 +3145,8 @@ DBMap* db_alloc(const char *file, int line, DBType type, DBOptions options, unsi
 	db->free_max = 0;
 	db->free_lock = 0;
 	/* Other */
-	db->nodes = ers_new(sizeof(struct dbn));
-	db->iters = ers_new(sizeof(DBIterator_impl));
+	db->nodes = ers_new(sizeof(struct dbn), "db_node", MEMTAG_DB);
+	db->iters = ers_new(sizeof(DBIterator_impl), "db_iterator", MEMTAG_DB);
 	db->cmp = db_default_cmp(type);
 	db->hash = db_default_hash(type);
 	db->release = db_default_release(type, options);
@@ -2434,6 +3158,12 @@ DBMap* db_alloc(const char *file, int line, DBType type, DBOptions options, unsi
 	db->item_count = 0;
 	db->maxlen = maxlen;
 	db->global_lock = 0;
+	db->oa_entries = NULL;
+	db->oa_count = 0;
+	db->oa_max = 0;
+	db->oa_deleted = 0;
+	db->oa_index = NULL;
+	db->oa_bits = 0;
 
 	if( db->maxlen == 0 && (type == DB_STRING || type == DB_ISTRING) )
 		db->maxlen = UINT16_MAX;
@@ -2586,7 +3316,7 @@ void linkdb_insert( struct linkdb_node** head, void *key, void* data)
 {
 	struct linkdb_node *node;
 	if( head == NULL ) return;
-	node = (struct linkdb_node*)aMalloc( sizeof(struct linkdb_node) );
+	node = (struct linkdb_node*)aMallocTag( sizeof(struct linkdb_node), MEMTAG_DB );
 	if( *head == NULL ) {
 		// first node
 		*head      = node;
@@ -4,7 +4,8 @@
  *                                                                           *
  *  <H1>Entry Reusage System</H1>                                            *
  *                                                                           *
- *  There are several root entry managers, each with a different entry size. *
+ *  There are several root entry managers, one for each type of entry        *
+ *  (name, entry size and subsystem, used for the memory accounting).        *
  *  Each manager will keep track of how many instances have been 'created'.  *
  *  They will only automatically destroy themselves after the last instance  *
  *  is destroyed.                                                            *
@@ -15,8 +16,12 @@
  *  Entries should be freed in the manager they where allocated from.        *
  *  Failure to do so can lead to unexpected behaviours.                      *
  *                                                                           *
+ *  Entries are allocated in slabs of about ERS_SLAB_SIZE bytes that start   *
+ *  at a cache line. When ers_set_release_time is used, slabs that have no   *
+ *  entries in use for that long are released.                               *
+ *                                                                           *
  *  <H2>Advantages:</H2>                                                     *
- *  - The same manager is used for entries of the same size.                 *
+ *  - The same manager is used for entries of the same type.                 *
  *    So entries freed in one instance of the manager can be used by other   *
  *    instances of the manager.                                              *
  *  - Much less memory allocation/deallocation - program will be faster.     *
@@ -24,43 +29,64 @@
  *                                                                           *
  *  <H2>Disavantages:</H2>                                                   *
  *  - Unused entries are almost inevitable - memory being wasted.            *
- *  - A  manager will only auto-destroy when all of its instances are        *
- *    destroyed so memory will usually only be recovered near the end.       *
+ *  - Only slabs without entries in use can be released, so memory is        *
+ *    usually only recovered near the end or after a peak of usage.          *
  *  - Always wastes space for entries smaller than a pointer.                *
  *                                                                           *
  *  WARNING: The system is not thread-safe at the moment.                    *
  *                                                                           *
  *  HISTORY:                                                                 *
  *    0.1 - Initial version                                                  *
+ *    0.2 - Slabs, statistics and release of unused slabs                    *
  *                                                                           *
- * @version 0.1 - Initial version                                            *
+ * @version 0.2 - Slabs, statistics and release of unused slabs              *
  * @author Flavio @ Amazon Project                                           *
  * @encoding US-ASCII                                                        *
  * @see common#ers.h                                                         *
 \*****************************************************************************/
 #include <stdlib.h>
+#include <string.h>
 
 #include "../common/cbasetypes.h"
 #include "../common/malloc.h" // CREATE, RECREATE, aMalloc, aFree
 #include "../common/showmsg.h" // ShowMessage, ShowError, ShowFatalError, CL_BOLD, CL_NORMAL
+#include "../common/timer.h" // add_timer_interval, delete_timer, DIFF_TICK
 #include "ers.h"
 
 #ifndef DISABLE_ERS
 /*****************************************************************************\
  *  (1) Private defines, structures and global variables.                    *
- *  ERS_BLOCK_ENTRIES - Number of entries in each block.                     *
+ *  ERS_SLAB_SIZE     - Size of the entries of a slab in bytes.              *
+ *  ERS_SLAB_ENTRIES  - Minimum number of entries in each slab.              *
+ *  ERS_CACHE_LINE    - Alignment of the slabs.                              *
  *  ERS_ROOT_SIZE     - Maximum number of root entry managers.               *
  *  ERLinkedList      - Structure of a linked list of reusable entries.      *
+ *  ERSlab            - Structure of a slab of entries.                      *
  *  ERS_impl          - Class of an entry manager.                           *
  *  ers_root          - Array of root entry managers.                        *
  *  ers_num           - Number of root entry managers in the array.          *
+ *  ers_release_time  - Time after which unused slabs are released.          *
 \*****************************************************************************/
 
 /**
- * Number of entries in each block.
+ * Size of the entries of a slab in bytes.
+ * Slabs of this size are mapped from the OS by the memory manager, so they
+ * are given back when released.
+ * @see #ers_obj_alloc_entry(ERS eri)
+ */
+#define ERS_SLAB_SIZE 65536
+
+/**
+ * Minimum number of entries in each slab.
  * @see #ers_obj_alloc_entry(ERS eri)
  */
-#define ERS_BLOCK_ENTRIES 4096
+#define ERS_SLAB_ENTRIES 16
+
+/**
+ * The entries of a slab start at a multiple of this.
+ * @see ERSlab#data
+ */
+#define ERS_CACHE_LINE 64
 
 /**
  * Maximum number of root entry managers.
@@ -81,15 +107,37 @@ typedef struct ers_ll {
 } *ERLinkedList;
 
 /**
- * Class of the object that manages entries of a certain size.
+ * Slab of entries.
+ * @param mem Allocated memory
+ * @param data First entry, aligned to ERS_CACHE_LINE
+ * @param idle If the slab had no entries in use at the last check
+ * @param idle_tick Tick of the check that found the slab unused
+ * @private
+ * @see ERS_impl#slabs
+ */
+typedef struct ers_slab {
+	uint8 *mem;
+	uint8 *data;
+	bool idle;
+	unsigned int idle_tick;
+} ERSlab;
+
+/**
+ * Class of the object that manages entries of a certain type.
  * @param eri Public interface of the object
  * @param reuse Linked list of reusable data entries
- * @param blocks Array with blocks of entries
- * @param free Number of unused entries in the last block
- * @param num Number of blocks in the array
+ * @param slabs Array with slabs of entries
+ * @param free Number of unused entries in the last slab
+ * @param num Number of slabs in the array
  * @param max Current maximum capacity of the array
  * @param destroy Destroy lock
  * @param size Size of the entries of the manager
+ * @param count Number of entries in each slab
+ * @param tag Subsystem the slabs are accounted to
+ * @param name Name of the type of entries
+ * @param used Number of entries in use
+ * @param peak Maximum number of entries in use
+ * @param released Number of slabs released so far
  * @private
  */
 typedef struct ers_impl {
@@ -110,17 +158,17 @@ typedef struct ers_impl {
 	ERLinkedList reuse;
 
 	/**
-	 * Array with blocks of entries.
+	 * Array with slabs of entries.
 	 */
-	uint8 **blocks;
+	ERSlab *slabs;
 
 	/**
-	 * Number of unused entries in the last block.
+	 * Number of unused entries in the last slab.
 	 */
 	uint32 free;
 
 	/**
-	 * Number of blocks in the array.
+	 * Number of slabs in the array.
 	 */
 	uint32 num;
 
@@ -139,6 +187,36 @@ typedef struct ers_impl {
 	 */
 	size_t size;
 
+	/**
+	 * Number of entries in each slab.
+	 */
+	uint32 count;
+
+	/**
+	 * Subsystem the slabs are accounted to.
+	 */
+	enum memtag tag;
+
+	/**
+	 * Name of the type of entries.
+	 */
+	const char *name;
+
+	/**
+	 * Number of entries in use.
+	 */
+	uint32 used;
+
+	/**
+	 * Maximum number of entries in use.
+	 */
+	uint32 peak;
+
+	/**
+	 * Number of slabs released so far.
+	 */
+	uint32 released;
+
 } *ERS_impl;
 
 /**
@@ -159,12 +237,31 @@ static ERS_impl ers_root[ERS_ROOT_SIZE];
  */
 static uint32 ers_num = 0;
 
+/**
+ * Time in ms after which slabs without entries in use are released.
+ * 0 keeps all slabs until the manager is destroyed.
+ * @private
+ * @static
+ * @see #ers_set_release_time(unsigned int time)
+ */
+static unsigned int ers_release_time = 0;
+
+/**
+ * Timer that looks for unused slabs.
+ * @private
+ * @static
+ * @see #ers_release_timer(int tid, unsigned int tick, int id, intptr_t data)
+ */
+static int ers_release_tid = INVALID_TIMER;
+
 /*****************************************************************************\
  *  (2) Object functions.                                                 *
  *  ers_obj_alloc_entry - Allocate an entry from the manager.                *
  *  ers_obj_free_entry  - Free an entry allocated from the manager.          *
  *  ers_obj_entry_size  - Return the size of the entries of the manager.     *
  *  ers_obj_destroy     - Destroy the instance of the manager.               *
+ *  ers_obj_find_slab   - Find the slab of an entry.                         *
+ *  ers_obj_release     - Release slabs without entries in use.              *
 \*****************************************************************************/
 
 /**
@@ -172,7 +269,7 @@ static uint32 ers_num = 0;
  * If there are reusable entries available, it reuses one instead.
  * @param self Interface of the entry manager
  * @return An entry
- * @see #ERS_BLOCK_ENTRIES
+ * @see #ERS_SLAB_SIZE
  * @see #ERLinkedList
  * @see ERS_impl::vtable#alloc
  */
@@ -191,22 +288,29 @@ static void *ers_obj_alloc_entry(ERS self)
 		obj->reuse = obj->reuse->next;
 	} else if (obj->free) { // Unused entry
 		obj->free--;
-		ret = &obj->blocks[obj->num -1][obj->free*obj->size];
-	} else { // allocate a new block
-		if (obj->num == obj->max) { // expand the block array
-			if (obj->max == UINT32_MAX) { // No more space for blocks
-				ShowFatalError("ers::alloc : maximum number of blocks reached, increase ERS_BLOCK_ENTRIES.\n"
+		ret = &obj->slabs[obj->num -1].data[obj->free*obj->size];
+	} else { // allocate a new slab
+		ERSlab *slab;
+
+		if (obj->num == obj->max) { // expand the slab array
+			if (obj->max == UINT32_MAX) { // No more space for slabs
+				ShowFatalError("ers::alloc : maximum number of slabs reached, increase ERS_SLAB_SIZE.\n"
 						"exiting the program...\n");
 				exit(EXIT_FAILURE);
 			}
 			obj->max = (obj->max*4)+3; // left shift bits '11' - overflow won't happen
-			RECREATE(obj->blocks, uint8 *, obj->max);
+			RECREATE_TAG(obj->slabs, ERSlab, obj->max, obj->tag);
 		}
-		CREATE(obj->blocks[obj->num], uint8, obj->size*ERS_BLOCK_ENTRIES);
-		obj->free = ERS_BLOCK_ENTRIES -1;
-		ret = &obj->blocks[obj->num][obj->free*obj->size];
+		slab = &obj->slabs[obj->num];
+		slab->mem = (uint8 *)aMallocTag(obj->size*obj->count + ERS_CACHE_LINE -1, obj->tag);
+		slab->data = (uint8 *)(((uintptr_t)slab->mem + ERS_CACHE_LINE -1)&~(uintptr_t)(ERS_CACHE_LINE -1));
+		slab->idle = false;
+		obj->free = obj->count -1;
+		ret = &slab->data[obj->free*obj->size];
 		obj->num++;
 	}
+	if (++obj->used > obj->peak)
+		obj->peak = obj->used;
 	return ret;
 }
 
@@ -236,6 +340,7 @@ static void ers_obj_free_entry(ERS self, void *entry)
 	reuse = (ERLinkedList)entry;
 	reuse->next = obj->reuse;
 	obj->reuse = reuse;
+	obj->used--;
 }
 
 /**
@@ -260,7 +365,7 @@ static size_t ers_obj_entry_size(ERS self)
 /**
  * Destroy this instance of the manager.
  * The manager is actually only destroyed when all the instances are destroyed.
- * When destroying the manager a warning is shown if the manager has 
+ * When destroying the manager a warning is shown if the manager has
  * missing/extra entries.
  * @param self Interface of the entry manager
  * @see #ERLinkedList
@@ -269,7 +374,7 @@ static size_t ers_obj_entry_size(ERS self)
 static void ers_obj_destroy(ERS self)
 {
 	ERS_impl obj = (ERS_impl)self;
-	ERLinkedList reuse,old;
+	ERLinkedList reuse;
 	uint32 i;
 	uint32 count;
 
@@ -291,66 +396,175 @@ static void ers_obj_destroy(ERS self)
 			break;
 		}
 	}
-	reuse = obj->reuse;
-	count = 0;
 	// Check for missing/extra entries
-	for (i = 0; i < obj->num; i++) {
-		if (i == 0) {
-			count = ERS_BLOCK_ENTRIES -obj->free;
-		} else if (count > UINT32_MAX -ERS_BLOCK_ENTRIES) {
-			count = UINT32_MAX;
-			break;
-		} else {
-			count += ERS_BLOCK_ENTRIES;
-		}
-		while (reuse && count) {
-			count--;
-			old = reuse;
-			reuse = reuse->next;
-			old->next = NULL; // this makes duplicate frees report as missing entries
-		}
-	}
+	count = ( obj->num ) ? (obj->num -1)*obj->count + (obj->count -obj->free) : 0;
+	for (reuse = obj->reuse; reuse && count; reuse = reuse->next)
+		count--; // duplicate frees make the list loop, so the count is the limit
 	if (count) { // missing entries
-		ShowWarning("ers::destroy : %u entries missing (possible double free), continuing destruction (entry size=%u).\n",
-				count, obj->size);
+		ShowWarning("ers::destroy : %u entries missing (possible double free), continuing destruction (%s, entry size=%u).\n",
+				count, obj->name, obj->size);
 	} else if (reuse) { // extra entries
 		while (reuse && count != UINT32_MAX) {
 			count++;
 			reuse = reuse->next;
 		}
-		ShowWarning("ers::destroy : %u extra entries found, continuing destruction (entry size=%u).\n",
-				count, obj->size);
+		ShowWarning("ers::destroy : %u extra entries found, continuing destruction (%s, entry size=%u).\n",
+				count, obj->name, obj->size);
 	}
 	// destroy the entry manager
 	if (obj->max) {
 		for (i = 0; i < obj->num; i++)
-			aFree(obj->blocks[i]); // release block of entries
-		aFree(obj->blocks); // release array of blocks
+			aFree(obj->slabs[i].mem); // release slab of entries
+		aFree(obj->slabs); // release array of slabs
 	}
 	aFree(obj); // release manager
 }
 
+/**
+ * Find the slab of an entry.
+ * @param index Indexes of the slabs, sorted by address
+ * @param obj Entry manager
+ * @param entry Entry of the manager
+ * @return Index of the slab
+ * @private
+ * @see #ers_obj_release(ERS_impl obj, unsigned int tick)
+ */
+static uint32 ers_obj_find_slab(const uint32 *index, ERS_impl obj, void *entry)
+{
+	uint32 min = 0;
+	uint32 max = obj->num;
+
+	while (max - min > 1) { // last slab that starts at or before the entry
+		uint32 mid = (min + max)/2;
+
+		if ((uint8 *)entry < obj->slabs[index[mid]].data)
+			max = mid;
+		else
+			min = mid;
+	}
+	return index[min];
+}
+
+/**
+ * Slab array used by ers_obj_compare_slabs.
+ * @private
+ * @static
+ */
+static ERSlab *ers_sort_slabs;
+
+/**
+ * qsort comparator of slab indexes by address.
+ * @private
+ */
+static int ers_obj_compare_slabs(const void *a, const void *b)
+{
+	const uint8 *pa = ers_sort_slabs[*(const uint32 *)a].data;
+	const uint8 *pb = ers_sort_slabs[*(const uint32 *)b].data;
+
+	return ( pa < pb ) ? -1 : ( pa > pb ) ? 1 : 0;
+}
+
+/**
+ * Release the slabs of this manager that had no entries in use for
+ * ers_release_time.
+ * Unused slabs are only looked for when there are enough free entries to
+ * fill one, so managers that are in use don't walk their reuse list.
+ * @param obj Entry manager
+ * @param tick Current tick
+ * @private
+ * @see #ers_release_timer(int tid, unsigned int tick, int id, intptr_t data)
+ */
+static void ers_obj_release(ERS_impl obj, unsigned int tick)
+{
+	ERLinkedList reuse;
+	ERLinkedList *link;
+	uint32 *index;
+	uint32 *unused;
+	uint32 i, j;
+	uint32 release = 0;
+
+	if (obj->num == 0)
+		return;
+	if (obj->num*obj->count - obj->used < obj->count) { // no slab can be unused
+		for (i = 0; i < obj->num; i++)
+			obj->slabs[i].idle = false;
+		return;
+	}
+
+	CREATE(index, uint32, obj->num);
+	CREATE(unused, uint32, obj->num);
+	for (i = 0; i < obj->num; i++)
+		index[i] = i;
+	ers_sort_slabs = obj->slabs;
+	qsort(index, obj->num, sizeof(uint32), ers_obj_compare_slabs);
+
+	// Count the entries that aren't in use
+	unused[obj->num -1] = obj->free;
+	for (reuse = obj->reuse; reuse; reuse = reuse->next)
+		unused[ers_obj_find_slab(index, obj, reuse)]++;
+	for (i = 0; i < obj->num; i++) {
+		ERSlab *slab = &obj->slabs[i];
+
+		if (unused[i] < obj->count)
+			slab->idle = false;
+		else if (!slab->idle) {
+			slab->idle = true;
+			slab->idle_tick = tick;
+		} else if (DIFF_TICK(tick, slab->idle_tick) >= (int)ers_release_time) {
+			unused[i] = UINT32_MAX; // release
+			release++;
+		}
+	}
+
+	if (release) {
+		// Remove the entries of the released slabs from the reuse list
+		link = &obj->reuse;
+		while (*link) {
+			if (unused[ers_obj_find_slab(index, obj, *link)] == UINT32_MAX)
+				*link = (*link)->next;
+			else
+				link = &(*link)->next;
+		}
+		if (unused[obj->num -1] == UINT32_MAX)
+			obj->free = 0; // the unused entries were in the last slab
+		// Release the slabs, keeping the order
+		for (i = 0, j = 0; i < obj->num; i++) {
+			if (unused[i] == UINT32_MAX)
+				aFree(obj->slabs[i].mem);
+			else
+				obj->slabs[j++] = obj->slabs[i];
+		}
+		obj->num = j;
+		obj->released += release;
+	}
+	aFree(index);
+	aFree(unused);
+}
+
 /*****************************************************************************\
  *  (3) Public functions.                                                    *
  *  ers_new               - Get a new instance of an entry manager.          *
  *  ers_report            - Print a report about the current state.          *
+ *  ers_set_release_time  - Set the time after which unused slabs are freed. *
  *  ers_force_destroy_all - Force the destruction of all the managers.       *
 \*****************************************************************************/
 
 /**
- * Get a new instance of the manager that handles the specified entry size.
+ * Get a new instance of the manager that handles the specified type of entry.
  * Size has to greater than 0.
- * If the specified size is smaller than a pointer, the size of a pointer is 
+ * If the specified size is smaller than a pointer, the size of a pointer is
  * used instead.
- * It's also aligned to ERS_ALIGNED bytes, so the smallest multiple of 
+ * It's also aligned to ERS_ALIGNED bytes, so the smallest multiple of
  * ERS_ALIGNED that is greater or equal to size is what's actually used.
  * @param The requested size of the entry in bytes
+ * @param name Name of the type of entries, shown by ers_report
+ * @param tag Subsystem the slabs of entries are accounted to
  * @return Interface of the object
  * @see #ERS_impl
  * @see #ers_root
  * @see #ers_num
  */
-ERS ers_new(uint32 size)
+ERS ers_new(uint32 size, const char *name, enum memtag tag)
 {
 	ERS_impl obj;
 	uint32 i;
@@ -368,33 +582,40 @@ ERS ers_new(uint32 size)
 
 	for (i = 0; i < ers_num; i++) {
 		obj = ers_root[i];
-		if (obj->size == size) {
-			// found a manager that handles the entry size
+		if (obj->size == size && obj->tag == tag && strcmp(obj->name, name) == 0) {
+			// found a manager that handles the entry type
 			obj->destroy++;
 			return &obj->vtable;
 		}
 	}
-	// create a new manager to handle the entry size
+	// create a new manager to handle the entry type
 	if (ers_num == ERS_ROOT_SIZE) {
 		ShowFatalError("ers_alloc: too many root objects, increase ERS_ROOT_SIZE.\n"
 				"exiting the program...\n");
 		exit(EXIT_FAILURE);
 	}
-	obj = (ERS_impl)aMalloc(sizeof(struct ers_impl));
+	obj = (ERS_impl)aMallocTag(sizeof(struct ers_impl), tag);
 	// Public interface
 	obj->vtable.alloc      = ers_obj_alloc_entry;
 	obj->vtable.free       = ers_obj_free_entry;
 	obj->vtable.entry_size = ers_obj_entry_size;
 	obj->vtable.destroy    = ers_obj_destroy;
-	// Block reusage system
+	// Slab reusage system
 	obj->reuse   = NULL;
-	obj->blocks  = NULL;
+	obj->slabs   = NULL;
 	obj->free    = 0;
 	obj->num     = 0;
 	obj->max     = 0;
 	obj->destroy = 1;
 	// Properties
-	obj->size = size;
+	obj->size  = size;
+	obj->count = ( size < ERS_SLAB_SIZE/ERS_SLAB_ENTRIES ) ? ERS_SLAB_SIZE/size : ERS_SLAB_ENTRIES;
+	obj->tag   = tag;
+	obj->name  = name;
+	// Statistics
+	obj->used     = 0;
+	obj->peak     = 0;
+	obj->released = 0;
 	ers_root[ers_num++] = obj;
 	return &obj->vtable;
 }
@@ -402,9 +623,8 @@ ERS ers_new(uint32 size)
 /**
  * Print a report about the current state of the Entry Reusage System.
  * Shows information about the global system and each entry manager.
- * The number of entries are checked and a warning is shown if extra reusable 
- * entries are found.
- * The extra entries are included in the count of reusable entries.
+ * The number of entries are checked and a warning is shown if the reusable
+ * entries don't match the entries that aren't in use.
  * @see #ERLinkedList
  * @see #ERS_impl
  * @see #ers_root
@@ -413,10 +633,8 @@ ERS ers_new(uint32 size)
 void ers_report(void)
 {
 	uint32 i;
-	uint32 j;
-	uint32 used;
 	uint32 reusable;
-	uint32 extra;
+	uint32 capacity;
 	ERLinkedList reuse;
 	ERS_impl obj;
 
@@ -424,62 +642,75 @@ void ers_report(void)
 	ShowMessage(CL_BOLD"Entry Reusage System report:\n"CL_NORMAL);
 	ShowMessage("root array size     : %u\n", ERS_ROOT_SIZE);
 	ShowMessage("root entry managers : %u\n", ers_num);
-	ShowMessage("entries per block   : %u\n", ERS_BLOCK_ENTRIES);
+	ShowMessage("slab size           : %u\n", ERS_SLAB_SIZE);
+	ShowMessage("release time        : %u ms\n", ers_release_time);
 	for (i = 0; i < ers_num; i++) {
 		obj = ers_root[i];
-		reuse = obj->reuse;
-		used = 0;
+		capacity = obj->num*obj->count;
+		// Count reusable entries
 		reusable = 0;
-		// Count used and reusable entries
-		for (j = 0; j < obj->num; j++) {
-			if (j == 0) { // take into acount the free entries
-				used = ERS_BLOCK_ENTRIES -obj->free;
-			} else if (reuse) { // counting reusable entries
-				used = ERS_BLOCK_ENTRIES;
-			} else { // no more reusable entries, count remaining used entries
-				for (; j < obj->num; j++) {
-					if (used > UINT32_MAX -ERS_BLOCK_ENTRIES) { // overflow
-						used = UINT32_MAX;
-						break;
-					}
-					used += ERS_BLOCK_ENTRIES;
-				}
-				break;
-			}
-			while (used && reuse) { // count reusable entries
-				used--;
-				if (reusable != UINT32_MAX)
-					reusable++;
-				reuse = reuse->next;
-			}
-		}
-		// Count extra reusable entries
-		extra = 0;
-		while (reuse && extra != UINT32_MAX) {
-			extra++;
-			reuse = reuse->next;
-		}
+		for (reuse = obj->reuse; reuse && reusable <= capacity; reuse = reuse->next)
+			reusable++;
 		// Entry manager report
-		ShowMessage(CL_BOLD"[Entry manager #%u report]\n"CL_NORMAL, i);
+		ShowMessage(CL_BOLD"[Entry manager #%u report: %s]\n"CL_NORMAL, i, obj->name);
 		ShowMessage("\tinstances          : %u\n", obj->destroy);
+		ShowMessage("\tsubsystem          : %s\n", malloc_tag_name(obj->tag));
 		ShowMessage("\tentry size         : %u\n", obj->size);
-		ShowMessage("\tblock array size   : %u\n", obj->max);
-		ShowMessage("\tallocated blocks   : %u\n", obj->num);
-		ShowMessage("\tentries being used : %u\n", used);
+		ShowMessage("\tentries per slab   : %u\n", obj->count);
+		ShowMessage("\tallocated slabs    : %u (%u KB)\n", obj->num, (uint32)(obj->num*(obj->size*obj->count + ERS_CACHE_LINE -1)/1024));
+		ShowMessage("\treleased slabs     : %u\n", obj->released);
+		ShowMessage("\tentries being used : %u\n", obj->used);
+		ShowMessage("\tpeak entries used  : %u\n", obj->peak);
 		ShowMessage("\tunused entries     : %u\n", obj->free);
 		ShowMessage("\treusable entries   : %u\n", reusable);
-		if (extra)
-			ShowMessage("\tWARNING - %u extra reusable entries were found.\n", extra);
+		if (obj->used + obj->free + reusable != capacity)
+			ShowMessage("\tWARNING - %u entries in use and %u reusable entries don't match the %u entries of the slabs.\n", obj->used, reusable, capacity - obj->free);
 	}
 	ShowMessage("End of report\n");
 }
 
+/**
+ * Look for slabs without entries in use and release those that stayed
+ * unused for ers_release_time.
+ * @private
+ * @see #ers_set_release_time(unsigned int time)
+ */
+static int ers_release_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	uint32 i;
+
+	for (i = 0; i < ers_num; i++)
+		ers_obj_release(ers_root[i], tick);
+	return 0;
+}
+
+/**
+ * Set the time after which slabs without entries in use are released.
+ * The slabs are checked every quarter of that time (at least every second).
+ * @param time Time in ms, 0 to keep all slabs
+ * @see #ers_release_time
+ */
+void ers_set_release_time(unsigned int time)
+{
+	if (ers_release_tid != INVALID_TIMER) {
+		delete_timer(ers_release_tid, ers_release_timer);
+		ers_release_tid = INVALID_TIMER;
+	}
+	ers_release_time = time;
+	if (time) {
+		int interval = (int)max(time/4, 1000);
+
+		add_timer_func_list(ers_release_timer, "ers_release_timer");
+		ers_release_tid = add_timer_interval(gettick() + interval, ers_release_timer, 0, 0, interval);
+	}
+}
+
 /**
  * Forcibly destroy all the entry managers, checking for nothing.
  * The system is left as if no instances or entries had ever been allocated.
  * All previous entries and instances of the managers become invalid.
  * The use of this is NOT recommended.
- * It should only be used in extreme situations to make shure all the memory 
+ * It should only be used in extreme situations to make shure all the memory
  * allocated by this system is released.
  * @see #ERS_impl
  * @see #ers_root
@@ -495,8 +726,8 @@ void ers_force_destroy_all(void)
 		obj = ers_root[i];
 		if (obj->max) {
 			for (j = 0; j < obj->num; j++)
-				aFree(obj->blocks[j]); // block of entries
-			aFree(obj->blocks); // array of blocks
+				aFree(obj->slabs[j].mem); // slab of entries
+			aFree(obj->slabs); // array of slabs
 		}
 		aFree(obj); // entry manager object
 	}
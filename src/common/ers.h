@@ -41,6 +41,7 @@
 #define _ERS_H_
 
 #include "cbasetypes.h"
+#include "malloc.h" // enum memtag
 
 /*****************************************************************************\
  *  (1) All public parts of the Entry Reusage System.                        *
@@ -49,6 +50,7 @@
  *  ERS                   - Entry manager.                                   *
  *  ers_new               - Allocate an instance of an entry manager.        *
  *  ers_report            - Print a report about the current state.          *
+ *  ers_set_release_time  - Set the time after which unused slabs are freed. *
  *  ers_force_destroy_all - Force the destruction of all the managers.       *
 \*****************************************************************************/
 
@@ -121,8 +123,9 @@ typedef struct eri {
 #	define ers_entry_size(obj) (size_t)0
 #	define ers_destroy(obj)
 // Disable the public functions
-#	define ers_new(size) NULL
+#	define ers_new(size,name,tag) NULL
 #	define ers_report()
+#	define ers_set_release_time(time)
 #	define ers_force_destroy_all()
 #else /* not DISABLE_ERS */
 // These defines should be used to allow the code to keep working whenever 
@@ -133,26 +136,36 @@ typedef struct eri {
 #	define ers_destroy(obj)    (obj)->destroy(obj)
 
 /**
- * Get a new instance of the manager that handles the specified entry size.
+ * Get a new instance of the manager that handles the specified type of entry.
+ * Instances with the same name, size and tag share the manager.
  * Size has to greater than 0.
  * If the specified size is smaller than a pointer, the size of a pointer is 
  * used instead.
  * It's also aligned to ERS_ALIGNED bytes, so the smallest multiple of 
  * ERS_ALIGNED that is greater or equal to size is what's actually used.
  * @param The requested size of the entry in bytes
+ * @param name Name of the type of entries, shown by ers_report
+ * @param tag Subsystem the slabs of entries are accounted to
  * @return Interface of the object
  */
-ERS ers_new(uint32 size);
+ERS ers_new(uint32 size, const char *name, enum memtag tag);
 
 /**
  * Print a report about the current state of the Entry Reusage System.
- * Shows information about the global system and each entry manager.
- * The number of entries are checked and a warning is shown if extra reusable 
- * entries are found.
- * The extra entries are included in the count of reusable entries.
+ * Shows information about the global system and each entry manager, with 
+ * the entries in use, the peak of entries in use and the slabs released.
+ * The number of entries are checked and a warning is shown if the reusable 
+ * entries don't match the entries that aren't in use.
  */
 void ers_report(void);
 
+/**
+ * Set the time after which slabs without entries in use are released.
+ * The slabs are checked every quarter of that time (at least every second).
+ * @param time Time in ms, 0 to keep all slabs
+ */
+void ers_set_release_time(unsigned int time);
+
 /**
  * Forcibly destroy all the entry managers, checking for nothing.
  * The system is left as if no instances or entries had ever been allocated.
@@ -0,0 +1,242 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "../common/cbasetypes.h"
+#include "../common/malloc.h"
+#include "los.h"
+
+#include <stdlib.h>
+
+#define LOS_CACHE_BITS 8 // the cache of each map has 1<<LOS_CACHE_BITS entries
+#define LOS_TABLE_RANGE 15 // lines up to this distance on each axis use the mask table
+
+struct los_cache_entry {
+	uint32 from; // x<<16|y of the end with the lowest x (lowest y if equal)
+	uint32 to; // x<<16|y of the other end
+	uint32 version; // los_map.version when the result was stored
+	bool result;
+};
+
+struct los_map {
+	int xs, ys;
+	int row_bytes; // bytes of each row of the row plane
+	int col_bytes; // bytes of each column of the column plane
+	uint8* row; // bit x%8 of row[y*row_bytes + x/8] is set if (x,y) is a wall
+	uint8* col; // bit y%8 of col[x*col_bytes + y/8] is set if (x,y) is a wall
+	uint32 version; // bumped when a wall changes, invalidates the cache
+	unsigned int hits, misses;
+	struct los_cache_entry cache[1<<LOS_CACHE_BITS];
+};
+
+/// Cells of the line from (0,0) to (dx,dy), as rows of x offsets when the line
+/// is closer to horizontal, or as columns of y offsets (from min(0,dy)) otherwise.
+struct los_line {
+	int count; // rows/columns
+	uint16 mask[LOS_TABLE_RANGE+1];
+};
+
+static struct los_line los_table[LOS_TABLE_RANGE+1][2*LOS_TABLE_RANGE+1]; // [dx][dy+LOS_TABLE_RANGE]
+static bool los_table_ready = false;
+
+/// Builds the mask table from the same per-cell walk as path_search_long.
+static void los_table_init(void)
+{
+	int dx, dy;
+
+	for( dx = 0; dx <= LOS_TABLE_RANGE; ++dx )
+	{
+		for( dy = -LOS_TABLE_RANGE; dy <= LOS_TABLE_RANGE; ++dy )
+		{
+			struct los_line* line = &los_table[dx][dy+LOS_TABLE_RANGE];
+			bool rows = ( dx >= abs(dy) );
+			int weight = max(dx, abs(dy));
+			int x = 0, y = 0, wx = 0, wy = 0;
+
+			line->count = ( rows ? abs(dy) : dx ) + 1;
+			while( true )
+			{
+				if( rows )
+					line->mask[abs(y)] |= 1<<x;
+				else
+					line->mask[x] |= 1<<(y - min(0, dy));
+				if( x == dx && y == dy )
+					break;
+				wx += dx;
+				wy += dy;
+				if( wx >= weight ) {
+					wx -= weight;
+					x++;
+				}
+				if( wy >= weight ) {
+					wy -= weight;
+					y++;
+				} else if( wy < 0 ) {
+					wy += weight;
+					y--;
+				}
+			}
+		}
+	}
+	los_table_ready = true;
+}
+
+struct los_map* los_create(int xs, int ys)
+{
+	struct los_map* lm;
+
+	if( !los_table_ready )
+		los_table_init();
+
+	CREATE(lm, struct los_map, 1);
+	lm->xs = xs;
+	lm->ys = ys;
+	lm->row_bytes = (xs + 7)/8;
+	lm->col_bytes = (ys + 7)/8;
+	CREATE_TAG(lm->row, uint8, lm->row_bytes*ys + 2, MEMTAG_MAPCELL); // los_window reads up to 2 bytes past the cell
+	CREATE_TAG(lm->col, uint8, lm->col_bytes*xs + 2, MEMTAG_MAPCELL);
+	lm->version = 1;
+	return lm;
+}
+
+void los_destroy(struct los_map* lm)
+{
+	if( lm == NULL )
+		return;
+	aFree(lm->row);
+	aFree(lm->col);
+	aFree(lm);
+}
+
+void los_setwall(struct los_map* lm, int x, int y, bool wall)
+{
+	uint8* r;
+	uint8* c;
+	uint8 rbit, cbit;
+
+	if( x < 0 || x >= lm->xs || y < 0 || y >= lm->ys )
+		return;
+
+	r = &lm->row[y*lm->row_bytes + x/8];
+	c = &lm->col[x*lm->col_bytes + y/8];
+	rbit = 1<<(x%8);
+	cbit = 1<<(y%8);
+	if( ((*r & rbit) != 0) == wall )
+		return; // unchanged
+
+	if( wall )
+	{
+		*r |= rbit;
+		*c |= cbit;
+	}
+	else
+	{
+		*r &= ~rbit;
+		*c &= ~cbit;
+	}
+	if( ++lm->version == 0 )
+		lm->version = 1; // 0 is never valid in the cache
+}
+
+/// Returns (at least) 16 bits of the line, starting at the given one.
+static inline uint32 los_window(const uint8* line, int bit)
+{
+	const uint8* p = line + bit/8;
+	return ( (uint32)p[0] | (uint32)p[1]<<8 | (uint32)p[2]<<16 ) >> (bit%8);
+}
+
+bool los_trace(const struct los_map* lm, int x0, int y0, int x1, int y1)
+{
+	int dx, dy;
+
+	if( x1 < x0 )
+	{
+		swap(x0, x1);
+		swap(y0, y1);
+	}
+	dx = x1 - x0;
+	dy = y1 - y0;
+
+	if( dx <= LOS_TABLE_RANGE && abs(dy) <= LOS_TABLE_RANGE )
+	{// one masked read per row (or column) of the line
+		const struct los_line* line = &los_table[dx][dy+LOS_TABLE_RANGE];
+		uint32 hit = 0;
+		int i;
+
+		if( dx >= abs(dy) )
+		{
+			int s = ( dy < 0 ) ? -lm->row_bytes : lm->row_bytes;
+			const uint8* row = lm->row + y0*lm->row_bytes;
+			for( i = 0; i < line->count; ++i, row += s )
+				hit |= los_window(row, x0) & line->mask[i];
+		}
+		else
+		{
+			const uint8* col = lm->col + x0*lm->col_bytes;
+			int y = min(y0, y1);
+			for( i = 0; i < line->count; ++i, col += lm->col_bytes )
+				hit |= los_window(col, y) & line->mask[i];
+		}
+		return ( hit == 0 );
+	}
+	else
+	{// long line, walk it cell by cell as path_search_long
+		int wx = 0, wy = 0;
+		int weight = max(dx, abs(dy));
+
+		while( true )
+		{
+			if( lm->row[y0*lm->row_bytes + x0/8] & (1<<(x0%8)) )
+				return false;
+			if( x0 == x1 && y0 == y1 )
+				return true;
+			wx += dx;
+			wy += dy;
+			if( wx >= weight ) {
+				wx -= weight;
+				x0++;
+			}
+			if( wy >= weight ) {
+				wy -= weight;
+				y0++;
+			} else if( wy < 0 ) {
+				wy += weight;
+				y0--;
+			}
+		}
+	}
+}
+
+bool los_check(struct los_map* lm, int x0, int y0, int x1, int y1)
+{
+	struct los_cache_entry* entry;
+	uint32 from, to;
+
+	// the line is the same in both directions
+	if( x1 < x0 || (x1 == x0 && y1 < y0) )
+	{
+		swap(x0, x1);
+		swap(y0, y1);
+	}
+	from = (uint32)x0<<16 | (uint32)y0;
+	to = (uint32)x1<<16 | (uint32)y1;
+
+	entry = &lm->cache[(from*2654435761U + to*2246822519U) >> (32 - LOS_CACHE_BITS)];
+	if( entry->version == lm->version && entry->from == from && entry->to == to )
+	{
+		lm->hits++;
+		return entry->result;
+	}
+	lm->misses++;
+
+	entry->from = from;
+	entry->to = to;
+	entry->version = lm->version;
+	entry->result = los_trace(lm, x0, y0, x1, y1);
+	return entry->result;
+}
+
+void los_stats(const struct los_map* lm, unsigned int* hits, unsigned int* misses)
+{
+	*hits = lm->hits;
+	*misses = lm->misses;
+}
@@ -0,0 +1,41 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef _LOS_H_
+#define _LOS_H_
+
+#include "../common/cbasetypes.h"
+
+// Line of sight over a grid of cells.
+//
+// The walls are kept in two bitplanes, one by rows and one by columns.
+// The cells of short lines are precomputed as masks of each row (or
+// column) they cross, so a line costs one masked read per row instead of
+// one lookup per cell. The lines are the same as the per-cell walk of
+// path_search_long, longer lines still walk the cells one by one.
+//
+// los_check also remembers the last results in a small cache, which is
+// cleared whenever a wall changes.
+
+struct los_map;
+
+/// Creates a map of xs*ys cells without walls.
+struct los_map* los_create(int xs, int ys);
+
+/// Frees the map (NULL is ignored).
+void los_destroy(struct los_map* lm);
+
+/// Sets if the cell blocks the line of sight.
+void los_setwall(struct los_map* lm, int x, int y, bool wall);
+
+/// Returns true if no cell of the line (x0,y0)-(x1,y1) is a wall, ends included.
+/// Both ends must be inside the map.
+bool los_trace(const struct los_map* lm, int x0, int y0, int x1, int y1);
+
+/// Same as los_trace, using the cache of the map.
+bool los_check(struct los_map* lm, int x0, int y0, int x1, int y1);
+
+/// Number of cached lookups that were hits/misses since the map was created.
+void los_stats(const struct los_map* lm, unsigned int* hits, unsigned int* misses);
+
+#endif /* _LOS_H_ */
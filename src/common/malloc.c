@@ -5,11 +5,21 @@
 #include "core.h"
 #include "malloc.h"
 #include "showmsg.h"
+#include "thread.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
 
 ////////////// Memory Libraries //////////////////
 
@@ -136,6 +146,23 @@ void aFree_(void* p, const char* file, int line, const char* func)
 }
 
 
+/// Names of the subsystems, indexed by enum memtag.
+static const char* memtag_name[MEMTAG_MAX] = {
+	"other",
+	"socket",
+	"fifo",
+	"timer",
+	"db",
+	"ers",
+	"mapcell",
+	"mapblock",
+	"pc",
+	"mob",
+	"npc",
+	"script",
+};
+
+
 #ifdef USE_MEMMGR
 
 #if defined(DEBUG)
@@ -177,13 +204,30 @@ void aFree_(void* p, const char* file, int line, const char* func)
 /* xɊmۂubN̐B */
 #define BLOCK_ALLOC		104
 
+/* empty chunks of BLOCK_ALLOC blocks that are kept instead of being released to the OS */
+#define CHUNK_SPARE		1
+
+/* per-thread cache: size classes up to BLOCK_DATA_SIZE1, CACHE_UNITS units each */
+#define CACHE_CLASSES	( BLOCK_DATA_COUNT1 + 1 )
+#define CACHE_UNITS		16
+
+/* long-lived large allocations are packed in regions of huge pages */
+#define HUGE_REGION_SIZE	( 2*1024*1024 )
+
+/* other large allocations of at least this size are mapped from the OS, so freeing them releases the memory */
+#define LARGE_MAP_SIZE		( 64*1024 )
+
+/* call sites listed by the statistics */
+#define SITE_BITS		14
+#define SITE_COUNT		( 1 << SITE_BITS )
+
 /* check value used for buffer overflow detection */
 #define TAILCHECK_VALUE (0xdeadbeafL)
 
 /* ubN */
 struct block
 {
-	struct block* block_next;		/* Ɋmۂ̈ */
+	struct block_chunk* chunk;		/* chunk the block belongs to */
 	struct block* unfill_prev;		/* ̖܂ĂȂ̈ */
 	struct block* unfill_next;		/* ̖܂ĂȂ̈ */
 	unsigned short unit_size;		/* jbg̑傫 */
@@ -201,11 +245,26 @@ struct unit_head
 	const  char*   file;
 	unsigned short line;
 	unsigned short size;
+	unsigned char  tag;         /* enum memtag */
 	long           checksum;    /* placeholder for memory's tail check value */
 };
 
 static struct block* hash_unfill[BLOCK_DATA_COUNT1 + BLOCK_DATA_COUNT2 + 1];
-static struct block* block_first, *block_last, block_head;
+static struct block block_head;
+
+/* blocks are allocated from the OS in chunks */
+struct block_chunk
+{
+	struct block_chunk* prev;
+	struct block_chunk* next;
+	struct block*       free;		/* unused blocks, linked by unfill_next */
+	int                 used;		/* number of blocks in use */
+	struct block        block[BLOCK_ALLOC];
+};
+
+static struct block_chunk* chunk_first = NULL, *chunk_last = NULL;
+static int chunk_count = 0;
+static int chunk_empty = 0;
 
 /* g񂹂Ȃ̈p̃f[^ */
 struct unit_head_large
@@ -213,15 +272,57 @@ struct unit_head_large
 	size_t                  size;
 	struct unit_head_large* prev;
 	struct unit_head_large* next;
+	struct huge_region*     region;    /* NULL if the memory came from malloc or was mapped */
 	struct unit_head        unit_head;
 };
 
 static struct unit_head_large *unit_head_large_first = NULL;
 
+/* memory for long-lived large allocations. It is handed out sequentially
+ * and released when everything in it was freed. */
+struct huge_region
+{
+	struct huge_region* prev;
+	struct huge_region* next;
+	size_t              size;		/* mapped bytes */
+	size_t              pos;		/* bytes handed out */
+	int                 count;		/* allocations in use */
+};
+
+static struct huge_region* huge_region_first = NULL;  /* new allocations go here */
+static size_t huge_region_bytes = 0;
+
+/* allocations made so far per size class, index 0 is for large allocations */
+static uint64 memmgr_class_total[BLOCK_DATA_COUNT1 + BLOCK_DATA_COUNT2 + 1];
+
+/* memory in use per subsystem */
+static size_t memmgr_tag_bytes[MEMTAG_MAX];
+static size_t memmgr_tag_count[MEMTAG_MAX];
+
+/* units freed by this thread while in threaded mode, linked through their data.
+ * They stay allocated in their blocks until the cache is flushed. */
+struct memmgr_cache
+{
+	struct unit_head* unit[CACHE_CLASSES];
+	unsigned char     count[CACHE_CLASSES];
+	uint32            total[CACHE_CLASSES];	/* allocations from the cache */
+	intptr_t          usage;				/* bytes allocated minus bytes freed through the cache */
+	intptr_t          tag_bytes[MEMTAG_MAX];	/* same, per subsystem */
+	int               tag_count[MEMTAG_MAX];
+};
+
+static THREAD_LOCAL struct memmgr_cache memmgr_cache;
+static const char memmgr_cached[] = "(cached)";  /* file of cached units */
+
 static struct block* block_malloc(unsigned short hash);
 static void          block_free(struct block* p);
 static size_t        memmgr_usage_bytes;
 
+/// Serializes the memory manager while worker threads use it.
+/// @see malloc_set_threaded
+static Mutex* memmgr_mutex = NULL;
+static int memmgr_threaded = 0;
+
 #define memmgr_assert(v) do { if(!(v)) { ShowError("Memory manager: assertion '" #v "' failed!\n"); } } while(0)
 
 static inline struct unit_head* block2unit(struct block* p, unsigned short n)
@@ -229,18 +330,24 @@ static inline struct unit_head* block2unit(struct block* p, unsigned short n)
 	return (struct unit_head*)(&p->data[p->unit_size*n]);
 }
 
-static inline void memmgr_usage_increase(size_t delta)
+#define cache_next(head) ( *(struct unit_head**)&(head)->checksum )
+
+static inline void memmgr_usage_increase(size_t delta, unsigned char tag)
 {
 	memmgr_assert( SIZE_MAX-memmgr_usage_bytes >= delta );
 
 	memmgr_usage_bytes+= delta;
+	memmgr_tag_bytes[tag]+= delta;
+	memmgr_tag_count[tag]++;
 }
 
-static inline void memmgr_usage_decrease(size_t delta)
+static inline void memmgr_usage_decrease(size_t delta, unsigned char tag)
 {
 	memmgr_assert( memmgr_usage_bytes >= delta );
 
 	memmgr_usage_bytes-= delta;
+	memmgr_tag_bytes[tag]-= delta;
+	memmgr_tag_count[tag]--;
 }
 
 static inline long* memmgr_unit_tail_large(struct unit_head_large* large)
@@ -295,7 +402,124 @@ static size_t hash2size( unsigned short hash )
 	}
 }
 
-void* _mmalloc(size_t size, const char *file, int line, const char *func )
+/// Maps memory from the OS, aligned to HUGE_REGION_SIZE if huge pages are wanted.
+static void* memmgr_sysalloc(size_t size, bool huge)
+{
+#ifdef WIN32
+	void* p = VirtualAlloc(NULL, size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+#else
+	char* p;
+
+	if( huge )
+	{// transparent huge pages need aligned memory, trim the excess
+		char* raw = (char*)mmap(NULL, size + HUGE_REGION_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+
+		if( raw == (char*)MAP_FAILED )
+			p = NULL;
+		else
+		{
+			size_t head = (size_t)(-(uintptr_t)raw & (HUGE_REGION_SIZE - 1));
+
+			p = raw + head;
+			if( head > 0 )
+				munmap(raw, head);
+			munmap(p + size, HUGE_REGION_SIZE - head);
+#ifdef MADV_HUGEPAGE
+			madvise(p, size, MADV_HUGEPAGE);
+#endif
+		}
+	}
+	else
+	{
+		p = (char*)mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if( p == (char*)MAP_FAILED )
+			p = NULL;
+	}
+#endif
+
+	if( p == NULL )
+	{
+		ShowFatalError("Memory manager::memmgr_sysalloc failed (mapping %lu bytes).\n", (unsigned long)size);
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+/// Returns memory to the OS.
+static void memmgr_sysfree(void* p, size_t size)
+{
+#ifdef WIN32
+	VirtualFree(p, 0, MEM_RELEASE);
+#else
+	munmap(p, size);
+#endif
+}
+
+/// Offset of the first allocation in a huge page region.
+#define HUGE_REGION_START ( (sizeof(struct huge_region) + 15)&~(size_t)15 )
+
+/// Allocates long-lived memory from the current huge page region.
+static struct unit_head_large* huge_alloc(size_t size)
+{
+	struct huge_region* region = huge_region_first;
+	struct unit_head_large* p;
+
+	size = (size + 15)&~(size_t)15;
+	if( region == NULL || region->pos + size > region->size )
+	{// start a new region
+		size_t mapsize = (HUGE_REGION_START + size + HUGE_REGION_SIZE - 1)&~(size_t)(HUGE_REGION_SIZE - 1);
+
+		if( region != NULL && region->count == 0 )
+		{// the current region is empty
+			huge_region_first = region->next;
+			if( huge_region_first )
+				huge_region_first->prev = NULL;
+			huge_region_bytes -= region->size;
+			memmgr_sysfree(region, region->size);
+		}
+
+		region = (struct huge_region*)memmgr_sysalloc(mapsize, true);
+		region->size  = mapsize;
+		region->pos   = HUGE_REGION_START;
+		region->count = 0;
+		region->prev  = NULL;
+		region->next  = huge_region_first;
+		if( huge_region_first )
+			huge_region_first->prev = region;
+		huge_region_first = region;
+		huge_region_bytes += mapsize;
+	}
+
+	p = (struct unit_head_large*)((char*)region + region->pos);
+	region->pos += size;
+	region->count++;
+	p->region = region;
+	return p;
+}
+
+/// Frees memory of a huge page region, releasing the region when it becomes empty.
+static void huge_free(struct unit_head_large* p)
+{
+	struct huge_region* region = p->region;
+
+	memmgr_assert( region->count > 0 );
+	if( --region->count > 0 )
+		return;
+
+	if( region == huge_region_first )
+	{// keep the current region
+		region->pos = HUGE_REGION_START;
+		return;
+	}
+
+	region->prev->next = region->next;
+	if( region->next )
+		region->next->prev = region->prev;
+	huge_region_bytes -= region->size;
+	memmgr_sysfree(region, region->size);
+}
+
+static void* memmgr_alloc(size_t size, bool huge, unsigned char tag, const char *file, int line, const char *func )
 {
 	struct block *block;
 	short size_hash = size2hash( size );
@@ -312,13 +536,23 @@ void* _mmalloc(size_t size, const char *file, int line, const char *func )
 		return NULL;
 	}
 
-	memmgr_usage_increase(size);
+	memmgr_usage_increase(size, tag);
 
 	/* ubN𒴂̈̊mۂɂ́Amalloc() p */
 	/* ̍ہAunit_head.block  NULL ċʂ */
 	if( hash2size(size_hash) > BLOCK_DATA_SIZE - sizeof(struct unit_head) )
 	{
-		struct unit_head_large* p = (struct unit_head_large*)MALLOC(sizeof(struct unit_head_large)+size, file, line, func);
+		struct unit_head_large* p;
+
+		if( huge )
+			p = huge_alloc(sizeof(struct unit_head_large)+size);
+		else if( sizeof(struct unit_head_large)+size >= LARGE_MAP_SIZE )
+		{
+			p = (struct unit_head_large*)memmgr_sysalloc(sizeof(struct unit_head_large)+size, false);
+			p->region = NULL;
+		}
+		else if( (p = (struct unit_head_large*)MALLOC(sizeof(struct unit_head_large)+size, file, line, func)) != NULL )
+			p->region = NULL;
 
 		if( p != NULL )
 		{
@@ -327,6 +561,7 @@ void* _mmalloc(size_t size, const char *file, int line, const char *func )
 			p->unit_head.size  = 0;
 			p->unit_head.file  = file;
 			p->unit_head.line  = line;
+			p->unit_head.tag   = tag;
 			p->prev = NULL;
 
 			if( unit_head_large_first == NULL )
@@ -346,6 +581,7 @@ void* _mmalloc(size_t size, const char *file, int line, const char *func )
 #endif
 
 			memmgr_unit_tail_large(p)[0] = TAILCHECK_VALUE;
+			memmgr_class_total[0]++;
 
 			return &p->unit_head.checksum;
 		}
@@ -429,38 +665,157 @@ void* _mmalloc(size_t size, const char *file, int line, const char *func )
 	head->file  = file;
 	head->line  = line;
 	head->size  = (unsigned short)size;
+	head->tag   = tag;
 
 	memmgr_unit_tail(head)[0] = TAILCHECK_VALUE;
+	memmgr_class_total[size_hash]++;
 
 	return &head->checksum;
 };
 
-void* _mcalloc(size_t num, size_t size, const char* file, int line, const char* func)
+/// Allocates a unit from the cache of this thread.
+/// Returns NULL if the lock has to be taken.
+static void* memmgr_cache_alloc(size_t size, unsigned char tag, const char* file, int line, const char* func)
+{
+	struct unit_head* head;
+	unsigned short hash;
+
+	if( size == 0 || size > BLOCK_DATA_SIZE1 )
+		return NULL;
+	hash = size2hash(size);
+	if( (head = memmgr_cache.unit[hash]) == NULL )
+		return NULL;
+
+	memmgr_cache.unit[hash] = cache_next(head);
+	memmgr_cache.count[hash]--;
+
+#ifdef DEBUG_MEMMGR
+	memset(&head->checksum, 0xcd, hash2size(hash));
+#endif
+
+	head->file = file;
+	head->line = line;
+	head->size = (unsigned short)size;
+	head->tag  = tag;
+
+	memmgr_unit_tail(head)[0] = TAILCHECK_VALUE;
+	memmgr_cache.usage += size;
+	memmgr_cache.tag_bytes[tag] += size;
+	memmgr_cache.tag_count[tag]++;
+	memmgr_cache.total[hash]++;
+
+	return &head->checksum;
+}
+
+/// Puts a freed unit in the cache of this thread.
+/// Returns false if the lock has to be taken.
+static bool memmgr_cache_free(struct unit_head* head)
+{
+	struct block* block = head->block;
+	unsigned short hash;
+
+	if( head->size == 0 || block == NULL || head->file == memmgr_cached )
+		return false;// large, or freed (reported by memmgr_free)
+	if( (char*)head - (char*)block > sizeof(struct block) || memmgr_unit_tail(head)[0] != TAILCHECK_VALUE )
+		return false;// invalid (reported by memmgr_free)
+	hash = block->unit_hash;
+	if( hash >= CACHE_CLASSES || memmgr_cache.count[hash] >= CACHE_UNITS )
+		return false;
+
+	memmgr_cache.usage -= head->size;
+	memmgr_cache.tag_bytes[head->tag] -= head->size;
+	memmgr_cache.tag_count[head->tag]--;
+	head->file = memmgr_cached;
+	cache_next(head) = memmgr_cache.unit[hash];
+	memmgr_cache.unit[hash] = head;
+	memmgr_cache.count[hash]++;
+	return true;
+}
+
+/// Allocates memory, serialized while in threaded mode.
+static void* memmgr_alloc_sync(size_t size, bool huge, unsigned char tag, const char* file, int line, const char* func)
+{
+	void* p;
+
+	if( memmgr_mutex == NULL )
+		return memmgr_alloc(size, huge, tag, file, line, func);
+
+	mutex_lock(memmgr_mutex);
+	p = memmgr_alloc(size, huge, tag, file, line, func);
+	mutex_unlock(memmgr_mutex);
+	return p;
+}
+
+static void* memmgr_calloc(size_t num, size_t size, bool huge, unsigned char tag, const char* file, int line, const char* func)
 {
 	void* p;
 
 	memmgr_assert( num && SIZE_MAX/num > size );
 
-	p = _mmalloc(num * size, file, line, func);
+	p = memmgr_alloc_sync(num * size, huge, tag, file, line, func);
 	memset(p, 0, num * size);
 
 	return p;
 }
 
-void* _mrealloc(void* memblock, size_t size, const char* file, int line, const char* func)
+void* _mmalloc(size_t size, enum memtag tag, const char *file, int line, const char *func )
+{
+	void* p;
+
+	if( memmgr_threaded && (p = memmgr_cache_alloc(size, (unsigned char)tag, file, line, func)) != NULL )
+		return p;
+
+	return memmgr_alloc_sync(size, false, (unsigned char)tag, file, line, func);
+}
+
+void* _mcalloc(size_t num, size_t size, enum memtag tag, const char* file, int line, const char* func)
+{
+	void* p;
+
+	memmgr_assert( num && SIZE_MAX/num > size );
+
+	p = _mmalloc(num * size, tag, file, line, func);
+	memset(p, 0, num * size);
+
+	return p;
+}
+
+/// Allocates memory that is expected to live until shutdown.
+/// Large allocations are packed in regions backed by huge pages when the OS supports them.
+void* _mmalloc_huge(size_t size, enum memtag tag, const char* file, int line, const char* func)
+{
+	return memmgr_alloc_sync(size, true, (unsigned char)tag, file, line, func);
+}
+
+void* _mcalloc_huge(size_t num, size_t size, enum memtag tag, const char* file, int line, const char* func)
+{
+	return memmgr_calloc(num, size, true, (unsigned char)tag, file, line, func);
+}
+
+/// Reallocates memory, keeping its subsystem unless a tag is given.
+void* _mrealloc(void* memblock, size_t size, enum memtag tag, const char* file, int line, const char* func)
 {
 	size_t old_size;
+	bool huge = false;
 
 	if( memblock == NULL )
 	{
-		return _mmalloc(size, file, line, func);
+		return _mmalloc(size, tag, file, line, func);
+	}
+
+	if( tag == MEMTAG_OTHER )
+	{
+		tag = (enum memtag)memmgr_memblock2unit_head(memblock)->tag;
 	}
 
 	old_size = memmgr_memblock2unit_head(memblock)->size;
 
 	if( old_size == 0 )
 	{
-		old_size = memmgr_memblock2unit_head_large(memblock)->size;
+		struct unit_head_large* large = memmgr_memblock2unit_head_large(memblock);
+
+		old_size = large->size;
+		huge = ( large->region != NULL );
 	}
 
 	if( old_size > size )
@@ -472,7 +827,7 @@ void* _mrealloc(void* memblock, size_t size, const char* file, int line, const c
 	else
 	{
 		// grow
-		void* p = _mmalloc(size, file, line, func);
+		void* p = ( huge ? _mmalloc_huge(size, tag, file, line, func) : _mmalloc(size, tag, file, line, func) );
 
 		if( p != NULL )
 		{
@@ -484,7 +839,7 @@ void* _mrealloc(void* memblock, size_t size, const char* file, int line, const c
 	}
 }
 
-char* _mstrdup(const char* p, const char* file, int line, const char* func)
+char* _mstrdup(const char* p, enum memtag tag, const char* file, int line, const char* func)
 {
 	if( p == NULL )
 	{
@@ -493,7 +848,7 @@ char* _mstrdup(const char* p, const char* file, int line, const char* func)
 	else
 	{
 		size_t len = strlen(p);
-		char *string  = (char *)_mmalloc(len + 1, file, line, func);
+		char *string  = (char *)_mmalloc(len + 1, tag, file, line, func);
 
 		memcpy(string, p, len+1);
 
@@ -501,7 +856,45 @@ char* _mstrdup(const char* p, const char* file, int line, const char* func)
 	}
 }
 
-void _mfree(void* ptr, const char* file, int line, const char* func)
+/// Returns a unit to its block.
+static void unit_free(struct unit_head* head, const char* file, int line)
+{
+	struct block *block = head->block;
+
+	head->block = NULL;
+
+#ifdef DEBUG_MEMMGR
+	memset(&head->checksum, 0xfd, block->unit_size - ( (uintptr_t)&head->checksum - (uintptr_t)head ) );
+	head->file = file;
+	head->line = line;
+#endif
+
+	memmgr_assert( block->unit_used > 0 );
+
+	if( --block->unit_used == 0 )
+	{
+		/* ubN̉ */
+		block_free(block);
+	}
+	else
+	{
+		if( block->unfill_prev == NULL )
+		{
+			// unfill Xgɒǉ
+			if( hash_unfill[ block->unit_hash ] )
+			{
+				hash_unfill[ block->unit_hash ]->unfill_prev = block;
+			}
+			block->unfill_prev = &block_head;
+			block->unfill_next = hash_unfill[ block->unit_hash ];
+			hash_unfill[ block->unit_hash ] = block;
+		}
+		head->size     = block->unit_unfill;
+		block->unit_unfill = (unsigned short)(((uintptr_t)head - (uintptr_t)block->data) / block->unit_size);
+	}
+}
+
+static void memmgr_free(void* ptr, const char* file, int line, const char* func)
 {
 	struct unit_head* head;
 
@@ -536,14 +929,19 @@ void _mfree(void* ptr, const char* file, int line, const char* func)
 				head_large->next->prev = head_large->prev;
 			}
 
-			memmgr_usage_decrease(head_large->size);
+			memmgr_usage_decrease(head_large->size, head->tag);
 
 #ifdef DEBUG_MEMMGR
 			// set freed memory to 0xfd
 			memset(ptr, 0xfd, head_large->size);
 #endif
 
-			FREE(head_large, file, line, func);
+			if( head_large->region )
+				huge_free(head_large);
+			else if( sizeof(struct unit_head_large)+head_large->size >= LARGE_MAP_SIZE )
+				memmgr_sysfree(head_large, sizeof(struct unit_head_large)+head_large->size);
+			else
+				FREE(head_large, file, line, func);
 		}
 	}
 	else
@@ -555,7 +953,7 @@ void _mfree(void* ptr, const char* file, int line, const char* func)
 		{
 			ShowError("Memory manager: args of aFree 0x%p is invalid pointer %s line %d\n", ptr, file, line);
 		}
-		else if( head->block == NULL )
+		else if( head->block == NULL || head->file == memmgr_cached )
 		{
 			ShowError("Memory manager: args of aFree 0x%p is freed pointer %s:%d@%s\n", ptr, file, line, func);
 		}
@@ -565,95 +963,129 @@ void _mfree(void* ptr, const char* file, int line, const char* func)
 		}
 		else
 		{
-			memmgr_usage_decrease(head->size);
+			memmgr_usage_decrease(head->size, head->tag);
+			unit_free(head, file, line);
+		}
+	}
+}
+
+void _mfree(void* ptr, const char* file, int line, const char* func)
+{
+	if( memmgr_mutex == NULL )
+	{
+		memmgr_free(ptr, file, line, func);
+		return;
+	}
 
-			head->block = NULL;
+	if( ptr == NULL || memmgr_cache_free(memmgr_memblock2unit_head(ptr)) )
+		return;
 
-#ifdef DEBUG_MEMMGR
-			memset(ptr, 0xfd, block->unit_size - ( (uintptr_t)&head->checksum - (uintptr_t)head ) );
-			head->file = file;
-			head->line = line;
-#endif
+	mutex_lock(memmgr_mutex);
+	memmgr_free(ptr, file, line, func);
+	mutex_unlock(memmgr_mutex);
+}
 
-			memmgr_assert( block->unit_used > 0 );
+/// Returns the units cached by this thread to their blocks.
+static void memmgr_cache_flush(void)
+{
+	int hash;
 
-			if( --block->unit_used == 0 )
-			{
-				/* ubN̉ */
-				block_free(block);
-			}
-			else
-			{
-				if( block->unfill_prev == NULL )
-				{
-					// unfill Xgɒǉ
-					if( hash_unfill[ block->unit_hash ] )
-					{
-						hash_unfill[ block->unit_hash ]->unfill_prev = block;
-					}
-					block->unfill_prev = &block_head;
-					block->unfill_next = hash_unfill[ block->unit_hash ];
-					hash_unfill[ block->unit_hash ] = block;
-				}
-				head->size     = block->unit_unfill;
-				block->unit_unfill = (unsigned short)(((uintptr_t)head - (uintptr_t)block->data) / block->unit_size);
-			}
+	if( memmgr_mutex )
+		mutex_lock(memmgr_mutex);
+	for( hash = 0; hash < CACHE_CLASSES; ++hash )
+	{
+		while( memmgr_cache.unit[hash] )
+		{
+			struct unit_head* head = memmgr_cache.unit[hash];
+
+			memmgr_cache.unit[hash] = cache_next(head);
+			unit_free(head, __FILE__, __LINE__);
 		}
+		memmgr_cache.count[hash] = 0;
+		memmgr_class_total[hash] += memmgr_cache.total[hash];
+		memmgr_cache.total[hash] = 0;
+	}
+	memmgr_usage_bytes = (size_t)((intptr_t)memmgr_usage_bytes + memmgr_cache.usage);
+	memmgr_cache.usage = 0;
+	for( hash = 0; hash < MEMTAG_MAX; ++hash )
+	{
+		memmgr_tag_bytes[hash] = (size_t)((intptr_t)memmgr_tag_bytes[hash] + memmgr_cache.tag_bytes[hash]);
+		memmgr_tag_count[hash] = (size_t)((intptr_t)memmgr_tag_count[hash] + memmgr_cache.tag_count[hash]);
+		memmgr_cache.tag_bytes[hash] = 0;
+		memmgr_cache.tag_count[hash] = 0;
 	}
+	if( memmgr_mutex )
+		mutex_unlock(memmgr_mutex);
 }
 
-/* ubNmۂ */
-static struct block* block_malloc(unsigned short hash)
+/// Allocates a chunk of blocks from the OS.
+static struct block_chunk* chunk_malloc(void)
 {
+	struct block_chunk* chunk = (struct block_chunk*)memmgr_sysalloc(sizeof(struct block_chunk), false);
 	int i;
-	struct block *p;
 
-	if( hash_unfill[0] != NULL )
+	chunk->prev = chunk_last;
+	chunk->next = NULL;
+	if( chunk_last )
+		chunk_last->next = chunk;
+	else
+		chunk_first = chunk;
+	chunk_last = chunk;
+
+	chunk->free = NULL;
+	chunk->used = 0;
+	for( i = BLOCK_ALLOC - 1; i >= 0; i-- )
 	{
-		/* ubNp̗̈͊mۍς */
-		p = hash_unfill[0];
-		hash_unfill[0] = hash_unfill[0]->unfill_next;
+		struct block* p = &chunk->block[i];
+
+		p->chunk       = chunk;
+		p->unfill_prev = NULL;
+		p->unfill_next = chunk->free;
+		p->unit_used   = 0;
+		chunk->free = p;
 	}
+
+	chunk_count++;
+	chunk_empty++;
+	return chunk;
+}
+
+/// Releases a chunk of unused blocks to the OS.
+static void chunk_free(struct block_chunk* chunk)
+{
+	if( chunk->prev )
+		chunk->prev->next = chunk->next;
 	else
-	{
-		/* ubNp̗̈VɊmۂ */
-		p = (struct block*)MALLOC(sizeof(struct block) * (BLOCK_ALLOC), __FILE__, __LINE__, __func__ );
+		chunk_first = chunk->next;
+	if( chunk->next )
+		chunk->next->prev = chunk->prev;
+	else
+		chunk_last = chunk->prev;
 
-		if( p == NULL )
-		{
-			ShowFatalError("Memory manager::block_alloc failed.\n");
-			exit(EXIT_FAILURE);
-		}
+	chunk_count--;
+	chunk_empty--;
+	memmgr_sysfree(chunk, sizeof(struct block_chunk));
+}
 
-		if( block_first == NULL )
-		{
-			/* m */
-			block_first = p;
-		}
-		else
-		{
-			block_last->block_next = p;
-		}
+/* ubNmۂ */
+static struct block* block_malloc(unsigned short hash)
+{
+	struct block_chunk* chunk;
+	struct block *p;
 
-		block_last = &p[BLOCK_ALLOC - 1];
-		block_last->block_next = NULL;
+	// older chunks first, so the newer ones can become empty
+	for( chunk = chunk_first; chunk != NULL && chunk->free == NULL; chunk = chunk->next )
+		;
+	if( chunk == NULL )
+	{
+		chunk = chunk_malloc();
+	}
 
-		/* ubNA */
-		for( i = 0; i < BLOCK_ALLOC; i++ )
-		{
-			if( i != 0 )
-			{
-				// p[0] ͂ꂩĝŃNɂ͉Ȃ
-				p[i].unfill_next = hash_unfill[0];
-				hash_unfill[0]   = &p[i];
-				p[i].unfill_prev = NULL;
-				p[i].unit_used = 0;
-			}
-			if( i != BLOCK_ALLOC-1 )
-			{
-				p[i].block_next = &p[i+1];
-			}
-		}
+	p = chunk->free;
+	chunk->free = p->unfill_next;
+	if( chunk->used++ == 0 )
+	{
+		chunk_empty--;
 	}
 
 	// unfill ɒǉ
@@ -677,6 +1109,8 @@ static struct block* block_malloc(unsigned short hash)
 
 static void block_free(struct block* p)
 {
+	struct block_chunk* chunk;
+
 	if( p->unfill_prev )
 	{
 		if( p->unfill_prev == &block_head )
@@ -694,13 +1128,19 @@ static void block_free(struct block* p)
 		p->unfill_prev = NULL;
 	}
 
-	p->unfill_next = hash_unfill[0];
-	hash_unfill[0] = p;
+	chunk = p->chunk;
+	p->unfill_next = chunk->free;
+	chunk->free = p;
+
+	if( --chunk->used == 0 && ++chunk_empty > CHUNK_SPARE )
+	{
+		chunk_free(chunk);
+	}
 }
 
 size_t memmgr_usage(void)
 {
-	return memmgr_usage_bytes / 1024;
+	return (size_t)memmgr_usage_bytes / 1024;
 }
 
 #ifdef LOG_MEMMGR
@@ -739,22 +1179,24 @@ static void memmgr_log(const char* buf, ...)
 /// @return true if the memory is active
 bool memmgr_verify(void* ptr)
 {
-	struct block* block = block_first;
+	struct block_chunk* chunk;
 	struct unit_head_large* large = unit_head_large_first;
 
 	if( ptr == NULL )
 		return false;// never valid
 
 	// search small blocks
-	while( block )
+	for( chunk = chunk_first; chunk != NULL; chunk = chunk->next )
 	{
-		if( (char*)ptr >= (char*)block && (char*)ptr < ((char*)block) + sizeof(struct block) )
+		if( (char*)ptr >= (char*)chunk->block && (char*)ptr < (char*)(chunk->block + BLOCK_ALLOC) )
 		{// found memory block
+			struct block* block = &chunk->block[((char*)ptr - (char*)chunk->block)/sizeof(struct block)];
+
 			if( block->unit_used && (char*)ptr >= block->data )
 			{// memory block is being used and ptr points to a sub-unit
 				size_t i = (size_t)((char*)ptr - block->data)/block->unit_size;
 				struct unit_head* head = block2unit(block, i);
-				if( i < block->unit_maxused && head->block != NULL )
+				if( i < block->unit_maxused && head->block != NULL && head->file != memmgr_cached )
 				{// memory unit is allocated, check if ptr points to the usable part
 					return ( (char*)ptr >= (char*)&head->checksum
 						&& (char*)ptr < (char*)memmgr_unit_tail(head) );
@@ -762,7 +1204,6 @@ bool memmgr_verify(void* ptr)
 			}
 			return false;
 		}
-		block = block->block_next;
 	}
 
 	// search large blocks
@@ -780,36 +1221,45 @@ bool memmgr_verify(void* ptr)
 
 static void memmgr_final(void)
 {
-	struct block *block = block_first;
+	struct block_chunk* chunk;
+	int i, j;
 
 #ifdef LOG_MEMMGR
 	int count = 0;
 #endif /* LOG_MEMMGR */
 
-	while( block )
+	memmgr_cache_flush();
+
+	for( chunk = chunk_first; chunk != NULL; chunk = chunk->next )
 	{
-		if( block->unit_used )
+		for( i = 0; i < BLOCK_ALLOC; i++ )
 		{
-			int i;
+			struct block* block = &chunk->block[i];
 
-			for( i = 0; i < block->unit_maxused; i++ )
+			for( j = 0; block->unit_used && j < block->unit_maxused; j++ )
 			{
-				struct unit_head *head = block2unit(block, i);
+				struct unit_head *head = block2unit(block, j);
 
 				if( head->block != NULL )
 				{
-					void* ptr = &head->checksum;
 #ifdef LOG_MEMMGR
-					memmgr_log("%04d : %s line %d size %lu address 0x%p\n", ++count, head->file, head->line, (unsigned long)head->size, ptr);
+					memmgr_log("%04d : %s line %d size %lu address 0x%p\n", ++count, head->file, head->line, (unsigned long)head->size, &head->checksum);
 #endif /* LOG_MEMMGR */
-					// get block pointer and free it [celest]
-					_mfree(ptr, ALC_MARK);
 				}
 			}
 		}
-		block = block->block_next;
 	}
 
+	// leaked units are released with their chunks
+	while( chunk_first )
+	{
+		chunk = chunk_first;
+		chunk_first = chunk->next;
+		memmgr_sysfree(chunk, sizeof(struct block_chunk));
+	}
+	chunk_last = NULL;
+	chunk_count = chunk_empty = 0;
+
 	while( unit_head_large_first )
 	{
 		struct unit_head_large* large = unit_head_large_first;
@@ -818,9 +1268,18 @@ static void memmgr_final(void)
 		memmgr_log("%04d : %s line %d size %lu address 0x%p\n", ++count, large->unit_head.file, large->unit_head.line, (unsigned long)large->size, &large->unit_head.checksum);
 #endif /* LOG_MEMMGR */
 
-		_mfree(large, ALC_MARK);
+		memmgr_free(&large->unit_head.checksum, ALC_MARK);
 	}
 
+	while( huge_region_first )
+	{
+		struct huge_region* region = huge_region_first;
+
+		huge_region_first = region->next;
+		memmgr_sysfree(region, region->size);
+	}
+	huge_region_bytes = 0;
+
 #ifdef LOG_MEMMGR
 	if( count == 0 )
 	{
@@ -834,6 +1293,152 @@ static void memmgr_final(void)
 #endif /* LOG_MEMMGR */
 }
 
+/* memory in use by a call site */
+struct memmgr_site
+{
+	const char* file;
+	int         line;
+	size_t      count;
+	size_t      bytes;
+};
+
+static void memmgr_scan_add(struct memmgr_site* sites, const char* file, int line, size_t size)
+{
+	unsigned int i = (((uint32)(uintptr_t)file ^ (uint32)line*2654435769U) * 2654435769U) >> (32 - SITE_BITS);
+	int n;
+
+	for( n = 0; n < SITE_COUNT; ++n, i = (i + 1)&(SITE_COUNT - 1) )
+	{
+		struct memmgr_site* site = &sites[i];
+
+		if( site->file == NULL )
+		{
+			site->file = file;
+			site->line = line;
+		}
+		else if( site->file != file || site->line != line )
+			continue;
+		site->count++;
+		site->bytes += size;
+		return;
+	}
+}
+
+/// Collects the memory in use by call site from the unit headers.
+/// The units in use per size class and the blocks holding them are
+/// added to units and blocks, if not NULL.
+/// @param sites Table of SITE_COUNT zeroed entries
+/// @return Number of call sites, moved to the start of the table
+static int memmgr_scan(struct memmgr_site* sites, size_t* units, int* blocks)
+{
+	struct block_chunk* chunk;
+	struct unit_head_large* large;
+	int i, j, n;
+
+	if( memmgr_mutex )
+		mutex_lock(memmgr_mutex);
+
+	for( chunk = chunk_first; chunk != NULL; chunk = chunk->next )
+	{
+		for( i = 0; i < BLOCK_ALLOC; i++ )
+		{
+			struct block* block = &chunk->block[i];
+
+			if( block->unit_used == 0 )
+				continue;
+			if( blocks )
+				blocks[block->unit_hash]++;
+			for( j = 0; j < block->unit_maxused; j++ )
+			{
+				struct unit_head *head = block2unit(block, j);
+
+				if( head->block == NULL || head->file == memmgr_cached )
+					continue;
+				memmgr_scan_add(sites, head->file, head->line, head->size);
+				if( units )
+					units[block->unit_hash]++;
+			}
+		}
+	}
+
+	for( large = unit_head_large_first; large != NULL; large = large->next )
+	{
+		memmgr_scan_add(sites, large->unit_head.file, large->unit_head.line, large->size);
+		if( units )
+			units[0]++;
+	}
+
+	if( memmgr_mutex )
+		mutex_unlock(memmgr_mutex);
+
+	for( i = 0, n = 0; i < SITE_COUNT; ++i )
+		if( sites[i].file != NULL )
+			sites[n++] = sites[i];
+	return n;
+}
+
+/// Calls the callback for every call site with memory in use.
+static void memmgr_foreach_site(MallocSiteFunc callback, void* param)
+{
+	struct memmgr_site* sites = (struct memmgr_site*)calloc(SITE_COUNT, sizeof(struct memmgr_site));
+	int i, n;
+
+	if( sites == NULL )
+		return;
+	n = memmgr_scan(sites, NULL, NULL);
+	for( i = 0; i < n; ++i )
+		callback(sites[i].file, sites[i].line, sites[i].count, sites[i].bytes, param);
+	free(sites);
+}
+
+static int memmgr_site_cmp(const void* a, const void* b)
+{
+	size_t x = ((const struct memmgr_site*)a)->bytes;
+	size_t y = ((const struct memmgr_site*)b)->bytes;
+
+	return ( x < y ) - ( x > y );// most bytes first
+}
+
+/// Prints the memory in use by size class and the call sites using the most memory.
+/// Must be called from the main thread.
+static void memmgr_report(int max_sites)
+{
+	static size_t units[BLOCK_DATA_COUNT1 + BLOCK_DATA_COUNT2 + 1];
+	static int blocks[BLOCK_DATA_COUNT1 + BLOCK_DATA_COUNT2 + 1];
+	struct memmgr_site* sites = (struct memmgr_site*)calloc(SITE_COUNT, sizeof(struct memmgr_site));
+	int i, n;
+
+	if( sites == NULL )
+	{
+		ShowError("Memory manager: not enough memory for the report.\n");
+		return;
+	}
+	memset(units, 0, sizeof(units));
+	memset(blocks, 0, sizeof(blocks));
+	n = memmgr_scan(sites, units, blocks);
+
+	ShowInfo("Memory manager: %lu KB in use, %d block chunks of %lu KB (%d empty), %lu KB in huge page regions.\n", (unsigned long)memmgr_usage(), chunk_count, (unsigned long)(sizeof(struct block_chunk)/1024), chunk_empty, (unsigned long)(huge_region_bytes/1024));
+	ShowInfo("Subsystems (memory in use, allocations):\n");
+	for( i = 0; i < MEMTAG_MAX; ++i )
+		ShowMessage("  %-10s %8lu KB %8lu\n", memtag_name[i], (unsigned long)(memmgr_tag_bytes[i]/1024), (unsigned long)memmgr_tag_count[i]);
+	ShowInfo("Size classes (size: in use / allocated so far, blocks, fill):\n");
+	for( i = 1; i < ARRAYLENGTH(units); ++i )
+	{
+		size_t capacity = blocks[i] * (BLOCK_DATA_SIZE / (hash2size(i) + sizeof(struct unit_head)));
+
+		if( blocks[i] == 0 )
+			continue;
+		ShowMessage("  %6lu: %8lu / %10"PRIu64", %5d blocks, %3lu%%\n", (unsigned long)hash2size(i), (unsigned long)units[i], memmgr_class_total[i], blocks[i], (unsigned long)(units[i]*100/capacity));
+	}
+	ShowMessage("   large: %8lu / %10"PRIu64"\n", (unsigned long)units[0], memmgr_class_total[0]);
+
+	qsort(sites, n, sizeof(struct memmgr_site), memmgr_site_cmp);
+	ShowInfo("Call sites by memory in use (%d of %d):\n", min(n, max_sites), n);
+	for( i = 0; i < n && i < max_sites; ++i )
+		ShowMessage("  %8lu KB %8lu allocations  %s:%d\n", (unsigned long)(sites[i].bytes/1024), (unsigned long)sites[i].count, sites[i].file, sites[i].line);
+	free(sites);
+}
+
 static void memmgr_init(void)
 {
 #ifdef LOG_MEMMGR
@@ -879,6 +1484,79 @@ size_t malloc_usage(void)
 #endif
 }
 
+/// Allows worker threads to use aMalloc/aFree while enabled.
+/// Calls can be nested; the memory manager is serialized until the last
+/// caller disables it. Must not be changed while worker threads are running.
+void malloc_set_threaded(bool threaded)
+{
+#ifdef USE_MEMMGR
+	if( threaded )
+	{
+		if( memmgr_threaded++ == 0 )
+			memmgr_mutex = mutex_create();
+	}
+	else if( memmgr_threaded > 0 && --memmgr_threaded == 0 )
+	{
+		memmgr_cache_flush();
+		mutex_destroy(memmgr_mutex);
+		memmgr_mutex = NULL;
+	}
+#endif
+}
+
+/// Releases the per-thread state of the memory manager.
+/// Worker threads call this before they exit.
+void malloc_thread_final(void)
+{
+#ifdef USE_MEMMGR
+	memmgr_cache_flush();
+#endif
+}
+
+/// Prints the memory statistics.
+/// @param max_sites Number of call sites to list, sorted by memory in use
+void malloc_report(int max_sites)
+{
+#ifdef USE_MEMMGR
+	memmgr_report(max_sites);
+#else
+	ShowInfo("Memory statistics require the built-in memory manager (%lu KB in use).\n", (unsigned long)(MEMORY_USAGE()/1024));
+#endif
+}
+
+/// Returns the memory in use by a subsystem, in bytes.
+/// While in threaded mode, the memory of the worker threads is added when they finish.
+/// @param tag Subsystem
+/// @param out_count Number of allocations, optional
+size_t malloc_tag_usage(enum memtag tag, size_t* out_count)
+{
+#ifdef USE_MEMMGR
+	if( tag >= 0 && tag < MEMTAG_MAX )
+	{
+		if( out_count )
+			*out_count = memmgr_tag_count[tag];
+		return memmgr_tag_bytes[tag];
+	}
+#endif
+	if( out_count )
+		*out_count = 0;
+	return 0;
+}
+
+/// Returns the name of a subsystem.
+const char* malloc_tag_name(enum memtag tag)
+{
+	return ( tag >= 0 && tag < MEMTAG_MAX ) ? memtag_name[tag] : "unknown";
+}
+
+/// Calls the callback for every call site with memory in use.
+void malloc_foreach_site(MallocSiteFunc callback, void* param)
+{
+#ifdef USE_MEMMGR
+	memmgr_foreach_site(callback, param);
+#endif
+}
+
 void malloc_final(void)
 {
 #ifdef USE_MEMMGR
@@ -8,6 +8,24 @@
 
 #define ALC_MARK __FILE__, __LINE__, __func__
 
+/// Subsystems the memory in use is accounted to (see malloc_tag_usage).
+enum memtag
+{
+	MEMTAG_OTHER = 0,
+	MEMTAG_SOCKET,  // sessions
+	MEMTAG_FIFO,    // session buffers
+	MEMTAG_TIMER,
+	MEMTAG_DB,      // DBMap and linkdb nodes
+	MEMTAG_ERS,     // entry managers without a subsystem
+	MEMTAG_MAPCELL, // map cells
+	MEMTAG_MAPBLOCK,// block grids
+	MEMTAG_PC,
+	MEMTAG_MOB,
+	MEMTAG_NPC,
+	MEMTAG_SCRIPT,  // script code and states
+	MEMTAG_MAX
+};
+
 
 // default use of the built-in memory manager
 #if !defined(NO_MEMMGR) && !defined(USE_MEMMGR)
@@ -28,16 +46,24 @@
 // Enable memory manager logging by default
 #define LOG_MEMMGR
 
-#	define aMalloc(n)       _mmalloc(n,ALC_MARK)
-#	define aCalloc(m,n)     _mcalloc(m,n,ALC_MARK)
-#	define aRealloc(p,n)    _mrealloc(p,n,ALC_MARK)
-#	define aStrdup(p)       _mstrdup(p,ALC_MARK)
+#	define aMalloc(n)       _mmalloc(n,MEMTAG_OTHER,ALC_MARK)
+#	define aCalloc(m,n)     _mcalloc(m,n,MEMTAG_OTHER,ALC_MARK)
+#	define aRealloc(p,n)    _mrealloc(p,n,MEMTAG_OTHER,ALC_MARK)
+#	define aStrdup(p)       _mstrdup(p,MEMTAG_OTHER,ALC_MARK)
 #	define aFree(p)         _mfree(p,ALC_MARK)
-
-	void* _mmalloc          (size_t size, const char *file, int line, const char *func);
-	void* _mcalloc          (size_t num, size_t size, const char *file, int line, const char *func);
-	void* _mrealloc         (void *p, size_t size, const char *file, int line, const char *func);
-	char* _mstrdup          (const char *p, const char *file, int line, const char *func);
+#	define aMallocTag(n,t)     _mmalloc(n,t,ALC_MARK)
+#	define aCallocTag(m,n,t)   _mcalloc(m,n,t,ALC_MARK)
+#	define aReallocTag(p,n,t)  _mrealloc(p,n,t,ALC_MARK)
+#	define aStrdupTag(p,t)     _mstrdup(p,t,ALC_MARK)
+#	define aMallocHuge(n,t)    _mmalloc_huge(n,t,ALC_MARK)
+#	define aCallocHuge(m,n,t)  _mcalloc_huge(m,n,t,ALC_MARK)
+
+	void* _mmalloc          (size_t size, enum memtag tag, const char *file, int line, const char *func);
+	void* _mcalloc          (size_t num, size_t size, enum memtag tag, const char *file, int line, const char *func);
+	void* _mmalloc_huge     (size_t size, enum memtag tag, const char *file, int line, const char *func);
+	void* _mcalloc_huge     (size_t num, size_t size, enum memtag tag, const char *file, int line, const char *func);
+	void* _mrealloc         (void *p, size_t size, enum memtag tag, const char *file, int line, const char *func);
+	char* _mstrdup          (const char *p, enum memtag tag, const char *file, int line, const char *func);
 	void  _mfree            (void *p, const char *file, int line, const char *func);
 
 #else
@@ -47,6 +73,12 @@
 #	define aRealloc(p,n)    aRealloc_(p,n,ALC_MARK)
 #	define aStrdup(p)       aStrdup_(p,ALC_MARK)
 #	define aFree(p)         aFree_(p,ALC_MARK)
+#	define aMallocTag(n,t)     aMalloc_((n),ALC_MARK)
+#	define aCallocTag(m,n,t)   aCalloc_((m),(n),ALC_MARK)
+#	define aReallocTag(p,n,t)  aRealloc_(p,n,ALC_MARK)
+#	define aStrdupTag(p,t)     aStrdup_(p,ALC_MARK)
+#	define aMallocHuge(n,t)    aMalloc_((n),ALC_MARK)
+#	define aCallocHuge(m,n,t)  aCalloc_((m),(n),ALC_MARK)
 
 	void* aMalloc_          (size_t size, const char *file, int line, const char *func);
 	void* aCalloc_          (size_t num, size_t size, const char *file, int line, const char *func);
@@ -80,12 +112,26 @@
 // should be merged with any of above later
 #define CREATE(result, type, number) (result) = (type *) aCalloc ((number), sizeof(type))
 #define RECREATE(result, type, number) (result) = (type *) aRealloc ((result), sizeof(type) * (number))
+// same, with the memory accounted to a subsystem (enum memtag)
+#define CREATE_TAG(result, type, number, tag) (result) = (type *) aCallocTag ((number), sizeof(type), (tag))
+#define RECREATE_TAG(result, type, number, tag) (result) = (type *) aReallocTag ((result), sizeof(type) * (number), (tag))
+// for large arrays that live until shutdown (backed by huge pages when available)
+#define CREATE_HUGE(result, type, number, tag) (result) = (type *) aCallocHuge ((number), sizeof(type), (tag))
 
 ////////////////////////////////////////////////
 
 void malloc_memory_check(void);
 bool malloc_verify_ptr(void* ptr);
 size_t malloc_usage(void);
+void malloc_set_threaded(bool threaded);
+void malloc_thread_final(void);
+void malloc_report(int max_sites);
+
+/// Callback for malloc_foreach_site, with the allocations in use by a call site.
+typedef void (*MallocSiteFunc)(const char* file, int line, size_t count, size_t bytes, void* param);
+void malloc_foreach_site(MallocSiteFunc callback, void* param);
+size_t malloc_tag_usage(enum memtag tag, size_t* out_count);
+const char* malloc_tag_name(enum memtag tag);
 void malloc_init(void);
 void malloc_final(void);
 
@@ -1,6 +1,7 @@
 // Copyright (c) Athena Dev Teams - Licensed under GNU GPL
 // For more information, see LICENCE in the main folder
 
+#include "../common/malloc.h"
 #include "../common/timer.h" // gettick
 #include "random.h"
 #if defined(WIN32)
@@ -30,14 +31,24 @@ void rnd_init(void)
 	seed += (uint32)gettid();
 #endif // HAVE_GETTID
 #endif
-	init_genrand(seed);
+	rnd_seed(seed);
 }
 
 
+/// State of the fast generator (xorshift128), never all zeros.
+static uint32 rnd_fast_state[4] = { 123456789, 362436069, 521288629, 88675123 };
+
+
 /// Initializes the random number generator.
 void rnd_seed(uint32 seed)
 {
+	int i;
+
 	init_genrand(seed);
+	for( i = 0; i < 4; ++i )
+		rnd_fast_state[i] = (uint32)genrand_int32();
+	if( (rnd_fast_state[0]|rnd_fast_state[1]|rnd_fast_state[2]|rnd_fast_state[3]) == 0 )
+		rnd_fast_state[0] = 1;
 }
 
 
@@ -81,3 +92,135 @@ double rnd_uniform53(void)
 {
 	return genrand_res53();
 }
+
+
+/// Generates a random number in the interval [0, UINT32_MAX] with the fast generator.
+/// NOTE: xorshift128, much cheaper than rnd() but with a shorter period (2^128-1)
+uint32 rnd_fast(void)
+{
+	uint32 t = rnd_fast_state[0] ^ (rnd_fast_state[0] << 11);
+	rnd_fast_state[0] = rnd_fast_state[1];
+	rnd_fast_state[1] = rnd_fast_state[2];
+	rnd_fast_state[2] = rnd_fast_state[3];
+	rnd_fast_state[3] = rnd_fast_state[3] ^ (rnd_fast_state[3] >> 19) ^ t ^ (t >> 8);
+	return rnd_fast_state[3];
+}
+
+
+/// Fills rolls with count numbers in the interval [0, dice_faces) of the fast generator.
+void rnd_fast_rolls(uint32* rolls, int count, uint32 dice_faces)
+{
+	uint32 s0 = rnd_fast_state[0], s1 = rnd_fast_state[1], s2 = rnd_fast_state[2], s3 = rnd_fast_state[3];
+	int i;
+
+	for( i = 0; i < count; ++i )
+	{
+		uint32 t = s0 ^ (s0 << 11);
+		s0 = s1;
+		s1 = s2;
+		s2 = s3;
+		s3 = s3 ^ (s3 >> 19) ^ t ^ (t >> 8);
+		rolls[i] = (uint32)(((uint64)s3*dice_faces) >> 32);
+	}
+	rnd_fast_state[0] = s0;
+	rnd_fast_state[1] = s1;
+	rnd_fast_state[2] = s2;
+	rnd_fast_state[3] = s3;
+}
+
+
+/// Alias table of a weighted choice (Vose's method, in integers).
+/// Column i is picked with probability 1/count, it then gives i if a roll
+/// in [0, total) is below threshold[i] and alias[i] otherwise.
+struct rnd_alias {
+	int count;
+	uint32 total; // sum of the weights
+	uint32* threshold;
+	int* alias;
+};
+
+
+/// Creates the alias table of the given weights.
+/// Returns NULL if there is nothing to choose (no weights or all of them 0)
+/// or if the weights add up to more than UINT32_MAX.
+struct rnd_alias* rnd_alias_create(const uint32* weights, int count)
+{
+	struct rnd_alias* ra;
+	uint64* scaled;
+	int* small;
+	int* large;
+	int nsmall = 0, nlarge = 0;
+	uint64 total = 0;
+	int i;
+
+	for( i = 0; i < count; ++i )
+		total += weights[i];
+	if( total == 0 || total > UINT32_MAX )
+		return NULL;
+
+	CREATE(ra, struct rnd_alias, 1);
+	ra->count = count;
+	ra->total = (uint32)total;
+	CREATE(ra->threshold, uint32, count);
+	CREATE(ra->alias, int, count);
+
+	// every column holds total units, the weights are scaled by count so they add up to count*total
+	CREATE(scaled, uint64, count);
+	CREATE(small, int, count);
+	CREATE(large, int, count);
+	for( i = 0; i < count; ++i )
+	{
+		scaled[i] = (uint64)weights[i]*count;
+		if( scaled[i] < total )
+			small[nsmall++] = i;
+		else
+			large[nlarge++] = i;
+	}
+	while( nsmall > 0 && nlarge > 0 )
+	{
+		int s = small[--nsmall];
+		int l = large[nlarge-1];
+
+		ra->threshold[s] = (uint32)scaled[s];
+		ra->alias[s] = l;
+		scaled[l] -= total - scaled[s];
+		if( scaled[l] < total )
+		{
+			--nlarge;
+			small[nsmall++] = l;
+		}
+	}
+	// the rest fill their column exactly (the small ones always run out first)
+	while( nlarge > 0 )
+	{
+		int l = large[--nlarge];
+		ra->threshold[l] = ra->total;
+		ra->alias[l] = l;
+	}
+
+	aFree(scaled);
+	aFree(small);
+	aFree(large);
+	return ra;
+}
+
+
+/// Frees the alias table (NULL is ignored).
+void rnd_alias_destroy(struct rnd_alias* ra)
+{
+	if( ra == NULL )
+		return;
+	aFree(ra->threshold);
+	aFree(ra->alias);
+	aFree(ra);
+}
+
+
+/// Picks an index with probability weights[index]/total, using the fast generator.
+int rnd_alias_pick(const struct rnd_alias* ra)
+{
+	int i = (int)(((uint64)rnd_fast()*(uint32)ra->count) >> 32);
+	uint32 roll = (uint32)(((uint64)rnd_fast()*ra->total) >> 32);
+
+	return ( roll < ra->threshold[i] ) ? i : ra->alias[i];
+}
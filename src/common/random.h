@@ -15,4 +15,12 @@ int32 rnd_value(int32 min, int32 max);// [min, max]
 double rnd_uniform(void);// [0.0, 1.0)
 double rnd_uniform53(void);// [0.0, 1.0)
 
+uint32 rnd_fast(void);// [0, UINT32_MAX]
+void rnd_fast_rolls(uint32* rolls, int count, uint32 dice_faces);// count times [0, dice_faces)
+
+struct rnd_alias;
+struct rnd_alias* rnd_alias_create(const uint32* weights, int count);
+void rnd_alias_destroy(struct rnd_alias* ra);
+int rnd_alias_pick(const struct rnd_alias* ra);// [0, count), weighted
+
 #endif /* _RANDOM_H_ */
@@ -3,6 +3,7 @@
 
 #include "../common/cbasetypes.h"
 #include "../common/strlib.h" // StringBuf
+#include "../common/thread.h" // THREAD_LOCAL
 #include "showmsg.h"
 
 #include <stdio.h>
@@ -51,6 +52,11 @@ int stdout_with_ansisequence = 0;
 
 int msg_silent = 0; //Specifies how silent the console is.
 
+/// Messages of a thread are counted instead of shown while set.
+/// @see showmsg_discard
+static THREAD_LOCAL bool msg_discard = false;
+static THREAD_LOCAL int msg_discarded = 0;
+
 ///////////////////////////////////////////////////////////////////////////////
 /// static/dynamic buffer for the messages
 
@@ -679,6 +685,11 @@ int _vShowMessage(enum msg_type flag, const char *string, va_list ap)
 	FILE *fp;
 #endif
 	
+	if( msg_discard )
+	{
+		++msg_discarded;
+		return 0;
+	}
 	if (!string || *string == '\0') {
 		ShowError("Empty string passed to _vShowMessage().\n");
 		return 1;
@@ -770,6 +781,19 @@ int _vShowMessage(enum msg_type flag, const char *string, va_list ap)
 	return 0;
 }
 
+/// Discards the messages of the calling thread while enabled.
+/// Used by worker threads that can't show messages in a meaningful order.
+void showmsg_discard(bool discard)
+{
+	msg_discard = discard;
+}
+
+/// Returns how many messages of the calling thread were discarded.
+int showmsg_discarded(void)
+{
+	return msg_discarded;
+}
+
 void ClearScreen(void)
 {
 #ifndef _WIN32
@@ -4,6 +4,8 @@
 #ifndef _SHOWMSG_H_
 #define _SHOWMSG_H_
 
+#include "../common/cbasetypes.h"
+
 // for help with the console colors look here:
 // http://www.edoceo.com/liberum/?doc=printf-with-color
 // some code explanation (used here):
@@ -81,6 +83,9 @@ enum msg_type {
 	MSG_FATALERROR
 };
 
+extern void showmsg_discard(bool discard);
+extern int showmsg_discarded(void);
+
 extern void ClearScreen(void);
 extern int ShowMessage(const char *, ...);
 extern int ShowStatus(const char *, ...);
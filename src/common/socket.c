@@ -206,12 +206,23 @@ int naddr_ = 0;   // # of ip addresses
 // Larger packets cause a buffer overflow and stack corruption.
 static size_t socket_max_client_packet = 20480;
 
-// initial recv buffer size (this will also be the max. size)
+// max. recv buffer size of client connections (the buffer starts at FIFO_MIN_SIZE and grows as needed)
 // biggest known packet: S 0153 <len>.w <emblem data>.?B -> 24x24 256 color .bmp (0153 + len.w + 1618/1654/1756 bytes)
 #define RFIFO_SIZE (2*1024)
-// initial send buffer size (will be resized as needed)
+// send buffer size of the dummy session #0 (other sessions start at FIFO_MIN_SIZE and grow as needed)
 #define WFIFO_SIZE (16*1024)
 
+// Fifo buffers are taken from shared pools of size classes, from FIFO_MIN_SIZE
+// up to FIFO_MAX_POOLED bytes (powers of two). Larger buffers grow in multiples
+// of FIFO_MAX_POOLED and are allocated directly.
+#define FIFO_MIN_SIZE 512
+#define FIFO_MAX_POOLED (64*1024)
+#define FIFO_CLASSES 8
+// Bytes of free buffers kept in each pool.
+#define FIFO_POOL_SIZE (1024*1024)
+// Client connections give back grown buffers after being idle for this many seconds.
+#define FIFO_SHRINK_TIME 5
+
 // Maximum size of pending data in the write fifo. (for non-server connections)
 // The connection is closed if it goes over the limit.
 #define WFIFO_MAX (1*1024*1024)
@@ -344,6 +355,7 @@ int send_from_fifo(int fd)
 	{//An exception has occured
 		if( sErrno != S_EWOULDBLOCK ) {
 			//ShowDebug("send_from_fifo: error %d, ending connection #%d\n", sErrno, fd);
+			session[fd]->wdata_sent += (uint32)session[fd]->wdata_size;
 			session[fd]->wdata_size = 0; //Clear the send queue as we can't send anymore. [Skotlex]
 			set_eof(fd);
 		}
@@ -358,6 +370,7 @@ int send_from_fifo(int fd)
 			memmove(session[fd]->wdata, session[fd]->wdata + len, session[fd]->wdata_size - len);
 
 		session[fd]->wdata_size -= len;
+		session[fd]->wdata_sent += (uint32)len;
 	}
 
 	return 0;
@@ -528,17 +541,113 @@ int make_connection(uint32 ip, uint16 port)
 	return fd;
 }
 
+/// Free fifo buffers of a size class, linked through their first bytes.
+struct fifo_pool
+{
+	uint8* free;
+	int count;
+	int max;// free buffers kept
+};
+static struct fifo_pool fifo_pool[FIFO_CLASSES];
+
+/// Returns the size class of a buffer size, or -1 if buffers of that size aren't pooled.
+static int fifo_class(size_t size)
+{
+	int i;
+
+	for( i = 0; i < FIFO_CLASSES; ++i )
+		if( size == ((size_t)FIFO_MIN_SIZE<<i) )
+			return i;
+	return -1;
+}
+
+/// Rounds up a buffer size to its size class or to a multiple of FIFO_MAX_POOLED.
+static size_t fifo_roundsize(size_t size)
+{
+	size_t newsize = FIFO_MIN_SIZE;
+
+	if( size > FIFO_MAX_POOLED )
+		return (size + FIFO_MAX_POOLED - 1)/FIFO_MAX_POOLED*FIFO_MAX_POOLED;
+	while( newsize < size )
+		newsize *= 2;
+	return newsize;
+}
+
+/// Takes a fifo buffer from the pools.
+static uint8* fifo_alloc(size_t size)
+{
+	int i = fifo_class(size);
+	uint8* p;
+
+	if( i >= 0 && fifo_pool[i].free != NULL )
+	{
+		p = fifo_pool[i].free;
+		fifo_pool[i].free = *(uint8**)p;
+		fifo_pool[i].count--;
+		return p;
+	}
+	return (uint8*)aMallocTag(size, MEMTAG_FIFO);
+}
+
+/// Gives a fifo buffer back to the pools.
+static void fifo_free(uint8* p, size_t size)
+{
+	int i = fifo_class(size);
+
+	if( i >= 0 && fifo_pool[i].count < fifo_pool[i].max )
+	{
+		*(uint8**)p = fifo_pool[i].free;
+		fifo_pool[i].free = p;
+		fifo_pool[i].count++;
+		return;
+	}
+	aFree(p);
+}
+
+/// Moves the used part of a fifo buffer to a buffer of another size.
+static uint8* fifo_resize(uint8* p, size_t used, size_t oldsize, size_t newsize)
+{
+	uint8* newp = fifo_alloc(newsize);
+
+	memcpy(newp, p, used);
+	fifo_free(p, oldsize);
+	return newp;
+}
+
+/// Releases the free buffers of the pools.
+static void fifo_pool_final(void)
+{
+	int i;
+
+	for( i = 0; i < FIFO_CLASSES; ++i )
+	{
+		while( fifo_pool[i].free )
+		{
+			uint8* p = fifo_pool[i].free;
+
+			fifo_pool[i].free = *(uint8**)p;
+			aFree(p);
+		}
+		fifo_pool[i].count = 0;
+	}
+}
+
 static int create_session(int fd, RecvFunc func_recv, SendFunc func_send, ParseFunc func_parse)
 {
-	CREATE(session[fd], struct socket_data, 1);
-	CREATE(session[fd]->rdata, unsigned char, RFIFO_SIZE);
-	CREATE(session[fd]->wdata, unsigned char, WFIFO_SIZE);
-	session[fd]->max_rdata  = RFIFO_SIZE;
-	session[fd]->max_wdata  = WFIFO_SIZE;
+	// the dummy session #0 is written to without WFIFOHEAD, it needs the full buffers
+	size_t rsize = ( fd == 0 ) ? RFIFO_SIZE : FIFO_MIN_SIZE;
+	size_t wsize = ( fd == 0 ) ? WFIFO_SIZE : FIFO_MIN_SIZE;
+
+	CREATE_TAG(session[fd], struct socket_data, 1, MEMTAG_SOCKET);
+	session[fd]->rdata      = fifo_alloc(rsize);
+	session[fd]->wdata      = fifo_alloc(wsize);
+	session[fd]->max_rdata  = rsize;
+	session[fd]->max_wdata  = wsize;
 	session[fd]->func_recv  = func_recv;
 	session[fd]->func_send  = func_send;
 	session[fd]->func_parse = func_parse;
 	session[fd]->rdata_tick = last_tick;
+	session[fd]->fifo_tick  = last_tick;
 	return 0;
 }
 
@@ -546,8 +655,8 @@ static void delete_session(int fd)
 {
 	if( session_isValid(fd) )
 	{
-		aFree(session[fd]->rdata);
-		aFree(session[fd]->wdata);
+		fifo_free(session[fd]->rdata, session[fd]->max_rdata);
+		fifo_free(session[fd]->wdata, session[fd]->max_wdata);
 		aFree(session[fd]->session_data);
 		aFree(session[fd]);
 		session[fd] = NULL;
@@ -560,12 +669,12 @@ int realloc_fifo(int fd, unsigned int rfifo_size, unsigned int wfifo_size)
 		return 0;
 
 	if( session[fd]->max_rdata != rfifo_size && session[fd]->rdata_size < rfifo_size) {
-		RECREATE(session[fd]->rdata, unsigned char, rfifo_size);
+		session[fd]->rdata = fifo_resize(session[fd]->rdata, session[fd]->rdata_size, session[fd]->max_rdata, rfifo_size);
 		session[fd]->max_rdata  = rfifo_size;
 	}
 
 	if( session[fd]->max_wdata != wfifo_size && session[fd]->wdata_size < wfifo_size) {
-		RECREATE(session[fd]->wdata, unsigned char, wfifo_size);
+		session[fd]->wdata = fifo_resize(session[fd]->wdata, session[fd]->wdata_size, session[fd]->max_wdata, wfifo_size);
 		session[fd]->max_wdata  = wfifo_size;
 	}
 	return 0;
@@ -579,25 +688,62 @@ int realloc_writefifo(int fd, size_t addition)
 		return 0;
 
 	if( session[fd]->wdata_size + addition  > session[fd]->max_wdata )
-	{	// grow rule; grow in multiples of WFIFO_SIZE
-		newsize = WFIFO_SIZE;
-		while( session[fd]->wdata_size + addition > newsize ) newsize += WFIFO_SIZE;
+	{	// grow rule; grow to the size class that fits
+		newsize = fifo_roundsize(session[fd]->wdata_size + addition);
+		session[fd]->fifo_tick = last_tick;
 	}
 	else
 	if( session[fd]->max_wdata >= (size_t)2*(session[fd]->flag.server?FIFOSIZE_SERVERLINK:WFIFO_SIZE)
 		&& (session[fd]->wdata_size+addition)*4 < session[fd]->max_wdata )
 	{	// shrink rule, shrink by 2 when only a quarter of the fifo is used, don't shrink below nominal size.
-		newsize = session[fd]->max_wdata / 2;
+		newsize = fifo_roundsize(session[fd]->max_wdata / 2);
 	}
 	else // no change
 		return 0;
 
-	RECREATE(session[fd]->wdata, unsigned char, newsize);
+	session[fd]->wdata = fifo_resize(session[fd]->wdata, session[fd]->wdata_size, session[fd]->max_wdata, newsize);
 	session[fd]->max_wdata  = newsize;
 
 	return 0;
 }
 
+/// Adjusts the buffers of a client connection after its data was parsed.
+/// A full recv buffer grows up to RFIFO_SIZE. Buffers that grew are given
+/// back when they are empty and didn't grow for FIFO_SHRINK_TIME.
+/// @return false if the recv buffer is full and can't grow (invalid packet)
+static bool fifo_adjust(int fd)
+{
+	struct socket_data* s = session[fd];
+
+	if( s->flag.server )
+		return true;
+
+	if( s->rdata_size == s->max_rdata )
+	{
+		if( s->max_rdata >= RFIFO_SIZE )
+			return false;
+		s->rdata = fifo_resize(s->rdata, s->rdata_size, s->max_rdata, s->max_rdata*2);
+		s->max_rdata *= 2;
+		s->fifo_tick = last_tick;
+	}
+	else if( DIFF_TICK(last_tick, s->fifo_tick) >= FIFO_SHRINK_TIME )
+	{
+		if( s->rdata_size == 0 && s->max_rdata > FIFO_MIN_SIZE )
+		{
+			fifo_free(s->rdata, s->max_rdata);
+			s->rdata = fifo_alloc(FIFO_MIN_SIZE);
+			s->max_rdata = FIFO_MIN_SIZE;
+		}
+		if( s->wdata_size == 0 && s->max_wdata > FIFO_MIN_SIZE )
+		{
+			fifo_free(s->wdata, s->max_wdata);
+			s->wdata = fifo_alloc(FIFO_MIN_SIZE);
+			s->max_wdata = FIFO_MIN_SIZE;
+		}
+	}
+	return true;
+}
+
 /// advance the RFIFO cursor (marking 'len' bytes as processed)
 int RFIFOSKIP(int fd, size_t len)
 {
@@ -670,9 +816,9 @@ int WFIFOSET(int fd, size_t len)
 	if( s->flag.server && s->wdata_size >= 2*FIFOSIZE_SERVERLINK )
 		flush_fifo(fd);
 
-	// always keep a WFIFO_SIZE reserve in the buffer
+	// always keep a FIFO_MIN_SIZE reserve in the buffer
 	// For inter-server connections, let the reserve be 1/4th of the link size.
-	newreserve = s->flag.server ? FIFOSIZE_SERVERLINK / 4 : WFIFO_SIZE;
+	newreserve = s->flag.server ? FIFOSIZE_SERVERLINK / 4 : FIFO_MIN_SIZE;
 
 	// readjust the buffer to include the chosen reserve
 	realloc_writefifo(fd, newreserve);
@@ -779,12 +925,12 @@ int do_sockets(int next)
 		if(!session[i])
 			continue;
 
+		RFIFOFLUSH(i);
 		// after parse, check client's RFIFO size to know if there is an invalid packet (too big and not parsed)
-		if (session[i]->rdata_size == RFIFO_SIZE && session[i]->max_rdata == RFIFO_SIZE) {
+		if( !fifo_adjust(i) ) {
 			set_eof(i);
 			continue;
 		}
-		RFIFOFLUSH(i);
 	}
 
 	return 0;
@@ -1108,10 +1254,11 @@ void socket_final(void)
 		if(session[i])
 			do_close(i);
 
-	// session[0] ̃_~[f[^폜
-	aFree(session[0]->rdata);
-	aFree(session[0]->wdata);
+	// session[0] �̃_�~�[�f�[�^���폜
+	fifo_free(session[0]->rdata, session[0]->max_rdata);
+	fifo_free(session[0]->wdata, session[0]->max_wdata);
 	aFree(session[0]);
+	fifo_pool_final();
 }
 
 /// Closes a socket.
@@ -1219,6 +1366,7 @@ void socket_init(void)
 {
 	char *SOCKET_CONF_FILENAME = "conf/packet_athena.conf";
 	unsigned int rlim_cur = FD_SETSIZE;
+	int i;
 
 #ifdef WIN32
 	{// Start up windows networking
@@ -1282,6 +1430,9 @@ void socket_init(void)
 	// initialise last send-receive tick
 	last_tick = time(NULL);
 
+	for( i = 0; i < FIFO_CLASSES; ++i )
+		fifo_pool[i].max = FIFO_POOL_SIZE/(FIFO_MIN_SIZE<<i);
+
 	// session[0] is now currently used for disconnected sessions of the map server, and as such,
 	// should hold enough buffer (it is a vacuum so to speak) as it is never flushed. [Skotlex]
 	create_session(0, null_recv, null_send, null_parse);
@@ -92,7 +92,9 @@ struct socket_data
 	size_t max_rdata, max_wdata;
 	size_t rdata_size, wdata_size;
 	size_t rdata_pos;
+	uint32 wdata_sent; // bytes sent so far (wraps around); wdata_sent+wdata_size is the stream position of the end of the write queue
 	time_t rdata_tick; // time of last recv (for detecting timeouts); zero when timeout is disabled
+	time_t fifo_tick; // time the buffers last grew (they shrink back when idle)
 
 	RecvFunc func_recv;
 	SendFunc func_send;
@@ -5,6 +5,7 @@
 #include "malloc.h"
 #include "showmsg.h"
 #include "strlib.h"
+#include "thread.h"
 #include "timer.h"
 #include "sql.h"
 
@@ -13,7 +14,7 @@
 #endif
 #include <mysql.h>
 #include <string.h>// strlen/strnlen/memcpy/memset
-#include <stdlib.h>// strtoul
+#include <stdlib.h>// strtoul, malloc, free
 
 
 
@@ -1006,3 +1007,387 @@ void SqlStmt_Free(SqlStmt* self)
 		aFree(self);
 	}
 }
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Asynchronous queries
+///////////////////////////////////////////////////////////////////////////////
+//
+// NOTE: everything that crosses threads uses the system allocator, the
+//       memory manager is not thread-safe. The workers don't print anything,
+//       errors are reported in the results.
+//
+
+
+
+/// Queued query.
+struct SqlAsyncQuery
+{
+	int id;
+	size_t max_rows;
+	char* query;
+	unsigned long query_len;
+	struct SqlAsyncQuery* next;
+};
+
+
+
+/// Sql asynchronous query worker pool
+struct SqlAsync
+{
+	char* user;
+	char* passwd;
+	char* host;
+	char* db;
+	char* encoding;
+	uint16 port;
+
+	Mutex* mutex;
+	Cond* cond;
+	bool terminate;
+
+	// queued queries (FIFO)
+	struct SqlAsyncQuery* queue_first;
+	struct SqlAsyncQuery* queue_last;
+	size_t num_pending;// queued + executing
+
+	// finished queries (FIFO)
+	SqlAsyncResult* done_first;
+	SqlAsyncResult* done_last;
+
+	Thread** workers;
+	int num_workers;
+};
+
+
+
+/// Duplicates a string with the system allocator.
+///
+/// @private
+static char* SqlAsync_P_Strdup(const char* str, size_t len)
+{
+	char* ret = (char*)malloc(len + 1);
+	if( ret != NULL )
+	{
+		memcpy(ret, str, len);
+		ret[len] = '\0';
+	}
+	return ret;
+}
+
+
+
+/// Creates an error result.
+///
+/// @private
+static SqlAsyncResult* SqlAsync_P_ErrorResult(int id, const char* error)
+{
+	SqlAsyncResult* result = (SqlAsyncResult*)calloc(1, sizeof(SqlAsyncResult));
+	if( result != NULL )
+	{
+		result->id = id;
+		result->status = SQL_ERROR;
+		safestrncpy(result->error, error, sizeof(result->error));
+	}
+	return result;
+}
+
+
+
+/// Executes a query in the worker connection and copies the result.
+///
+/// @private
+static SqlAsyncResult* SqlAsync_P_Execute(MYSQL* handle, struct SqlAsyncQuery* query)
+{
+	SqlAsyncResult* result;
+	MYSQL_RES* res;
+	MYSQL_ROW row;
+	unsigned long* lengths;
+	size_t i, j;
+
+	if( mysql_real_query(handle, query->query, query->query_len) )
+		return SqlAsync_P_ErrorResult(query->id, mysql_error(handle));
+	res = mysql_store_result(handle);
+	if( mysql_errno(handle) != 0 )
+	{
+		if( res )
+			mysql_free_result(res);
+		return SqlAsync_P_ErrorResult(query->id, mysql_error(handle));
+	}
+
+	result = (SqlAsyncResult*)calloc(1, sizeof(SqlAsyncResult));
+	if( result == NULL )
+	{
+		if( res )
+			mysql_free_result(res);
+		return NULL;
+	}
+	result->id = query->id;
+	result->status = SQL_SUCCESS;
+	if( res == NULL )
+		return result;// no result set (not a SELECT)
+
+	result->total_rows = (uint64)mysql_num_rows(res);
+	result->num_cols = (size_t)mysql_num_fields(res);
+	result->num_rows = (size_t)( result->total_rows < (uint64)query->max_rows ? result->total_rows : query->max_rows );
+	if( result->num_rows > 0 && result->num_cols > 0 )
+		result->data = (char**)calloc(result->num_rows*result->num_cols, sizeof(char*));
+	if( result->data == NULL )
+		result->num_rows = 0;
+	for( i = 0; i < result->num_rows && (row = mysql_fetch_row(res)) != NULL; ++i )
+	{
+		lengths = mysql_fetch_lengths(res);
+		for( j = 0; j < result->num_cols; ++j )
+			if( row[j] != NULL )
+				result->data[i*result->num_cols + j] = SqlAsync_P_Strdup(row[j], (size_t)lengths[j]);
+	}
+	result->num_rows = i;
+	mysql_free_result(res);
+	return result;
+}
+
+
+
+/// Worker thread. Executes queued queries until told to terminate.
+///
+/// @private
+static void* SqlAsync_P_Worker(void* param)
+{
+	SqlAsync* self = (SqlAsync*)param;
+	struct SqlAsyncQuery* query;
+	SqlAsyncResult* result;
+	MYSQL handle;
+	bool connected = false;
+	my_bool reconnect = 1;
+
+	mysql_thread_init();
+	mysql_init(&handle);
+	mysql_options(&handle, MYSQL_OPT_RECONNECT, &reconnect);
+
+	mutex_lock(self->mutex);
+	for(;;)
+	{
+		while( !self->terminate && self->queue_first == NULL )
+			cond_wait(self->cond, self->mutex, -1);
+		if( self->terminate )
+			break;
+
+		// dequeue
+		query = self->queue_first;
+		self->queue_first = query->next;
+		if( self->queue_first == NULL )
+			self->queue_last = NULL;
+		mutex_unlock(self->mutex);
+
+		// execute
+		if( !connected )
+		{
+			if( mysql_real_connect(&handle, self->host, self->user, self->passwd, self->db, (unsigned int)self->port, NULL/*unix_socket*/, 0/*clientflag*/) )
+			{
+				connected = true;
+				if( self->encoding != NULL && self->encoding[0] != '\0' )
+					mysql_set_character_set(&handle, self->encoding);
+			}
+		}
+		if( connected )
+			result = SqlAsync_P_Execute(&handle, query);
+		else
+			result = SqlAsync_P_ErrorResult(query->id, mysql_error(&handle));
+		free(query->query);
+		free(query);
+
+		// publish
+		mutex_lock(self->mutex);
+		--self->num_pending;
+		if( result != NULL )
+		{
+			if( self->done_last )
+				self->done_last->next = result;
+			else
+				self->done_first = result;
+			self->done_last = result;
+		}
+	}
+	mutex_unlock(self->mutex);
+
+	mysql_close(&handle);
+	mysql_thread_end();
+	return NULL;
+}
+
+
+
+/// Allocates a new worker pool and starts it's threads.
+SqlAsync* SqlAsync_Create(int num_workers, const char* user, const char* passwd, const char* host, uint16 port, const char* db, const char* encoding)
+{
+	SqlAsync* self;
+	int i;
+
+	if( num_workers < 1 )
+		num_workers = 1;
+	if( encoding == NULL )
+		encoding = "";
+
+	CREATE(self, SqlAsync, 1);
+	self->user = aStrdup(user);
+	self->passwd = aStrdup(passwd);
+	self->host = aStrdup(host);
+	self->db = aStrdup(db);
+	self->encoding = aStrdup(encoding);
+	self->port = port;
+	self->mutex = mutex_create();
+	self->cond = cond_create();
+	CREATE(self->workers, Thread*, num_workers);
+	for( i = 0; i < num_workers; ++i )
+	{
+		self->workers[self->num_workers] = thread_create(SqlAsync_P_Worker, self);
+		if( self->workers[self->num_workers] != NULL )
+			++self->num_workers;
+	}
+	if( self->num_workers == 0 )
+	{
+		ShowError("SqlAsync_Create: failed to start the worker threads.\n");
+		SqlAsync_Free(self);
+		return NULL;
+	}
+	return self;
+}
+
+
+
+/// Queues a query for execution.
+int SqlAsync_Query(SqlAsync* self, int id, const char* query, size_t max_rows)
+{
+	struct SqlAsyncQuery* q;
+	size_t len;
+
+	if( self == NULL || query == NULL )
+		return SQL_ERROR;
+
+	len = strlen(query);
+	q = (struct SqlAsyncQuery*)malloc(sizeof(struct SqlAsyncQuery));
+	if( q == NULL )
+		return SQL_ERROR;
+	q->query = SqlAsync_P_Strdup(query, len);
+	if( q->query == NULL )
+	{
+		free(q);
+		return SQL_ERROR;
+	}
+	q->id = id;
+	q->max_rows = max_rows;
+	q->query_len = (unsigned long)len;
+	q->next = NULL;
+
+	mutex_lock(self->mutex);
+	if( self->queue_last )
+		self->queue_last->next = q;
+	else
+		self->queue_first = q;
+	self->queue_last = q;
+	++self->num_pending;
+	cond_signal(self->cond);
+	mutex_unlock(self->mutex);
+
+	return SQL_SUCCESS;
+}
+
+
+
+/// Returns the number of queries that are queued or executing.
+size_t SqlAsync_NumPending(SqlAsync* self)
+{
+	size_t n;
+
+	if( self == NULL )
+		return 0;
+	mutex_lock(self->mutex);
+	n = self->num_pending;
+	mutex_unlock(self->mutex);
+	return n;
+}
+
+
+
+/// Retrieves the next finished query, or NULL if there is none.
+SqlAsyncResult* SqlAsync_Poll(SqlAsync* self)
+{
+	SqlAsyncResult* result;
+
+	if( self == NULL )
+		return NULL;
+
+	mutex_lock(self->mutex);
+	result = self->done_first;
+	if( result != NULL )
+	{
+		self->done_first = result->next;
+		if( self->done_first == NULL )
+			self->done_last = NULL;
+		result->next = NULL;
+	}
+	mutex_unlock(self->mutex);
+	return result;
+}
+
+
+
+/// Frees a result returned by SqlAsync_Poll.
+void SqlAsync_FreeResult(SqlAsyncResult* result)
+{
+	size_t i;
+
+	if( result == NULL )
+		return;
+	if( result->data )
+	{
+		for( i = 0; i < result->num_rows*result->num_cols; ++i )
+			if( result->data[i] )
+				free(result->data[i]);
+		free(result->data);
+	}
+	free(result);
+}
+
+
+
+/// Stops the workers and frees the handle.
+void SqlAsync_Free(SqlAsync* self)
+{
+	struct SqlAsyncQuery* q;
+	int i;
+
+	if( self == NULL )
+		return;
+
+	mutex_lock(self->mutex);
+	self->terminate = true;
+	cond_broadcast(self->cond);
+	mutex_unlock(self->mutex);
+	for( i = 0; i < self->num_workers; ++i )
+		thread_wait(self->workers[i], NULL);
+
+	while( (q = self->queue_first) != NULL )
+	{
+		self->queue_first = q->next;
+		free(q->query);
+		free(q);
+	}
+	while( self->done_first != NULL )
+	{
+		SqlAsyncResult* result = self->done_first;
+		self->done_first = result->next;
+		SqlAsync_FreeResult(result);
+	}
+	cond_destroy(self->cond);
+	mutex_destroy(self->mutex);
+	aFree(self->workers);
+	aFree(self->user);
+	aFree(self->passwd);
+	aFree(self->host);
+	aFree(self->db);
+	aFree(self->encoding);
+	aFree(self);
+}
@@ -55,9 +55,12 @@ enum SqlDataType
 
 struct Sql;// Sql handle (private access)
 struct SqlStmt;// Sql statement (private access)
+struct SqlAsync;// Sql asynchronous query worker (private access)
 
 typedef enum SqlDataType SqlDataType;
 typedef struct Sql Sql;
+typedef struct SqlAsync SqlAsync;
+typedef struct SqlAsyncResult SqlAsyncResult;
 typedef struct SqlStmt SqlStmt;
 
 
@@ -354,4 +357,73 @@ void SqlStmt_Free(SqlStmt* self);
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Asynchronous queries
+///////////////////////////////////////////////////////////////////////////////
+//
+// The queries are executed by worker threads, each with it's own connection,
+// so slow queries don't stall the server. Results are collected from the main
+// thread with SqlAsync_Poll.
+//
+// All the data is copied out of the mysql result in the worker, so a result
+// can be used after the worker moved on to other queries.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+/// Result of an asynchronous query.
+struct SqlAsyncResult
+{
+	int id;// id given to SqlAsync_Query
+	int status;// SQL_SUCCESS or SQL_ERROR
+	size_t num_rows;// number of rows stored (limited by max_rows)
+	uint64 total_rows;// number of rows returned by the query
+	size_t num_cols;// number of columns
+	char** data;// num_rows*num_cols strings (NULL for NULL columns)
+	char error[256];// error message when status is SQL_ERROR
+	struct SqlAsyncResult* next;// (private)
+};
+
+
+
+/// Allocates a new worker pool and starts it's threads.
+/// The workers connect to the database when they get the first query.
+/// Returns NULL if no thread could be started.
+SqlAsync* SqlAsync_Create(int num_workers, const char* user, const char* passwd, const char* host, uint16 port, const char* db, const char* encoding);
+
+
+
+/// Queues a query for execution.
+/// The id is returned in the result and should be unique.
+/// At most max_rows rows are copied into the result.
+///
+/// @return SQL_SUCCESS or SQL_ERROR
+int SqlAsync_Query(SqlAsync* self, int id, const char* query, size_t max_rows);
+
+
+
+/// Returns the number of queries that are queued or executing.
+size_t SqlAsync_NumPending(SqlAsync* self);
+
+
+
+/// Retrieves the next finished query, or NULL if there is none.
+/// The result must be released with SqlAsync_FreeResult.
+SqlAsyncResult* SqlAsync_Poll(SqlAsync* self);
+
+
+
+/// Frees a result returned by SqlAsync_Poll.
+void SqlAsync_FreeResult(SqlAsyncResult* result);
+
+
+
+/// Stops the workers and frees the handle.
+/// Waits for the queries that are executing, queued queries and
+/// finished results that weren't polled are discarded.
+void SqlAsync_Free(SqlAsync* self);
+
+
+
 #endif /* _COMMON_SQL_H_ */
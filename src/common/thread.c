@@ -0,0 +1,267 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "../common/cbasetypes.h"
+#include "../common/malloc.h"
+#include "../common/showmsg.h"
+#include "thread.h"
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+#include <stdlib.h>// malloc, free
+
+// NOTE: handles use the system allocator directly so they can be created
+//       and released from any thread (the memory manager is not thread-safe)
+
+struct Thread
+{
+#ifdef WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	ThreadFunc func;
+	void* param;
+	void* result;
+};
+
+struct Mutex
+{
+#ifdef WIN32
+	CRITICAL_SECTION cs;
+#else
+	pthread_mutex_t mutex;
+#endif
+};
+
+struct Cond
+{
+#ifdef WIN32
+	CONDITION_VARIABLE cond;
+#else
+	pthread_cond_t cond;
+#endif
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Threads
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef WIN32
+static DWORD WINAPI thread_main(LPVOID param)
+{
+	Thread* self = (Thread*)param;
+	self->result = self->func(self->param);
+	malloc_thread_final();
+	return 0;
+}
+#else
+static void* thread_main(void* param)
+{
+	Thread* self = (Thread*)param;
+	self->result = self->func(self->param);
+	malloc_thread_final();
+	return NULL;
+}
+#endif
+
+
+Thread* thread_create(ThreadFunc func, void* param)
+{
+	Thread* self;
+
+	if( func == NULL )
+		return NULL;
+	self = (Thread*)malloc(sizeof(Thread));
+	if( self == NULL )
+		return NULL;
+	self->func = func;
+	self->param = param;
+	self->result = NULL;
+#ifdef WIN32
+	self->handle = CreateThread(NULL, 0, thread_main, self, 0, NULL);
+	if( self->handle == NULL )
+	{
+		ShowError("thread_create: CreateThread failed (error %lu).\n", (unsigned long)GetLastError());
+		free(self);
+		return NULL;
+	}
+#else
+	if( pthread_create(&self->handle, NULL, thread_main, self) != 0 )
+	{
+		ShowError("thread_create: pthread_create failed.\n");
+		free(self);
+		return NULL;
+	}
+#endif
+	return self;
+}
+
+
+bool thread_wait(Thread* self, void** out_result)
+{
+	if( self == NULL )
+		return false;
+#ifdef WIN32
+	WaitForSingleObject(self->handle, INFINITE);
+	CloseHandle(self->handle);
+#else
+	pthread_join(self->handle, NULL);
+#endif
+	if( out_result )
+		*out_result = self->result;
+	free(self);
+	return true;
+}
+
+
+int thread_cpucount(void)
+{
+#ifdef WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return ( si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1 );
+#elif defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return ( n > 0 ? (int)n : 1 );
+#else
+	return 1;
+#endif
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Mutexes
+///////////////////////////////////////////////////////////////////////////////
+
+Mutex* mutex_create(void)
+{
+	Mutex* self = (Mutex*)malloc(sizeof(Mutex));
+	if( self == NULL )
+		return NULL;
+#ifdef WIN32
+	InitializeCriticalSection(&self->cs);
+#else
+	pthread_mutex_init(&self->mutex, NULL);
+#endif
+	return self;
+}
+
+
+void mutex_destroy(Mutex* self)
+{
+	if( self == NULL )
+		return;
+#ifdef WIN32
+	DeleteCriticalSection(&self->cs);
+#else
+	pthread_mutex_destroy(&self->mutex);
+#endif
+	free(self);
+}
+
+
+void mutex_lock(Mutex* self)
+{
+#ifdef WIN32
+	EnterCriticalSection(&self->cs);
+#else
+	pthread_mutex_lock(&self->mutex);
+#endif
+}
+
+
+void mutex_unlock(Mutex* self)
+{
+#ifdef WIN32
+	LeaveCriticalSection(&self->cs);
+#else
+	pthread_mutex_unlock(&self->mutex);
+#endif
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Condition variables
+///////////////////////////////////////////////////////////////////////////////
+
+Cond* cond_create(void)
+{
+	Cond* self = (Cond*)malloc(sizeof(Cond));
+	if( self == NULL )
+		return NULL;
+#ifdef WIN32
+	InitializeConditionVariable(&self->cond);
+#else
+	pthread_cond_init(&self->cond, NULL);
+#endif
+	return self;
+}
+
+
+void cond_destroy(Cond* self)
+{
+	if( self == NULL )
+		return;
+#ifndef WIN32
+	pthread_cond_destroy(&self->cond);
+#endif
+	free(self);
+}
+
+
+bool cond_wait(Cond* self, Mutex* mutex, int timeout_ms)
+{
+#ifdef WIN32
+	return ( SleepConditionVariableCS(&self->cond, &mutex->cs, (timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms)) != 0 );
+#else
+	if( timeout_ms < 0 )
+		return ( pthread_cond_wait(&self->cond, &mutex->mutex) == 0 );
+	else
+	{
+		struct timeval now;
+		struct timespec abstime;
+
+		gettimeofday(&now, NULL);
+		abstime.tv_sec = now.tv_sec + timeout_ms/1000;
+		abstime.tv_nsec = now.tv_usec*1000 + (long)(timeout_ms%1000)*1000000;
+		if( abstime.tv_nsec >= 1000000000 )
+		{
+			abstime.tv_sec += 1;
+			abstime.tv_nsec -= 1000000000;
+		}
+		return ( pthread_cond_timedwait(&self->cond, &mutex->mutex, &abstime) != ETIMEDOUT );
+	}
+#endif
+}
+
+
+void cond_signal(Cond* self)
+{
+#ifdef WIN32
+	WakeConditionVariable(&self->cond);
+#else
+	pthread_cond_signal(&self->cond);
+#endif
+}
+
+
+void cond_broadcast(Cond* self)
+{
+#ifdef WIN32
+	WakeAllConditionVariable(&self->cond);
+#else
+	pthread_cond_broadcast(&self->cond);
+#endif
+}
@@ -0,0 +1,56 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef _THREAD_H_
+#define _THREAD_H_
+
+#include "../common/cbasetypes.h"
+
+// Minimal portable threading primitives.
+// The servers are single-threaded by design, so only code that explicitly
+// hands work off to a worker (and never touches game state from it) should
+// use these. Workers can only use aMalloc while malloc_set_threaded is on.
+
+struct Thread;// thread handle (private access)
+struct Mutex;// mutex handle (private access)
+struct Cond;// condition variable handle (private access)
+
+typedef struct Thread Thread;
+typedef struct Mutex Mutex;
+typedef struct Cond Cond;
+
+typedef void* (*ThreadFunc)(void* param);
+
+/// Storage class of variables that have a separate copy in each thread.
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/// Creates and starts a new thread that runs func(param).
+/// Returns NULL if the thread could not be created.
+Thread* thread_create(ThreadFunc func, void* param);
+
+/// Waits for the thread to finish and releases the handle.
+/// The return value of the thread function is stored in out_result, if not NULL.
+bool thread_wait(Thread* self, void** out_result);
+
+/// Returns the number of logical cpus, or 1 if it can't be determined.
+int thread_cpucount(void);
+
+Mutex* mutex_create(void);
+void mutex_destroy(Mutex* self);
+void mutex_lock(Mutex* self);
+void mutex_unlock(Mutex* self);
+
+Cond* cond_create(void);
+void cond_destroy(Cond* self);
+/// Atomically unlocks the mutex and waits for a signal.
+/// The mutex is locked again before returning.
+/// A negative timeout waits forever. Returns false on timeout.
+bool cond_wait(Cond* self, Mutex* mutex, int timeout_ms);
+void cond_signal(Cond* self);
+void cond_broadcast(Cond* self);
+
+#endif /* _THREAD_H_ */
@@ -75,10 +75,10 @@ int add_timer_func_list(TimerFunc func, char* name)
 			else if( strcmp(name,tfl->name) == 0 )
 				ShowWarning("add_timer_func_list: function %p has the same name as %p(%s)\n",func,tfl->func,tfl->name);
 		}
-		CREATE(tfl,struct timer_func_list,1);
+		CREATE_TAG(tfl,struct timer_func_list,1,MEMTAG_TIMER);
 		tfl->next = tfl_root;
 		tfl->func = func;
-		tfl->name = aStrdup(name);
+		tfl->name = aStrdupTag(name,MEMTAG_TIMER);
 		tfl_root = tfl;
 	}
 	return 0;
@@ -226,7 +226,7 @@ static int acquire_timer(void)
 	if (tid >= timer_data_num && tid >= timer_data_max)
 	{// expand timer array
 		timer_data_max += 256;
-		RECREATE(timer_data, struct TimerData, timer_data_max);
+		RECREATE_TAG(timer_data, struct TimerData, timer_data_max, MEMTAG_TIMER);
 		memset(timer_data + (timer_data_max - 256), 0, sizeof(struct TimerData)*256);
 	}
 
@@ -377,7 +377,7 @@ int do_timer(unsigned int tick)
 				timer_data[tid].type = 0;
 				if (free_timer_list_pos >= free_timer_list_max) {
 					free_timer_list_max += 256;
-					RECREATE(free_timer_list,int,free_timer_list_max);
+					RECREATE_TAG(free_timer_list,int,free_timer_list_max,MEMTAG_TIMER);
 					memset(free_timer_list + (free_timer_list_max - 256), 0, 256 * sizeof(int));
 				}
 				free_timer_list[free_timer_list_pos++] = tid;
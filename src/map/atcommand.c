@@ -1969,7 +1969,7 @@ static int atcommand_pvpon_sub(struct block_list *bl,va_list ap)
 		sd->pvp_timer = add_timer(gettick() + 200, pc_calc_pvprank_timer, sd->bl.id, 0);
 		sd->pvp_rank = 0;
 		sd->pvp_lastusers = 0;
-		sd->pvp_point = 5;
+		pc_setpvppoint(sd, 5);
 		sd->pvp_won = 0;
 		sd->pvp_lost = 0;
 	}
@@ -4152,6 +4152,7 @@ ACMD_FUNC(reloaditemdb)
 {
 	nullpo_retr(-1, sd);
 	itemdb_reload();
+	mob_build_droptables(); // drops of items that no longer exist
 	clif_displaymessage(fd, msg_txt(97)); // Item database has been reloaded.
 
 	return 0;
@@ -4240,6 +4241,8 @@ ACMD_FUNC(reloadbattleconf)
 		chrif_ragsrvinfo(battle_config.base_exp_rate, battle_config.job_exp_rate, battle_config.item_rate_common);
 #endif
 	}
+	else if( prev_config.drop_rate0item != battle_config.drop_rate0item )
+		mob_build_droptables(); // the drop tables skip the 0% drops
 	clif_displaymessage(fd, msg_txt(255));
 	return 0;
 }
@@ -4274,6 +4277,7 @@ ACMD_FUNC(reloadmotd)
 
 /*==========================================
  * @reloadscript - reloads all scripts (npcs, warps, mob spawns, ...)
+ * @reloadscript changed - only reloads the npc files that were modified
  *------------------------------------------*/
 ACMD_FUNC(reloadscript)
 {
@@ -4283,6 +4287,14 @@ ACMD_FUNC(reloadscript)
 	//atcommand_broadcast( fd, sd, "@broadcast", "Reloading NPCs..." );
 
 	flush_fifos();
+
+	if( message && strcmpi(message, "changed") == 0 )
+	{
+		sprintf(atcmd_output, "%d npc file(s) reloaded.", npc_reload_changed());
+		clif_displaymessage(fd, atcmd_output);
+		return 0;
+	}
+
 	script_reload();
 	npc_reload();
 
@@ -940,6 +940,125 @@ static int battle_blewcount_bonus(struct map_session_data *sd, int skill_num)
 	return 0;
 }
 
+/*==========================================
+ * Card bonuses of weapon attacks
+ *------------------------------------------*/
+
+// Bonuses of the attacker that apply to the attack.
+enum e_cardfix_kind {
+	CARDFIX_ARROW,  // right hand and arrows
+	CARDFIX_RIGHT,  // right hand of a melee attack
+	CARDFIX_LEFT,   // left hand of a melee attack
+	CARDFIX_MERGED, // both hands of a melee attack, left_cardfix_to_right
+};
+
+#define CARDFIX_NOELE ELE_MAX // no element bonus (NK_NO_ELEFIX)
+
+/// Bonus of the weapon against the element, with the ones that depend on the attack flags.
+static int battle_addele_fix(struct weapon_data* wd, int ele, int flag)
+{
+	int i, ele_fix = wd->addele[ele];
+
+	for( i = 0; i < ARRAYLENGTH(wd->addele2) && wd->addele2[i].rate != 0; i++ )
+	{
+		if( wd->addele2[i].ele != ele )
+			continue;
+		if( !(wd->addele2[i].flag&flag&BF_WEAPONMASK &&
+			  wd->addele2[i].flag&flag&BF_RANGEMASK &&
+			  wd->addele2[i].flag&flag&BF_SKILLMASK) )
+			continue;
+		ele_fix += wd->addele2[i].rate;
+	}
+	return ele_fix;
+}
+
+/// Reduction of the player against the element, with the ones that depend on the attack flags.
+static int battle_subele_fix(struct map_session_data* tsd, int ele, int flag)
+{
+	int i, ele_fix = tsd->subele[ele];
+
+	for( i = 0; i < ARRAYLENGTH(tsd->subele2) && tsd->subele2[i].rate != 0; i++ )
+	{
+		if( tsd->subele2[i].ele != ele )
+			continue;
+		if( !(tsd->subele2[i].flag&flag&BF_WEAPONMASK &&
+			  tsd->subele2[i].flag&flag&BF_RANGEMASK &&
+			  tsd->subele2[i].flag&flag&BF_SKILLMASK) )
+			continue;
+		ele_fix += tsd->subele2[i].rate;
+	}
+	return ele_fix;
+}
+
+/// Card bonus rate (1000 = none) of the attacker's weapons against the target.
+/// Each bonus is applied in turn, rounding down, so the order matters.
+static int battle_cardfix_atk_calc(struct map_session_data* sd, int kind, int race, int race2, int ele, int size, bool boss, int flag)
+{
+	struct weapon_data* rw = &sd->right_weapon;
+	struct weapon_data* lw = &sd->left_weapon;
+	int boss_race = boss ? RC_BOSS : RC_NONBOSS;
+	int cardfix = 1000;
+
+	switch( kind )
+	{
+	case CARDFIX_ARROW:
+		cardfix=cardfix*(100+rw->addrace[race]+sd->arrow_addrace[race])/100;
+		if( ele != CARDFIX_NOELE )
+			cardfix=cardfix*(100+battle_addele_fix(rw, ele, flag)+sd->arrow_addele[ele])/100;
+		cardfix=cardfix*(100+rw->addsize[size]+sd->arrow_addsize[size])/100;
+		cardfix=cardfix*(100+rw->addrace2[race2])/100;
+		cardfix=cardfix*(100+rw->addrace[boss_race]+sd->arrow_addrace[boss_race])/100;
+		if( race != RC_DEMIHUMAN )
+			cardfix=cardfix*(100+rw->addrace[RC_NONDEMIHUMAN]+sd->arrow_addrace[RC_NONDEMIHUMAN])/100;
+		break;
+	case CARDFIX_RIGHT:
+	case CARDFIX_LEFT:
+	{
+		struct weapon_data* w = ( kind == CARDFIX_RIGHT ) ? rw : lw;
+		cardfix=cardfix*(100+w->addrace[race])/100;
+		if( kind == CARDFIX_RIGHT && ele != CARDFIX_NOELE ) // the element bonus of the left hand goes to the right one
+			cardfix=cardfix*(100+battle_addele_fix(w, ele, flag))/100;
+		cardfix=cardfix*(100+w->addsize[size])/100;
+		cardfix=cardfix*(100+w->addrace2[race2])/100;
+		cardfix=cardfix*(100+w->addrace[boss_race])/100;
+		if( race != RC_DEMIHUMAN )
+			cardfix=cardfix*(100+w->addrace[RC_NONDEMIHUMAN])/100;
+		break;
+	}
+	case CARDFIX_MERGED:
+		cardfix=cardfix*(100+rw->addrace[race]+lw->addrace[race])/100;
+		cardfix=cardfix*(100+battle_addele_fix(rw, ele, flag)+battle_addele_fix(lw, ele, flag))/100;
+		cardfix=cardfix*(100+rw->addsize[size]+lw->addsize[size])/100;
+		cardfix=cardfix*(100+rw->addrace2[race2]+lw->addrace2[race2])/100;
+		cardfix=cardfix*(100+rw->addrace[boss_race]+lw->addrace[boss_race])/100;
+		if( race != RC_DEMIHUMAN )
+			cardfix=cardfix*(100+rw->addrace[RC_NONDEMIHUMAN]+lw->addrace[RC_NONDEMIHUMAN])/100;
+		break;
+	}
+	return cardfix;
+}
+
+/// Card reduction rate (1000 = none) of the target against the attacker.
+/// ele_lh is the element of the left hand if it differs, CARDFIX_NOELE otherwise.
+static short battle_cardfix_def_calc(struct map_session_data* tsd, int ele, int ele_lh, int size, int race, int race2, bool boss, int flag)
+{
+	short cardfix = 1000;
+
+	if( ele != CARDFIX_NOELE )
+	{
+		cardfix=cardfix*(100-battle_subele_fix(tsd, ele, flag))/100;
+		if( ele_lh != CARDFIX_NOELE )
+			cardfix=cardfix*(100-battle_subele_fix(tsd, ele_lh, flag))/100;
+	}
+	cardfix=cardfix*(100-tsd->subsize[size])/100;
+	cardfix=cardfix*(100-tsd->subrace2[race2])/100;
+	cardfix=cardfix*(100-tsd->subrace[race])/100;
+	cardfix=cardfix*(100-tsd->subrace[boss?RC_BOSS:RC_NONBOSS])/100;
+	if( race != RC_DEMIHUMAN )
+		cardfix=cardfix*(100-tsd->subrace[RC_NONDEMIHUMAN])/100;
+	return cardfix;
+}
+
 struct Damage battle_calc_magic_attack(struct block_list *src,struct block_list *target,int skill_num,int skill_lv,int mflag);
 struct Damage battle_calc_misc_attack(struct block_list *src,struct block_list *target,int skill_num,int skill_lv,int mflag);
 
@@ -2008,101 +2127,24 @@ static struct Damage battle_calc_weapon_attack(struct block_list *src,struct blo
 		{
 			int cardfix = 1000, cardfix_ = 1000;
 			int t_race2 = status_get_race2(target);
+			int t_ele = (nk&NK_NO_ELEFIX) ? CARDFIX_NOELE : tstatus->def_ele;
+			bool t_boss = is_boss(target) != 0;
 			if(sd->state.arrow_atk)
-			{
-				cardfix=cardfix*(100+sd->right_weapon.addrace[tstatus->race]+sd->arrow_addrace[tstatus->race])/100;
-				if (!(nk&NK_NO_ELEFIX))
-				{
-					int ele_fix = sd->right_weapon.addele[tstatus->def_ele] + sd->arrow_addele[tstatus->def_ele];
-					for (i = 0; ARRAYLENGTH(sd->right_weapon.addele2) > i && sd->right_weapon.addele2[i].rate != 0; i++) {
-						if (sd->right_weapon.addele2[i].ele != tstatus->def_ele) continue;
-						if(!(sd->right_weapon.addele2[i].flag&wd.flag&BF_WEAPONMASK &&
-							 sd->right_weapon.addele2[i].flag&wd.flag&BF_RANGEMASK &&
-							 sd->right_weapon.addele2[i].flag&wd.flag&BF_SKILLMASK))
-								continue;
-						ele_fix += sd->right_weapon.addele2[i].rate;
-					}
-					cardfix=cardfix*(100+ele_fix)/100;
-				}
-				cardfix=cardfix*(100+sd->right_weapon.addsize[tstatus->size]+sd->arrow_addsize[tstatus->size])/100;
-				cardfix=cardfix*(100+sd->right_weapon.addrace2[t_race2])/100;
-				cardfix=cardfix*(100+sd->right_weapon.addrace[is_boss(target)?RC_BOSS:RC_NONBOSS]+sd->arrow_addrace[is_boss(target)?RC_BOSS:RC_NONBOSS])/100;
-				if( tstatus->race != RC_DEMIHUMAN )
-					cardfix=cardfix*(100+sd->right_weapon.addrace[RC_NONDEMIHUMAN]+sd->arrow_addrace[RC_NONDEMIHUMAN])/100;
-			}
+				cardfix = battle_cardfix_atk_calc(sd, CARDFIX_ARROW, tstatus->race, t_race2, t_ele, tstatus->size, t_boss, wd.flag);
 			else
 			{ // Melee attack
 				if( !battle_config.left_cardfix_to_right )
 				{
-					cardfix=cardfix*(100+sd->right_weapon.addrace[tstatus->race])/100;					
-					if (!(nk&NK_NO_ELEFIX)) {
-						int ele_fix = sd->right_weapon.addele[tstatus->def_ele];
-						for (i = 0; ARRAYLENGTH(sd->right_weapon.addele2) > i && sd->right_weapon.addele2[i].rate != 0; i++) {
-							if (sd->right_weapon.addele2[i].ele != tstatus->def_ele) continue;
-							if(!(sd->right_weapon.addele2[i].flag&wd.flag&BF_WEAPONMASK &&
-								 sd->right_weapon.addele2[i].flag&wd.flag&BF_RANGEMASK &&
-								 sd->right_weapon.addele2[i].flag&wd.flag&BF_SKILLMASK))
-									continue;
-							ele_fix += sd->right_weapon.addele2[i].rate;
-						}
-						cardfix=cardfix*(100+ele_fix)/100;
-					}
-					cardfix=cardfix*(100+sd->right_weapon.addsize[tstatus->size])/100;
-					cardfix=cardfix*(100+sd->right_weapon.addrace2[t_race2])/100;
-					cardfix=cardfix*(100+sd->right_weapon.addrace[is_boss(target)?RC_BOSS:RC_NONBOSS])/100;
-					if( tstatus->race != RC_DEMIHUMAN )
-						cardfix=cardfix*(100+sd->right_weapon.addrace[RC_NONDEMIHUMAN])/100;
-
+					cardfix = battle_cardfix_atk_calc(sd, CARDFIX_RIGHT, tstatus->race, t_race2, t_ele, tstatus->size, t_boss, wd.flag);
 					if( flag.lh )
 					{
-						cardfix_=cardfix_*(100+sd->left_weapon.addrace[tstatus->race])/100;						
-						if (!(nk&NK_NO_ELEFIX))	{
-							int ele_fix_lh = sd->left_weapon.addele[tstatus->def_ele];							
-							for (i = 0; ARRAYLENGTH(sd->left_weapon.addele2) > i && sd->left_weapon.addele2[i].rate != 0; i++) {
-								if (sd->left_weapon.addele2[i].ele != tstatus->def_ele) continue;
-								if(!(sd->left_weapon.addele2[i].flag&wd.flag&BF_WEAPONMASK &&
-									 sd->left_weapon.addele2[i].flag&wd.flag&BF_RANGEMASK &&
-									 sd->left_weapon.addele2[i].flag&wd.flag&BF_SKILLMASK))
-										continue;
-								ele_fix_lh += sd->left_weapon.addele2[i].rate;
-							}
-							cardfix=cardfix*(100+ele_fix_lh)/100;
-						}
-						cardfix_=cardfix_*(100+sd->left_weapon.addsize[tstatus->size])/100;
-						cardfix_=cardfix_*(100+sd->left_weapon.addrace2[t_race2])/100;
-						cardfix_=cardfix_*(100+sd->left_weapon.addrace[is_boss(target)?RC_BOSS:RC_NONBOSS])/100;
-						if( tstatus->race != RC_DEMIHUMAN )
-							cardfix_=cardfix_*(100+sd->left_weapon.addrace[RC_NONDEMIHUMAN])/100;
+						cardfix_ = battle_cardfix_atk_calc(sd, CARDFIX_LEFT, tstatus->race, t_race2, CARDFIX_NOELE, tstatus->size, t_boss, wd.flag);
+						if( t_ele != CARDFIX_NOELE )
+							cardfix=cardfix*(100+battle_addele_fix(&sd->left_weapon, t_ele, wd.flag))/100;
 					}
 				}
 				else
-				{
-					int ele_fix = sd->right_weapon.addele[tstatus->def_ele] + sd->left_weapon.addele[tstatus->def_ele];
-					for (i = 0; ARRAYLENGTH(sd->right_weapon.addele2) > i && sd->right_weapon.addele2[i].rate != 0; i++) {
-						if (sd->right_weapon.addele2[i].ele != tstatus->def_ele) continue;
-						if(!(sd->right_weapon.addele2[i].flag&wd.flag&BF_WEAPONMASK &&
-							 sd->right_weapon.addele2[i].flag&wd.flag&BF_RANGEMASK &&
-							 sd->right_weapon.addele2[i].flag&wd.flag&BF_SKILLMASK))
-								continue;
-						ele_fix += sd->right_weapon.addele2[i].rate;
-					}
-					for (i = 0; ARRAYLENGTH(sd->left_weapon.addele2) > i && sd->left_weapon.addele2[i].rate != 0; i++) {
-						if (sd->left_weapon.addele2[i].ele != tstatus->def_ele) continue;
-						if(!(sd->left_weapon.addele2[i].flag&wd.flag&BF_WEAPONMASK &&
-							 sd->left_weapon.addele2[i].flag&wd.flag&BF_RANGEMASK &&
-							 sd->left_weapon.addele2[i].flag&wd.flag&BF_SKILLMASK))
-								continue;
-						ele_fix += sd->left_weapon.addele2[i].rate;
-					}
-
-					cardfix=cardfix*(100+sd->right_weapon.addrace[tstatus->race]+sd->left_weapon.addrace[tstatus->race])/100;
-					cardfix=cardfix*(100+ele_fix)/100;
-					cardfix=cardfix*(100+sd->right_weapon.addsize[tstatus->size]+sd->left_weapon.addsize[tstatus->size])/100;
-					cardfix=cardfix*(100+sd->right_weapon.addrace2[t_race2]+sd->left_weapon.addrace2[t_race2])/100;
-					cardfix=cardfix*(100+sd->right_weapon.addrace[is_boss(target)?RC_BOSS:RC_NONBOSS]+sd->left_weapon.addrace[is_boss(target)?RC_BOSS:RC_NONBOSS])/100;
-					if( tstatus->race != RC_DEMIHUMAN )
-						cardfix=cardfix*(100+sd->right_weapon.addrace[RC_NONDEMIHUMAN]+sd->left_weapon.addrace[RC_NONDEMIHUMAN])/100;
-				}
+					cardfix = battle_cardfix_atk_calc(sd, CARDFIX_MERGED, tstatus->race, t_race2, tstatus->def_ele, tstatus->size, t_boss, wd.flag);
 			}
 
 			for( i = 0; i < ARRAYLENGTH(sd->right_weapon.add_dmg) && sd->right_weapon.add_dmg[i].rate; i++ )
@@ -2145,45 +2187,13 @@ static struct Damage battle_calc_weapon_attack(struct block_list *src,struct blo
 	if( tsd && !(nk&NK_NO_CARDFIX_DEF) )
 	{
 		short s_race2,s_class;
-		short cardfix=1000;
+		short cardfix;
 
 		s_race2 = status_get_race2(src);
 		s_class = status_get_class(src);
 
-		if( !(nk&NK_NO_ELEFIX) )
-		{
-			int ele_fix = tsd->subele[s_ele];
-			for (i = 0; ARRAYLENGTH(tsd->subele2) > i && tsd->subele2[i].rate != 0; i++)
-			{
-				if(tsd->subele2[i].ele != s_ele) continue;
-				if(!(tsd->subele2[i].flag&wd.flag&BF_WEAPONMASK &&
-					 tsd->subele2[i].flag&wd.flag&BF_RANGEMASK &&
-					 tsd->subele2[i].flag&wd.flag&BF_SKILLMASK))
-					continue;
-				ele_fix += tsd->subele2[i].rate;
-			}
-			cardfix=cardfix*(100-ele_fix)/100;
-			if( flag.lh && s_ele_ != s_ele )
-			{
-				int ele_fix_lh = tsd->subele[s_ele_];
-				for (i = 0; ARRAYLENGTH(tsd->subele2) > i && tsd->subele2[i].rate != 0; i++)
-				{
-					if(tsd->subele2[i].ele != s_ele_) continue;
-					if(!(tsd->subele2[i].flag&wd.flag&BF_WEAPONMASK &&
-						 tsd->subele2[i].flag&wd.flag&BF_RANGEMASK &&
-						 tsd->subele2[i].flag&wd.flag&BF_SKILLMASK))
-						continue;
-					ele_fix_lh += tsd->subele2[i].rate;
-				}
-				cardfix=cardfix*(100-ele_fix_lh)/100;
-			}
-		}
-		cardfix=cardfix*(100-tsd->subsize[sstatus->size])/100;
- 		cardfix=cardfix*(100-tsd->subrace2[s_race2])/100;
-		cardfix=cardfix*(100-tsd->subrace[sstatus->race])/100;
-		cardfix=cardfix*(100-tsd->subrace[is_boss(src)?RC_BOSS:RC_NONBOSS])/100;
-		if( sstatus->race != RC_DEMIHUMAN )
-			cardfix=cardfix*(100-tsd->subrace[RC_NONDEMIHUMAN])/100;
+		cardfix = battle_cardfix_def_calc(tsd, (nk&NK_NO_ELEFIX) ? CARDFIX_NOELE : s_ele, ( flag.lh && s_ele_ != s_ele ) ? s_ele_ : CARDFIX_NOELE,
+			sstatus->size, sstatus->race, s_race2, is_boss(src) != 0, wd.flag);
 
 		for( i = 0; i < ARRAYLENGTH(tsd->add_def) && tsd->add_def[i].rate;i++ )
 		{
@@ -3978,6 +3988,7 @@ static const struct _battle_data {
 	{ "day_duration",                       &battle_config.day_duration,                    0,      0,      INT_MAX,        },
 	{ "night_duration",                     &battle_config.night_duration,                  0,      0,      INT_MAX,        },
 	{ "mob_remove_delay",                   &battle_config.mob_remove_delay,                60000,  1000,   INT_MAX,        },
+	{ "map_hibernate_delay",                &battle_config.map_hibernate_delay,             60000,  0,      INT_MAX,        },
 	{ "mob_active_time",                    &battle_config.mob_active_time,                 0,      0,      INT_MAX,        },
 	{ "boss_active_time",                   &battle_config.boss_active_time,                0,      0,      INT_MAX,        },
 	{ "sg_miracle_skill_duration",          &battle_config.sg_miracle_skill_duration,       3600000, 0,     INT_MAX,        },
@@ -4126,7 +4137,7 @@ int battle_config_read(const char* cfgName)
 
 void do_init_battle(void)
 {
-	delay_damage_ers = ers_new(sizeof(struct delay_damage));
+	delay_damage_ers = ers_new(sizeof(struct delay_damage), "delay_damage", MEMTAG_ERS);
 	add_timer_func_list(battle_delay_damage_sub, "battle_delay_damage_sub");
 }
 
@@ -0,0 +1,614 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "../common/cbasetypes.h"
+#include "../common/malloc.h"
+#include "../common/showmsg.h"
+#include "../common/strlib.h"
+#include "../common/timer.h"
+#include "../common/utils.h" // cap_value()
+#include "battle.h"
+#include "battlebench.h"
+#include "itemdb.h"
+#include "map.h"
+#include "mob.h"
+#include "pc.h"
+#include "skill.h"
+#include "status.h"
+#include "unit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Offline harness of battle_calc_attack (battle_calc_weapon_attack,
+// battle_calc_magic_attack and battle_calc_misc_attack).
+//
+// Once the map-server has loaded its databases, it makes players of the
+// second and transcendent jobs with random stats, equipment, cards and
+// statuses, and monsters of the mob db. Then it goes through a fixed list
+// of attacks between them (normal attacks, skills of the attacker) and
+// - records their results to a file (--battle-bench-record <file>),
+// - compares their results with a recorded file (--battle-bench-check <file>),
+// - times <count> calculations over the list (--battle-bench <count>).
+//
+// Everything comes from fixed seeds and the recorded attacks run in the same
+// order from the same state, so the results only change when the formulas
+// (or the databases/configuration) do. rand() is seeded before each recorded
+// attack; a change of the formulas that draws the random numbers in another
+// order changes the results as well and needs a new recording.
+
+int battlebench_count = 0;
+const char* battlebench_record = NULL;
+const char* battlebench_check = NULL;
+
+#define BB_SEED 20101019
+#define BB_PLAYERS 48
+#define BB_MOBS 64
+#define BB_CASES 20000 // attacks of the recorded results
+#define BB_MAP "prt_fild08" // a field without special mapflags
+#define BB_X 100
+#define BB_Y 100
+
+struct bb_case {
+	struct block_list* src;
+	struct block_list* target;
+	short skill_id, skill_lv;
+	short dx, dy; // position of the target
+	int count; // targets of the attack (divides the damage of NK_SPLASHSPLIT skills)
+	int attack_type; // BF_WEAPON/BF_MAGIC/BF_MISC
+	unsigned int seed; // of rand() when recorded
+};
+
+struct bb_result {
+	int damage, damage2, div_, type, dmg_lv, flag;
+};
+
+static struct map_session_data* bb_pc[BB_PLAYERS];
+static struct mob_data* bb_mob[BB_MOBS];
+static struct bb_case* bb_cases;
+static int bb_map;
+
+static unsigned int bb_seed;
+
+/// Own generator, so the setup doesn't depend on the rest of the server.
+static int bb_rand(int n)
+{
+	bb_seed = bb_seed*1103515245 + 12345;
+	return (n > 0) ? (int)((bb_seed>>8)%(unsigned int)n) : 0;
+}
+
+static const int bb_jobs[] = {
+	JOB_KNIGHT, JOB_PRIEST, JOB_WIZARD, JOB_BLACKSMITH, JOB_HUNTER, JOB_ASSASSIN,
+	JOB_CRUSADER, JOB_MONK, JOB_SAGE, JOB_ROGUE, JOB_ALCHEMIST, JOB_BARD, JOB_DANCER,
+	JOB_LORD_KNIGHT, JOB_HIGH_PRIEST, JOB_HIGH_WIZARD, JOB_WHITESMITH, JOB_SNIPER, JOB_ASSASSIN_CROSS,
+	JOB_PALADIN, JOB_CHAMPION, JOB_PROFESSOR, JOB_STALKER, JOB_CREATOR, JOB_CLOWN, JOB_GYPSY,
+	JOB_SUPER_NOVICE, JOB_GUNSLINGER, JOB_NINJA, JOB_TAEKWON, JOB_STAR_GLADIATOR, JOB_SOUL_LINKER,
+};
+
+/// Statuses given to some of the units, with their level.
+static const struct { enum sc_type type; int val1; bool pc_only; } bb_statuses[] = {
+	{ SC_BLESSING,          10, false },
+	{ SC_INCREASEAGI,       10, false },
+	{ SC_ANGELUS,           10, false },
+	{ SC_IMPOSITIO,          5, true  },
+	{ SC_GLORIA,             5, true  },
+	{ SC_ADRENALINE,         5, true  },
+	{ SC_WEAPONPERFECTION,  10, true  },
+	{ SC_OVERTHRUST,         5, true  },
+	{ SC_MAXOVERTHRUST,      5, true  },
+	{ SC_ASPERSIO,           5, true  },
+	{ SC_ENCPOISON,         10, true  },
+	{ SC_CONCENTRATION,     10, true  },
+	{ SC_TRUESIGHT,          5, true  },
+	{ SC_EDP,                5, true  },
+	{ SC_MAGICPOWER,         5, true  },
+	{ SC_TWOHANDQUICKEN,    10, true  },
+	{ SC_ENERGYCOAT,         1, true  },
+	{ SC_DEFENDER,           5, true  },
+	{ SC_PROVOKE,           10, false },
+	{ SC_ASSUMPTIO,          5, false },
+	{ SC_MINDBREAKER,        5, false },
+	{ SC_SIGNUMCRUCIS,      10, false },
+	{ SC_ETERNALCHAOS,       1, false },
+	{ SC_DECREASEAGI,       10, false },
+	{ SC_CURSE,              1, false },
+	{ SC_FREEZE,             1, false },
+};
+
+/// Candidate items, by kind.
+static int* bb_weapons; static int bb_weapon_count;
+static int* bb_armors;  static int bb_armor_count;
+static int* bb_cards;   static int bb_card_count;
+static int* bb_ammo;    static int bb_ammo_count;
+
+static void bb_additem(int** list, int* count, int nameid)
+{
+	RECREATE(*list, int, *count+1);
+	(*list)[(*count)++] = nameid;
+}
+
+static void bb_readitems(void)
+{
+	int nameid;
+
+	for( nameid = 501; nameid < 32768; ++nameid )
+	{
+		struct item_data* id = itemdb_exists(nameid);
+		if( id == NULL || !id->equip )
+			continue;
+		switch( id->type )
+		{
+		case IT_WEAPON: bb_additem(&bb_weapons, &bb_weapon_count, nameid); break;
+		case IT_ARMOR:  bb_additem(&bb_armors, &bb_armor_count, nameid); break;
+		case IT_CARD:   bb_additem(&bb_cards, &bb_card_count, nameid); break;
+		case IT_AMMO:   bb_additem(&bb_ammo, &bb_ammo_count, nameid); break;
+		}
+	}
+}
+
+/// Puts the item in inventory slot n, equipped at pos.
+/// Returns false (and clears the slot) if the player can't equip it.
+static bool bb_equip(struct map_session_data* sd, int n, int nameid, int pos)
+{
+	struct item* it = &sd->status.inventory[n];
+	struct item_data* id = itemdb_search(nameid);
+	int i;
+
+	memset(it, 0, sizeof(*it));
+	it->nameid = nameid;
+	it->amount = ( id->type == IT_AMMO ) ? 1000 : 1;
+	it->identify = 1;
+	it->equip = pos;
+	sd->inventory_data[n] = id;
+	if( !pc_isequip(sd, n) )
+	{
+		memset(it, 0, sizeof(*it));
+		sd->inventory_data[n] = NULL;
+		return false;
+	}
+
+	if( (id->type == IT_WEAPON || id->type == IT_ARMOR) && !id->flag.no_refine )
+		it->refine = bb_rand(11);
+	for( i = 0; i < id->slot && i < MAX_SLOTS && bb_card_count; ++i )
+	{
+		int card = bb_cards[bb_rand(bb_card_count)];
+		if( itemdb_search(card)->equip&pos && bb_rand(3) )
+			it->card[i] = card;
+	}
+	return true;
+}
+
+/// Tries random candidates until one can be equipped at pos.
+static bool bb_equip_random(struct map_session_data* sd, int n, const int* list, int count, int pos, int used)
+{
+	int tries;
+
+	for( tries = 0; tries < 200 && count; ++tries )
+	{
+		int nameid = list[bb_rand(count)];
+		struct item_data* id = itemdb_search(nameid);
+		int p = ( pos&EQP_ACC ) ? pos : id->equip;
+
+		if( !(id->equip&pos) || p&used )
+			continue;
+		if( bb_equip(sd, n, nameid, p) )
+			return true;
+	}
+	return false;
+}
+
+/// Ammo type used by the weapon type, 0 if none.
+static int bb_ammotype(int weapontype)
+{
+	switch( weapontype )
+	{
+	case W_BOW: return A_ARROW;
+	case W_REVOLVER: case W_RIFLE: case W_GATLING: return A_BULLET;
+	case W_SHOTGUN: return A_SHELL;
+	case W_GRENADE: return A_GRENADE;
+	case W_HUUMA: return A_SHURIKEN;
+	}
+	return 0;
+}
+
+static void bb_startstatuses(struct block_list* bl, int chance)
+{
+	int i;
+
+	for( i = 0; i < ARRAYLENGTH(bb_statuses); ++i )
+	{
+		if( bb_statuses[i].pc_only && bl->type != BL_PC )
+			continue;
+		if( bb_rand(100) >= chance )
+			continue;
+		status_change_start(bl, bb_statuses[i].type, 10000, bb_statuses[i].val1, 0, 0, 0, 3600000, 1|2|8);
+	}
+}
+
+static struct map_session_data* bb_makepc(int index)
+{
+	static const int equip_order[] = { EQP_HEAD_TOP, EQP_HEAD_MID, EQP_HEAD_LOW, EQP_ARMOR, EQP_HAND_L, EQP_GARMENT, EQP_SHOES, EQP_ACC_L, EQP_ACC_R };
+	struct map_session_data* sd;
+	struct item_data* weapon = NULL;
+	int job = bb_jobs[index%ARRAYLENGTH(bb_jobs)];
+	int n = 0, used = 0, i;
+	int sex = ( job == JOB_DANCER || job == JOB_GYPSY ) ? 0 : ( job == JOB_BARD || job == JOB_CLOWN ) ? 1 : bb_rand(2);
+
+	CREATE(sd, struct map_session_data, 1);
+	pc_setnewpc(sd, 2000000 + index, 150000 + index, 0, 0, sex, 0);
+	safesnprintf(sd->status.name, NAME_LENGTH, "bench%d", index);
+	sd->status.class_ = job;
+	sd->class_ = pc_jobid2mapid(job);
+	sd->status.base_level = 99;
+	sd->status.job_level = (sd->class_&JOBL_UPPER) ? 70 : 50;
+	sd->status.str = 1 + bb_rand(99);
+	sd->status.agi = 1 + bb_rand(99);
+	sd->status.vit = 1 + bb_rand(99);
+	sd->status.int_ = 1 + bb_rand(99);
+	sd->status.dex = 1 + bb_rand(99);
+	sd->status.luk = 1 + bb_rand(99);
+	sd->status.hp = sd->status.sp = 1;
+	sd->bl.m = bb_map;
+	sd->bl.x = BB_X;
+	sd->bl.y = BB_Y;
+
+	// timers as in pc_authok
+	sd->followtimer = INVALID_TIMER;
+	sd->invincible_timer = INVALID_TIMER;
+	sd->npc_timer_id = INVALID_TIMER;
+	sd->pvp_timer = INVALID_TIMER;
+	sd->rental_timer = INVALID_TIMER;
+	for( i = 0; i < MAX_SKILL_LEVEL; i++ )
+		sd->spirit_timer[i] = INVALID_TIMER;
+	for( i = 0; i < ARRAYLENGTH(sd->autobonus); i++ )
+		sd->autobonus[i].active = INVALID_TIMER;
+	for( i = 0; i < ARRAYLENGTH(sd->autobonus2); i++ )
+		sd->autobonus2[i].active = INVALID_TIMER;
+	for( i = 0; i < ARRAYLENGTH(sd->autobonus3); i++ )
+		sd->autobonus3[i].active = INVALID_TIMER;
+	for( i = 0; i < MAX_EVENTTIMER; i++ )
+		sd->eventtimer[i] = INVALID_TIMER;
+	for( i = 0; i < 3; i++ )
+		sd->hate_mob[i] = -1;
+
+	// all skills at their max level, pc_calc_skilltree keeps the ones of the job
+	for( i = 1; i < MAX_SKILL; i++ )
+	{
+		sd->status.skill[i].lv = skill_get_max(i);
+		if( sd->status.skill[i].lv > 0 )
+			sd->status.skill[i].id = i; // NV_BASIC must be known when the tree is calculated
+	}
+
+	// weapon (two for some assassins), ammo, armor
+	if( bb_equip_random(sd, n, bb_weapons, bb_weapon_count, EQP_HAND_R, used) )
+	{
+		weapon = sd->inventory_data[n];
+		used |= sd->status.inventory[n++].equip;
+		if( (sd->class_&MAPID_UPPERMASK) == MAPID_ASSASSIN && !(used&EQP_HAND_L) && bb_rand(2) )
+		{
+			int tries;
+			for( tries = 0; tries < 200; ++tries )
+			{
+				struct item_data* id = itemdb_search(bb_weapons[bb_rand(bb_weapon_count)]);
+				if( id->equip == EQP_HAND_R && (id->look == W_DAGGER || id->look == W_1HSWORD || id->look == W_1HAXE)
+				&&  bb_equip(sd, n, id->nameid, EQP_HAND_L) )
+				{
+					used |= sd->status.inventory[n++].equip;
+					break;
+				}
+			}
+		}
+	}
+	if( weapon && bb_ammotype(weapon->look) )
+	{
+		int tries;
+		for( tries = 0; tries < 200 && bb_ammo_count; ++tries )
+		{
+			struct item_data* id = itemdb_search(bb_ammo[bb_rand(bb_ammo_count)]);
+			if( id->look == bb_ammotype(weapon->look) && bb_equip(sd, n, id->nameid, EQP_AMMO) )
+			{
+				used |= sd->status.inventory[n++].equip;
+				break;
+			}
+		}
+	}
+	for( i = 0; i < ARRAYLENGTH(equip_order); ++i )
+	{
+		if( used&equip_order[i] || bb_rand(10) == 0 )
+			continue;
+		if( bb_equip_random(sd, n, bb_armors, bb_armor_count, equip_order[i], used) )
+			used |= sd->status.inventory[n++].equip;
+	}
+
+	pc_setequipindex(sd);
+	status_change_init(&sd->bl);
+	status_set_viewdata(&sd->bl, sd->status.class_);
+	unit_dataset(&sd->bl);
+	map_addiddb(&sd->bl);
+	status_calc_pc(sd, 1);
+
+	bb_startstatuses(&sd->bl, 25);
+	sd->battle_status.hp = sd->battle_status.max_hp;
+	sd->battle_status.sp = sd->battle_status.max_sp;
+	sd->status.zeny = 1000000000; // NJ_ZENYNAGE
+	return sd;
+}
+
+static struct mob_data* bb_makemob(void)
+{
+	struct mob_data* md = NULL;
+
+	while( md == NULL )
+	{
+		int class_ = 1001 + bb_rand(1000);
+		if( !mobdb_checkid(class_) )
+			continue;
+		md = mob_once_spawn_sub(NULL, bb_map, BB_X, BB_Y, NULL, class_, NULL);
+	}
+	md->bl.x = BB_X;
+	md->bl.y = BB_Y;
+	status_calc_mob(md, 1);
+	bb_startstatuses(&md->bl, 10);
+	return md;
+}
+
+/// Whether the skill makes a damage calculation.
+static bool bb_isattackskill(int skill_id)
+{
+	return ( skill_id > 0 && skill_get_type(skill_id) && !(skill_get_nk(skill_id)&NK_NO_DAMAGE) );
+}
+
+/// Picks an attack of the unit, returns its type.
+static int bb_pickattack(struct block_list* src, short* skill_id, short* skill_lv)
+{
+	int ids[MAX_SKILL], lvs[MAX_SKILL];
+	int count = 0, i;
+
+	*skill_id = *skill_lv = 0;
+	if( bb_rand(3) == 0 )
+		return BF_WEAPON; // normal attack
+
+	if( src->type == BL_PC )
+	{
+		TBL_PC* sd = (TBL_PC*)src;
+		for( i = 1; i < MAX_SKILL; ++i )
+		{
+			if( sd->status.skill[i].lv > 0 && bb_isattackskill(sd->status.skill[i].id) )
+			{
+				ids[count] = sd->status.skill[i].id;
+				lvs[count++] = sd->status.skill[i].lv;
+			}
+		}
+	}
+	else if( src->type == BL_MOB )
+	{
+		TBL_MOB* md = (TBL_MOB*)src;
+		for( i = 0; i < md->db->maxskill; ++i )
+		{
+			if( bb_isattackskill(md->db->skill[i].skill_id) )
+			{
+				ids[count] = md->db->skill[i].skill_id;
+				lvs[count++] = md->db->skill[i].skill_lv;
+			}
+		}
+	}
+	if( count == 0 )
+		return BF_WEAPON;
+
+	i = bb_rand(count);
+	*skill_id = ids[i];
+	*skill_lv = 1 + bb_rand(cap_value(lvs[i], 1, skill_get_max(ids[i])));
+	return skill_get_type(ids[i]);
+}
+
+static void bb_makecases(void)
+{
+	int i;
+
+	CREATE(bb_cases, struct bb_case, BB_CASES);
+	for( i = 0; i < BB_CASES; ++i )
+	{
+		struct bb_case* c = &bb_cases[i];
+		int range;
+
+		if( bb_rand(5) )
+		{// player against a monster (or another player)
+			c->src = &bb_pc[bb_rand(BB_PLAYERS)]->bl;
+			c->target = bb_rand(5) ? &bb_mob[bb_rand(BB_MOBS)]->bl : &bb_pc[bb_rand(BB_PLAYERS)]->bl;
+		}
+		else
+		{// monster against a player
+			c->src = &bb_mob[bb_rand(BB_MOBS)]->bl;
+			c->target = &bb_pc[bb_rand(BB_PLAYERS)]->bl;
+		}
+		if( c->src == c->target )
+			c->target = &bb_mob[bb_rand(BB_MOBS)]->bl;
+		c->attack_type = bb_pickattack(c->src, &c->skill_id, &c->skill_lv);
+		c->count = ( skill_get_nk(c->skill_id)&NK_SPLASHSPLIT ) ? 1 : 0;
+		range = c->skill_id ? skill_get_range(c->skill_id, c->skill_lv) : status_get_range(c->src);
+		range = max(1, min(abs(range), 14));
+		c->dx = 1 + bb_rand(range);
+		c->dy = bb_rand(c->dx + 1);
+		c->seed = bb_seed;
+	}
+}
+
+static void bb_result(const struct bb_case* c, struct bb_result* r)
+{
+	struct Damage d;
+
+	c->target->x = BB_X + c->dx;
+	c->target->y = BB_Y + c->dy;
+	c->src->x = BB_X;
+	c->src->y = BB_Y;
+	d = battle_calc_attack(c->attack_type, c->src, c->target, c->skill_id, c->skill_lv, c->count);
+	r->damage = d.damage;
+	r->damage2 = d.damage2;
+	r->div_ = d.div_;
+	r->type = d.type;
+	r->dmg_lv = d.dmg_lv;
+	r->flag = d.flag;
+}
+
+static void bb_free(void)
+{
+	int i;
+
+	for( i = 0; i < BB_MOBS; ++i )
+		if( bb_mob[i] )
+			unit_free(&bb_mob[i]->bl, CLR_OUTSIGHT);
+	for( i = 0; i < BB_PLAYERS; ++i )
+		if( bb_pc[i] )
+		{
+			unit_free(&bb_pc[i]->bl, CLR_OUTSIGHT);
+			aFree(bb_pc[i]);
+		}
+	memset(bb_mob, 0, sizeof(bb_mob));
+	memset(bb_pc, 0, sizeof(bb_pc));
+	aFree(bb_cases); bb_cases = NULL;
+	aFree(bb_weapons); bb_weapons = NULL; bb_weapon_count = 0;
+	aFree(bb_armors); bb_armors = NULL; bb_armor_count = 0;
+	aFree(bb_cards); bb_cards = NULL; bb_card_count = 0;
+	aFree(bb_ammo); bb_ammo = NULL; bb_ammo_count = 0;
+}
+
+/// Records or checks the results of all attacks, in order.
+/// Returns the number of differences.
+static int bb_golden(void)
+{
+	FILE* fp;
+	char line[256];
+	int i, diff = 0, missing = 0;
+	const char* file = battlebench_check ? battlebench_check : battlebench_record;
+
+	fp = fopen(file, battlebench_check ? "r" : "w");
+	if( fp == NULL )
+	{
+		ShowError("battlebench: can't open '%s'.\n", file);
+		return 1;
+	}
+	if( !battlebench_check )
+		fprintf(fp, "// battlebench results: case,attack type,skill,level,damage,damage2,div,type,dmg_lv,flag\n");
+
+	for( i = 0; i < BB_CASES; ++i )
+	{
+		const struct bb_case* c = &bb_cases[i];
+		struct bb_result r;
+		char buf[256];
+
+		srand(c->seed);
+		bb_result(c, &r);
+		snprintf(buf, sizeof(buf), "%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n", i, c->attack_type, c->skill_id, c->skill_lv, r.damage, r.damage2, r.div_, r.type, r.dmg_lv, r.flag);
+
+		if( !battlebench_check )
+		{
+			fputs(buf, fp);
+			continue;
+		}
+		do
+		{
+			if( fgets(line, sizeof(line), fp) == NULL )
+				line[0] = '\0';
+		} while( line[0] == '/' );
+		if( line[0] == '\0' )
+		{
+			missing++;
+			continue;
+		}
+		if( strcmp(line, buf) != 0 )
+		{
+			if( diff < 10 )
+			{
+				ShowWarning("battlebench: case %d (attacker %d, target %d) differs\n", i, c->src->id, c->target->id);
+				ShowMessage("    expected %s    got      %s", line, buf);
+			}
+			diff++;
+		}
+	}
+	fclose(fp);
+
+	if( !battlebench_check )
+		ShowStatus("battlebench: recorded %d results in '%s'.\n", BB_CASES, file);
+	else if( diff == 0 && missing == 0 )
+		ShowStatus("battlebench: all %d results match '%s'.\n", BB_CASES, file);
+	else
+		ShowError("battlebench: %d of %d results differ from '%s' (%d missing).\n", diff + missing, BB_CASES, file, missing);
+	return diff + missing;
+}
+
+/// Times battlebench_count calculations, going through the attacks in order.
+static void bb_time(void)
+{
+	static const char* names[] = { "weapon", "magic", "misc" };
+	unsigned int count[3] = { 0, 0, 0 }, ms[3] = { 0, 0, 0 };
+	unsigned int tick, total;
+	int i, t;
+
+	// by attack type, in blocks of the same type
+	for( t = 0; t < 3; ++t )
+	{
+		int type = ( t == 0 ) ? BF_WEAPON : ( t == 1 ) ? BF_MAGIC : BF_MISC;
+		int share = 0;
+
+		for( i = 0; i < BB_CASES; ++i )
+			share += ( bb_cases[i].attack_type == type );
+		count[t] = (unsigned int)((int64)battlebench_count*share/BB_CASES);
+
+		tick = gettick_nocache();
+		for( i = 0; (unsigned int)i < count[t]; )
+		{
+			int j;
+			for( j = 0; j < BB_CASES && (unsigned int)i < count[t]; ++j )
+			{
+				struct bb_result r;
+				if( bb_cases[j].attack_type != type )
+					continue;
+				bb_result(&bb_cases[j], &r);
+				++i;
+			}
+		}
+		ms[t] = gettick_nocache() - tick;
+	}
+
+	total = ms[0] + ms[1] + ms[2];
+	for( t = 0; t < 3; ++t )
+		ShowInfo("battlebench: %-6s %9u calculations in %6u ms (%u per second)\n", names[t], count[t], ms[t], (unsigned int)((int64)count[t]*1000/max(ms[t], 1)));
+	ShowInfo("battlebench: total  %9u calculations in %6u ms (%u per second)\n", count[0] + count[1] + count[2], total, (unsigned int)((int64)(count[0] + count[1] + count[2])*1000/max(total, 1)));
+}
+
+bool battlebench_enabled(void)
+{
+	return ( battlebench_count > 0 || battlebench_record || battlebench_check );
+}
+
+/// Runs the harness, returns the number of results that differ from the recorded ones.
+int battlebench_run(void)
+{
+	int i, diff = 0;
+
+	bb_map = map_mapname2mapid(BB_MAP);
+	if( bb_map < 0 )
+	{
+		ShowWarning("battlebench: map '%s' is not loaded, using '%s'.\n", BB_MAP, map[0].name);
+		bb_map = 0;
+	}
+
+	bb_seed = BB_SEED;
+	srand(BB_SEED);
+	bb_readitems();
+	for( i = 0; i < BB_PLAYERS; ++i )
+		bb_pc[i] = bb_makepc(i);
+	for( i = 0; i < BB_MOBS; ++i )
+		bb_mob[i] = bb_makemob();
+	bb_makecases();
+	ShowStatus("battlebench: %d players, %d monsters, %d attacks.\n", BB_PLAYERS, BB_MOBS, BB_CASES);
+
+	if( battlebench_record || battlebench_check )
+		diff = bb_golden();
+	if( battlebench_count > 0 )
+		bb_time();
+
+	bb_free();
+	return diff;
+}
@@ -0,0 +1,16 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef _BATTLEBENCH_H_
+#define _BATTLEBENCH_H_
+
+// Offline harness of the damage formulas, started with the map-server
+// options --battle-bench/--battle-bench-record/--battle-bench-check.
+extern int battlebench_count; // calculations to time
+extern const char* battlebench_record; // file to record the golden results in
+extern const char* battlebench_check; // file of golden results to compare with
+
+bool battlebench_enabled(void);
+int battlebench_run(void);
+
+#endif /* _BATTLEBENCH_H_ */
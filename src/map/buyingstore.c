@@ -12,6 +12,7 @@
 #include "clif.h"  // clif_buyingstore_*
 #include "log.h"  // log_pick, log_zeny
 #include "pc.h"  // struct map_session_data
+#include "searchstore.h"  // searchstore_index, searchstore_unindex
 
 
 /// constants (client-side restrictions)
@@ -191,6 +192,10 @@ void buyingstore_create(struct map_session_data* sd, int zenylimit, unsigned cha
 	sd->buyingstore.zenylimit = zenylimit;
 	sd->buyingstore.slots = i;  // store actual amount of items
 	safestrncpy(sd->message, storename, sizeof(sd->message));
+	for( i = 0; i < sd->buyingstore.slots; i++ )
+	{
+		searchstore_index(SEARCHTYPE_BUYING_STORE, sd->status.account_id, sd->buyingstore.items[i].nameid, sd->buyingstore.items[i].price);
+	}
 	clif_buyingstore_myitemlist(sd);
 	clif_buyingstore_entry(sd);
 }
@@ -200,6 +205,13 @@ void buyingstore_close(struct map_session_data* sd)
 {
 	if( sd->state.buyingstore )
 	{
+		unsigned int i;
+
+		for( i = 0; i < sd->buyingstore.slots; i++ )
+		{
+			searchstore_unindex(SEARCHTYPE_BUYING_STORE, sd->status.account_id, sd->buyingstore.items[i].nameid);
+		}
+
 		// invalidate data
 		sd->state.buyingstore = false;
 		memset(&sd->buyingstore, 0, sizeof(sd->buyingstore));
@@ -375,6 +387,10 @@ void buyingstore_trade(struct map_session_data* sd, int account_id, unsigned int
 		pc_additem(pl_sd, &sd->status.inventory[index], amount);
 		pc_delitem(sd, index, amount, 1, 0);
 		pl_sd->buyingstore.items[listidx].amount-= amount;
+		if( pl_sd->buyingstore.items[listidx].amount == 0 )
+		{// bought enough
+			searchstore_unindex(SEARCHTYPE_BUYING_STORE, pl_sd->status.account_id, nameid);
+		}
 
 		// pay up
 		pc_payzeny(pl_sd, zeny);
@@ -279,6 +279,142 @@ static inline unsigned char clif_bl_type(struct block_list *bl) {
 }
 #endif
 
+int backpressure_soft_limit = 64*1024; // write queue of a client above which effects are dropped and movement is merged (0 = disabled)
+int backpressure_hard_limit = 256*1024; // write queue of a client above which area chat is dropped
+int backpressure_crowd = 50; // players on a map above which area chat is dropped already at the soft limit
+
+enum clif_packet_prio {
+	PRIO_NORMAL,
+	PRIO_LOW,  // effects and emotions, purely cosmetic
+	PRIO_CHAT, // area chat
+	PRIO_MOVE, // movement of other units, superseded by the next one
+};
+
+/// How often each backpressure policy triggered.
+static struct {
+	unsigned int congested; // area packets for congested clients
+	unsigned int effect;    // effects and emotions dropped
+	unsigned int chat;      // area chat dropped
+	unsigned int merged;    // movement merged into a queued packet
+	unsigned int kept;      // not dropped because of the session priority rules
+} clif_backpressure;
+
+static enum clif_packet_prio clif_packet_priority(uint16 cmd)
+{
+	switch( cmd )
+	{
+	case 0x0c0: // ZC_EMOTION
+	case 0x19b: // ZC_NOTIFY_EFFECT
+	case 0x1d3: // ZC_SOUND
+	case 0x1f3: // ZC_NOTIFY_EFFECT2
+	case 0x284: // ZC_NOTIFY_EFFECT3
+		return PRIO_LOW;
+	case 0x08d: // ZC_NOTIFY_CHAT
+		return PRIO_CHAT;
+	case 0x086: // ZC_NOTIFY_MOVE
+	case 0x088: // ZC_STOPMOVE
+		return PRIO_MOVE;
+	}
+	return PRIO_NORMAL;
+}
+
+/// Session priority rules: packets about the player themself or a party member are never dropped.
+static bool clif_backpressure_keep(struct map_session_data* sd, struct block_list* src_bl)
+{
+	if( src_bl == &sd->bl )
+		return true;
+	if( src_bl->type == BL_PC && sd->status.party_id && ((TBL_PC*)src_bl)->status.party_id == sd->status.party_id )
+		return true;
+	return false;
+}
+
+/// Overwrites the movement packet of the same unit if it is still waiting in the write queue.
+/// Otherwise remembers where this one is going to be queued.
+static bool clif_move_merge(struct map_session_data* sd, const uint8* buf, int len)
+{
+	struct socket_data* s = session[sd->fd];
+	int id = (int)RBUFL(buf,2);
+	int i = (int)((uint32)id%ARRAYLENGTH(sd->movequeue));
+	int32 offset = (int32)(sd->movequeue[i].pos - s->wdata_sent); // negative once it was (partially) sent
+
+	if( sd->movequeue[i].id == id && offset >= 0 && (size_t)offset + len <= s->wdata_size &&
+		WBUFW(s->wdata,offset) == RBUFW(buf,0) && (int)WBUFL(s->wdata,offset+2) == id )
+	{
+		memcpy(s->wdata + offset, buf, len);
+		return true;
+	}
+	sd->movequeue[i].id = id;
+	sd->movequeue[i].pos = s->wdata_sent + (uint32)s->wdata_size;
+	return false;
+}
+
+/// Forgets the queued movement packet of the unit, so later movement isn't merged
+/// into a packet that is followed by other packets about the unit (vanish, spawn, ...).
+static void clif_move_forget(struct map_session_data* sd, int id)
+{
+	int i = (int)((uint32)id%ARRAYLENGTH(sd->movequeue));
+
+	if( sd->movequeue[i].id == id )
+		sd->movequeue[i].id = 0;
+}
+
+/// Applies the backpressure policies to an area packet for a client with a long write queue.
+/// Returns false if the packet is not to be queued (dropped or merged).
+static bool clif_backpressure_check(struct map_session_data* sd, struct block_list* src_bl, const uint8* buf, int len)
+{
+	size_t queued = session[sd->fd]->wdata_size;
+
+	++clif_backpressure.congested;
+	switch( clif_packet_priority(RBUFW(buf,0)) )
+	{
+	case PRIO_LOW:
+		if( clif_backpressure_keep(sd, src_bl) )
+			break;
+		++clif_backpressure.effect;
+		return false;
+	case PRIO_CHAT:
+		if( queued < (size_t)backpressure_hard_limit && map[src_bl->m].users < backpressure_crowd )
+			return true;
+		if( clif_backpressure_keep(sd, src_bl) )
+			break;
+		++clif_backpressure.chat;
+		return false;
+	case PRIO_MOVE:
+		if( clif_move_merge(sd, buf, len) )
+		{
+			++clif_backpressure.merged;
+			return false;
+		}
+		return true;
+	default:
+		return true;
+	}
+	++clif_backpressure.kept;
+	return true;
+}
+
+/// Shows the congested clients and how often each backpressure policy triggered.
+void clif_backpressure_report(void)
+{
+	int fd, count = 0;
+	size_t queued = 0;
+
+	for( fd = 1; fd < fd_max; ++fd )
+	{
+		if( session[fd] && !session[fd]->flag.server && backpressure_soft_limit > 0 && session[fd]->wdata_size >= (size_t)backpressure_soft_limit )
+		{
+			++count;
+			queued += session[fd]->wdata_size;
+		}
+	}
+	ShowInfo("Backpressure: %d congested client(s) with %u KB queued (soft limit %d KB, hard limit %d KB).\n", count, (unsigned int)(queued/1024), backpressure_soft_limit/1024, backpressure_hard_limit/1024);
+	ShowInfo("  area packets to congested clients : %u\n", clif_backpressure.congested);
+	ShowInfo("  effects and emotions dropped      : %u\n", clif_backpressure.effect);
+	ShowInfo("  area chat dropped                 : %u\n", clif_backpressure.chat);
+	ShowInfo("  movement merged                   : %u\n", clif_backpressure.merged);
+	ShowInfo("  kept by session priority          : %u\n", clif_backpressure.kept);
+}
+
 /*==========================================
  * clif_sendAREA*w莞p
  *------------------------------------------*/
@@ -335,6 +471,10 @@ static int clif_send_sub(struct block_list *bl, va_list ap)
 	}
 
 	if (packet_db[sd->packet_ver][RBUFW(buf,0)].len) { // packet must exist for the client version
+		if( clif_packet_priority(RBUFW(buf,0)) == PRIO_NORMAL )
+			clif_move_forget(sd, src_bl->id); // also below the soft limit, the movement may still be queued
+		if( backpressure_soft_limit > 0 && session[fd]->wdata_size >= (size_t)backpressure_soft_limit && !clif_backpressure_check(sd, src_bl, buf, len) )
+			return 0; // the client can't keep up
 		memcpy(WFIFOP(fd,0), buf, len);
 		WFIFOSET(fd,len);
 	}
@@ -791,6 +931,11 @@ void clif_clearflooritem(struct flooritem_data *fitem, int fd)
 ///     4 = trickdead
 void clif_clearunit_single(int id, clr_type type, int fd)
 {
+	struct map_session_data* sd;
+
+	if( session[fd] && (sd = (struct map_session_data*)session[fd]->session_data) != NULL )
+		clif_move_forget(sd, id);
+
 	WFIFOHEAD(fd, packet_len(0x80));
 	WFIFOW(fd,0) = 0x80;
 	WFIFOL(fd,2) = id;
@@ -1619,6 +1764,7 @@ void clif_changemap(struct map_session_data *sd, short map, int x, int y)
 	int fd;
 	nullpo_retv(sd);
 	fd = sd->fd;
+	pc_status_flush(sd); // status updates belong to the old map
 
 	WFIFOHEAD(fd,packet_len(0x91));
 	WFIFOW(fd,0) = 0x91;
@@ -1636,6 +1782,7 @@ void clif_changemapserver(struct map_session_data* sd, unsigned short map_index,
 	int fd;
 	nullpo_retv(sd);
 	fd = sd->fd;
+	pc_status_flush(sd); // status updates belong to the old map
 
 	WFIFOHEAD(fd,packet_len(0x92));
 	WFIFOW(fd,0) = 0x92;
@@ -3901,6 +4048,7 @@ void clif_getareachar_unit(struct map_session_data* sd,struct block_list *bl)
 
 	ud = unit_bl2ud(bl);
 	len = ( ud && ud->walktimer != INVALID_TIMER ) ? clif_set_unit_walking(bl,ud,buf) : clif_set_unit_idle(bl,buf,false);
+	clif_move_forget(sd, bl->id);
 	clif_send(buf,len,&sd->bl,SELF);
 
 	if (vd->cloth_color)
@@ -8916,7 +9064,7 @@ void clif_parse_WantToConnection(int fd, TBL_PC* sd)
 		return;
 	}
 
-	CREATE(sd, TBL_PC, 1);
+	CREATE_TAG(sd, TBL_PC, 1, MEMTAG_PC);
 	sd->fd = fd;
 	sd->packet_ver = packet_ver;
 	session[fd]->session_data = sd;
@@ -8998,8 +9146,12 @@ void clif_parse_LoadEndAck(int fd,struct map_session_data *sd)
 			pc_setinvincibletimer(sd,battle_config.pc_invincible_time);
 	}
 
-	if( map[sd->bl.m].users++ == 0 && battle_config.dynamic_mobs )
-		map_spawnmobs(sd->bl.m);
+	if( map[sd->bl.m].users++ == 0 ) {
+		if( map[sd->bl.m].hibernate_tick )
+			map_wakeup(sd->bl.m);
+		if( battle_config.dynamic_mobs )
+			map_spawnmobs(sd->bl.m);
+	}
 	if( map[sd->bl.m].instance_id )
 	{
 		instance[map[sd->bl.m].instance_id].users++;
@@ -9008,7 +9160,10 @@ void clif_parse_LoadEndAck(int fd,struct map_session_data *sd)
 	sd->state.debug_remove_map = 0; // temporary state to track double remove_map's [FlavioJS]
 
 	map_addblock(&sd->bl);
+	pc_pvprank_enter(sd);
 	clif_spawn(&sd->bl);
+	party_send_xy_mark(sd);
+	guild_send_xy_mark(sd);
 
 	// Party
 	// (needs to go after clif_spawn() to show hp bars correctly)
@@ -9025,7 +9180,7 @@ void clif_parse_LoadEndAck(int fd,struct map_session_data *sd)
 				sd->pvp_timer = add_timer(gettick()+200, pc_calc_pvprank_timer, sd->bl.id, 0);
 			sd->pvp_rank = 0;
 			sd->pvp_lastusers = 0;
-			sd->pvp_point = 5;
+			pc_setpvppoint(sd, 5);
 			sd->pvp_won = 0;
 			sd->pvp_lost = 0;
 		}
@@ -308,6 +308,11 @@ uint32 clif_getip(void);
 uint32 clif_refresh_ip(void);
 uint16 clif_getport(void);
 
+extern int backpressure_soft_limit;
+extern int backpressure_hard_limit;
+extern int backpressure_crowd;
+void clif_backpressure_report(void);
+
 void clif_authok(struct map_session_data *sd);
 void clif_authrefuse(int fd, uint8 error_code);
 void clif_authfail_fd(int fd, int type);
@@ -55,6 +55,10 @@ struct{
 
 static int guild_send_xy_timer(int tid, unsigned int tick, int id, intptr_t data);
 
+static int* guild_xy_dirty = NULL; // members to look at in guild_send_xy_timer (see guild_send_xy_mark)
+static int guild_xy_dirty_count = 0;
+static int guild_xy_dirty_max = 0;
+
 /*==========================================
  * Retrieves and validates the sd pointer for this guild member [Skotlex]
  *------------------------------------------*/
@@ -227,31 +231,49 @@ void guild_makemember(struct guild_member *m,struct map_session_data *sd)
 
 
 
-//Taken from party_send_xy_timer_sub. [Skotlex]
-int guild_send_xy_timer_sub(DBKey key,void *data,va_list ap)
+/// Marks a member who may have moved, guild_send_xy_timer only looks at
+/// the marked members (account ids, see party_send_xy_mark).
+void guild_send_xy_mark(struct map_session_data* sd)
 {
-	struct guild *g=(struct guild *)data;
-	int i;
+	if( !sd->status.guild_id || sd->state.guild_xy_dirty )
+		return;
+	sd->state.guild_xy_dirty = 1;
 
-	nullpo_ret(g);
+	if( guild_xy_dirty_count == guild_xy_dirty_max )
+	{
+		guild_xy_dirty_max += 256;
+		RECREATE(guild_xy_dirty, int, guild_xy_dirty_max);
+	}
+	guild_xy_dirty[guild_xy_dirty_count++] = sd->bl.id;
+}
 
-	for(i=0;i<g->max_member;i++){
-		//struct map_session_data* sd = g->member[i].sd;
-		struct map_session_data* sd = map_charid2sd(g->member[i].char_id); // temporary crashfix
-		if( sd != NULL && (sd->guild_x != sd->bl.x || sd->guild_y != sd->bl.y) && !sd->bg_id )
+//Code from party_send_xy_timer [Skotlex]
+static int guild_send_xy_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	int n;
+
+	for( n = 0; n < guild_xy_dirty_count; n++ )
+	{
+		struct map_session_data* sd = map_id2sd(guild_xy_dirty[n]);
+		struct guild* g;
+		int i;
+
+		if( sd == NULL )
+			continue; // logged out
+		sd->state.guild_xy_dirty = 0;
+
+		if( (g = guild_search(sd->status.guild_id)) == NULL )
+			continue;
+		ARR_FIND( 0, g->max_member, i, g->member[i].sd == sd );
+		if( i < g->max_member && (sd->guild_x != sd->bl.x || sd->guild_y != sd->bl.y) && !sd->bg_id )
 		{
 			clif_guild_xy(sd);
 			sd->guild_x = sd->bl.x;
 			sd->guild_y = sd->bl.y;
 		}
 	}
-	return 0;
-}
+	guild_xy_dirty_count = 0;
 
-//Code from party_send_xy_timer [Skotlex]
-static int guild_send_xy_timer(int tid, unsigned int tick, int id, intptr_t data)
-{
-	guild_db->foreach(guild_db,guild_send_xy_timer_sub,tick);
 	return 0;
 }
 
@@ -429,6 +451,7 @@ int guild_recv_info(struct guild *sg)
 		if(g->member[i].account_id>0){
 			sd = g->member[i].sd = guild_sd_check(g->guild_id, g->member[i].account_id, g->member[i].char_id);
 			if (sd) clif_charnameupdate(sd); // [LuzZza]
+			if (sd) guild_send_xy_mark(sd);
 			m++;
 		}else
 			g->member[i].sd=NULL;
@@ -606,8 +629,10 @@ void guild_member_joined(struct map_session_data *sd)
 	i = guild_getindex(g, sd->status.account_id, sd->status.char_id);
 	if (i == -1)
 		sd->status.guild_id = 0;
-	else
+	else {
 		g->member[i].sd = sd;
+		guild_send_xy_mark(sd);
+	}
 }
 
 // Mhoǉꂽ
@@ -1605,6 +1630,7 @@ void do_init_guild(void)
 
 void do_final_guild(void)
 {
+	aFree(guild_xy_dirty);
 	guild_db->destroy(guild_db,NULL);
 	guild_infoevent_db->destroy(guild_infoevent_db,guild_infoevent_db_final);
 
@@ -17,6 +17,7 @@
 #include "map.h"
 #include "npc.h"
 #include "party.h"
+#include "path.h" // path_freelos()
 #include "pc.h"
 
 #include <stdio.h>
@@ -153,9 +154,14 @@ int instance_add_map(const char *name, int instance_id, bool usebasename)
 
 	memset(map[im].npc, 0x00, sizeof(map[i].npc));
 	map[im].npc_num = 0;
+	map[im].npc_touch = NULL;
+	memset(&map[im].walkcell, 0, sizeof(map[im].walkcell));
+	map[im].los = NULL;
 
 	memset(map[im].moblist, 0x00, sizeof(map[im].moblist));
 	map[im].mob_delete_timer = INVALID_TIMER;
+	map[im].empty_tick = gettick();
+	map[im].hibernate_tick = 0;
 
 	map[im].m = im;
 	map[im].instance_id = instance_id;
@@ -280,6 +286,9 @@ void instance_del_map(int m)
 	aFree(map[m].cell);
 	aFree(map[m].block);
 	aFree(map[m].block_mob);
+	npc_freetouch(m);
+	aFree(map[m].walkcell.xy);
+	path_freelos(m);
 
 	// Remove from instance
 	for( i = 0; i < instance[map[m].instance_id].num_map; i++ )
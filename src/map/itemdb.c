@@ -3,6 +3,7 @@
 
 #include "../common/nullpo.h"
 #include "../common/malloc.h"
+#include "../common/random.h"
 #include "../common/showmsg.h"
 #include "../common/strlib.h"
 #include "itemdb.h"
@@ -143,8 +144,8 @@ int itemdb_searchrandomid(int group)
 		ShowError("itemdb_searchrandomid: Invalid group id %d\n", group);
 		return UNKNOWN_ITEM_ID;
 	}
-	if (itemgroup_db[group].qty)
-		return itemgroup_db[group].nameid[rand()%itemgroup_db[group].qty];
+	if (itemgroup_db[group].alias)
+		return itemgroup_db[group].nameid[rnd_alias_pick(itemgroup_db[group].alias)];
 	
 	ShowError("itemdb_searchrandomid: No item entries for group id %d\n", group);
 	return UNKNOWN_ITEM_ID;
@@ -510,6 +511,7 @@ static void itemdb_read_itemgroup_sub(const char* filename)
 	int groupid,j,k,nameid;
 	char *str[3],*p;
 	char w1[1024], w2[1024];
+	struct item_group* group;
 	
 	if( (fp=fopen(filename,"r"))==NULL ){
 		ShowError("can't read %s\n", filename);
@@ -552,24 +554,46 @@ static void itemdb_read_itemgroup_sub(const char* filename)
 			continue;
 		}
 		k = atoi(str[2]);
-		if (itemgroup_db[groupid].qty+k >= MAX_RANDITEM) {
-			ShowWarning("itemdb_read_itemgroup: Group %d is full (%d entries) in %s:%d\n", groupid, MAX_RANDITEM, filename, ln);
+		if (k <= 0)
 			continue;
+		group = &itemgroup_db[groupid];
+		ARR_FIND(0, group->qty, j, group->nameid[j] == nameid);
+		if (j == group->qty) {
+			RECREATE(group->nameid, int, group->qty+1);
+			RECREATE(group->weight, uint32, group->qty+1);
+			group->nameid[j] = nameid;
+			group->weight[j] = 0;
+			group->qty++;
 		}
-		for(j=0;j<k;j++)
-			itemgroup_db[groupid].nameid[itemgroup_db[groupid].qty++] = nameid;
+		group->weight[j] += k;
 	}
 	fclose(fp);
 	return;
 }
 
+/// Frees the items of all groups.
+static void itemdb_clear_itemgroup(void)
+{
+	int i;
+	for (i = 0; i < MAX_ITEMGROUP; i++) {
+		aFree(itemgroup_db[i].nameid);
+		aFree(itemgroup_db[i].weight);
+		rnd_alias_destroy(itemgroup_db[i].alias);
+	}
+	memset(&itemgroup_db, 0, sizeof(itemgroup_db));
+}
+
 static void itemdb_read_itemgroup(void)
 {
 	char path[256];
+	int i;
 	snprintf(path, 255, "%s/item_group_db.txt", db_path);
 
-	memset(&itemgroup_db, 0, sizeof(itemgroup_db));
+	itemdb_clear_itemgroup();
 	itemdb_read_itemgroup_sub(path);
+	for (i = 0; i < MAX_ITEMGROUP; i++)
+		if (itemgroup_db[i].qty)
+			itemgroup_db[i].alias = rnd_alias_create(itemgroup_db[i].weight, itemgroup_db[i].qty);
 	ShowStatus("Done reading '"CL_WHITE"%s"CL_RESET"'.\n", "item_group_db.txt");
 	return;
 }
@@ -1083,6 +1107,7 @@ void do_final_itemdb(void)
 
 	itemdb_other->destroy(itemdb_other, itemdb_final_sub);
 	destroy_item_data(&dummy_item, 0);
+	itemdb_clear_itemgroup();
 }
 
 int do_init_itemdb(void)
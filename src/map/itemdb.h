@@ -6,8 +6,6 @@
 
 #include "../common/mmo.h" // ITEM_NAME_LENGTH
 
-#define MAX_RANDITEM	11000
-
 // The maximum number of item delays
 #define MAX_ITEMDELAYS	10
 
@@ -88,8 +86,10 @@ struct item_data {
 };
 
 struct item_group {
-	int nameid[MAX_RANDITEM];
-	int qty; //Counts amount of items in the group.
+	int* nameid; // distinct items of the group
+	uint32* weight; // times each item was listed
+	int qty; //Counts amount of distinct items in the group.
+	struct rnd_alias* alias; // weighted choice of an item, built once the groups are read
 };
 
 struct item_data* itemdb_searchname(const char *name);
@@ -5,11 +5,13 @@
 #include "../common/core.h"
 #include "../common/timer.h"
 #include "../common/grfio.h"
+#include "../common/ers.h"
 #include "../common/malloc.h"
 #include "../common/socket.h" // WFIFO*()
 #include "../common/showmsg.h"
 #include "../common/version.h"
 #include "../common/nullpo.h"
+#include "../common/random.h"
 #include "../common/strlib.h"
 #include "../common/utils.h"
 
@@ -23,7 +25,7 @@
 #include "pc.h"
 #include "status.h"
 #include "mob.h"
-#include "npc.h" // npc_setcells(), npc_unsetcells()
+#include "npc.h" // npc_setcells(), npc_unsetcells(), npc_freetouch()
 #include "chat.h"
 #include "itemdb.h"
 #include "storage.h"
@@ -33,6 +35,7 @@
 #include "unit.h"
 #include "battle.h"
 #include "battleground.h"
+#include "battlebench.h"
 #include "quest.h"
 #include "script.h"
 #include "mapreg.h"
@@ -51,6 +54,12 @@
 #include <string.h>
 #include <stdarg.h>
 #include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
 #ifndef _WIN32
 #include <unistd.h>
 #endif
@@ -64,6 +73,7 @@ char map_server_id[32] = "ragnarok";
 char map_server_pw[32] = "ragnarok";
 char map_server_db[32] = "ragnarok";
 Sql* mmysql_handle;
+SqlAsync* mmysql_async_handle = NULL;
 
 int db_use_sqldbs = 0;
 char item_db_db[32] = "item_db";
@@ -78,6 +88,7 @@ char log_db_id[32] = "ragnarok";
 char log_db_pw[32] = "ragnarok";
 char log_db_db[32] = "log";
 Sql* logmysql_handle;
+SqlAsync* logmysql_async_handle = NULL;
 
 #endif /* not TXT_ONLY */
 
@@ -96,6 +107,11 @@ char *GRF_PATH_FILENAME;
 
 // ɗ staticŃ?J?߂
 static DBMap* id_db=NULL; // int id -> struct block_list*
+static struct block_list** id_slot=NULL; // lookup table of id_db, indexed by (id & id_slot_mask)
+static int id_slot_mask=0;
+static int id_slot_overflow=0; // number of objects in id_db that are not in their slot
+#define ID_SLOT_MIN (1<<16)
+#define ID_SLOT_MAX (1<<22)
 static DBMap* pc_db=NULL; // int id -> struct map_session_data*
 static DBMap* mobid_db=NULL; // int id -> struct mob_data*
 static DBMap* bossid_db=NULL; // int id -> struct mob_data* (MVP db)
@@ -120,6 +136,8 @@ int map_port=0;
 
 int autosave_interval = DEFAULT_AUTOSAVE_INTERVAL;
 int minsave_interval = 100;
+int memory_dump_interval = 0; // in ms, 0 = disabled
+int ers_release_interval = 60*1000; // in ms, 0 = disabled
 int save_settings = 0xFFFF;
 int agit_flag = 0;
 int agit2_flag = 0;
@@ -148,12 +166,62 @@ struct map_cache_map_info {
 	int32 len;
 };
 
+// Uncompressed copy of the map cache with the cells ready to use (map_cache_raw_file).
+// It is mapped into memory and the cells of the maps point into it, so the
+// cells of a map are only read from disk when the map is used, and the OS
+// can drop them again while nothing changed them.
+#define MAP_RAW_MAGIC "MAPCRAW1"
+#define MAP_RAW_ALIGN 4096 // cells of each map start on a page
+
+struct map_raw_header {
+	char magic[8];
+	uint32 cell_size; // sizeof(struct mapcell)
+	uint32 source_size; // size and modification time of the map cache it was made from
+	uint32 source_time;
+	uint32 map_count;
+};
+
+struct map_raw_info {
+	char name[MAP_NAME_LENGTH];
+	int16 xs;
+	int16 ys;
+	uint32 offset; // of the cells, from the start of the file
+};
+
+static char* map_raw = NULL;
+static size_t map_raw_size = 0;
+
+/// Returns true if the cells of the map point into the mapped raw cache.
+static bool map_cells_raw(struct map_data* m)
+{
+	return ( map_raw != NULL && (char*)m->cell >= map_raw && (char*)m->cell < map_raw + map_raw_size );
+}
+
+/// Frees the cells of a map.
+static void map_freecells(struct map_data* m)
+{
+	if( m->cell && !map_cells_raw(m) )
+		aFree(m->cell);
+	m->cell = NULL;
+}
+
+/// Tells the OS that the cells of a map won't be used for a while.
+static void map_cells_cold(struct map_data* m)
+{
+#if !defined(WIN32) && defined(MADV_COLD)
+	if( map_cells_raw(m) )
+		madvise(m->cell, (size_t)m->xs*m->ys*sizeof(struct mapcell), MADV_COLD);
+#endif
+}
+
 char map_cache_file[256]="db/map_cache.dat";
+char map_cache_raw_file[256]="db/map_cache.raw";
 char db_path[256] = "db";
 char motd_txt[256] = "conf/motd.txt";
 char help_txt[256] = "conf/help.txt";
 char help2_txt[256] = "conf/help2.txt";
 char charhelp_txt[256] = "conf/charhelp.txt";
+char memory_dump_file[256] = "log/memory.log";
 
 char wisp_server_name[NAME_LENGTH] = "Server"; // can be modified in char-server configuration file
 
@@ -251,6 +319,29 @@ int map_freeblock_timer(int tid, unsigned int tick, int id, intptr_t data)
 	return 0;
 }
 
+/// Appends the memory in use per subsystem (in KB) to memory_dump_file.
+static int map_memory_dump_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	char timestring[20];
+	time_t curtime;
+	FILE* fp;
+	int i;
+
+	if( (fp = fopen(memory_dump_file, "a")) == NULL )
+	{
+		ShowError("map_memory_dump_timer: can't write to '%s'.\n", memory_dump_file);
+		return 0;
+	}
+	time(&curtime);
+	strftime(timestring, sizeof(timestring), "%Y-%m-%d %H:%M:%S", localtime(&curtime));
+	fprintf(fp, "%s total:%lu", timestring, (unsigned long)malloc_usage()); // already in KB
+	for( i = 0; i < MEMTAG_MAX; ++i )
+		fprintf(fp, " %s:%lu", malloc_tag_name((enum memtag)i), (unsigned long)(malloc_tag_usage((enum memtag)i, NULL)/1024));
+	fprintf(fp, "\n");
+	fclose(fp);
+	return 0;
+}
+
 //
 // block?
 //
@@ -415,6 +506,10 @@ int map_moveblock(struct block_list *bl, int x1, int y1, unsigned int tick)
 
 	if (bl->type&BL_CHAR) {
 		skill_unit_move(bl,tick,3);
+		if (bl->type == BL_PC) { // party/guild members see the new position
+			party_send_xy_mark((TBL_PC*)bl);
+			guild_send_xy_mark((TBL_PC*)bl);
+		}
 		sc = status_get_sc(bl);
 		if (sc) {
 			if (sc->count) {
@@ -1174,7 +1269,7 @@ int map_get_new_object_id(void)
 		if( i == MAX_FLOORITEM )
 			i = MIN_FLOORITEM;
 
-		if( idb_get(id_db, i) == NULL )
+		if( map_isfreeid(i) )
 			break;
 
 		++i;
@@ -1202,7 +1297,7 @@ int map_get_new_object_id(void)
  *------------------------------------------*/
 int map_clearflooritem_timer(int tid, unsigned int tick, int id, intptr_t data)
 {
-	struct flooritem_data* fitem = (struct flooritem_data*)idb_get(id_db, id);
+	struct flooritem_data* fitem = (struct flooritem_data*)map_id2bl(id);
 	if( fitem==NULL || fitem->bl.type!=BL_ITEM || (!data && fitem->cleartimer != tid) )
 	{
 		ShowError("map_clearflooritem_timer : error\n");
@@ -1262,6 +1357,81 @@ static int map_count_sub(struct block_list *bl,va_list ap)
 	return 1;
 }
 
+/// Checks a candidate cell of map_search_freecell.
+/// Returns 1 to take it, 0 to try another one and -1 to give up.
+static int map_search_freecell_check(struct block_list* src, int m, int x, int y, int bx, int by, int flag, int* spawn)
+{
+	if( x == bx && y == by )
+		return 0; //Avoid picking the same target tile.
+	if( !map_getcell(m,x,y,CELL_CHKREACH) )
+		return 0;
+	if( flag&2 && !unit_can_reach_pos(src, x, y, 1) )
+		return 0;
+	if( flag&4 )
+	{
+		if( *spawn >= 100 )
+			return -1; //Limit of retries reached.
+		if( (*spawn)++ < battle_config.no_spawn_on_player &&
+			map_foreachinarea(map_count_sub, m, x-AREA_SIZE, y-AREA_SIZE, x+AREA_SIZE, y+AREA_SIZE, BL_PC) )
+			return 0;
+	}
+	return 1;
+}
+
+/// Returns the walkable cells of the area x0,y0-x1,y1 of the map,
+/// (re)building the list if a cell of the map became walkable since it was built.
+static struct walkcell_list* map_walkcell_get(struct walkcell_list* list, int m, int x0, int y0, int x1, int y1)
+{
+	struct map_data* md = &map[m];
+	int x, y, count;
+
+	if( list->xy != NULL && list->version == md->walkcell_version )
+		return list;
+
+	x0 = max(x0, 0); y0 = max(y0, 0);
+	x1 = min(x1, md->xs-1); y1 = min(y1, md->ys-1);
+	count = 0;
+	for( y = y0; y <= y1; ++y )
+		for( x = x0; x <= x1; ++x )
+			if( md->cell[x + y*md->xs].walkable )
+				++count;
+	if( list->xy == NULL || count > list->max )
+	{
+		list->max = max(count, 1);
+		RECREATE(list->xy, int, list->max);
+	}
+	list->count = 0;
+	for( y = y0; y <= y1; ++y )
+		for( x = x0; x <= x1; ++x )
+			if( md->cell[x + y*md->xs].walkable )
+				list->xy[list->count++] = x + y*md->xs;
+	list->version = md->walkcell_version;
+	return list;
+}
+
+/// Picks random cells from the list until one passes map_search_freecell_check.
+static int map_search_walkcell(struct block_list* src, int m, short* x, short* y, int bx, int by, struct walkcell_list* list, int tries, int flag)
+{
+	int spawn = 0;
+
+	while( tries-- > 0 && list->count > 0 )
+	{
+		int xy = list->xy[rand()%list->count];
+		int r = map_search_freecell_check(src, m, xy%map[m].xs, xy/map[m].xs, bx, by, flag, &spawn);
+		if( r < 0 )
+			return 0;
+		if( r > 0 )
+		{
+			*x = xy%map[m].xs;
+			*y = xy/map[m].xs;
+			return 1;
+		}
+	}
+	*x = bx;
+	*y = by;
+	return 0;
+}
+
 /*==========================================
  * Locates a random spare cell around the object given, using range as max 
  * distance from that spot. Used for warping functions. Use range < 0 for 
@@ -1309,35 +1479,57 @@ int map_search_freecell(struct block_list *src, int m, short *x,short *y, int rx
 		tries = map[m].xs*map[m].ys;
 		if (tries > 500) tries = 500;
 	}
+
+	if( rx < 0 && ry < 0 )
+	{// whole map, pick from the walkable cells instead of random coordinates
+		struct walkcell_list* list = map_walkcell_get(&map[m].walkcell, m, 1, 1, map[m].xs-2, map[m].ys-2);
+		return map_search_walkcell(src, m, x, y, bx, by, list, tries, flag);
+	}
 	
 	while(tries--) {
+		int r;
+
 		*x = (rx >= 0)?(rand()%rx2-rx+bx):(rand()%(map[m].xs-2)+1);
 		*y = (ry >= 0)?(rand()%ry2-ry+by):(rand()%(map[m].ys-2)+1);
 		
-		if (*x == bx && *y == by)
-			continue; //Avoid picking the same target tile.
-		
-		if (map_getcell(m,*x,*y,CELL_CHKREACH))
-		{
-			if(flag&2 && !unit_can_reach_pos(src, *x, *y, 1))
-				continue;
-			if(flag&4) {
-				if (spawn >= 100) return 0; //Limit of retries reached.
-				if (spawn++ < battle_config.no_spawn_on_player &&
-					map_foreachinarea(map_count_sub, m,
-						*x-AREA_SIZE, *y-AREA_SIZE,
-					  	*x+AREA_SIZE, *y+AREA_SIZE, BL_PC)
-				)
-				continue;
-			}
+		r = map_search_freecell_check(src, m, *x, *y, bx, by, flag, &spawn);
+		if( r < 0 )
+			return 0;
+		if( r > 0 )
 			return 1;
-		}
 	}
 	*x = bx;
 	*y = by;
 	return 0;
 }
 
+/*==========================================
+ * Locates a random free cell of the spawn area (the whole map for random spawns)
+ * from the walkable cells of the area, see map_search_freecell.
+ * Only flag&4 is supported.
+ *------------------------------------------*/
+int map_search_spawncell(struct spawn_data* spawn, short* x, short* y, int flag)
+{
+	int m = spawn->m, bx = spawn->x, by = spawn->y;
+	int rx = spawn->xs, ry = spawn->ys;
+	struct walkcell_list* list;
+	int tries;
+
+	if( rx < 0 && ry < 0 )
+	{
+		tries = min(map[m].xs*map[m].ys, 500);
+		list = map_walkcell_get(&map[m].walkcell, m, 1, 1, map[m].xs-2, map[m].ys-2);
+	}
+	else
+	{
+		rx = max(rx, 0);
+		ry = max(ry, 0);
+		tries = min((2*rx+1)*(2*ry+1), 100);
+		list = map_walkcell_get(&spawn->walkcell, m, bx-rx, by-ry, bx+rx, by+ry);
+	}
+	return map_search_walkcell(NULL, m, x, y, bx, by, list, tries, flag&4);
+}
+
 /*==========================================
  * (m,x,y)𒆐S3x3?ɏACeݒu
  *
@@ -1474,11 +1666,53 @@ void map_reqnickdb(struct map_session_data * sd, int charid)
 	chrif_searchcharid(charid);
 }
 
+/// Rebuilds the lookup table of id_db with at least 'size' slots.
+/// Objects go to slot (id & id_slot_mask), the id doubles as generation so a 
+/// slot with another id is a miss. Objects whose slot is taken are only in id_db.
+static void map_idslot_rebuild(int size)
+{
+	DBIterator* iter;
+	struct block_list* bl;
+
+	size = cap_value(size, ID_SLOT_MIN, ID_SLOT_MAX);
+	while( size < ID_SLOT_MAX && size/2 < (int)id_db->size(id_db) )
+		size *= 2;
+	if( size != id_slot_mask+1 )
+	{
+		RECREATE(id_slot, struct block_list*, size);
+		id_slot_mask = size-1;
+	}
+	memset(id_slot, 0, size*sizeof(struct block_list*));
+
+	id_slot_overflow = 0;
+	iter = db_iterator(id_db);
+	for( bl = (struct block_list*)dbi_first(iter); dbi_exists(iter); bl = (struct block_list*)dbi_next(iter) )
+	{
+		if( id_slot[bl->id&id_slot_mask] == NULL )
+			id_slot[bl->id&id_slot_mask] = bl;
+		else
+			id_slot_overflow++;
+	}
+	dbi_destroy(iter);
+}
+
+/// Returns true if the id is not used and its slot in the lookup table is free.
+/// Used when generating ids, so new objects can be found with one array access.
+bool map_isfreeid(int id)
+{
+	if( id_slot[id&id_slot_mask] != NULL )
+		return false;
+	return ( id_slot_overflow == 0 || idb_get(id_db,id) == NULL );
+}
+
 /*==========================================
  * id_dbblǉ
  *------------------------------------------*/
 void map_addiddb(struct block_list *bl)
 {
+	struct block_list* old;
+	int slot;
+
 	nullpo_retv(bl);
 
 	if( bl->type == BL_PC )
@@ -1499,7 +1733,21 @@ void map_addiddb(struct block_list *bl)
 	if( bl->type & BL_REGEN )
 		idb_put(regen_db, bl->id, bl);
 
-	idb_put(id_db,bl->id,bl);
+	old = (struct block_list*)idb_put(id_db,bl->id,bl);
+	slot = bl->id&id_slot_mask;
+	if( old != NULL && id_slot[slot] == old )
+		id_slot[slot] = bl; // replaced
+	else if( id_slot[slot] == NULL )
+	{
+		id_slot[slot] = bl;
+		if( old != NULL )
+			id_slot_overflow--; // was not in the slot
+	}
+	else if( old == NULL )
+		id_slot_overflow++;
+
+	if( id_slot_mask+1 < ID_SLOT_MAX && ((int)id_db->size(id_db) > (id_slot_mask+1)/2 || (id_slot_overflow > 64 && id_slot_overflow > (int)id_db->size(id_db)/8)) )
+		map_idslot_rebuild((id_slot_mask+1)*2); // getting full or too many collisions
 }
 
 /*==========================================
@@ -1507,6 +1755,9 @@ void map_addiddb(struct block_list *bl)
  *------------------------------------------*/
 void map_deliddb(struct block_list *bl)
 {
+	struct block_list* old;
+	int slot;
+
 	nullpo_retv(bl);
 
 	if( bl->type == BL_PC )
@@ -1524,7 +1775,15 @@ void map_deliddb(struct block_list *bl)
 	if( bl->type & BL_REGEN )
 		idb_remove(regen_db,bl->id);
 
-	idb_remove(id_db,bl->id);
+	old = (struct block_list*)idb_remove(id_db,bl->id);
+	if( old != NULL )
+	{
+		slot = bl->id&id_slot_mask;
+		if( id_slot[slot] == old )
+			id_slot[slot] = NULL;
+		else
+			id_slot_overflow--;
+	}
 }
 
 /*==========================================
@@ -1630,14 +1889,20 @@ int map_quit(struct map_session_data *sd)
  *------------------------------------------*/
 struct map_session_data * map_id2sd(int id)
 {
+	struct block_list* bl;
+
 	if (id <= 0) return NULL;
-	return (struct map_session_data*)idb_get(pc_db,id);
+	bl = map_id2bl(id);
+	return BL_CAST(BL_PC, bl);
 }
 
 struct mob_data * map_id2md(int id)
 {
+	struct block_list* bl;
+
 	if (id <= 0) return NULL;
-	return (struct mob_data*)idb_get(mobid_db,id);
+	bl = map_id2bl(id);
+	return BL_CAST(BL_MOB, bl);
 }
 
 struct npc_data * map_id2nd(int id)
@@ -1749,6 +2014,12 @@ struct map_session_data * map_nick2sd(const char *nick)
  *------------------------------------------*/
 struct block_list * map_id2bl(int id)
 {
+	struct block_list* bl = id_slot[id&id_slot_mask];
+
+	if( bl != NULL && bl->id == id )
+		return bl;
+	if( id_slot_overflow == 0 )
+		return NULL;
 	return (struct block_list*)idb_get(id_db,id);
 }
 
@@ -2059,7 +2330,7 @@ bool map_addnpc(int m,struct npc_data *nd)
 
 	map[m].npc[map[m].npc_num]=nd;
 	map[m].npc_num++;
-	idb_put(id_db,nd->bl.id,nd);
+	map_addiddb(&nd->bl);
 	return true;
 }
 
@@ -2164,6 +2435,60 @@ void map_removemobs(int m)
 	map[m].mob_delete_timer = add_timer(gettick()+battle_config.mob_remove_delay, map_removemobs_timer, m, 0);
 }
 
+/*==========================================
+ * Map hibernation
+ * Maps that stayed empty for map_hibernate_delay stop the AI of their mobs,
+ * postpone the respawns and don't run their skill units. Nothing is
+ * simulated when they wake up: postponed respawns happen at once and skill
+ * units expire on the next skill_unit_timer by their start tick.
+ *------------------------------------------*/
+static int map_hibernate_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	int m;
+
+	if( !battle_config.map_hibernate_delay )
+		return 0;
+
+	for( m = 0; m < map_num; m++ )
+	{
+		if( map[m].users == 0 && map[m].hibernate_tick == 0 && DIFF_TICK(tick, map[m].empty_tick) >= battle_config.map_hibernate_delay )
+		{
+			map[m].hibernate_tick = tick ? tick : 1;
+			map_cells_cold(&map[m]);
+		}
+	}
+	return 0;
+}
+
+static int map_wakeup_sub(struct mob_data* md, va_list ap)
+{
+	int m = va_arg(ap, int);
+	int* count = va_arg(ap, int*);
+
+	if( md->state.hibernate_spawn && md->spawn && md->spawn->m == m )
+	{
+		md->state.hibernate_spawn = 0;
+		mob_spawn(md);
+		(*count)++;
+	}
+	return 0;
+}
+
+/// Resumes a hibernating map, called when a player arrives.
+void map_wakeup(int m)
+{
+	int count = 0;
+
+	if( map[m].hibernate_tick == 0 )
+		return;
+
+	map_foreachmob(map_wakeup_sub, m, &count);
+	if( battle_config.etc_log )
+		ShowStatus("Map %s: Woke up after %d seconds, respawned '"CL_WHITE"%d"CL_RESET"' mobs.\n", map[m].name, DIFF_TICK(gettick(), map[m].hibernate_tick)/1000, count);
+	map[m].hibernate_tick = 0;
+	skill_unit_wakeup(m);
+}
+
 /*==========================================
  * mapmap??
  *------------------------------------------*/
@@ -2385,6 +2710,8 @@ int map_getcellp(struct map_data* m,int x,int y,cell_chk cellchk)
 			return (cell.novending);
 		case CELL_CHKNOCHAT:
 			return (cell.nochat);
+		case CELL_CHKSKILL:
+			return (cell.skill);
 
 		// special checks
 		case CELL_CHKPASS:
@@ -2428,8 +2755,16 @@ void map_setcell(int m, int x, int y, cell_t cell, bool flag)
 	j = x + y*map[m].xs;
 
 	switch( cell ) {
-		case CELL_WALKABLE:      map[m].cell[j].walkable = flag;      break;
-		case CELL_SHOOTABLE:     map[m].cell[j].shootable = flag;     break;
+		case CELL_WALKABLE:
+			if( flag && !map[m].cell[j].walkable )
+				map[m].walkcell_version++;
+			map[m].cell[j].walkable = flag;
+			path_updatelos(m, x, y);
+			break;
+		case CELL_SHOOTABLE:
+			map[m].cell[j].shootable = flag;
+			path_updatelos(m, x, y);
+			break;
 		case CELL_WATER:         map[m].cell[j].water = flag;         break;
 
 		case CELL_NPC:           map[m].cell[j].npc = flag;           break;
@@ -2437,6 +2772,7 @@ void map_setcell(int m, int x, int y, cell_t cell, bool flag)
 		case CELL_LANDPROTECTOR: map[m].cell[j].landprotector = flag; break;
 		case CELL_NOVENDING:     map[m].cell[j].novending = flag;     break;
 		case CELL_NOCHAT:        map[m].cell[j].nochat = flag;        break;
+		case CELL_SKILL:         map[m].cell[j].skill = flag;         break;
 		default:
 			ShowWarning("map_setcell: invalid cell type '%d'\n", (int)cell);
 			break;
@@ -2454,9 +2790,12 @@ void map_setgatcell(int m, int x, int y, int gat)
 	j = x + y*map[m].xs;
 
 	cell = map_gat2cell(gat);
+	if( cell.walkable && !map[m].cell[j].walkable )
+		map[m].walkcell_version++;
 	map[m].cell[j].walkable = cell.walkable;
 	map[m].cell[j].shootable = cell.shootable;
 	map[m].cell[j].water = cell.water;
+	path_updatelos(m, x, y);
 }
 
 /*==========================================
@@ -2710,7 +3049,7 @@ int map_readfromcache(struct map_data *m, char *buffer, char *decode_buffer)
 		// TO-DO: Maybe handle the scenario, if the decoded buffer isn't the same size as expected? [Shinryo]
 		decode_zip(decode_buffer, &size, p+sizeof(struct map_cache_map_info), info->len);
 
-		CREATE(m->cell, struct mapcell, size);
+		CREATE_HUGE(m->cell, struct mapcell, size, MEMTAG_MAPCELL);
 
 
 		for( xy = 0; xy < size; ++xy )
@@ -2722,6 +3061,190 @@ int map_readfromcache(struct map_data *m, char *buffer, char *decode_buffer)
 	return 0; // Not found
 }
 
+#ifndef WIN32
+/// Writes the raw cache from the compressed map cache.
+static bool map_raw_build(char* buffer, uint32 source_size, uint32 source_time)
+{
+	struct map_cache_main_header* main_header = (struct map_cache_main_header*)buffer;
+	struct map_raw_header header;
+	struct map_raw_info* infos;
+	struct mapcell* cells;
+	char* decode_buffer;
+	char tmp_file[300];
+	char* p;
+	uint32 offset;
+	FILE* fp;
+	int i;
+
+	snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", map_cache_raw_file);
+	if( (fp = fopen(tmp_file, "wb")) == NULL )
+	{
+		ShowWarning("map_raw_build: can't write '%s', the maps are decompressed into memory.\n", tmp_file);
+		return false;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAP_RAW_MAGIC, sizeof(header.magic));
+	header.cell_size = sizeof(struct mapcell);
+	header.source_size = source_size;
+	header.source_time = source_time;
+	header.map_count = main_header->map_count;
+
+	CREATE(infos, struct map_raw_info, max(1,header.map_count));
+	CREATE(cells, struct mapcell, MAX_MAP_SIZE);
+	CREATE(decode_buffer, char, MAX_MAP_SIZE);
+
+	// offsets
+	offset = (uint32)(sizeof(header) + header.map_count*sizeof(struct map_raw_info));
+	p = buffer + sizeof(struct map_cache_main_header);
+	for( i = 0; i < (int)header.map_count; i++ )
+	{
+		struct map_cache_map_info* info = (struct map_cache_map_info*)p;
+		uint32 size = ( info->xs > 0 && info->ys > 0 ) ? (uint32)info->xs*info->ys : 0;
+
+		if( size > MAX_MAP_SIZE )
+			size = 0; // rejected by map_readfromraw
+		memcpy(infos[i].name, info->name, MAP_NAME_LENGTH);
+		infos[i].xs = info->xs;
+		infos[i].ys = info->ys;
+		offset = (offset + MAP_RAW_ALIGN - 1)/MAP_RAW_ALIGN*MAP_RAW_ALIGN;
+		infos[i].offset = offset;
+		offset += size*sizeof(struct mapcell);
+		p += sizeof(struct map_cache_map_info) + info->len;
+	}
+	fwrite(&header, sizeof(header), 1, fp);
+	fwrite(infos, sizeof(struct map_raw_info), header.map_count, fp);
+
+	// cells
+	p = buffer + sizeof(struct map_cache_main_header);
+	for( i = 0; i < (int)header.map_count; i++ )
+	{
+		struct map_cache_map_info* info = (struct map_cache_map_info*)p;
+		unsigned long size = ( info->xs > 0 && info->ys > 0 ) ? (unsigned long)info->xs*info->ys : 0;
+		unsigned long xy;
+
+		if( size > 0 && size <= MAX_MAP_SIZE )
+		{
+			decode_zip(decode_buffer, &size, p+sizeof(struct map_cache_map_info), info->len);
+			for( xy = 0; xy < size; ++xy )
+				cells[xy] = map_gat2cell(decode_buffer[xy]);
+			fseek(fp, infos[i].offset, SEEK_SET);
+			fwrite(cells, sizeof(struct mapcell), size, fp);
+		}
+		p += sizeof(struct map_cache_map_info) + info->len;
+	}
+
+	aFree(decode_buffer);
+	aFree(cells);
+	aFree(infos);
+	if( ferror(fp) )
+	{
+		fclose(fp);
+		remove(tmp_file);
+		ShowWarning("map_raw_build: failed to write '%s'.\n", tmp_file);
+		return false;
+	}
+	fclose(fp);
+	if( rename(tmp_file, map_cache_raw_file) != 0 )
+	{
+		remove(tmp_file);
+		ShowWarning("map_raw_build: can't replace '%s'.\n", map_cache_raw_file);
+		return false;
+	}
+	ShowStatus("Created the uncompressed map cache '"CL_WHITE"%s"CL_RESET"' (%d maps).\n", map_cache_raw_file, header.map_count);
+	return true;
+}
+
+/// Maps the raw cache into memory if it was made from the current map cache.
+static bool map_raw_open(uint32 source_size, uint32 source_time)
+{
+	struct map_raw_header* header;
+	struct stat st;
+	void* p;
+	int fd;
+
+	if( (fd = open(map_cache_raw_file, O_RDONLY)) < 0 )
+		return false;
+	if( fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct map_raw_header) )
+	{
+		close(fd);
+		return false;
+	}
+	// private writable mapping, changed cells (npc, basilica, ...) are copied on write
+	p = mmap(NULL, (size_t)st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if( p == MAP_FAILED )
+		return false;
+
+	header = (struct map_raw_header*)p;
+	if( memcmp(header->magic, MAP_RAW_MAGIC, sizeof(header->magic)) != 0 || header->cell_size != sizeof(struct mapcell) ||
+		header->source_size != source_size || header->source_time != source_time ||
+		sizeof(struct map_raw_header) + header->map_count*sizeof(struct map_raw_info) > (size_t)st.st_size )
+	{// outdated
+		munmap(p, (size_t)st.st_size);
+		return false;
+	}
+	map_raw = (char*)p;
+	map_raw_size = (size_t)st.st_size;
+	return true;
+}
+#endif
+
+/// Prepares the raw cache of map_cache_file, making it when it's missing or outdated.
+static bool map_raw_init(void)
+{
+#ifndef WIN32
+	struct stat st;
+	FILE* fp;
+	char* buffer;
+	bool built;
+
+	if( stat(map_cache_file, &st) != 0 )
+		return false;
+	if( map_raw_open((uint32)st.st_size, (uint32)st.st_mtime) )
+		return true;
+
+	if( (fp = fopen(map_cache_file, "rb")) == NULL )
+		return false;
+	buffer = map_init_mapcache(fp);
+	fclose(fp);
+	if( buffer == NULL )
+		return false;
+	built = map_raw_build(buffer, (uint32)st.st_size, (uint32)st.st_mtime);
+	aFree(buffer);
+	return ( built && map_raw_open((uint32)st.st_size, (uint32)st.st_mtime) );
+#else
+	return false;
+#endif
+}
+
+/// Points the cells of the map into the raw cache.
+static int map_readfromraw(struct map_data* m)
+{
+	struct map_raw_header* header = (struct map_raw_header*)map_raw;
+	struct map_raw_info* infos = (struct map_raw_info*)(map_raw + sizeof(struct map_raw_header));
+	unsigned long size;
+	uint32 i;
+
+	ARR_FIND(0, header->map_count, i, strcmp(m->name, infos[i].name) == 0);
+	if( i == header->map_count || infos[i].xs <= 0 || infos[i].ys <= 0 )
+		return 0; // not found or invalid
+
+	size = (unsigned long)infos[i].xs*(unsigned long)infos[i].ys;
+	if( size > MAX_MAP_SIZE )
+	{
+		ShowWarning("map_readfromraw: %s exceeded MAX_MAP_SIZE of %d\n", infos[i].name, MAX_MAP_SIZE);
+		return 0;
+	}
+	if( infos[i].offset + size*sizeof(struct mapcell) > map_raw_size )
+		return 0; // truncated
+
+	m->xs = infos[i].xs;
+	m->ys = infos[i].ys;
+	m->cell = (struct mapcell*)(map_raw + infos[i].offset);
+	return 1;
+}
+
 int map_addmap(char* mapname)
 {
 	if( strcmpi(mapname,"clear")==0 )
@@ -2842,7 +3365,7 @@ int map_readgat (struct map_data* m)
 	m->xs = *(int32*)(gat+6);
 	m->ys = *(int32*)(gat+10);
 	num_cells = m->xs * m->ys;
-	CREATE(m->cell, struct mapcell, num_cells);
+	CREATE_HUGE(m->cell, struct mapcell, num_cells, MEMTAG_MAPCELL);
 
 	water_height = map_waterheight(m->name);
 
@@ -2892,6 +3415,8 @@ int map_readallmaps (void)
 
 	if( enable_grf )
 		ShowStatus("Loading maps (using GRF files)...\n");
+	else if( map_raw_init() )
+		ShowStatus("Loading maps (using %s as map cache)...\n", map_cache_raw_file);
 	else
 	{
 		ShowStatus("Loading maps (using %s as map cache)...\n", map_cache_file);
@@ -2925,6 +3450,8 @@ int map_readallmaps (void)
 		if( !
 			(enable_grf?
 				 map_readgat(&map[i])
+				:map_raw?
+				 map_readfromraw(&map[i])
 				:map_readfromcache(&map[i], map_cache_buffer, map_cache_decode_buffer))
 			) {
 			map_delmapid(i);
@@ -2938,10 +3465,7 @@ int map_readallmaps (void)
 		if (uidb_get(map_db,(unsigned int)map[i].index) != NULL)
 		{
 			ShowWarning("Map %s already loaded!"CL_CLL"\n", map[i].name);
-			if (map[i].cell) {
-				aFree(map[i].cell);
-				map[i].cell = NULL;	
-			}
+			map_freecells(&map[i]);
 			map_delmapid(i);
 			maps_removed++;
 			i--;
@@ -2953,19 +3477,21 @@ int map_readallmaps (void)
 		map[i].m = i;
 		memset(map[i].moblist, 0, sizeof(map[i].moblist));	//Initialize moblist [Skotlex]
 		map[i].mob_delete_timer = INVALID_TIMER;	//Initialize timer [Skotlex]
+		map[i].empty_tick = gettick();
+		map[i].hibernate_tick = 0;
 
 		map[i].bxs = (map[i].xs + BLOCK_SIZE - 1) / BLOCK_SIZE;
 		map[i].bys = (map[i].ys + BLOCK_SIZE - 1) / BLOCK_SIZE;
 
 		size = map[i].bxs * map[i].bys * sizeof(struct block_list*);
-		map[i].block = (struct block_list**)aCalloc(size, 1);
-		map[i].block_mob = (struct block_list**)aCalloc(size, 1);
+		map[i].block = (struct block_list**)aCallocHuge(size, 1, MEMTAG_MAPBLOCK);
+		map[i].block_mob = (struct block_list**)aCallocHuge(size, 1, MEMTAG_MAPBLOCK);
 	}
 
 	// intialization and configuration-dependent adjustments of mapflags
 	map_flags_init();
 
-	if( !enable_grf ) {
+	if( fp ) {
 		fclose(fp);
 
 		// The cache isn't needed anymore, so free it.. [Shinryo]
@@ -3048,6 +3574,18 @@ int parse_console(const char* buf)
 		{
 			runflag = SERVER_STATE_STOP;
 		}
+		else if( strcmpi("memory", command) == 0 )
+		{
+			malloc_report(20);
+		}
+		else if( strcmpi("ers", command) == 0 )
+		{
+			ers_report();
+		}
+		else if( strcmpi("backpressure", command) == 0 )
+		{
+			clif_backpressure_report();
+		}
 	}
 	else if( strcmpi("help", type) == 0 )
 	{
@@ -3059,6 +3597,12 @@ int parse_console(const char* buf)
 		ShowInfo("IE: @spawn\n");
 		ShowInfo("To shutdown the server:\n");
 		ShowInfo("  server:shutdown\n");
+		ShowInfo("To show the memory usage by subsystem, size and call site:\n");
+		ShowInfo("  server:memory\n");
+		ShowInfo("To show the entry pools (entries in use, peak, slabs):\n");
+		ShowInfo("  server:ers\n");
+		ShowInfo("To show the clients that can't keep up and the packets dropped or merged for them:\n");
+		ShowInfo("  server:backpressure\n");
 	}
 
 	return 0;
@@ -3151,6 +3695,24 @@ int map_config_read(char *cfgName)
 			if (minsave_interval < 1)
 				minsave_interval = 1;
 		} else
+		if (strcmpi(w1, "memory_dump_time") == 0)
+			memory_dump_interval = max(0, atoi(w2)) * 1000;
+		else
+		if (strcmpi(w1, "memory_dump_file") == 0)
+			safestrncpy(memory_dump_file, w2, sizeof(memory_dump_file));
+		else
+		if (strcmpi(w1, "ers_release_time") == 0)
+			ers_release_interval = max(0, atoi(w2)) * 1000;
+		else
+		if (strcmpi(w1, "backpressure_soft_limit") == 0)
+			backpressure_soft_limit = max(0, atoi(w2)) * 1024;
+		else
+		if (strcmpi(w1, "backpressure_hard_limit") == 0)
+			backpressure_hard_limit = max(0, atoi(w2)) * 1024;
+		else
+		if (strcmpi(w1, "backpressure_crowd") == 0)
+			backpressure_crowd = max(0, atoi(w2));
+		else
 		if (strcmpi(w1, "save_settings") == 0)
 			save_settings = atoi(w2);
 		else
@@ -3169,6 +3731,9 @@ int map_config_read(char *cfgName)
 		if(strcmpi(w1,"map_cache_file") == 0)
 			strncpy(map_cache_file,w2,255);
 		else
+		if(strcmpi(w1,"map_cache_raw_file") == 0)
+			strncpy(map_cache_raw_file,w2,255);
+		else
 		if(strcmpi(w1,"db_path") == 0)
 			strncpy(db_path,w2,255);
 		else
@@ -3298,18 +3863,29 @@ int map_sql_init(void)
 	ShowStatus("Connected to main database '%s'.\n", map_server_db);
 	Sql_PrintExtendedInfo(mmysql_handle);
 
+	if( script_config.async_query_sql )
+	{// worker connections for query_sql
+		mmysql_async_handle = SqlAsync_Create(script_config.async_query_sql_workers, map_server_id, map_server_pw, map_server_ip, map_server_port, map_server_db, default_codepage);
+		if( mmysql_async_handle != NULL )
+			ShowStatus("Using %d worker connection(s) for query_sql.\n", script_config.async_query_sql_workers);
+	}
+
 	return 0;
 }
 
 int map_sql_close(void)
 {
 	ShowStatus("Close Map DB Connection....\n");
+	SqlAsync_Free(mmysql_async_handle);
+	mmysql_async_handle = NULL;
 	Sql_Free(mmysql_handle);
 	mmysql_handle = NULL;
 
 	if (log_config.sql_logs)
 	{
 		ShowStatus("Close Log DB Connection....\n");
+		SqlAsync_Free(logmysql_async_handle);
+		logmysql_async_handle = NULL;
 		Sql_Free(logmysql_handle);
 		logmysql_handle = NULL;
 	}
@@ -3333,6 +3909,13 @@ int log_sql_init(void)
 	ShowStatus("Connected to log database '%s'.\n", log_db_db);
 	Sql_PrintExtendedInfo(logmysql_handle);
 
+	if( script_config.async_query_sql )
+	{// worker connections for query_logsql
+		logmysql_async_handle = SqlAsync_Create(script_config.async_query_sql_workers, log_db_id, log_db_pw, log_db_ip, log_db_port, log_db_db, default_codepage);
+		if( logmysql_async_handle != NULL )
+			ShowStatus("Using %d worker connection(s) for query_logsql.\n", script_config.async_query_sql_workers);
+	}
+
 	return 0;
 }
 
@@ -3445,24 +4028,37 @@ void do_final(void)
 	do_final_unit();
 	do_final_battleground();
 	do_final_duel();
+	do_final_searchstore();
 	
 	map_db->destroy(map_db, map_db_final);
 	
 	for (i=0; i<map_num; i++) {
-		if(map[i].cell) aFree(map[i].cell);
+		map_freecells(&map[i]);
+		aFree(map[i].walkcell.xy);
+		path_freelos(i);
 		if(map[i].block) aFree(map[i].block);
 		if(map[i].block_mob) aFree(map[i].block_mob);
+		npc_freetouch(i);
 		if(battle_config.dynamic_mobs) { //Dynamic mobs flag by [random]
 			for (j=0; j<MAX_MOB_LIST_PER_MAP; j++)
-				if (map[i].moblist[j]) aFree(map[i].moblist[j]);
+				if (map[i].moblist[j]) {
+					aFree(map[i].moblist[j]->walkcell.xy);
+					aFree(map[i].moblist[j]);
+				}
 		}
 	}
+#ifndef WIN32
+	if( map_raw )
+		munmap(map_raw, map_raw_size);
+#endif
 
 	mapindex_final();
 	if(enable_grf)
 		grfio_final();
 
 	id_db->destroy(id_db, NULL);
+	aFree(id_slot);
+	id_slot = NULL;
 	pc_db->destroy(pc_db, NULL);
 	mobid_db->destroy(mobid_db, NULL);
 	bossid_db->destroy(bossid_db, NULL);
@@ -3527,6 +4123,9 @@ static void map_helpscreen(bool do_exit)
 	ShowInfo("  --grf-path <file>\t\tAlternative GRF path configuration.\n");
 	ShowInfo("  --inter-config <file>\t\tAlternative inter-server configuration.\n");
 	ShowInfo("  --log-config <file>\t\tAlternative logging configuration.\n");
+	ShowInfo("  --battle-bench <count>\tTimes <count> damage calculations, then closes server.\n");
+	ShowInfo("  --battle-bench-record <file>\tRecords the results of the damage calculations.\n");
+	ShowInfo("  --battle-bench-check <file>\tCompares the damage calculations with recorded results.\n");
 	if( do_exit )
 		exit(EXIT_SUCCESS);
 }
@@ -3605,6 +4204,7 @@ int do_init(int argc, char *argv[])
 	GRF_PATH_FILENAME = "conf/grf-files.txt";
 
 	srand(gettick());
+	rnd_init();
 
 	for( i = 1; i < argc ; i++ )
 	{
@@ -3667,6 +4267,21 @@ int do_init(int argc, char *argv[])
 				if( map_arg_next_value(arg, i, argc) )
 					LOG_CONF_NAME = argv[++i];
 			}
+			else if( strcmp(arg, "battle-bench") == 0 )
+			{
+				if( map_arg_next_value(arg, i, argc) )
+					battlebench_count = atoi(argv[++i]);
+			}
+			else if( strcmp(arg, "battle-bench-record") == 0 )
+			{
+				if( map_arg_next_value(arg, i, argc) )
+					battlebench_record = argv[++i];
+			}
+			else if( strcmp(arg, "battle-bench-check") == 0 )
+			{
+				if( map_arg_next_value(arg, i, argc) )
+					battlebench_check = argv[++i];
+			}
 			else if( strcmp(arg, "run-once") == 0 ) // close the map-server as soon as its done.. for testing [Celest]
 			{
 				runflag = SERVER_STATE_STOP;
@@ -3692,6 +4307,12 @@ int do_init(int argc, char *argv[])
 		}
 	}
 
+	if( battlebench_record && battlebench_check )
+	{
+		ShowError("Options '--battle-bench-record' and '--battle-bench-check' can't be used together.\n");
+		exit(EXIT_FAILURE);
+	}
+
 	map_config_read(MAP_CONF_NAME);
 	chrif_checkdefaultlogin();
 
@@ -3721,13 +4342,14 @@ int do_init(int argc, char *argv[])
 	inter_config_read(INTER_CONF_NAME);
 	log_config_read(LOG_CONF_NAME);
 
-	id_db = idb_alloc(DB_OPT_BASE);
-	pc_db = idb_alloc(DB_OPT_BASE);	//Added for reliable map_id2sd() use. [Skotlex]
-	mobid_db = idb_alloc(DB_OPT_BASE);	//Added to lower the load of the lazy mob ai. [Skotlex]
+	id_db = idb_alloc(DB_OPT_OPEN_HASH);
+	map_idslot_rebuild(ID_SLOT_MIN);
+	pc_db = idb_alloc(DB_OPT_OPEN_HASH);	//Added for reliable map_id2sd() use. [Skotlex]
+	mobid_db = idb_alloc(DB_OPT_OPEN_HASH);	//Added to lower the load of the lazy mob ai. [Skotlex]
 	bossid_db = idb_alloc(DB_OPT_BASE); // Used for Convex Mirror quick MVP search
 	map_db = uidb_alloc(DB_OPT_BASE);
 	nick_db = idb_alloc(DB_OPT_BASE);
-	charid_db = idb_alloc(DB_OPT_BASE);
+	charid_db = idb_alloc(DB_OPT_OPEN_HASH);
 	regen_db = idb_alloc(DB_OPT_BASE); // efficient status_natural_heal processing
 
 	iwall_db = strdb_alloc(DB_OPT_RELEASE_DATA,2*NAME_LENGTH+2+1); // [Zephyrus] Invisible Walls
@@ -3747,7 +4369,13 @@ int do_init(int argc, char *argv[])
 	add_timer_func_list(map_freeblock_timer, "map_freeblock_timer");
 	add_timer_func_list(map_clearflooritem_timer, "map_clearflooritem_timer");
 	add_timer_func_list(map_removemobs_timer, "map_removemobs_timer");
+	add_timer_func_list(map_hibernate_timer, "map_hibernate_timer");
+	add_timer_interval(gettick()+1000, map_hibernate_timer, 0, 0, 1000);
 	add_timer_interval(gettick()+1000, map_freeblock_timer, 0, 0, 60*1000);
+	add_timer_func_list(map_memory_dump_timer, "map_memory_dump_timer");
+	if( memory_dump_interval > 0 )
+		add_timer_interval(gettick()+memory_dump_interval, map_memory_dump_timer, 0, 0, memory_dump_interval);
+	ers_set_release_time(ers_release_interval);
 
 	do_init_atcommand();
 	do_init_battle();
@@ -3771,9 +4399,17 @@ int do_init(int argc, char *argv[])
 	do_init_unit();
 	do_init_battleground();
 	do_init_duel();
+	do_init_searchstore();
 
 	npc_event_do_oninit();	// npcOnInitCxg?s
 
+	if( battlebench_enabled() )
+	{// offline damage calculations, no players
+		if( battlebench_run() )
+			exit(EXIT_FAILURE);
+		runflag = SERVER_STATE_STOP;
+	}
+
 	if( console )
 	{
 		//##TODO invoke a CONSOLE_START plugin event
@@ -13,6 +13,8 @@
 #include <stdarg.h>
 
 struct npc_data;
+struct npc_touch_block;
+struct los_map;
 struct item_data;
 
 //Uncomment to enable the Cell Stack Limit mod.
@@ -254,6 +256,16 @@ struct block_list {
 };
 
 
+/// Walkable cells of an area, picked at random by map_search_freecell/map_search_spawncell.
+/// Rebuilt when a cell of the map becomes walkable (see map_data.walkcell_version),
+/// cells that stop being walkable are only skipped when picked.
+struct walkcell_list {
+	int* xy; // x + y*xs of each cell
+	int count;
+	int max;
+	unsigned int version; // map_data.walkcell_version when the list was built
+};
+
 // Mob List Held in memory for Dynamic Mobs [Wizputer]
 // Expanded to specify all mob-related spawn data by [Skotlex]
 struct spawn_data {
@@ -270,6 +282,8 @@ struct spawn_data {
 		unsigned int boss : 1;
 	} state;
 	char name[NAME_LENGTH],eventname[EVENT_NAME_LENGTH]; //Name/event
+	const char* path; //Npc source file of permanent spawns
+	struct walkcell_list walkcell; //Walkable cells of the spawn area (built on first spawn)
 };
 
 
@@ -372,6 +386,7 @@ typedef enum {
 	CELL_LANDPROTECTOR,
 	CELL_NOVENDING,
 	CELL_NOCHAT,
+	CELL_SKILL,
 } cell_t;
 
 // used by map_getcell()
@@ -393,6 +408,7 @@ typedef enum {
 	CELL_CHKLANDPROTECTOR,
 	CELL_CHKNOVENDING,
 	CELL_CHKNOCHAT,
+	CELL_CHKSKILL,		// a skill unit is on the cell
 } cell_chk;
 
 struct mapcell
@@ -409,7 +425,8 @@ struct mapcell
 		basilica : 1,
 		landprotector : 1,
 		novending : 1,
-		nochat : 1;
+		nochat : 1,
+		skill : 1;
 
 #ifdef CELL_NOSTACK
 	unsigned char cell_bl; //Holds amount of bls in this cell.
@@ -435,6 +452,9 @@ struct map_data {
 	int npc_num;
 	int users;
 	int iwall_num; // Total of invisible walls in this map
+	struct los_map* los; // walls for path_search_long (built on first use)
+	struct walkcell_list walkcell; // walkable cells of the map (built on first use)
+	unsigned int walkcell_version; // bumped when a cell becomes walkable
 	struct map_flag {
 		unsigned town : 1; // [Suggestion to protect Mail System]
 		unsigned autotrade : 1;
@@ -488,6 +508,7 @@ struct map_data {
 	} flag;
 	struct point save;
 	struct npc_data *npc[MAX_NPC_PER_MAP];
+	struct npc_touch_block* npc_touch; // npcs with a touch area over each block (see npc_setcells)
 	struct {
 		int drop_id;
 		int drop_type;
@@ -496,6 +517,8 @@ struct map_data {
 
 	struct spawn_data *moblist[MAX_MOB_LIST_PER_MAP]; // [Wizputer]
 	int mob_delete_timer;	// [Skotlex]
+	unsigned int empty_tick; // when the last player left the map
+	unsigned int hibernate_tick; // when the map started hibernating, 0 while awake (see map_hibernate_timer)
 	int zone;	// zone number (for item/skill restrictions)
 	int jexp;	// map experience multiplicator
 	int bexp;	// map experience multiplicator
@@ -565,6 +588,7 @@ struct skill_unit *map_find_skill_unit_oncell(struct block_list *,int x,int y,in
 // ꎞIobject֘A
 int map_get_new_object_id(void);
 int map_search_freecell(struct block_list *src, int m, short *x, short *y, int rx, int ry, int flag);
+int map_search_spawncell(struct spawn_data* spawn, short* x, short* y, int flag);
 //
 int map_quit(struct map_session_data *);
 // npc
@@ -600,6 +624,7 @@ int map_eraseipport(unsigned short map, uint32 ip, uint16 port);
 int map_eraseallipport(void);
 void map_addiddb(struct block_list *);
 void map_deliddb(struct block_list *bl);
+bool map_isfreeid(int id);
 void map_foreachpc(int (*func)(struct map_session_data* sd, va_list args), ...);
 void map_foreachmob(int (*func)(struct mob_data* md, va_list args), ...);
 void map_foreachnpc(int (*func)(struct npc_data* nd, va_list args), ...);
@@ -646,6 +671,7 @@ void map_iwall_remove(const char *wall_name);
 int map_addmobtolist(unsigned short m, struct spawn_data *spawn);	// [Wizputer]
 void map_spawnmobs(int); // [Wizputer]
 void map_removemobs(int); // [Wizputer]
+void map_wakeup(int m);
 void do_reconnect_map(void); //Invoked on map-char reconnection [Skotlex]
 void map_addmap2db(struct map_data *m);
 void map_removemapdb(struct map_data *m);
@@ -684,6 +710,8 @@ extern int db_use_sqldbs;
 
 extern Sql* mmysql_handle;
 extern Sql* logmysql_handle;
+extern SqlAsync* mmysql_async_handle;
+extern SqlAsync* logmysql_async_handle;
 
 extern char item_db_db[32];
 extern char item_db2_db[32];
@@ -215,7 +215,7 @@ void mapreg_final(void)
 
 void mapreg_init(void)
 {
-	mapreg_db = idb_alloc(DB_OPT_BASE);
+	mapreg_db = idb_alloc(DB_OPT_OPEN_HASH);
 	mapregstr_db = idb_alloc(DB_OPT_RELEASE_DATA);
 
 	script_load_mapreg();
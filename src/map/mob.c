@@ -6,6 +6,7 @@
 #include "../common/db.h"
 #include "../common/nullpo.h"
 #include "../common/malloc.h"
+#include "../common/random.h"
 #include "../common/showmsg.h"
 #include "../common/ers.h"
 #include "../common/strlib.h"
@@ -210,7 +211,7 @@ int mob_parse_dataset(struct spawn_data *data)
  *------------------------------------------*/
 struct mob_data* mob_spawn_dataset(struct spawn_data *data)
 {
-	struct mob_data *md = (struct mob_data*)aCalloc(1, sizeof(struct mob_data));
+	struct mob_data *md = (struct mob_data*)aCallocTag(1, sizeof(struct mob_data), MEMTAG_MOB);
 	md->bl.id= npc_get_new_npc_id();
 	md->bl.type = BL_MOB;
 	md->bl.m = data->m;
@@ -780,6 +781,11 @@ int mob_delayspawn(int tid, unsigned int tick, int id, intptr_t data)
 			return 0;
 		}
 		md->spawn_timer = INVALID_TIMER;
+		if( md->spawn && map[md->spawn->m].hibernate_tick )
+		{// respawned when a player arrives (map_wakeup)
+			md->state.hibernate_spawn = 1;
+			return 0;
+		}
 		mob_spawn(md);
 	}
 	return 0;
@@ -841,7 +847,7 @@ int mob_spawn (struct mob_data *md)
 
 		if( (md->bl.x == 0 && md->bl.y == 0) || md->spawn->xs || md->spawn->ys )
 		{	//Monster can be spawned on an area.
-			if( !map_search_freecell(&md->bl, -1, &md->bl.x, &md->bl.y, md->spawn->xs, md->spawn->ys, battle_config.no_spawn_on_player?4:0) )
+			if( !map_search_spawncell(md->spawn, &md->bl.x, &md->bl.y, battle_config.no_spawn_on_player?4:0) )
 			{ // retry again later
 				if( md->spawn_timer != INVALID_TIMER )
 					delete_timer(md->spawn_timer, mob_delayspawn);
@@ -1574,7 +1580,7 @@ static int mob_ai_sub_lazy(struct mob_data *md, va_list args)
 
 	nullpo_ret(md);
 
-	if(md->bl.prev == NULL)
+	if(md->bl.prev == NULL || map[md->bl.m].hibernate_tick)
 		return 0;
 
 	tick = va_arg(args,unsigned int);
@@ -2184,6 +2190,9 @@ int mob_dead(struct mob_data *md, struct block_list *src, int type)
 		struct item_drop_list *dlist = ers_alloc(item_drop_list_ers, struct item_drop_list);
 		struct item_drop *ditem;
 		int drop_rate;
+		int luk = 0, itemboost = 0;
+		bool pk_bonus;
+		uint32 rolls[MAX_MOB_DROP];
 		dlist->m = md->bl.m;
 		dlist->x = md->bl.x;
 		dlist->y = md->bl.y;
@@ -2192,45 +2201,39 @@ int mob_dead(struct mob_data *md, struct block_list *src, int type)
 		dlist->third_charid = (third_sd ? third_sd->status.char_id : 0);
 		dlist->item = NULL;
 
-		for (i = 0; i < MAX_MOB_DROP; i++)
-		{
-			if (md->db->dropitem[i].nameid <= 0)
-				continue;
-			if (!itemdb_exists(md->db->dropitem[i].nameid))
-				continue;
-			drop_rate = md->db->dropitem[i].p;
-			if (drop_rate <= 0) {
-				if (battle_config.drop_rate0item)
-					continue;
-				drop_rate = 1;
-			}
+		// the same for all drops of this kill
+		if (src && (battle_config.drops_by_luk || battle_config.drops_by_luk2))
+			luk = status_get_luk(src);
+		pk_bonus = ( sd && battle_config.pk_mode && (int)(md->level - sd->status.base_level) >= 20 );
+		if (sd && sd->sc.data[SC_ITEMBOOST])
+			itemboost = sd->sc.data[SC_ITEMBOOST]->val1;
+		rnd_fast_rolls(rolls, md->db->droptable_count, 10000);
 
-			// change drops depending on monsters size [Valaris]
-			if(md->special_state.size==1 && drop_rate >= 2)
-				drop_rate/=2;
-			else if(md->special_state.size==2)
-				drop_rate*=2;
-			if (src) {
-				//Drops affected by luk as a fixed increase [Valaris]
-				if (battle_config.drops_by_luk)
-					drop_rate += status_get_luk(src)*battle_config.drops_by_luk/100;
-				//Drops affected by luk as a % increase [Skotlex] 
-				if (battle_config.drops_by_luk2)
-					drop_rate += (int)(0.5+drop_rate*status_get_luk(src)*battle_config.drops_by_luk2/10000.);
-			}
-			if (sd && battle_config.pk_mode &&
-				(int)(md->level - sd->status.base_level) >= 20)
+		for (i = 0; i < md->db->droptable_count; i++)
+		{
+			const struct mob_drop* drop = &md->db->droptable[i];
+
+			// rate with the configured adjustments and the monster size [Valaris]
+			drop_rate = drop->rate[md->special_state.size];
+
+			//Drops affected by luk as a fixed increase [Valaris]
+			if (battle_config.drops_by_luk)
+				drop_rate += luk*battle_config.drops_by_luk/100;
+			//Drops affected by luk as a % increase [Skotlex] 
+			if (battle_config.drops_by_luk2)
+				drop_rate += (int)(0.5+drop_rate*luk*battle_config.drops_by_luk2/10000.);
+			if (pk_bonus)
 				drop_rate = (int)(drop_rate*1.25); // pk_mode increase drops if 20 level difference [Valaris]
 
 			// Increase drop rate if user has SC_ITEMBOOST
-			if (sd && sd->sc.data[SC_ITEMBOOST]) // now rig the drop rate to never be over 90% unless it is originally >90%.
-				drop_rate = max(drop_rate,cap_value((int)(0.5+drop_rate*(sd->sc.data[SC_ITEMBOOST]->val1)/100.),0,9000));
+			if (itemboost) // now rig the drop rate to never be over 90% unless it is originally >90%.
+				drop_rate = max(drop_rate,cap_value((int)(0.5+drop_rate*itemboost/100.),0,9000));
 
 			// attempt to drop the item
-			if (rand() % 10000 >= drop_rate)
+			if ((int)rolls[i] >= drop_rate)
 					continue;
 
-			ditem = mob_setdropitem(md->db->dropitem[i].nameid, 1);
+			ditem = mob_setdropitem(md->db->dropitem[drop->index].nameid, 1);
 
 			//A Rare Drop Global Announce by Lupus
 			if( mvp_sd && drop_rate <= battle_config.rare_drop_announce )
@@ -2244,7 +2247,7 @@ int mob_dead(struct mob_data *md, struct block_list *src, int type)
 			}
 			// Announce first, or else ditem will be freed. [Lance]
 			// By popular demand, use base drop rate for autoloot code. [Skotlex]
-			mob_item_drop(md, dlist, ditem, 0, md->db->dropitem[i].p, homkillonly);
+			mob_item_drop(md, dlist, ditem, 0, md->db->dropitem[drop->index].p, homkillonly);
 		}
 
 		// Ore Discovery [Celest]
@@ -4273,6 +4276,48 @@ static bool mob_readdb_race2(char* fields[], int columns, int current)
 	return true;
 }
 
+/*==========================================
+ * Builds the drop table of each mob from its dropitem list:
+ * only the drops that can happen, with the rates of each size.
+ * Needs to be redone when the item db or drop_rate0item changes.
+ *------------------------------------------*/
+void mob_build_droptables(void)
+{
+	int class_, i;
+
+	for (class_ = 0; class_ < MAX_MOB_DB; class_++)
+	{
+		struct mob_db* db = mob_db_data[class_];
+		if (db == NULL)
+			continue;
+
+		db->droptable_count = 0;
+		for (i = 0; i < MAX_MOB_DROP; i++)
+		{
+			struct mob_drop* drop;
+			int rate;
+
+			if (db->dropitem[i].nameid <= 0)
+				continue;
+			if (!itemdb_exists(db->dropitem[i].nameid))
+				continue;
+			rate = db->dropitem[i].p;
+			if (rate <= 0) {
+				if (battle_config.drop_rate0item)
+					continue;
+				rate = 1;
+			}
+
+			drop = &db->droptable[db->droptable_count++];
+			drop->index = i;
+			drop->rate[0] = rate;
+			drop->rate[1] = ( rate >= 2 ) ? rate/2 : rate; // small monsters
+			drop->rate[2] = rate*2; // big monsters
+			drop->rate[3] = rate;
+		}
+	}
+}
+
 static void mob_load(void)
 {
 #ifndef TXT_ONLY
@@ -4287,6 +4332,7 @@ static void mob_load(void)
 	mob_readchatdb();
 	mob_readskilldb();
 	sv_readdb(db_path, "mob_race2_db.txt", ',', 2, 20, -1, &mob_readdb_race2);
+	mob_build_droptables();
 }
 
 void mob_reload(void)
@@ -4320,8 +4366,8 @@ int do_init_mob(void)
 	memset(mob_db_data,0,sizeof(mob_db_data)); //Clear the array
 	mob_db_data[0] = (struct mob_db*)aCalloc(1, sizeof (struct mob_db));	//This mob is used for random spawns
 	mob_makedummymobdb(0); //The first time this is invoked, it creates the dummy mob
-	item_drop_ers = ers_new(sizeof(struct item_drop));
-	item_drop_list_ers = ers_new(sizeof(struct item_drop_list));
+	item_drop_ers = ers_new(sizeof(struct item_drop), "mob_item_drop", MEMTAG_ERS);
+	item_drop_list_ers = ers_new(sizeof(struct item_drop_list), "mob_item_drop_list", MEMTAG_ERS);
 
 	mob_load();
 
@@ -85,6 +85,12 @@ struct spawn_info {
 	unsigned short mapindex;
 	unsigned short qty;
 };
+
+/// Drop of a mob that can happen, see mob_build_droptables.
+struct mob_drop {
+	short index; // in mob_db.dropitem
+	int rate[4]; // drop rate by special_state.size (normal, small, big, -)
+};
  
 struct mob_db {
 	char sprite[NAME_LENGTH],name[NAME_LENGTH],jname[NAME_LENGTH];
@@ -95,6 +101,8 @@ struct mob_db {
 	unsigned short lv;
 	struct { int nameid,p; } dropitem[MAX_MOB_DROP];
 	struct { int nameid,p; } mvpitem[3];
+	struct mob_drop droptable[MAX_MOB_DROP];
+	int droptable_count;
 	struct status_data status;
 	struct view_data vd;
 	short option;
@@ -129,6 +137,7 @@ struct mob_data {
 		unsigned int npc_killmonster: 1; //for new killmonster behavior
 		unsigned int rebirth: 1; // NPC_Rebirth used
 		unsigned int boss : 1;
+		unsigned int hibernate_spawn : 1; // respawn postponed until the map wakes up
 		enum MobSkillState skillstate;
 		unsigned char steal_flag; //number of steal tries (to prevent steal exploit on mobs with few items) [Lupus]
 		unsigned char attacked_count; //For rude attacked.
@@ -278,5 +287,6 @@ int mob_clone_spawn(struct map_session_data *sd, int m, int x, int y, const char
 int mob_clone_delete(struct mob_data *md);
 
 void mob_reload(void);
+void mob_build_droptables(void);
 
 #endif /* _MOB_H_ */
@@ -5,8 +5,10 @@
 #include "../common/timer.h"
 #include "../common/nullpo.h"
 #include "../common/malloc.h"
+#include "../common/md5calc.h"
 #include "../common/showmsg.h"
 #include "../common/strlib.h"
+#include "../common/thread.h"
 #include "../common/utils.h"
 #include "../common/ers.h"
 #include "../common/db.h"
@@ -45,6 +47,23 @@ struct npc_src_list {
 };
 static struct npc_src_list* npc_src_files = NULL;
 
+/// What was loaded from a npc source file, kept between reloads.
+/// @see npc_reload_changed
+struct npc_path_data {
+	char* path;
+	unsigned char md5[16]; // contents when it was last loaded
+	bool mapflags; // file has mapflags (they can't be unloaded)
+	bool reload; // selected by npc_reload_changed
+	int func_num;
+	struct npc_path_func {
+		char* name;
+		struct script_code* code;
+	} *func; // user functions
+};
+static DBMap* npc_path_db = NULL; // const char* path -> struct npc_path_data*
+static struct npc_path_data* npc_last_npd = NULL; // file being parsed
+static const char* npc_last_path = NULL;
+
 static int npc_id=START_NPC_NUM;
 static int npc_warp=0;
 static int npc_shop=0;
@@ -57,7 +76,7 @@ static int npc_cache_mob=0;
 /// Fatal error if nothing is available.
 int npc_get_new_npc_id(void)
 {
-	if( npc_id >= START_NPC_NUM && map_id2bl(npc_id) == NULL )
+	if( npc_id >= START_NPC_NUM && map_isfreeid(npc_id) )
 		return npc_id++;// available
 	{// find next id
 		int base_id = npc_id;
@@ -65,7 +84,7 @@ int npc_get_new_npc_id(void)
 		{
 			if( npc_id < START_NPC_NUM )
 				npc_id = START_NPC_NUM;
-			if( map_id2bl(npc_id) == NULL )
+			if( map_isfreeid(npc_id) )
 				return npc_id++;// available
 		}
 		// full loop, nothing available
@@ -795,6 +814,22 @@ int npc_event(struct map_session_data* sd, const char* eventname, int ontouch)
 	return npc_event_sub(sd,ev,eventname);
 }
 
+/// Touch areas (warps and OnTouch npcs) are indexed per block of the map,
+/// so a step on a CELL_NPC cell only looks at the npcs whose area overlaps
+/// the block instead of every npc of the map.
+struct npc_touch_block {
+	struct npc_data** nd;
+	int count, max;
+};
+
+/// Returns the touch areas over the block of a cell, or NULL if there are none.
+static struct npc_touch_block* npc_touch_block(int m, int x, int y)
+{
+	if( map[m].npc_touch == NULL || x < 0 || y < 0 || x >= map[m].xs || y >= map[m].ys )
+		return NULL;
+	return &map[m].npc_touch[x/BLOCK_SIZE + (y/BLOCK_SIZE)*map[m].bxs];
+}
+
 int npc_touch_areanpc_sub(struct block_list *bl, va_list ap)
 {
 	struct map_session_data *sd;
@@ -850,6 +885,8 @@ int npc_touchnext_areanpc(struct map_session_data* sd, bool leavemap)
  *------------------------------------------*/
 int npc_touch_areanpc(struct map_session_data* sd, int m, int x, int y)
 {
+	struct npc_touch_block* tb;
+	struct npc_data* nd;
 	int xs,ys;
 	int f = 1;
 	int i;
@@ -860,43 +897,45 @@ int npc_touch_areanpc(struct map_session_data* sd, int m, int x, int y)
 	//if(sd->npc_id)
 	//	return 1;
 
-	for(i=0;i<map[m].npc_num;i++)
+	tb = npc_touch_block(m, x, y);
+	for(i=0;tb && i<tb->count;i++)
 	{
-		if (map[m].npc[i]->sc.option&OPTION_INVISIBLE) {
+		nd = tb->nd[i];
+		if (nd->sc.option&OPTION_INVISIBLE) {
 			f=0; // a npc was found, but it is disabled; don't print warning
 			continue;
 		}
 
-		switch(map[m].npc[i]->subtype) {
+		switch(nd->subtype) {
 		case WARP:
-			xs=map[m].npc[i]->u.warp.xs;
-			ys=map[m].npc[i]->u.warp.ys;
+			xs=nd->u.warp.xs;
+			ys=nd->u.warp.ys;
 			break;
 		case SCRIPT:
-			xs=map[m].npc[i]->u.scr.xs;
-			ys=map[m].npc[i]->u.scr.ys;
+			xs=nd->u.scr.xs;
+			ys=nd->u.scr.ys;
 			break;
 		default:
 			continue;
 		}
-		if( x >= map[m].npc[i]->bl.x-xs && x <= map[m].npc[i]->bl.x+xs
-		&&  y >= map[m].npc[i]->bl.y-ys && y <= map[m].npc[i]->bl.y+ys )
+		if( x >= nd->bl.x-xs && x <= nd->bl.x+xs
+		&&  y >= nd->bl.y-ys && y <= nd->bl.y+ys )
 			break;
 	}
-	if( i == map[m].npc_num )
+	if( tb == NULL || i == tb->count )
 	{
 		if( f == 1 ) // no npc found
 			ShowError("npc_touch_areanpc : stray NPC cell on coordinates '%s',%d,%d\n", map[m].name, x, y);
 		return 1;
 	}
-	switch(map[m].npc[i]->subtype) {
+	switch(nd->subtype) {
 		case WARP:
 			if( pc_ishiding(sd) )
 				break; // hidden chars cannot use warps
-			pc_setpos(sd,map[m].npc[i]->u.warp.mapindex,map[m].npc[i]->u.warp.x,map[m].npc[i]->u.warp.y,CLR_OUTSIGHT);
+			pc_setpos(sd,nd->u.warp.mapindex,nd->u.warp.x,nd->u.warp.y,CLR_OUTSIGHT);
 			break;
 		case SCRIPT:
-			if( npc_ontouch_event(sd,map[m].npc[i]) > 0 && npc_ontouch2_event(sd,map[m].npc[i]) > 0 )
+			if( npc_ontouch_event(sd,nd) > 0 && npc_ontouch2_event(sd,nd) > 0 )
 			{ // failed to run OnTouch event, so just click the npc
 				struct unit_data *ud = unit_bl2ud(&sd->bl);
 				if( ud && ud->walkpath.path_pos < ud->walkpath.path_len )
@@ -904,8 +943,8 @@ int npc_touch_areanpc(struct map_session_data* sd, int m, int x, int y)
 					clif_fixpos(&sd->bl);
 					ud->walkpath.path_pos = ud->walkpath.path_len;
 				}
-				sd->areanpc_id = map[m].npc[i]->bl.id;
-				npc_click(sd,map[m].npc[i]);
+				sd->areanpc_id = nd->bl.id;
+				npc_click(sd,nd);
 			}
 			break;
 	}
@@ -919,47 +958,50 @@ int npc_touch_areanpc2(struct mob_data *md)
 	int i, m = md->bl.m, x = md->bl.x, y = md->bl.y, id;
 	char eventname[EVENT_NAME_LENGTH];
 	struct event_data* ev;
+	struct npc_touch_block* tb = npc_touch_block(m, x, y);
+	struct npc_data* nd;
 	int xs, ys;
 
-	for( i = 0; i < map[m].npc_num; i++ )
+	for( i = 0; tb && i < tb->count; i++ )
 	{
-		if( map[m].npc[i]->sc.option&OPTION_INVISIBLE )
+		nd = tb->nd[i];
+		if( nd->sc.option&OPTION_INVISIBLE )
 			continue;
 
-		switch( map[m].npc[i]->subtype )
+		switch( nd->subtype )
 		{
 			case WARP:
 				if( !( battle_config.mob_warp&1 ) )
 					continue;
-				xs = map[m].npc[i]->u.warp.xs;
-				ys = map[m].npc[i]->u.warp.ys;
+				xs = nd->u.warp.xs;
+				ys = nd->u.warp.ys;
 				break;
 			case SCRIPT:
-				xs = map[m].npc[i]->u.scr.xs;
-				ys = map[m].npc[i]->u.scr.ys;
+				xs = nd->u.scr.xs;
+				ys = nd->u.scr.ys;
 				break;
 			default:
 				continue; // Keep Searching
 		}
 
-		if( x >= map[m].npc[i]->bl.x-xs && x <= map[m].npc[i]->bl.x+xs && y >= map[m].npc[i]->bl.y-ys && y <= map[m].npc[i]->bl.y+ys )
+		if( x >= nd->bl.x-xs && x <= nd->bl.x+xs && y >= nd->bl.y-ys && y <= nd->bl.y+ys )
 		{ // In the npc touch area
-			switch( map[m].npc[i]->subtype )
+			switch( nd->subtype )
 			{
 				case WARP:
-					xs = map_mapindex2mapid(map[m].npc[i]->u.warp.mapindex);
+					xs = map_mapindex2mapid(nd->u.warp.mapindex);
 					if( m < 0 )
 						break; // Cannot Warp between map servers
-					if( unit_warp(&md->bl, xs, map[m].npc[i]->u.warp.x, map[m].npc[i]->u.warp.y, CLR_OUTSIGHT) == 0 )
+					if( unit_warp(&md->bl, xs, nd->u.warp.x, nd->u.warp.y, CLR_OUTSIGHT) == 0 )
 						return 1; // Warped
 					break;
 				case SCRIPT:
-					if( map[m].npc[i]->bl.id == md->areanpc_id )
+					if( nd->bl.id == md->areanpc_id )
 						break; // Already touch this NPC
-					snprintf(eventname, ARRAYLENGTH(eventname), "%s::OnTouchNPC", map[m].npc[i]->exname);
+					snprintf(eventname, ARRAYLENGTH(eventname), "%s::OnTouchNPC", nd->exname);
 					if( (ev = (struct event_data*)strdb_get(ev_db, eventname)) == NULL || ev->nd == NULL )
 						break; // No OnTouchNPC Event
-					md->areanpc_id = map[m].npc[i]->bl.id;
+					md->areanpc_id = nd->bl.id;
 					id = md->bl.id; // Stores Unique ID
 					run_script(ev->nd->u.scr.script, ev->pos, md->bl.id, ev->nd->bl.id);
 					if( map_id2md(id) == NULL ) return 1; // Not Warped, but killed
@@ -1731,6 +1773,101 @@ void npc_delsrcfile(const char* name)
 	}
 }
 
+/// Returns the information of a npc source file, creating it if needed.
+static struct npc_path_data* npc_path_get(const char* path)
+{
+	struct npc_path_data* npd = (struct npc_path_data*)strdb_get(npc_path_db, path);
+
+	if( npd == NULL )
+	{
+		CREATE(npd, struct npc_path_data, 1);
+		npd->path = aStrdup(path);
+		strdb_put(npc_path_db, npd->path, npd);
+	}
+	return npd;
+}
+
+/// Forgets what was loaded from the file.
+static void npc_path_clear(struct npc_path_data* npd)
+{
+	int i;
+
+	for( i = 0; i < npd->func_num; ++i )
+		aFree(npd->func[i].name);
+	aFree(npd->func);
+	npd->func = NULL;
+	npd->func_num = 0;
+	npd->mapflags = false;
+}
+
+/// Starts tracking what is loaded from a npc source file.
+static struct npc_path_data* npc_path_begin(const char* path, const char* buffer)
+{
+	struct npc_path_data* npd = npc_path_get(path);
+
+	npc_path_clear(npd);
+	MD5_Binary(buffer, npd->md5);
+	return npd;
+}
+
+static int npc_path_final_sub(DBKey key, void* data, va_list ap)
+{
+	struct npc_path_data* npd = (struct npc_path_data*)data;
+
+	npc_path_clear(npd);
+	aFree(npd->path);
+	aFree(npd);
+	return 0;
+}
+
+/// Computes the md5 of the current contents of a npc source file.
+/// Reads the whole file to a buffer.
+/// Returns NULL if the file can't be read.
+static char* npc_readsrcfile(const char* filepath, size_t* out_len, bool report)
+{
+	FILE* fp;
+	size_t len;
+	char* buffer;
+
+	fp = fopen(filepath, "rb");
+	if( fp == NULL )
+	{
+		if( report )
+			ShowError("npc_parsesrcfile: File not found '%s'.\n", filepath);
+		return NULL;
+	}
+	len = filesize(fp);
+	buffer = (char*)aMalloc(len+1);
+	len = fread(buffer, sizeof(char), len, fp);
+	buffer[len] = '\0';
+	if( ferror(fp) )
+	{
+		if( report )
+			ShowError("npc_parsesrcfile: Failed to read file '%s' - %s\n", filepath, strerror(errno));
+		aFree(buffer);
+		fclose(fp);
+		return NULL;
+	}
+	fclose(fp);
+
+	*out_len = len;
+	return buffer;
+}
+
+static bool npc_srcfile_md5(const char* filepath, unsigned char* md5)
+{
+	size_t len;
+	char* buffer;
+
+	buffer = npc_readsrcfile(filepath, &len, false);
+	if( buffer == NULL )
+		return false;
+
+	MD5_Binary(buffer, md5);
+	aFree(buffer);
+	return true;
+}
+
 /// Parses and sets the name and exname of a npc.
 /// Assumes that m, x and y are already set in nd.
 static void npc_parsename(struct npc_data* nd, const char* name, const char* start, const char* buffer, const char* filepath)
@@ -1803,7 +1940,7 @@ struct npc_data* npc_add_warp(short from_mapid, short from_x, short from_y, shor
 	int i;
 	struct npc_data *nd;
 
-	CREATE(nd, struct npc_data, 1);
+	CREATE_TAG(nd, struct npc_data, 1, MEMTAG_NPC);
 	nd->bl.id = npc_get_new_npc_id();
 	map_addnpc(from_mapid, nd);
 	nd->bl.prev = nd->bl.next = NULL;
@@ -1864,7 +2001,7 @@ static const char* npc_parse_warp(char* w1, char* w2, char* w3, char* w4, const
 		return strchr(start,'\n');// skip and continue
 	}
 
-	CREATE(nd, struct npc_data, 1);
+	CREATE_TAG(nd, struct npc_data, 1, MEMTAG_NPC);
 
 	nd->bl.id = npc_get_new_npc_id();
 	map_addnpc(m, nd);
@@ -1873,6 +2010,7 @@ static const char* npc_parse_warp(char* w1, char* w2, char* w3, char* w4, const
 	nd->bl.x = x;
 	nd->bl.y = y;
 	npc_parsename(nd, w3, start, buffer, filepath);
+	nd->path = npc_last_path;
 
 	if (!battle_config.warp_point_debug)
 		nd->class_ = WARP_CLASS;
@@ -1976,8 +2114,8 @@ static const char* npc_parse_shop(char* w1, char* w2, char* w3, char* w4, const
 		return strchr(start,'\n');// continue
 	}
 
-	CREATE(nd, struct npc_data, 1);
-	CREATE(nd->u.shop.shop_item, struct npc_item_list, i);
+	CREATE_TAG(nd, struct npc_data, 1, MEMTAG_NPC);
+	CREATE_TAG(nd->u.shop.shop_item, struct npc_item_list, i, MEMTAG_NPC);
 	memcpy(nd->u.shop.shop_item, items, sizeof(struct npc_item_list)*i);
 	nd->u.shop.count = i;
 	nd->bl.prev = nd->bl.next = NULL;
@@ -1986,6 +2124,7 @@ static const char* npc_parse_shop(char* w1, char* w2, char* w3, char* w4, const
 	nd->bl.y = y;
 	nd->bl.id = npc_get_new_npc_id();
 	npc_parsename(nd, w3, start, buffer, filepath);
+	nd->path = npc_last_path;
 	nd->class_ = m==-1?-1:atoi(w4);
 	nd->speed = 200;
 
@@ -2057,7 +2196,8 @@ int npc_convertlabel_db(DBKey key, void* data, va_list ap)
 }
 
 // Skip the contents of a script.
-static const char* npc_skip_script(const char* start, const char* buffer, const char* filepath)
+// Errors are only shown if report is set.
+static const char* npc_skip_script2(const char* start, const char* buffer, const char* filepath, bool report)
 {
 	const char* p;
 	int curly_count;
@@ -2069,7 +2209,8 @@ static const char* npc_skip_script(const char* start, const char* buffer, const
 	p = strchr(start,'{');
 	if( p == NULL )
 	{
-		ShowError("npc_skip_script: Missing left curly in file '%s', line'%d'.", filepath, strline(buffer,start-buffer));
+		if( report )
+			ShowError("npc_skip_script: Missing left curly in file '%s', line'%d'.", filepath, strline(buffer,start-buffer));
 		return NULL;// can't continue
 	}
 
@@ -2093,19 +2234,22 @@ static const char* npc_skip_script(const char* start, const char* buffer, const
 					++p;// escape sequence (not part of a multibyte character)
 				else if( *p == '\0' )
 				{
-					script_error(buffer, filepath, 0, "Unexpected end of string.", p);
+					if( report )
+						script_error(buffer, filepath, 0, "Unexpected end of string.", p);
 					return NULL;// can't continue
 				}
 				else if( *p == '\n' )
 				{
-					script_error(buffer, filepath, 0, "Unexpected newline at string.", p);
+					if( report )
+						script_error(buffer, filepath, 0, "Unexpected newline at string.", p);
 					return NULL;// can't continue
 				}
 			}
 		}
 		else if( *p == '\0' )
 		{// end of buffer
-			ShowError("Missing %d right curlys at file '%s', line '%d'.\n", curly_count, filepath, strline(buffer,p-buffer));
+			if( report )
+				ShowError("Missing %d right curlys at file '%s', line '%d'.\n", curly_count, filepath, strline(buffer,p-buffer));
 			return NULL;// can't continue
 		}
 	}
@@ -2113,6 +2257,11 @@ static const char* npc_skip_script(const char* start, const char* buffer, const
 	return p+1;// return after the last '}'
 }
 
+static const char* npc_skip_script(const char* start, const char* buffer, const char* filepath)
+{
+	return npc_skip_script2(start, buffer, filepath, true);
+}
+
 /// Parses a npc script.
 ///
 /// -%TAB%script%TAB%<NPC Name>%TAB%-1,{<code>}
@@ -2170,7 +2319,7 @@ static const char* npc_parse_script(char* w1, char* w2, char* w3, char* w4, cons
 		label_db->clear(label_db, NULL); // not needed anymore, so clear the db
 	}
 
-	CREATE(nd, struct npc_data, 1);
+	CREATE_TAG(nd, struct npc_data, 1, MEMTAG_NPC);
 
 	if( sscanf(w4, "%d,%d,%d", &class_, &xs, &ys) == 3 )
 	{// OnTouch area defined
@@ -2190,6 +2339,7 @@ static const char* npc_parse_script(char* w1, char* w2, char* w3, char* w4, cons
 	nd->bl.y = y;
 	npc_parsename(nd, w3, start, buffer, filepath);
 	nd->bl.id = npc_get_new_npc_id();
+	nd->path = npc_last_path;
 	nd->class_ = class_;
 	nd->speed = 200;
 	nd->u.scr.script = script;
@@ -2338,7 +2488,7 @@ const char* npc_parse_duplicate(char* w1, char* w2, char* w3, char* w4, const ch
 		return end;// next line, try to continue
 	}
 
-	CREATE(nd, struct npc_data, 1);
+	CREATE_TAG(nd, struct npc_data, 1, MEMTAG_NPC);
 
 	nd->bl.prev = nd->bl.next = NULL;
 	nd->bl.m = m;
@@ -2349,6 +2499,7 @@ const char* npc_parse_duplicate(char* w1, char* w2, char* w3, char* w4, const ch
 	nd->class_ = class_;
 	nd->speed = 200;
 	nd->src_id = src_id;
+	nd->path = npc_last_path;
 	nd->bl.type = BL_NPC;
 	nd->subtype = (enum npc_subtype)type;
 	switch( type )
@@ -2489,7 +2640,7 @@ int npc_duplicate4instance(struct npc_data *snd, int m)
 			return 1;
 		}
 
-		CREATE(wnd, struct npc_data, 1);
+		CREATE_TAG(wnd, struct npc_data, 1, MEMTAG_NPC);
 		wnd->bl.id = npc_get_new_npc_id();
 		map_addnpc(m, wnd);
 		wnd->bl.prev = wnd->bl.next = NULL;
@@ -2535,6 +2686,59 @@ int npc_duplicate4instance(struct npc_data *snd, int m)
 	return 0;
 }
 
+/// Adds (flag true) or removes the npc in the touch index of the blocks its area overlaps.
+static void npc_touch_index(struct npc_data* nd, int xs, int ys, bool flag)
+{
+	int m = nd->bl.m;
+	int bx0 = max(nd->bl.x - xs, 0)/BLOCK_SIZE, bx1 = min(nd->bl.x + xs, map[m].xs - 1)/BLOCK_SIZE;
+	int by0 = max(nd->bl.y - ys, 0)/BLOCK_SIZE, by1 = min(nd->bl.y + ys, map[m].ys - 1)/BLOCK_SIZE;
+	int bx, by, i;
+
+	if( map[m].npc_touch == NULL )
+	{
+		if( !flag )
+			return;
+		CREATE(map[m].npc_touch, struct npc_touch_block, map[m].bxs*map[m].bys);
+	}
+
+	for( by = by0; by <= by1; by++ )
+	{
+		for( bx = bx0; bx <= bx1; bx++ )
+		{
+			struct npc_touch_block* tb = &map[m].npc_touch[bx + by*map[m].bxs];
+
+			ARR_FIND(0, tb->count, i, tb->nd[i] == nd);
+			if( flag && i == tb->count )
+			{
+				if( tb->count == tb->max )
+				{
+					tb->max += 4;
+					RECREATE(tb->nd, struct npc_data*, tb->max);
+				}
+				tb->nd[tb->count++] = nd;
+			}
+			else if( !flag && i < tb->count )
+			{// keep the order, the first matching area wins
+				tb->count--;
+				memmove(&tb->nd[i], &tb->nd[i+1], (tb->count - i)*sizeof(tb->nd[0]));
+			}
+		}
+	}
+}
+
+/// Frees the touch index of a map.
+void npc_freetouch(int m)
+{
+	int i;
+
+	if( map[m].npc_touch == NULL )
+		return;
+	for( i = 0; i < map[m].bxs*map[m].bys; i++ )
+		aFree(map[m].npc_touch[i].nd);
+	aFree(map[m].npc_touch);
+	map[m].npc_touch = NULL;
+}
+
 void npc_setcells(struct npc_data* nd)
 {
 	int m = nd->bl.m, x = nd->bl.x, y = nd->bl.y, xs, ys;
@@ -2564,6 +2768,7 @@ void npc_setcells(struct npc_data* nd)
 			map_setcell(m, j, i, CELL_NPC, true);
 		}
 	}
+	npc_touch_index(nd, xs, ys, true);
 }
 
 int npc_unsetcells_sub(struct block_list* bl, va_list ap)
@@ -2602,6 +2807,7 @@ void npc_unsetcells(struct npc_data* nd)
 	for (i = y-ys; i <= y+ys; i++)
 		for (j = x-xs; j <= x+xs; j++)
 			map_setcell(m, j, i, CELL_NPC, false);
+	npc_touch_index(nd, xs, ys, false);
 
 	//Re-deploy NPC cells for other nearby npcs.
 	map_foreachinarea( npc_unsetcells_sub, m, x0, y0, x1, y1, BL_NPC, nd->bl.id );
@@ -2686,6 +2892,15 @@ static const char* npc_parse_function(char* w1, char* w2, char* w3, char* w4, co
 		aFree(oldscript);
 	}
 
+	if( npc_last_npd != NULL )
+	{// remember where it came from
+		struct npc_path_data* npd = npc_last_npd;
+		RECREATE(npd->func, struct npc_path_func, npd->func_num+1);
+		npd->func[npd->func_num].name = aStrdup(w3);
+		npd->func[npd->func_num].code = script;
+		npd->func_num++;
+	}
+
 	return end;
 }
 
@@ -2810,6 +3025,8 @@ static const char* npc_parse_mob(char* w1, char* w2, char* w3, char* w4, const c
 	else
 		safestrncpy(mob.name, w3, sizeof(mob.name));
 
+	mob.path = npc_last_path;
+
 	//Verify dataset.
 	if( !mob_parse_dataset(&mob) )
 	{
@@ -2894,6 +3111,9 @@ static const char* npc_parse_mapflag(char* w1, char* w2, char* w3, char* w4, con
 		return strchr(start,'\n');// skip and continue
 	}
 
+	if( npc_last_npd != NULL )
+		npc_last_npd->mapflags = true;
+
 	if (w4 && !strcmpi(w4, "off"))
 		state = 0;	//Disable mapflag rather than enable it. [Skotlex]
 	
@@ -3135,35 +3355,15 @@ static const char* npc_parse_mapflag(char* w1, char* w2, char* w3, char* w4, con
 	return strchr(start,'\n');// continue
 }
 
-void npc_parsesrcfile(const char* filepath)
+/// Parses the contents of a npc file.
+static void npc_parsesrcbuffer(const char* filepath, const char* buffer, size_t len)
 {
 	int m, lines = 0;
-	FILE* fp;
-	size_t len;
-	char* buffer;
 	const char* p;
 
-	// read whole file to buffer
-	fp = fopen(filepath, "rb");
-	if( fp == NULL )
-	{
-		ShowError("npc_parsesrcfile: File not found '%s'.\n", filepath);
-		return;
-	}
-	len = filesize(fp);
-	buffer = (char*)aMalloc(len+1);
-	len = fread(buffer, sizeof(char), len, fp);
-	buffer[len] = '\0';
-	if( ferror(fp) )
-	{
-		ShowError("npc_parsesrcfile: Failed to read file '%s' - %s\n", filepath, strerror(errno));
-		aFree(buffer);
-		fclose(fp);
-		return;
-	}
-	fclose(fp);
-
-	// parse buffer
+	npc_last_npd = npc_path_begin(filepath, buffer);
+	npc_last_path = npc_last_npd->path;
+	script_cache_begin(filepath, buffer);
 	for( p = skip_space(buffer); p && *p ; p = skip_space(p) )
 	{
 		int pos[9];
@@ -3279,9 +3479,184 @@ void npc_parsesrcfile(const char* filepath)
 			p = strchr(p,'\n');// skip and continue
 		}
 	}
+	script_cache_end();
+	npc_last_npd = NULL;
+	npc_last_path = NULL;
+}
+
+void npc_parsesrcfile(const char* filepath)
+{
+	size_t len;
+	char* buffer;
+
+	buffer = npc_readsrcfile(filepath, &len, true);
+	if( buffer == NULL )
+		return;
+	npc_parsesrcbuffer(filepath, buffer, len);
 	aFree(buffer);
+}
+
+/// Npc file that is read and compiled by a worker thread.
+struct npc_parse_job {
+	const char* filepath;
+	char* buffer; // NULL if the file can't be read
+	size_t len;
+	struct script_precompiled* scripts;
+	bool done;
+};
+
+/// Worker threads of npc_parsesrcfiles.
+static struct {
+	struct npc_parse_job* jobs;
+	int count;
+	int next; // next job for a worker
+	Mutex* mutex;
+	Cond* cond; // signaled when a job is done
+} npc_parse_pool;
+
+/// Compiles the scripts that npc_parsesrcbuffer will find in the file.
+/// Runs in a worker thread, so it must not change anything else.
+static void npc_precompilesrcfile(struct npc_parse_job* job)
+{
+	const char* p;
+	const char* start;
+	const char* end;
+	int pos[9];
+	int count;
+	bool is_function;
+
+	job->buffer = npc_readsrcfile(job->filepath, &job->len, false);
+	if( job->buffer == NULL )
+		return;// npc_parsesrcfile will report it
+
+	for( p = skip_space(job->buffer); p && *p; p = skip_space(p) )
+	{
+		// w1<TAB>w2<TAB>w3<TAB>w4
+		count = sv_parse(p, job->len+job->buffer-p, 0, '\t', pos, ARRAYLENGTH(pos), (e_svopt)(SV_TERMINATE_LF|SV_TERMINATE_CRLF));
+		if( count < 0 )
+			break;
+		if( count > 3 && pos[5]-pos[4] == 6 && strncasecmp(p+pos[4], "script", 6) == 0 )
+		{
+			is_function = ( pos[3]-pos[2] == 8 && strncasecmp(p+pos[2], "function", 8) == 0 );
+			start = strstr(p, is_function ? "\t{" : ",{");
+			end = strchr(p, '\n');
+			if( start != NULL && (end == NULL || start < end) )
+			{// same options as npc_parse_function and npc_parse_script
+				++start;
+				script_precompile(&job->scripts, start, is_function ? SCRIPT_RETURN_EMPTY_SCRIPT : SCRIPT_USE_LABEL_DB);
+				p = npc_skip_script2(start, job->buffer, job->filepath, false);
+				continue;
+			}
+		}
+		p = strchr(p, '\n');// next line
+	}
+}
+
+static void* npc_parse_worker(void* param)
+{
+	int i;
+
+	showmsg_discard(true);
+	script_precompile_threadinit();
+	for( ;; )
+	{
+		mutex_lock(npc_parse_pool.mutex);
+		i = npc_parse_pool.next++;
+		mutex_unlock(npc_parse_pool.mutex);
+		if( i >= npc_parse_pool.count )
+			break;
+
+		npc_precompilesrcfile(&npc_parse_pool.jobs[i]);
+
+		mutex_lock(npc_parse_pool.mutex);
+		npc_parse_pool.jobs[i].done = true;
+		cond_broadcast(npc_parse_pool.cond);
+		mutex_unlock(npc_parse_pool.mutex);
+	}
+	script_precompile_threadfinal();
+	return NULL;
+}
+
+/// Loads all npc files.
+/// The scripts are compiled in advance by worker threads, everything else
+/// (including linking the compiled scripts) is done here in file order.
+static void npc_parsesrcfiles(void)
+{
+	struct npc_src_list* file;
+	struct npc_parse_job* job;
+	Thread* workers[64];
+	int num_workers, i;
+
+	num_workers = script_config.script_parse_threads;
+	if( num_workers == 0 )
+		num_workers = thread_cpucount();
+	num_workers = cap_value(num_workers, 1, ARRAYLENGTH(workers));
+
+	memset(&npc_parse_pool, 0, sizeof(npc_parse_pool));
+	for( file = npc_src_files; file != NULL; file = file->next )
+		npc_parse_pool.count++;
+
+	if( num_workers == 1 || npc_parse_pool.count == 0 )
+	{// single-threaded
+		for( file = npc_src_files; file != NULL; file = file->next )
+		{
+			ShowStatus("Loading NPC file: %s"CL_CLL"\r", file->name);
+			npc_parsesrcfile(file->name);
+		}
+		return;
+	}
+
+	CREATE(npc_parse_pool.jobs, struct npc_parse_job, npc_parse_pool.count);
+	for( i = 0, file = npc_src_files; file != NULL; file = file->next, ++i )
+		npc_parse_pool.jobs[i].filepath = file->name;
+	npc_parse_pool.mutex = mutex_create();
+	npc_parse_pool.cond = cond_create();
+
+	malloc_set_threaded(true);
+	script_precompile_init();
+	for( i = 0; i < num_workers; ++i )
+	{
+		workers[i] = thread_create(npc_parse_worker, NULL);
+		if( workers[i] == NULL )
+			break;
+	}
+	num_workers = i;
+	if( num_workers == 0 )
+	{// no workers, parse everything here
+		for( i = 0; i < npc_parse_pool.count; ++i )
+			npc_parse_pool.jobs[i].done = true;
+	}
+
+	for( i = 0; i < npc_parse_pool.count; ++i )
+	{
+		job = &npc_parse_pool.jobs[i];
+		mutex_lock(npc_parse_pool.mutex);
+		while( !job->done )
+			cond_wait(npc_parse_pool.cond, npc_parse_pool.mutex, -1);
+		mutex_unlock(npc_parse_pool.mutex);
+
+		ShowStatus("Loading NPC file: %s"CL_CLL"\r", job->filepath);
+		if( job->buffer == NULL )
+		{
+			script_precompiled_free(job->scripts);
+			npc_parsesrcfile(job->filepath);
+			continue;
+		}
+		script_precompiled_begin(job->scripts);
+		npc_parsesrcbuffer(job->filepath, job->buffer, job->len);
+		script_precompiled_end();
+		aFree(job->buffer);
+	}
+
+	for( i = 0; i < num_workers; ++i )
+		thread_wait(workers[i], NULL);
+	script_precompile_final();
+	malloc_set_threaded(false);
 
-	return;
+	mutex_destroy(npc_parse_pool.mutex);
+	cond_destroy(npc_parse_pool.cond);
+	aFree(npc_parse_pool.jobs);
+	memset(&npc_parse_pool, 0, sizeof(npc_parse_pool));
 }
 
 int npc_script_event(struct map_session_data* sd, enum npce_event type)
@@ -3357,7 +3732,6 @@ void npc_read_event_script(void)
 
 int npc_reload(void)
 {
-	struct npc_src_list *nsl;
 	int m, i;
 	int npc_new_min = npc_id;
 	struct s_mapiterator* iter;
@@ -3384,6 +3758,7 @@ int npc_reload(void)
 		for (m = 0; m < map_num; m++) {
 			for (i = 0; i < MAX_MOB_LIST_PER_MAP; i++) {
 				if (map[m].moblist[i] != NULL) {
+					aFree(map[m].moblist[i]->walkcell.xy);
 					aFree(map[m].moblist[i]);
 					map[m].moblist[i] = NULL;
 				}
@@ -3412,11 +3787,8 @@ int npc_reload(void)
 
 	//TODO: the following code is copy-pasted from do_init_npc(); clean it up
 	// Reloading npcs now
-	for (nsl = npc_src_files; nsl; nsl = nsl->next)
-	{
-		ShowStatus("Loading NPC file: %s"CL_CLL"\r", nsl->name);
-		npc_parsesrcfile(nsl->name);
-	}
+	npc_parsesrcfiles();
+	script_cache_save();
 
 	ShowInfo ("Done loading '"CL_WHITE"%d"CL_RESET"' NPCs:"CL_CLL"\n"
 		"\t-'"CL_WHITE"%d"CL_RESET"' Warps\n"
@@ -3443,6 +3815,316 @@ int npc_reload(void)
 	return 0;
 }
 
+/// Removes qty monsters of a spawn from the mob spawn lookup database.
+static void npc_remove_spawninfo(struct spawn_data* spawn, int qty)
+{
+	struct mob_db* db = mob_db(spawn->class_);
+	struct spawn_info tmp;
+	int i;
+
+	ARR_FIND( 0, ARRAYLENGTH(db->spawn), i, db->spawn[i].mapindex == map[spawn->m].index );
+	if( i == ARRAYLENGTH(db->spawn) )
+		return;// not listed
+
+	if( db->spawn[i].qty <= qty )
+	{// remove from list
+		memmove(&db->spawn[i], &db->spawn[i+1], sizeof(db->spawn) - (i+1)*sizeof(db->spawn[0]));
+		memset(&db->spawn[ARRAYLENGTH(db->spawn)-1], 0, sizeof(db->spawn[0]));
+		return;
+	}
+
+	//Update total and re-sort list
+	db->spawn[i].qty -= qty;
+	for( ; i+1 < ARRAYLENGTH(db->spawn) && db->spawn[i+1].qty > db->spawn[i].qty; ++i )
+	{
+		tmp = db->spawn[i];
+		db->spawn[i] = db->spawn[i+1];
+		db->spawn[i+1] = tmp;
+	}
+}
+
+/// Returns true if the npc, mob spawn, ... came from a file selected by npc_reload_changed.
+static bool npc_path_isreloading(const char* path)
+{
+	struct npc_path_data* npd;
+
+	if( path == NULL )
+		return false;
+	npd = (struct npc_path_data*)strdb_get(npc_path_db, path);
+	return ( npd != NULL && npd->reload );
+}
+
+/// Returns true if the npc has to be unloaded together with the npcs in unload_db.
+static bool npc_reload_isdependent(struct npc_data* nd, DBMap* unload_db)
+{
+	int instance_id, src_id;
+
+	if( nd->src_id && idb_exists(unload_db, nd->src_id) )
+		return true;// duplicate
+	if( sscanf(nd->exname, "dup_%d_%d", &instance_id, &src_id) == 2 && idb_exists(unload_db, src_id) )
+		return true;// instance copy (see npc_duplicate4instance)
+	return false;
+}
+
+static int npc_reload_instance_sub(struct block_list* bl, va_list ap)
+{
+	struct npc_data* nd = (struct npc_data*)bl;
+	int m = va_arg(ap, int);
+	int npc_new_min = va_arg(ap, int);
+
+	if( nd->bl.id >= npc_new_min )
+		npc_duplicate4instance(nd, m);
+	return 0;
+}
+
+static int npc_event_doall_reload_sub(DBKey key, void* data, va_list ap)
+{
+	struct event_data* ev = (struct event_data*)data;
+	const char* p = strchr(key.str, ':');
+	int* c = va_arg(ap, int*);
+	const char* name = va_arg(ap, const char*);
+	int npc_new_min = va_arg(ap, int);
+
+	if( p && strcmpi(name, p) == 0 && ev->nd->bl.id >= npc_new_min )
+	{
+		run_script(ev->nd->u.scr.script,ev->pos,0,ev->nd->bl.id);
+		(*c)++;
+	}
+	return 0;
+}
+
+/// Runs the specified event (global only) on the npcs that were loaded by npc_reload_changed.
+static int npc_event_doall_reload(const char* name, int npc_new_min)
+{
+	int c = 0;
+	char buf[64];
+
+	safesnprintf(buf, sizeof(buf), "::%s", name);
+	ev_db->foreach(ev_db,npc_event_doall_reload_sub,&c,buf,npc_new_min);
+	return c;
+}
+
+/// Reloads the npc files that changed since they were loaded.
+/// The npcs, events, user functions and mob spawns of those files are replaced.
+/// Files with duplicates of npcs that are reloaded are reloaded as well.
+/// Untouched npcs keep their state (timers, variables, ...) and reloaded npcs
+/// keep their '.' variables if the unique name didn't change.
+/// Mapflags can't be unloaded, so modified files with mapflags trigger a full reload.
+/// @return number of files that were reloaded
+int npc_reload_changed(void)
+{
+	struct npc_src_list* nsl;
+	struct npc_path_data* npd;
+	struct npc_data* nd;
+	struct map_session_data* sd;
+	struct s_mapiterator* iter;
+	struct block_list* bl;
+	DBIterator* dbi;
+	DBKey key;
+	DBMap* unload_db; // int id -> struct npc_data*
+	DBMap* vars_db; // const char* exname -> struct linkdb_node*
+	struct linkdb_node* vars;
+	struct script_code** code_list = NULL; // code being freed
+	int code_num = 0, npc_code_num;
+	int file_num = 0, npc_num = 0;
+	int npc_new_min = npc_id;
+	int i, j, m;
+	bool changed;
+	unsigned char md5[16];
+
+	// select the modified files
+	dbi = db_iterator(npc_path_db);
+	for( npd = (struct npc_path_data*)dbi->first(dbi,NULL); dbi->exists(dbi); npd = (struct npc_path_data*)dbi->next(dbi,NULL) )
+		npd->reload = false;
+	dbi_destroy(dbi);
+
+	for( nsl = npc_src_files; nsl != NULL; nsl = nsl->next )
+	{
+		npd = npc_path_get(nsl->name);
+		if( npc_srcfile_md5(nsl->name, md5) && memcmp(md5, npd->md5, sizeof(md5)) == 0 )
+			continue;// unchanged
+
+		if( npd->mapflags )
+		{
+			ShowInfo("npc_reload_changed: '%s' has mapflags, reloading all npc files...\n", nsl->name);
+			script_reload();
+			npc_reload();
+			for( file_num = 0, nsl = npc_src_files; nsl != NULL; nsl = nsl->next )
+				file_num++;
+			return file_num;
+		}
+		npd->reload = true;
+	}
+
+	// npcs of the selected files and everything that depends on them
+	unload_db = idb_alloc(DB_OPT_BASE);
+	do
+	{
+		changed = false;
+		iter = mapit_geteachnpc();
+		for( bl = (struct block_list*)mapit_first(iter); mapit_exists(iter); bl = (struct block_list*)mapit_next(iter) )
+		{
+			nd = (struct npc_data*)bl;
+			if( nd == fake_nd || idb_exists(unload_db, nd->bl.id) )
+				continue;
+			if( npc_path_isreloading(nd->path) || npc_reload_isdependent(nd, unload_db) )
+			{
+				idb_put(unload_db, nd->bl.id, nd);
+				if( nd->path != NULL && !npc_path_isreloading(nd->path) )
+					npc_path_get(nd->path)->reload = true;// duplicate in another file
+				changed = true;
+			}
+		}
+		mapit_free(iter);
+	}
+	while( changed );
+
+	// remove the mob spawns
+	iter = mapit_geteachmob();
+	for( bl = (struct block_list*)mapit_first(iter); mapit_exists(iter); bl = (struct block_list*)mapit_next(iter) )
+	{
+		struct mob_data* md = (struct mob_data*)bl;
+		if( md->spawn == NULL || !npc_path_isreloading(md->spawn->path) )
+			continue;
+		if( !md->spawn->state.dynamic )
+			npc_remove_spawninfo(md->spawn, 1);
+		unit_free(&md->bl,CLR_OUTSIGHT);
+	}
+	mapit_free(iter);
+	for( m = 0; m < map_num; m++ )
+	{
+		for( i = 0; i < MAX_MOB_LIST_PER_MAP; i++ )
+		{
+			struct spawn_data* spawn = map[m].moblist[i];
+			if( spawn == NULL || !npc_path_isreloading(spawn->path) )
+				continue;
+			npc_remove_spawninfo(spawn, spawn->num);
+			aFree(spawn->walkcell.xy);
+			aFree(spawn);
+			map[m].moblist[i] = NULL;
+		}
+	}
+
+	// detach '.' variables and collect the code that is going away
+	vars_db = strdb_alloc(DB_OPT_DUP_KEY,0);
+	dbi = db_iterator(unload_db);
+	for( nd = (struct npc_data*)dbi->first(dbi,NULL); dbi->exists(dbi); nd = (struct npc_data*)dbi->next(dbi,NULL) )
+	{
+		if( nd->subtype != SCRIPT || nd->src_id != 0 || nd->u.scr.script == NULL )
+			continue;
+		RECREATE(code_list, struct script_code*, code_num+1);
+		code_list[code_num++] = nd->u.scr.script;
+		if( nd->u.scr.script->script_vars != NULL )
+		{
+			strdb_put(vars_db, nd->exname, nd->u.scr.script->script_vars);
+			nd->u.scr.script->script_vars = NULL;
+		}
+	}
+	dbi_destroy(dbi);
+	npc_code_num = code_num;// the rest are user functions
+	dbi = db_iterator(npc_path_db);
+	for( npd = (struct npc_path_data*)dbi->first(dbi,NULL); dbi->exists(dbi); npd = (struct npc_path_data*)dbi->next(dbi,NULL) )
+	{
+		DBMap* func_db = script_get_userfunc_db();
+		if( !npd->reload )
+			continue;
+		for( i = 0; i < npd->func_num; ++i )
+		{
+			if( strdb_get(func_db, npd->func[i].name) != npd->func[i].code )
+				continue;// overwritten by another file
+			strdb_remove(func_db, npd->func[i].name);
+			RECREATE(code_list, struct script_code*, code_num+1);
+			code_list[code_num++] = npd->func[i].code;
+		}
+	}
+	dbi_destroy(dbi);
+
+	// stop the scripts that are running that code
+	iter = mapit_getallusers();
+	for( sd = (TBL_PC*)mapit_first(iter); mapit_exists(iter); sd = (TBL_PC*)mapit_next(iter) )
+	{
+		if( sd->st == NULL || sd->st->state == RUN )
+			continue;
+		ARR_FIND( 0, code_num, i, script_state_usescode(sd->st, code_list[i]) );
+		if( i < code_num || idb_exists(unload_db, sd->npc_id) )
+		{
+			clif_scriptclose(sd, sd->npc_id);
+			npc_event_dequeue(sd);
+		}
+	}
+	mapit_free(iter);
+	for( i = 0; i < code_num; ++i )
+		script_stop_code_sleeptimers(code_list[i]);
+
+	// unload
+	dbi = db_iterator(unload_db);
+	for( nd = (struct npc_data*)dbi->first(dbi,NULL); dbi->exists(dbi); nd = (struct npc_data*)dbi->next(dbi,NULL) )
+	{
+		npc_unload(nd);
+		npc_num++;
+	}
+	dbi_destroy(dbi);
+	unload_db->destroy(unload_db, NULL);
+	for( i = npc_code_num; i < code_num; ++i )
+		script_free_code(code_list[i]);
+	aFree(code_list);
+
+	// load
+	npc_warp = npc_shop = npc_script = 0;
+	npc_mob = npc_cache_mob = npc_delay_mob = 0;
+	for( nsl = npc_src_files; nsl != NULL; nsl = nsl->next )
+	{
+		if( !npc_path_isreloading(nsl->name) )
+			continue;
+		ShowStatus("Loading NPC file: %s"CL_CLL"\r", nsl->name);
+		npc_parsesrcfile(nsl->name);
+		file_num++;
+	}
+	script_cache_save();
+
+	ShowInfo ("Done reloading '"CL_WHITE"%d"CL_RESET"' NPC files, '"CL_WHITE"%d"CL_RESET"' NPCs unloaded, '"CL_WHITE"%d"CL_RESET"' NPCs loaded:"CL_CLL"\n"
+		"\t-'"CL_WHITE"%d"CL_RESET"' Warps\n"
+		"\t-'"CL_WHITE"%d"CL_RESET"' Shops\n"
+		"\t-'"CL_WHITE"%d"CL_RESET"' Scripts\n"
+		"\t-'"CL_WHITE"%d"CL_RESET"' Spawn sets\n"
+		"\t-'"CL_WHITE"%d"CL_RESET"' Mobs Cached\n"
+		"\t-'"CL_WHITE"%d"CL_RESET"' Mobs Not Cached\n",
+		file_num, npc_num, npc_id - npc_new_min, npc_warp, npc_shop, npc_script, npc_mob, npc_cache_mob, npc_delay_mob);
+
+	// give the variables back to npcs with the same name
+	dbi = db_iterator(vars_db);
+	for( vars = (struct linkdb_node*)dbi->first(dbi,&key); dbi->exists(dbi); vars = (struct linkdb_node*)dbi->next(dbi,&key) )
+	{
+		nd = npc_name2id(key.str);
+		if( nd != NULL && nd->bl.id >= npc_new_min && nd->subtype == SCRIPT && nd->src_id == 0 && nd->u.scr.script != NULL && nd->u.scr.script->script_vars == NULL )
+			nd->u.scr.script->script_vars = vars;
+		else
+			script_free_vars(&vars);
+	}
+	dbi_destroy(dbi);
+	vars_db->destroy(vars_db, NULL);
+
+	// copies of the new npcs in running instances
+	for( i = 0; i < ARRAYLENGTH(instance); ++i )
+	{
+		if( instance[i].state != INSTANCE_BUSY )
+			continue;
+		for( j = 0; j < instance[i].num_map; ++j )
+			map_foreachinmap(npc_reload_instance_sub, map[instance[i].map[j]].instance_src_map, BL_NPC, instance[i].map[j], npc_new_min);
+	}
+
+	//Re-read the NPC Script Events cache.
+	npc_read_event_script();
+
+	//Execute the OnInit event for the new npcs.
+	ShowStatus("Event '"CL_WHITE"OnInit"CL_RESET"' executed with '"CL_WHITE"%d"CL_RESET"' NPCs.\n", npc_event_doall_reload("OnInit", npc_new_min));
+	if(!CheckForCharServer()){
+		ShowStatus("Event '"CL_WHITE"OnInterIfInit"CL_RESET"' executed with '"CL_WHITE"%d"CL_RESET"' NPCs.\n", npc_event_doall_reload("OnInterIfInit", npc_new_min));
+		ShowStatus("Event '"CL_WHITE"OnInterIfInitOnce"CL_RESET"' executed with '"CL_WHITE"%d"CL_RESET"' NPCs.\n", npc_event_doall_reload("OnInterIfInitOnce", npc_new_min));
+	}
+	return file_num;
+}
+
 /*==========================================
  * I
  *------------------------------------------*/
@@ -3467,6 +4149,7 @@ int do_final_npc(void)
 	npcview_db->destroy(npcview_db, NULL);
 	ers_destroy(timer_event_ers);
 	npc_clearsrcfile();
+	npc_path_db->destroy(npc_path_db, npc_path_final_sub);
 
 	return 0;
 }
@@ -3510,21 +4193,17 @@ static void npc_debug_warps(void)
  *------------------------------------------*/
 int do_init_npc(void)
 {
-	struct npc_src_list *file;
-
 	ev_db = strdb_alloc((DBOptions)(DB_OPT_DUP_KEY|DB_OPT_RELEASE_DATA),2*NAME_LENGTH+2+1);
 	npcname_db = strdb_alloc(DB_OPT_BASE,NAME_LENGTH);
 	npcview_db = idb_alloc(DB_OPT_RELEASE_DATA);
+	npc_path_db = strdb_alloc(DB_OPT_BASE,0);
 
-	timer_event_ers = ers_new(sizeof(struct timer_event_data));
+	timer_event_ers = ers_new(sizeof(struct timer_event_data), "npc_timer_event", MEMTAG_ERS);
 
 	// process all npc files
 	ShowStatus("Loading NPCs...\r");
-	for( file = npc_src_files; file != NULL; file = file->next )
-	{
-		ShowStatus("Loading NPC file: %s"CL_CLL"\r", file->name);
-		npc_parsesrcfile(file->name);
-	}
+	npc_parsesrcfiles();
+	script_cache_save();
 
 	ShowInfo ("Done loading '"CL_WHITE"%d"CL_RESET"' NPCs:"CL_CLL"\n"
 		"\t-'"CL_WHITE"%d"CL_RESET"' Warps\n"
@@ -42,6 +42,7 @@ struct npc_data {
 	void* chatdb; // pointer to a npc_parse struct (see npc_chat.c)
 	enum npc_subtype subtype;
 	int src_id;
+	const char* path; // source file (NULL if not loaded from a file)
 	union {
 		struct {
 			struct script_code *script;
@@ -118,6 +119,7 @@ int npc_globalmessage(const char* name,const char* mes);
 
 void npc_setcells(struct npc_data* nd);
 void npc_unsetcells(struct npc_data* nd);
+void npc_freetouch(int m);
 void npc_movenpc(struct npc_data* nd, int x, int y);
 int npc_enable(const char* name, int flag);
 void npc_setdisplayname(struct npc_data* nd, const char* newname);
@@ -148,6 +150,7 @@ int npc_remove_map(struct npc_data* nd);
 void npc_unload_duplicates (struct npc_data* nd);
 int npc_unload(struct npc_data* nd);
 int npc_reload(void);
+int npc_reload_changed(void);
 void npc_read_event_script(void);
 int npc_script_event(struct map_session_data* sd, enum npce_event type);
 
@@ -34,6 +34,10 @@ static unsigned long party_booking_nextid = 1;
 
 int party_send_xy_timer(int tid, unsigned int tick, int id, intptr_t data);
 
+static int* party_xy_dirty = NULL; // members to look at in party_send_xy_timer (see party_send_xy_mark)
+static int party_xy_dirty_count = 0;
+static int party_xy_dirty_max = 0;
+
 /*==========================================
  * Fills the given party_member structure according to the sd provided. 
  * Used when creating/adding people to a party. [Skotlex]
@@ -119,6 +123,7 @@ static TBL_PC* party_sd_check(int party_id, int account_id, int char_id)
  *------------------------------------------*/
 void do_final_party(void)
 {
+	aFree(party_xy_dirty);
 	party_db->destroy(party_db,NULL);
 	party_booking_db->destroy(party_booking_db,NULL); // Party Booking [Spiria]
 }
@@ -320,6 +325,8 @@ int party_recv_info(struct party* sp, int char_id)
 		if ( member->char_id == 0 )
 			continue;// empty
 		p->data[member_id].sd = party_sd_check(sp->party_id, member->account_id, member->char_id);
+		if( p->data[member_id].sd )
+			party_send_xy_mark(p->data[member_id].sd); // cached position was reset
 	}
 	party_check_state(p);
 	while( added_count > 0 )// new in party
@@ -460,6 +467,7 @@ void party_member_joined(struct map_session_data *sd)
 	if (i < MAX_PARTY)
 	{
 		p->data[i].sd = sd;
+		party_send_xy_mark(sd);
 		if( p->instance_id )
 			clif_instance_join(sd->fd,p->instance_id);
 	}
@@ -743,6 +751,8 @@ int party_recv_movemap(int party_id,int account_id,int char_id, unsigned short m
 	m->lv = lv;
 	//Check if they still exist on this map server
 	p->data[i].sd = party_sd_check(party_id, account_id, char_id);
+	if( p->data[i].sd )
+		party_send_xy_mark(p->data[i].sd);
 	
 	clif_party_info(p,NULL);
 	return 0;
@@ -881,36 +891,56 @@ int party_skill_check(struct map_session_data *sd, int party_id, int skillid, in
 	return 0;
 }
 
+/// Marks a member whose position or hp may have changed, party_send_xy_timer
+/// only looks at the marked members (account ids, a member may be in it twice
+/// after relogging).
+void party_send_xy_mark(struct map_session_data* sd)
+{
+	if( !sd->status.party_id || sd->state.party_xy_dirty )
+		return;
+	sd->state.party_xy_dirty = 1;
+
+	if( party_xy_dirty_count == party_xy_dirty_max )
+	{
+		party_xy_dirty_max += 256;
+		RECREATE(party_xy_dirty, int, party_xy_dirty_max);
+	}
+	party_xy_dirty[party_xy_dirty_count++] = sd->bl.id;
+}
+
 int party_send_xy_timer(int tid, unsigned int tick, int id, intptr_t data)
 {
-	struct party_data* p;
+	int n;
 
-	DBIterator* iter = party_db->iterator(party_db);
-	// for each existing party,
-	for( p = (struct party_data*)iter->first(iter,NULL); iter->exists(iter); p = (struct party_data*)iter->next(iter,NULL) )
+	for( n = 0; n < party_xy_dirty_count; n++ )
 	{
+		struct map_session_data* sd = map_id2sd(party_xy_dirty[n]);
+		struct party_data* p;
 		int i;
-		// for each member of this party,
-		for( i = 0; i < MAX_PARTY; i++ )
-		{
-			//struct map_session_data* sd = p->data[i].sd;
-			struct map_session_data* sd = map_charid2sd(p->party.member[i].char_id); //temporary crashfix
-			if( !sd ) continue;
-
-			if( p->data[i].x != sd->bl.x || p->data[i].y != sd->bl.y )
-			{// perform position update
-				clif_party_xy(sd);
-				p->data[i].x = sd->bl.x;
-				p->data[i].y = sd->bl.y;
-			}
-			if (battle_config.party_hp_mode && p->data[i].hp != sd->battle_status.hp)
-			{// perform hp update
-				clif_party_hp(sd);
-				p->data[i].hp = sd->battle_status.hp;
-			}
+
+		if( sd == NULL )
+			continue; // logged out
+		sd->state.party_xy_dirty = 0;
+
+		if( (p = party_search(sd->status.party_id)) == NULL )
+			continue;
+		ARR_FIND( 0, MAX_PARTY, i, p->data[i].sd == sd );
+		if( i == MAX_PARTY )
+			continue;
+
+		if( p->data[i].x != sd->bl.x || p->data[i].y != sd->bl.y )
+		{// perform position update
+			clif_party_xy(sd);
+			p->data[i].x = sd->bl.x;
+			p->data[i].y = sd->bl.y;
+		}
+		if (battle_config.party_hp_mode && p->data[i].hp != sd->battle_status.hp)
+		{// perform hp update
+			clif_party_hp(sd);
+			p->data[i].hp = sd->battle_status.hp;
 		}
 	}
-	iter->destroy(iter);
+	party_xy_dirty_count = 0;
 
 	return 0;
 }
@@ -926,6 +956,7 @@ int party_send_xy_clear(struct party_data *p)
 		p->data[i].hp = 0;
 		p->data[i].x = 0;
 		p->data[i].y = 0;
+		party_send_xy_mark(p->data[i].sd);
 	}
 	return 0;
 }
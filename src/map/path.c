@@ -5,6 +5,7 @@
 #include "../common/nullpo.h"
 #include "../common/showmsg.h"
 #include "../common/malloc.h"
+#include "../common/los.h"
 #include "map.h"
 #include "battle.h"
 #include "path.h"
@@ -194,6 +195,39 @@ int path_blownpos(int m,int x0,int y0,int dx,int dy,int count)
 	return (x0<<16)|y0; //TODO: use 'struct point' here instead?
 }
 
+/// Returns the wall bitplanes of the map, building them on first use.
+static struct los_map* path_getlos(struct map_data* md)
+{
+	int x, y;
+
+	if( md->los != NULL )
+		return md->los;
+
+	md->los = los_create(md->xs, md->ys);
+	for( y = 0; y < md->ys; ++y )
+		for( x = 0; x < md->xs; ++x )
+			if( map_getcellp(md, x, y, CELL_CHKWALL) )
+				los_setwall(md->los, x, y, true);
+	return md->los;
+}
+
+/*==========================================
+ * Updates the wall bit of a cell after its gat type changed.
+ *------------------------------------------*/
+void path_updatelos(int m, int x, int y)
+{
+	struct map_data* md = &map[m];
+
+	if( md->los != NULL )
+		los_setwall(md->los, x, y, map_getcellp(md, x, y, CELL_CHKWALL) != 0);
+}
+
+void path_freelos(int m)
+{
+	los_destroy(map[m].los);
+	map[m].los = NULL;
+}
+
 /*==========================================
  * is ranged attack from (x0,y0) to (x1,y1) possible?
  *------------------------------------------*/
@@ -205,13 +239,20 @@ bool path_search_long(struct shootpath_data *spd,int m,int x0,int y0,int x1,int
 	struct map_data *md;
 	struct shootpath_data s_spd;
 
-	if( spd == NULL )
-		spd = &s_spd; // use dummy output variable
-
 	if (!map[m].cell)
 		return false;
 	md = &map[m];
 
+	if( spd == NULL && cell == CELL_CHKWALL &&
+		x0 >= 0 && x0 < md->xs && y0 >= 0 && y0 < md->ys &&
+		x1 >= 0 && x1 < md->xs && y1 >= 0 && y1 < md->ys )
+	{// only the result is needed, check whole runs of cells in the wall bitplanes
+		return los_check(path_getlos(md), x0, y0, x1, y1);
+	}
+
+	if( spd == NULL )
+		spd = &s_spd; // use dummy output variable
+
 	dx = (x1 - x0);
 	if (dx < 0) {
 		swap(x0, x1);
@@ -27,6 +27,8 @@ bool path_search(struct walkpath_data *wpd,int m,int x0,int y0,int x1,int y1,int
 
 // tries to find a shootable path
 bool path_search_long(struct shootpath_data *spd,int m,int x0,int y0,int x1,int y1,cell_chk cell);
+void path_updatelos(int m, int x, int y);
+void path_freelos(int m);
 
 
 // distance related functions
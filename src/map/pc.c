@@ -275,18 +275,31 @@ unsigned char pc_famerank(int char_id, int job)
 }
 
 
-/// Called when a status changed in the player.
-/// Updates the client.
-/// @see enum _sp
-void pc_onstatuschanged(struct map_session_data* sd, int type)
-{
-	nullpo_retv(sd);
+static int* pc_status_pending = NULL; // ids of the players with status updates to send
+static int pc_status_pending_count = 0;
+static int pc_status_pending_max = 0;
+static int pc_status_flush_tid = INVALID_TIMER;
 
-	// update variables
-	if( type == SP_WEIGHT )
-		pc_updateweightstatus(sd);
+/// Bit of a status in map_session_data::status_dirty, -1 if it is sent immediately.
+static int pc_status_dirty_bit(int type)
+{
+	switch( type )
+	{
+	case SP_ZENY: // cancels the trade, keep the order with the trade packets
+	case SP_BASELEVEL: // level up effects
+	case SP_JOBLEVEL:
+		return -1;
+	case SP_CARTINFO:
+		return 62;
+	case SP_ATTACKRANGE:
+		return 63;
+	}
+	return ( type >= 0 && type <= SP_JOBLEVEL ) ? type : -1;
+}
 
-	// send status packet
+/// Sends the current value of a status to the client.
+static void pc_sendstatus(struct map_session_data* sd, int type)
+{
 	switch( type )
 	{
 	// params
@@ -400,6 +413,92 @@ void pc_onstatuschanged(struct map_session_data* sd, int type)
 	}
 }
 
+/// Sends the status updates of the player that are waiting for the end of the tick.
+void pc_status_flush(struct map_session_data* sd)
+{
+	static const int first[] = { SP_MAXHP, SP_MAXSP, SP_MAXWEIGHT }; // before the current values
+	uint64 dirty;
+	int i;
+
+	nullpo_retv(sd);
+
+	dirty = sd->status_dirty;
+	sd->status_dirty = 0;
+	for( i = 0; i < ARRAYLENGTH(first) && dirty; ++i )
+	{
+		if( dirty&(UINT64_C(1)<<first[i]) )
+		{
+			dirty &= ~(UINT64_C(1)<<first[i]);
+			pc_sendstatus(sd, first[i]);
+		}
+	}
+	for( i = 0; dirty; ++i, dirty >>= 1 )
+	{
+		if( !(dirty&1) )
+			continue;
+		if( i == 62 )
+			pc_sendstatus(sd, SP_CARTINFO);
+		else if( i == 63 )
+			pc_sendstatus(sd, SP_ATTACKRANGE);
+		else
+			pc_sendstatus(sd, i);
+	}
+}
+
+/// Sends the status updates collected during the tick, one packet per status with the final value.
+static int pc_status_flush_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	struct map_session_data* sd;
+	int i;
+
+	pc_status_flush_tid = INVALID_TIMER;
+	for( i = 0; i < pc_status_pending_count; ++i )
+	{
+		if( (sd = map_id2sd(pc_status_pending[i])) != NULL )
+			pc_status_flush(sd);
+	}
+	pc_status_pending_count = 0;
+	return 0;
+}
+
+/// Called when a status changed in the player.
+/// Updates the client at the end of the tick, so a status that changes
+/// several times (status_calc_pc, status change bursts) is sent once.
+/// @see enum _sp
+void pc_onstatuschanged(struct map_session_data* sd, int type)
+{
+	int bit;
+
+	nullpo_retv(sd);
+
+	// update variables
+	if( type == SP_WEIGHT )
+		pc_updateweightstatus(sd);
+	else if( type == SP_HP )
+		party_send_xy_mark(sd);
+
+	bit = pc_status_dirty_bit(type);
+	if( bit < 0 )
+	{// keep the order with the updates already waiting
+		pc_status_flush(sd);
+		pc_sendstatus(sd, type);
+		return;
+	}
+
+	if( sd->status_dirty == 0 )
+	{
+		if( pc_status_pending_count == pc_status_pending_max )
+		{
+			pc_status_pending_max += 256;
+			RECREATE(pc_status_pending, int, pc_status_pending_max);
+		}
+		pc_status_pending[pc_status_pending_count++] = sd->bl.id;
+		if( pc_status_flush_tid == INVALID_TIMER )
+			pc_status_flush_tid = add_timer(gettick(), pc_status_flush_timer, 0, 0);
+	}
+	sd->status_dirty |= UINT64_C(1)<<bit;
+}
+
 
 int pc_setrestartvalue(struct map_session_data *sd,int type)
 {
@@ -5777,7 +5876,7 @@ static int pc_respawn_timer(int tid, unsigned int tick, int id, intptr_t data)
 	struct map_session_data *sd = map_id2sd(id);
 	if( sd != NULL )
 	{
-		sd->pvp_point=0;
+		pc_setpvppoint(sd, 0);
 		pc_respawn(sd,CLR_OUTSIGHT);
 	}
 
@@ -6081,12 +6180,12 @@ int pc_dead(struct map_session_data *sd,struct block_list *src)
 	// disable certain pvp functions on pk_mode [Valaris]
 	if( map[sd->bl.m].flag.pvp && !battle_config.pk_mode && !map[sd->bl.m].flag.pvp_nocalcrank )
 	{
-		sd->pvp_point -= 5;
+		pc_setpvppoint(sd, sd->pvp_point - 5);
 		sd->pvp_lost++;
 		if( src && src->type == BL_PC )
 		{
 			struct map_session_data *ssd = (struct map_session_data *)src;
-			ssd->pvp_point++;
+			pc_setpvppoint(ssd, ssd->pvp_point + 1);
 			ssd->pvp_won++;
 		}
 		if( sd->pvp_point < 0 )
@@ -7627,22 +7726,98 @@ int pc_checkitem(struct map_session_data *sd)
 	return 0;
 }
 
+/// Pvp points of the players in the blocks of each map, highest first.
+/// Kept sorted as players enter/leave the map and their points change,
+/// so a rank is a binary search instead of a scan of the whole map.
+struct pc_pvprank_list {
+	short* point;
+	int count;
+	int max;
+};
+static struct pc_pvprank_list pc_pvprank_list[MAX_MAP_PER_SERVER];
+
+/// Index of the first point in the list that is lower than or equal to (or lower than, if strict) the given one.
+static int pc_pvprank_bound(struct pc_pvprank_list* list, short point, bool strict)
+{
+	int lo = 0, hi = list->count;
+
+	while( lo < hi )
+	{
+		int mid = (lo + hi)/2;
+		if( list->point[mid] > point || (strict && list->point[mid] == point) )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void pc_pvprank_insert(int m, short point)
+{
+	struct pc_pvprank_list* list = &pc_pvprank_list[m];
+	int i;
+
+	if( list->count == list->max )
+	{
+		list->max += 32;
+		RECREATE(list->point, short, list->max);
+	}
+	i = pc_pvprank_bound(list, point, true);
+	memmove(&list->point[i+1], &list->point[i], (list->count - i)*sizeof(list->point[0]));
+	list->point[i] = point;
+	list->count++;
+}
+
+static void pc_pvprank_delete(int m, short point)
+{
+	struct pc_pvprank_list* list = &pc_pvprank_list[m];
+	int i = pc_pvprank_bound(list, point, false);
+
+	if( i == list->count || list->point[i] != point )
+	{
+		ShowError("pc_pvprank_delete: point %d not found in map %s.\n", point, map[m].name);
+		return;
+	}
+	list->count--;
+	memmove(&list->point[i], &list->point[i+1], (list->count - i)*sizeof(list->point[0]));
+}
+
 /*==========================================
- * PVPʌvZp(foreachinarea)
+ * Adds/removes the player to/from the pvp ranking of its map.
+ * Called when the player is added to/removed from the map blocks.
  *------------------------------------------*/
-int pc_calc_pvprank_sub(struct block_list *bl,va_list ap)
+void pc_pvprank_enter(struct map_session_data* sd)
 {
-	struct map_session_data *sd1,*sd2=NULL;
+	if( sd->state.pvprank )
+		return;
+	pc_pvprank_insert(sd->bl.m, sd->pvp_point);
+	sd->state.pvprank = 1;
+}
 
-	sd1=(struct map_session_data *)bl;
-	sd2=va_arg(ap,struct map_session_data *);
+void pc_pvprank_leave(struct map_session_data* sd)
+{
+	if( !sd->state.pvprank )
+		return;
+	pc_pvprank_delete(sd->bl.m, sd->pvp_point);
+	sd->state.pvprank = 0;
+}
 
-	if( sd1->pvp_point > sd2->pvp_point )
-		sd2->pvp_rank++;
-	return 0;
+/*==========================================
+ * Sets the pvp points of the player, keeping the ranking of its map sorted.
+ *------------------------------------------*/
+void pc_setpvppoint(struct map_session_data* sd, int point)
+{
+	point = cap_value(point, SHRT_MIN, SHRT_MAX);
+	if( sd->state.pvprank && sd->pvp_point != point )
+	{
+		pc_pvprank_delete(sd->bl.m, sd->pvp_point);
+		pc_pvprank_insert(sd->bl.m, (short)point);
+	}
+	sd->pvp_point = (short)point;
 }
+
 /*==========================================
- * PVPʌvZ
+ * PVP rank: 1 + players of the map with more points
  *------------------------------------------*/
 int pc_calc_pvprank(struct map_session_data *sd)
 {
@@ -7650,8 +7825,7 @@ int pc_calc_pvprank(struct map_session_data *sd)
 	struct map_data *m;
 	m=&map[sd->bl.m];
 	old=sd->pvp_rank;
-	sd->pvp_rank=1;
-	map_foreachinmap(pc_calc_pvprank_sub,sd->bl.m,BL_PC,sd);
+	sd->pvp_rank=1+pc_pvprank_bound(&pc_pvprank_list[sd->bl.m], sd->pvp_point, false);
 	if(old!=sd->pvp_rank || sd->pvp_lastusers!=m->users)
 		clif_pvpset(sd,sd->pvp_rank,sd->pvp_lastusers=m->users,0);
 	return sd->pvp_rank;
@@ -8316,6 +8490,12 @@ int pc_read_motd(void)
  *------------------------------------------*/
 void do_final_pc(void)
 {
+	int i;
+
+	if( pc_status_pending )
+		aFree(pc_status_pending);
+	for( i = 0; i < MAX_MAP_PER_SERVER; i++ )
+		aFree(pc_pvprank_list[i].point);
 	return;
 }
 
@@ -8332,6 +8512,7 @@ int do_init_pc(void)
 	add_timer_func_list(pc_spiritball_timer, "pc_spiritball_timer");
 	add_timer_func_list(pc_follow_timer, "pc_follow_timer");
 	add_timer_func_list(pc_endautobonus, "pc_endautobonus");
+	add_timer_func_list(pc_status_flush_timer, "pc_status_flush_timer");
 
 	add_timer(gettick() + autosave_interval, pc_autosave, 0, 0);
 
@@ -134,6 +134,9 @@ struct map_session_data {
 		unsigned int vending : 1;
 		unsigned int noks : 3; // [Zeph Kill Steal Protection]
 		unsigned int changemap : 1;
+		unsigned int party_xy_dirty : 1; // in the list of party_send_xy_timer
+		unsigned int guild_xy_dirty : 1; // in the list of guild_send_xy_timer
+		unsigned int pvprank : 1; // counted in the pvp ranking of the map
 		short pmap; // Previous map on Map Change
 		unsigned short autoloot;
 		unsigned short autolootid; // [Zephyrus]
@@ -165,6 +168,11 @@ struct map_session_data {
 	unsigned int weight,max_weight;
 	int cart_weight,cart_num;
 	int fd;
+	struct {
+		int id;
+		uint32 pos;
+	} movequeue[8]; // last movement packet queued per unit while the client is congested, see clif_send_sub
+	uint64 status_dirty; // status updates to send at the end of the tick, see pc_onstatuschanged
 	unsigned short mapindex;
 	unsigned char head_dir; //0: Look forward. 1: Look right, 2: Look left.
 	unsigned int client_tick;
@@ -561,6 +569,7 @@ int pc_getrefinebonus(int lv,int type);
 bool pc_can_give_items(int level);
 
 void pc_onstatuschanged(struct map_session_data* sd, int type);
+void pc_status_flush(struct map_session_data* sd);
 
 int pc_setrestartvalue(struct map_session_data *sd,int type);
 int pc_makesavestatus(struct map_session_data *);
@@ -573,6 +582,7 @@ int pc_reg_received(struct map_session_data *sd);
 int pc_isequip(struct map_session_data *sd,int n);
 int pc_equippoint(struct map_session_data *sd,int n);
 int pc_setinventorydata(struct map_session_data *sd);
+int pc_setequipindex(struct map_session_data *sd);
 
 int pc_checkskill(struct map_session_data *sd,int skill_id);
 int pc_checkallowskill(struct map_session_data *sd);
@@ -714,6 +724,9 @@ int pc_deleventtimer(struct map_session_data *sd,const char *name);
 int pc_cleareventtimer(struct map_session_data *sd);
 int pc_addeventtimercount(struct map_session_data *sd,const char *name,int tick);
 
+void pc_pvprank_enter(struct map_session_data* sd);
+void pc_pvprank_leave(struct map_session_data* sd);
+void pc_setpvppoint(struct map_session_data* sd, int point);
 int pc_calc_pvprank(struct map_session_data *sd);
 int pc_calc_pvprank_timer(int tid, unsigned int tick, int id, intptr_t data);
 
@@ -14,6 +14,7 @@
 #include "../common/nullpo.h"
 #include "../common/showmsg.h"
 #include "../common/strlib.h"
+#include "../common/thread.h"
 #include "../common/timer.h"
 #include "../common/utils.h"
 
@@ -170,10 +171,13 @@
 #define SCRIPT_BLOCK_SIZE 512
 enum { LABEL_NEXTLINE=1,LABEL_START };
 
+// NOTE: the parser state is thread-local, so worker threads can compile
+//       scripts with their own copy of str_data (see script_precompile)
+
 /// temporary buffer for passing around compiled bytecode
 /// @see add_scriptb, set_label, parse_script
-static unsigned char* script_buf = NULL;
-static int script_pos = 0, script_size = 0;
+static THREAD_LOCAL unsigned char* script_buf = NULL;
+static THREAD_LOCAL int script_pos = 0, script_size = 0;
 
 static inline int GETVALUE(const unsigned char* buf, int i)
 {
@@ -188,7 +192,7 @@ static inline void SETVALUE(unsigned char* buf, int i, int n)
 
 // String buffer structures.
 // str_data stores string information
-static struct str_data_struct {
+static THREAD_LOCAL struct str_data_struct {
 	enum c_op type;
 	int str;
 	int backpatch;
@@ -197,18 +201,18 @@ static struct str_data_struct {
 	int val;
 	int next;
 } *str_data = NULL;
-static int str_data_size = 0; // size of the data
-static int str_num = LABEL_START; // next id to be assigned
+static THREAD_LOCAL int str_data_size = 0; // size of the data
+static THREAD_LOCAL int str_num = LABEL_START; // next id to be assigned
 
 // str_buf holds the strings themselves
-static char *str_buf;
-static int str_size = 0; // size of the buffer
-static int str_pos = 0; // next position to be assigned
+static THREAD_LOCAL char *str_buf;
+static THREAD_LOCAL int str_size = 0; // size of the buffer
+static THREAD_LOCAL int str_pos = 0; // next position to be assigned
 
 
 // Using a prime number for SCRIPT_HASH_SIZE should give better distributions
 #define SCRIPT_HASH_SIZE 1021
-int str_hash[SCRIPT_HASH_SIZE];
+static THREAD_LOCAL int str_hash[SCRIPT_HASH_SIZE];
 // Specifies which string hashing method to use
 //#define SCRIPT_HASH_DJB2
 //#define SCRIPT_HASH_SDBM
@@ -216,7 +220,7 @@ int str_hash[SCRIPT_HASH_SIZE];
 
 static DBMap* scriptlabel_db=NULL; // const char* label_name -> int script_pos
 static DBMap* userfunc_db=NULL; // const char* func_name -> struct script_code*
-static int parse_options=0;
+static THREAD_LOCAL int parse_options=0;
 DBMap* script_get_label_db(){ return scriptlabel_db; }
 DBMap* script_get_userfunc_db(){ return userfunc_db; }
 
@@ -228,6 +232,9 @@ struct Script_Config script_config = {
 	1, // warn_func_mismatch_argtypes
 	1, 65535, 2048, //warn_func_mismatch_paramnum/check_cmdcount/check_gotocount
 	0, INT_MAX, // input_min_value/input_max_value
+	0, 1, 30000, 4, // async_query_sql/async_query_sql_workers/async_query_sql_timeout/async_query_sql_max_per_npc
+	0, "db/script_cache.dat", // script_cache/script_cache_file
+	0, // script_parse_threads
 	"OnPCDieEvent", //die_event_name
 	"OnPCKillEvent", //kill_pc_event_name
 	"OnNPCKillEvent", //kill_mob_event_name
@@ -240,10 +247,10 @@ struct Script_Config script_config = {
 	"OnTouch",	//ontouch2_name (run whenever a char walks into the OnTouch area)
 };
 
-static jmp_buf     error_jump;
-static char*       error_msg;
-static const char* error_pos;
-static int         error_report; // if the error should produce output
+static THREAD_LOCAL jmp_buf     error_jump;
+static THREAD_LOCAL char*       error_msg;
+static THREAD_LOCAL const char* error_pos;
+static THREAD_LOCAL int         error_report; // if the error should produce output
 
 // for advanced scripting support ( nested if, switch, while, for, do-while, function, etc )
 // [Eoe / jA 1080, 1081, 1094, 1164]
@@ -265,7 +272,7 @@ enum e_arglist
 	ARGLIST_PAREN     = 2,
 };
 
-static struct {
+static THREAD_LOCAL struct {
 	struct {
 		enum curly_type type;
 		int index;
@@ -281,7 +288,20 @@ const char* parse_curly_close(const char* p);
 const char* parse_syntax_close(const char* p);
 const char* parse_syntax_close_sub(const char* p,int* flag);
 const char* parse_syntax(const char* p);
-static int parse_syntax_for_flag = 0;
+static THREAD_LOCAL int parse_syntax_for_flag = 0;
+
+/// Set while a worker thread compiles a script (see script_precompile).
+static THREAD_LOCAL struct {
+	bool active;
+	bool failed; // parse error, reported when the main thread parses it again
+	int* label_db; // labels that go to scriptlabel_db, in order
+	int label_db_count, label_db_max;
+} precompile;
+
+static void script_parse_init(void);
+static struct script_code* script_cache_fetch(const char* src, int options);
+static void script_cache_store(const char* src, int options, struct script_code* code);
+static bool script_precompiled_fetch(const char* src, int options, struct script_code** code);
 
 extern int current_equip_item_index; //for New CARDS Scripts. It contains Inventory Index of the EQUIP_SCRIPT caller item. [Lupus]
 int potion_flag=0; //For use on Alchemist improved potions/Potion Pitcher. [Skotlex]
@@ -302,6 +322,29 @@ extern script_function buildin_func[];
 
 static struct linkdb_node* sleep_db;// int oid -> struct script_state*
 
+#ifndef TXT_ONLY
+/// Pending asynchronous query.
+struct script_sqlquery {
+	int id;
+	int oid;// npc that issued the query
+	struct script_state* st;// waiting script, NULL if it stopped waiting
+	SqlAsyncResult* result;// NULL until the query finishes
+};
+
+static DBMap* sqlquery_db = NULL;// int id -> struct script_sqlquery*
+static DBMap* sqlquery_npc_db = NULL;// int oid -> int number of executing queries
+static int sqlquery_last_id = 0;
+
+/// Interval at which a script retries when it's npc has too many executing queries.
+#define SQLQUERY_RETRY_INTERVAL 100
+/// Interval at which the results of the asynchronous queries are collected.
+#define SQLQUERY_POLL_INTERVAL 20
+
+static int script_sqlquery_timer(int tid, unsigned int tick, int id, intptr_t data);
+static int script_sqlquery_final_sub(DBKey key, void* data, va_list ap);
+static void script_sqlquery_cancel(struct script_state* st);
+#endif
+
 /*==========================================
  * [Jvg^Cv錾 (Kvȕ̂)
  *------------------------------------------*/
@@ -699,7 +742,7 @@ int add_str(const char* p)
 	if( str_num >= str_data_size )
 	{
 		str_data_size += 128;
-		RECREATE(str_data,struct str_data_struct,str_data_size);
+		RECREATE_TAG(str_data,struct str_data_struct,str_data_size,MEMTAG_SCRIPT);
 		memset(str_data + (str_data_size - 128), '\0', 128);
 	}
 
@@ -709,7 +752,7 @@ int add_str(const char* p)
 	while( str_pos+len+1 >= str_size )
 	{
 		str_size += 256;
-		RECREATE(str_buf,char,str_size);
+		RECREATE_TAG(str_buf,char,str_size,MEMTAG_SCRIPT);
 		memset(str_buf + (str_size - 256), '\0', 256);
 	}
 
@@ -732,7 +775,7 @@ static void add_scriptb(int a)
 	if( script_pos+1 >= script_size )
 	{
 		script_size += SCRIPT_BLOCK_SIZE;
-		RECREATE(script_buf,unsigned char,script_size);
+		RECREATE_TAG(script_buf,unsigned char,script_size,MEMTAG_SCRIPT);
 	}
 	script_buf[script_pos++] = (uint8)(a);
 }
@@ -832,6 +875,23 @@ void set_label(int l,int pos, const char* script_pos)
 	}
 }
 
+/// Adds a label of the script to scriptlabel_db.
+/// Worker threads only keep the order, the label is added when the code is linked.
+static void add_label_db(int l, int pos)
+{
+	if( precompile.active )
+	{
+		if( precompile.label_db_count == precompile.label_db_max )
+		{
+			precompile.label_db_max += 16;
+			RECREATE(precompile.label_db, int, precompile.label_db_max);
+		}
+		precompile.label_db[precompile.label_db_count++] = l;
+	}
+	else
+		strdb_put(scriptlabel_db, get_str(l), (void*)(intptr_t)pos);
+}
+
 /// Skips spaces and/or comments.
 const char* skip_space(const char* p)
 {
@@ -1627,7 +1687,7 @@ const char* parse_syntax(const char* p)
 					str_data[l].type = C_USERFUNC;
 					set_label(l, script_pos, p);
 					if( parse_options&SCRIPT_USE_LABEL_DB )
-						strdb_put(scriptlabel_db, get_str(l), (void*)script_pos);
+						add_label_db(l, script_pos);
 				}
 				else
 					disp_error_message("parse_syntax:function: function name is invalid", func_name);
@@ -2010,6 +2070,20 @@ static void read_constdb(void)
 	fclose(fp);
 }
 
+/// Registers the built-in functions and constants.
+/// Done once, before the first script is parsed.
+static void script_parse_init(void)
+{
+	static bool first = true;
+
+	if( first )
+	{
+		add_buildin_func();
+		read_constdb();
+		first = false;
+	}
+}
+
 /*==========================================
  * G[\
  *------------------------------------------*/
@@ -2075,7 +2149,6 @@ struct script_code* parse_script(const char *src,const char *file,int line,int o
 	const char *p,*tmpp;
 	int i;
 	struct script_code* code = NULL;
-	static int first=1;
 	char end;
 	bool unresolved_names = false;
 
@@ -2083,19 +2156,27 @@ struct script_code* parse_script(const char *src,const char *file,int line,int o
 		return NULL;// empty script
 
 	memset(&syntax,0,sizeof(syntax));
-	if(first){
-		add_buildin_func();
-		read_constdb();
-		first=0;
+	script_parse_init();
+
+	if( !precompile.active )
+	{
+		if( (code = script_cache_fetch(src, options)) != NULL )
+			return code;// precompiled code from the script cache
+		if( script_precompiled_fetch(src, options, &code) )
+		{// compiled by a worker thread
+			if( code != NULL )
+				script_cache_store(src, options, code);
+			return code;
+		}
 	}
 
-	script_buf=(unsigned char *)aMalloc(SCRIPT_BLOCK_SIZE*sizeof(unsigned char));
+	script_buf=(unsigned char *)aMallocTag(SCRIPT_BLOCK_SIZE*sizeof(unsigned char), MEMTAG_SCRIPT);
 	script_pos=0;
 	script_size=SCRIPT_BLOCK_SIZE;
 	parse_nextline(true, NULL);
 
 	// who called parse_script is responsible for clearing the database after using it, but just in case... lets clear it here
-	if( options&SCRIPT_USE_LABEL_DB )
+	if( (options&SCRIPT_USE_LABEL_DB) && !precompile.active )
 		scriptlabel_db->clear(scriptlabel_db, NULL);
 	parse_options = options;
 
@@ -2103,7 +2184,9 @@ struct script_code* parse_script(const char *src,const char *file,int line,int o
 		//Restore program state when script has problems. [from jA]
 		int i;
 		const int size = ARRAYLENGTH(syntax.curly);
-		if( error_report )
+		if( precompile.active )
+			precompile.failed = true;
+		else if( error_report )
 			script_error(src,file,line,error_msg,error_pos);
 		aFree( error_msg );
 		aFree( script_buf );
@@ -2170,7 +2253,7 @@ struct script_code* parse_script(const char *src,const char *file,int line,int o
 			i=add_word(p);
 			set_label(i,script_pos,p);
 			if( parse_options&SCRIPT_USE_LABEL_DB )
-				strdb_put(scriptlabel_db, get_str(i), (void*)script_pos);
+				add_label_db(i, script_pos);
 			p=tmpp+1;
 			p=skip_space(p);
 			continue;
@@ -2253,13 +2336,806 @@ struct script_code* parse_script(const char *src,const char *file,int line,int o
 	}
 #endif
 
-	CREATE(code,struct script_code,1);
+	CREATE_TAG(code,struct script_code,1,MEMTAG_SCRIPT);
 	code->script_buf  = script_buf;
 	code->script_size = script_size;
 	code->script_vars = NULL;
+	if( !precompile.active )
+		script_cache_store(src, options, code);
 	return code;
 }
 
+/*==========================================
+ * Precompiled script cache
+ * Keeps the bytecode of the scripts in the npc files on disk, keyed by
+ * file and contents, so unchanged files don't need to be parsed again.
+ * The bytecode refers to str_data by id, so the names of all references
+ * and labels are stored with it and resolved again when loading.
+ *------------------------------------------*/
+#define SCRIPT_CACHE_MAGIC "eAScriptCache"
+#define SCRIPT_CACHE_VERSION 1
+
+/// Reference to a name in the bytecode (C_NAME operand).
+struct script_cache_ref {
+	int pos; // position of the operand
+	int name; // offset in names
+};
+
+/// Label defined by the script.
+struct script_cache_label {
+	int name; // offset in names
+	int type; // C_POS or C_USERFUNC_POS
+	int pos;
+	int in_db; // also in scriptlabel_db
+};
+
+struct script_cache_entry {
+	int offset; // position of the script in the file
+	int options;
+	int script_size;
+	unsigned char* script_buf;
+	int ref_count;
+	struct script_cache_ref* refs;
+	int label_count;
+	struct script_cache_label* labels;
+	int names_size;
+	char* names;
+};
+
+struct script_cache_file {
+	unsigned char md5[16];
+	bool used; // file was parsed since the server started
+	int count, max;
+	int cursor; // entry that is most likely requested next
+	struct script_cache_entry* entries;
+};
+
+static DBMap* script_cache_db = NULL; // const char* filepath -> struct script_cache_file*
+static unsigned char script_cache_env[16]; // built-in functions, parameters and constants
+static bool script_cache_loaded = false;
+static bool script_cache_dirty = false;
+static int script_cache_hits = 0;
+static int script_cache_misses = 0;
+
+/// File being parsed by npc_parsesrcfile.
+static struct {
+	struct script_cache_file* file;
+	const char* buffer;
+	size_t len;
+} script_cache_session = { NULL, NULL, 0 };
+
+/// Fingerprint of everything the compiled code depends on besides the script itself.
+/// Constants are compiled into the bytecode, so any change to const.txt or to the
+/// built-in functions invalidates the whole cache.
+static void script_cache_envhash(unsigned char* md5)
+{
+	StringBuf buf;
+	int i;
+
+	StringBuf_Init(&buf);
+	StringBuf_Printf(&buf, "%s %d\n", SCRIPT_CACHE_MAGIC, SCRIPT_CACHE_VERSION);
+	for( i = LABEL_START; i < str_num; ++i )
+	{
+		switch( str_data[i].type )
+		{
+		case C_FUNC:
+			StringBuf_Printf(&buf, "%s F %s\n", get_str(i), buildin_func[str_data[i].val].arg);
+			break;
+		case C_INT:
+		case C_PARAM:
+			StringBuf_Printf(&buf, "%s %d %d\n", get_str(i), str_data[i].type, str_data[i].val);
+			break;
+		}
+	}
+	MD5_Binary(StringBuf_Value(&buf), md5);
+	StringBuf_Destroy(&buf);
+}
+
+static void script_cache_clearfile(struct script_cache_file* file)
+{
+	int i;
+
+	for( i = 0; i < file->count; ++i )
+	{
+		struct script_cache_entry* e = &file->entries[i];
+		aFree(e->script_buf);
+		aFree(e->refs);
+		aFree(e->labels);
+		aFree(e->names);
+	}
+	file->count = 0;
+	file->cursor = 0;
+}
+
+static int script_cache_final_sub(DBKey key, void* data, va_list ap)
+{
+	struct script_cache_file* file = (struct script_cache_file*)data;
+
+	script_cache_clearfile(file);
+	aFree(file->entries);
+	aFree(file);
+	return 0;
+}
+
+/// Returns true if src points inside the file being parsed.
+static bool script_cache_insession(const char* src)
+{
+	return ( script_cache_session.file != NULL && src >= script_cache_session.buffer && src < script_cache_session.buffer + script_cache_session.len );
+}
+
+/// Adds the name of str_data[id] to the entry, reusing previous occurrences.
+static int script_cache_addname(struct script_cache_entry* e, int* nameofs, int id)
+{
+	int len;
+
+	if( nameofs[id] >= 0 )
+		return nameofs[id];
+
+	len = (int)strlen(get_str(id)) + 1;
+	RECREATE_TAG(e->names, char, e->names_size + len, MEMTAG_SCRIPT);
+	memcpy(e->names + e->names_size, get_str(id), len);
+	nameofs[id] = e->names_size;
+	e->names_size += len;
+	return nameofs[id];
+}
+
+/// Records the code that parse_script just compiled from src.
+/// Must be called before anything else touches str_data or scriptlabel_db.
+static void script_cache_store(const char* src, int options, struct script_code* code)
+{
+	struct script_cache_file* file = script_cache_session.file;
+	struct script_cache_entry* e;
+	int* nameofs;
+	int i, n;
+
+	if( !script_cache_insession(src) )
+		return;
+
+	if( file->count == file->max )
+	{
+		file->max += 32;
+		RECREATE_TAG(file->entries, struct script_cache_entry, file->max, MEMTAG_SCRIPT);
+	}
+	e = &file->entries[file->count++];
+	memset(e, 0, sizeof(struct script_cache_entry));
+	e->offset = (int)(src - script_cache_session.buffer);
+	e->options = options;
+	e->script_size = code->script_size;
+	CREATE_TAG(e->script_buf, unsigned char, code->script_size, MEMTAG_SCRIPT);
+	memcpy(e->script_buf, code->script_buf, code->script_size);
+
+	CREATE_TAG(nameofs, int, str_num, MEMTAG_SCRIPT);
+	memset(nameofs, 0xff, str_num*sizeof(int));
+
+	// references (each takes at least 4 bytes of bytecode)
+	CREATE_TAG(e->refs, struct script_cache_ref, code->script_size/4 + 1, MEMTAG_SCRIPT);
+	for( i = 0; i < code->script_size; )
+	{
+		switch( get_com(code->script_buf, &i) )
+		{
+		case C_INT:
+			get_num(code->script_buf, &i);
+			break;
+		case C_POS:
+		case C_USERFUNC_POS:
+			i += 3;
+			break;
+		case C_NAME:
+			n = GETVALUE(code->script_buf, i);
+			e->refs[e->ref_count].pos = i;
+			e->refs[e->ref_count].name = script_cache_addname(e, nameofs, n);
+			e->ref_count++;
+			i += 3;
+			break;
+		case C_STR:
+			while( code->script_buf[i++] );
+			break;
+		}
+	}
+
+	// labels
+	for( i = LABEL_START; i < str_num; ++i )
+	{
+		if( str_data[i].type != C_POS && str_data[i].type != C_USERFUNC_POS )
+			continue;
+		RECREATE_TAG(e->labels, struct script_cache_label, e->label_count + 1, MEMTAG_SCRIPT);
+		e->labels[e->label_count].name = script_cache_addname(e, nameofs, i);
+		e->labels[e->label_count].type = str_data[i].type;
+		e->labels[e->label_count].pos = str_data[i].label;
+		e->labels[e->label_count].in_db = ( (options&SCRIPT_USE_LABEL_DB) && strdb_exists(scriptlabel_db, get_str(i)) );
+		e->label_count++;
+	}
+
+	aFree(nameofs);
+	++script_cache_misses;
+	script_cache_dirty = true;
+}
+
+/// Returns a copy of the cached code for src, or NULL if it needs to be parsed.
+/// Leaves str_data and scriptlabel_db like parse_script would.
+static struct script_code* script_cache_fetch(const char* src, int options)
+{
+	struct script_cache_file* file = script_cache_session.file;
+	struct script_cache_entry* e = NULL;
+	struct script_code* code;
+	int i, n, offset;
+
+	if( !script_cache_insession(src) )
+		return NULL;
+
+	// scripts are usually requested in the order they were stored
+	offset = (int)(src - script_cache_session.buffer);
+	for( i = 0; i < file->count; ++i )
+	{
+		e = &file->entries[(file->cursor + i)%file->count];
+		if( e->offset == offset && e->options == options )
+			break;
+	}
+	if( i == file->count )
+		return NULL;
+	file->cursor = (file->cursor + i + 1)%file->count;
+
+	// default references to variables
+	for( i = LABEL_START; i < str_num; ++i )
+	{
+		if( str_data[i].type == C_NOP || str_data[i].type == C_NAME || str_data[i].type == C_POS ||
+			str_data[i].type == C_USERFUNC || str_data[i].type == C_USERFUNC_POS )
+		{
+			str_data[i].type = C_NAME;
+			str_data[i].backpatch = -1;
+			str_data[i].label = i;
+		}
+	}
+
+	CREATE_TAG(code, struct script_code, 1, MEMTAG_SCRIPT);
+	CREATE_TAG(code->script_buf, unsigned char, e->script_size, MEMTAG_SCRIPT);
+	memcpy(code->script_buf, e->script_buf, e->script_size);
+	code->script_size = e->script_size;
+	code->script_vars = NULL;
+
+	for( i = 0; i < e->ref_count; ++i )
+	{
+		n = add_str(e->names + e->refs[i].name);
+		if( str_data[n].type == C_NOP )
+		{// new name
+			str_data[n].type = C_NAME;
+			str_data[n].label = n;
+		}
+		SETVALUE(code->script_buf, e->refs[i].pos, n);
+	}
+
+	if( options&SCRIPT_USE_LABEL_DB )
+		scriptlabel_db->clear(scriptlabel_db, NULL);
+	for( i = 0; i < e->label_count; ++i )
+	{
+		n = add_str(e->names + e->labels[i].name);
+		str_data[n].type = (enum c_op)e->labels[i].type;
+		str_data[n].label = e->labels[i].pos;
+		if( e->labels[i].in_db )
+			strdb_put(scriptlabel_db, get_str(n), (void*)(intptr_t)e->labels[i].pos);
+	}
+
+	++script_cache_hits;
+	return code;
+}
+
+static bool script_cache_readint(FILE* fp, int* val, int max)
+{
+	return ( fread(val, sizeof(int), 1, fp) == 1 && *val >= 0 && *val <= max );
+}
+
+static bool script_cache_readentry(FILE* fp, struct script_cache_entry* e)
+{
+	int i;
+
+	memset(e, 0, sizeof(struct script_cache_entry));
+	if( !script_cache_readint(fp, &e->offset, INT_MAX) ||
+		!script_cache_readint(fp, &e->options, INT_MAX) ||
+		!script_cache_readint(fp, &e->script_size, 0xffffff) ||
+		!script_cache_readint(fp, &e->ref_count, e->script_size/4 + 1) ||
+		!script_cache_readint(fp, &e->label_count, 0xffffff) ||
+		!script_cache_readint(fp, &e->names_size, 0xffffff) ||
+		e->script_size == 0 )
+		return false;
+
+	CREATE_TAG(e->script_buf, unsigned char, e->script_size, MEMTAG_SCRIPT);
+	CREATE_TAG(e->refs, struct script_cache_ref, e->ref_count + 1, MEMTAG_SCRIPT);
+	CREATE_TAG(e->labels, struct script_cache_label, e->label_count + 1, MEMTAG_SCRIPT);
+	CREATE_TAG(e->names, char, e->names_size + 1, MEMTAG_SCRIPT);
+	if( fread(e->script_buf, 1, e->script_size, fp) != (size_t)e->script_size ||
+		fread(e->refs, sizeof(struct script_cache_ref), e->ref_count, fp) != (size_t)e->ref_count ||
+		fread(e->labels, sizeof(struct script_cache_label), e->label_count, fp) != (size_t)e->label_count ||
+		fread(e->names, 1, e->names_size, fp) != (size_t)e->names_size )
+		return false;
+
+	// everything must point inside the entry
+	if( e->names_size > 0 && e->names[e->names_size-1] != '\0' )
+		return false;
+	for( i = 0; i < e->ref_count; ++i )
+		if( e->refs[i].pos < 0 || e->refs[i].pos > e->script_size - 3 || e->refs[i].name < 0 || e->refs[i].name >= e->names_size )
+			return false;
+	for( i = 0; i < e->label_count; ++i )
+		if( (e->labels[i].type != C_POS && e->labels[i].type != C_USERFUNC_POS) || e->labels[i].name < 0 || e->labels[i].name >= e->names_size )
+			return false;
+	return true;
+}
+
+/// Loads the cache file.
+/// The whole cache is discarded if it was made for other built-in functions or constants.
+static void script_cache_load(void)
+{
+	FILE* fp;
+	char magic[sizeof(SCRIPT_CACHE_MAGIC)];
+	char path[1024];
+	unsigned char env[16];
+	int version, file_count, len, i, j;
+
+	script_cache_loaded = true;
+	script_parse_init();
+	script_cache_envhash(script_cache_env);
+
+	fp = fopen(script_config.script_cache_file, "rb");
+	if( fp == NULL )
+		return;// not created yet
+
+	if( fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, SCRIPT_CACHE_MAGIC, sizeof(magic)) != 0 ||
+		fread(&version, sizeof(version), 1, fp) != 1 || version != SCRIPT_CACHE_VERSION ||
+		fread(env, sizeof(env), 1, fp) != 1 || memcmp(env, script_cache_env, sizeof(env)) != 0 )
+	{
+		ShowInfo("Script cache '"CL_WHITE"%s"CL_RESET"' is outdated, all scripts will be recompiled.\n", script_config.script_cache_file);
+		fclose(fp);
+		return;
+	}
+
+	if( !script_cache_readint(fp, &file_count, INT_MAX) )
+		goto corrupted;
+	for( i = 0; i < file_count; ++i )
+	{
+		struct script_cache_file* file;
+
+		if( !script_cache_readint(fp, &len, sizeof(path) - 1) || fread(path, 1, len, fp) != (size_t)len )
+			goto corrupted;
+		path[len] = '\0';
+
+		CREATE_TAG(file, struct script_cache_file, 1, MEMTAG_SCRIPT);
+		strdb_put(script_cache_db, path, file);
+		if( fread(file->md5, sizeof(file->md5), 1, fp) != 1 || !script_cache_readint(fp, &file->max, INT_MAX) )
+			goto corrupted;
+		CREATE_TAG(file->entries, struct script_cache_entry, file->max + 1, MEMTAG_SCRIPT);
+		for( j = 0; j < file->max; ++j )
+		{
+			file->count++;
+			if( !script_cache_readentry(fp, &file->entries[j]) )
+				goto corrupted;
+		}
+	}
+	fclose(fp);
+	ShowStatus("Done reading script cache '"CL_WHITE"%s"CL_RESET"' ("CL_WHITE"%d"CL_RESET" files).\n", script_config.script_cache_file, file_count);
+	return;
+
+corrupted:
+	ShowWarning("Script cache '%s' is corrupted, all scripts will be recompiled.\n", script_config.script_cache_file);
+	fclose(fp);
+	script_cache_db->clear(script_cache_db, script_cache_final_sub);
+}
+
+/// Writes the files that were parsed since the server started to the cache file.
+/// Only done if something was compiled.
+void script_cache_save(void)
+{
+	DBIterator* iter;
+	DBKey key;
+	struct script_cache_file* file;
+	FILE* fp;
+	int version = SCRIPT_CACHE_VERSION;
+	int file_count = 0, len, i;
+
+	if( !script_config.script_cache || !script_cache_loaded )
+		return;
+
+	ShowInfo("Script cache: '"CL_WHITE"%d"CL_RESET"' scripts loaded, '"CL_WHITE"%d"CL_RESET"' compiled."CL_CLL"\n", script_cache_hits, script_cache_misses);
+	script_cache_hits = script_cache_misses = 0;
+	if( !script_cache_dirty )
+		return;
+
+	fp = fopen(script_config.script_cache_file, "wb");
+	if( fp == NULL )
+	{
+		ShowError("script_cache_save: can't write '%s'.\n", script_config.script_cache_file);
+		return;
+	}
+
+	iter = db_iterator(script_cache_db);
+	for( file = (struct script_cache_file*)iter->first(iter,NULL); iter->exists(iter); file = (struct script_cache_file*)iter->next(iter,NULL) )
+		if( file->used )
+			file_count++;
+
+	fwrite(SCRIPT_CACHE_MAGIC, sizeof(SCRIPT_CACHE_MAGIC), 1, fp);
+	fwrite(&version, sizeof(version), 1, fp);
+	fwrite(script_cache_env, sizeof(script_cache_env), 1, fp);
+	fwrite(&file_count, sizeof(file_count), 1, fp);
+	for( file = (struct script_cache_file*)iter->first(iter,&key); iter->exists(iter); file = (struct script_cache_file*)iter->next(iter,&key) )
+	{
+		if( !file->used )
+			continue;
+		len = (int)strlen(key.str);
+		fwrite(&len, sizeof(len), 1, fp);
+		fwrite(key.str, 1, len, fp);
+		fwrite(file->md5, sizeof(file->md5), 1, fp);
+		fwrite(&file->count, sizeof(file->count), 1, fp);
+		for( i = 0; i < file->count; ++i )
+		{
+			struct script_cache_entry* e = &file->entries[i];
+			fwrite(&e->offset, sizeof(int), 1, fp);
+			fwrite(&e->options, sizeof(int), 1, fp);
+			fwrite(&e->script_size, sizeof(int), 1, fp);
+			fwrite(&e->ref_count, sizeof(int), 1, fp);
+			fwrite(&e->label_count, sizeof(int), 1, fp);
+			fwrite(&e->names_size, sizeof(int), 1, fp);
+			fwrite(e->script_buf, 1, e->script_size, fp);
+			fwrite(e->refs, sizeof(struct script_cache_ref), e->ref_count, fp);
+			fwrite(e->labels, sizeof(struct script_cache_label), e->label_count, fp);
+			fwrite(e->names, 1, e->names_size, fp);
+		}
+	}
+	dbi_destroy(iter);
+	fclose(fp);
+	script_cache_dirty = false;
+}
+
+/// Starts using the cache for the scripts in buffer, the contents of filepath.
+/// Cached code is only used if the contents didn't change.
+void script_cache_begin(const char* filepath, const char* buffer)
+{
+	struct script_cache_file* file;
+	unsigned char md5[16];
+
+	script_cache_end();
+	if( !script_config.script_cache )
+		return;
+	if( !script_cache_loaded )
+		script_cache_load();
+
+	MD5_Binary(buffer, md5);
+	file = (struct script_cache_file*)strdb_get(script_cache_db, filepath);
+	if( file == NULL )
+	{
+		CREATE_TAG(file, struct script_cache_file, 1, MEMTAG_SCRIPT);
+		strdb_put(script_cache_db, filepath, file);
+	}
+	else if( memcmp(file->md5, md5, sizeof(md5)) != 0 )
+	{// modified, compile everything again
+		script_cache_clearfile(file);
+		script_cache_dirty = true;
+	}
+	memcpy(file->md5, md5, sizeof(md5));
+	file->used = true;
+	file->cursor = 0;
+
+	script_cache_session.file = file;
+	script_cache_session.buffer = buffer;
+	script_cache_session.len = strlen(buffer);
+}
+
+/// Stops using the cache.
+void script_cache_end(void)
+{
+	script_cache_session.file = NULL;
+	script_cache_session.buffer = NULL;
+	script_cache_session.len = 0;
+}
+
+/*==========================================
+ * Parallel compilation
+ * Worker threads compile scripts against a copy of the names the main
+ * thread had when they started. The names each script creates are kept in
+ * the order they were created, and are added to str_data when parse_script
+ * asks for the script on the main thread. The resulting ids and bytecode
+ * are the same as if the script was parsed by the main thread.
+ *------------------------------------------*/
+
+/// Label defined by a precompiled script.
+struct script_precompiled_label {
+	int id; // id in the str_data of the worker
+	int type; // C_POS or C_USERFUNC_POS
+	int pos;
+};
+
+struct script_precompiled {
+	const char* src;
+	int options;
+	bool failed; // parse error, parse_script parses it again to report it
+	struct script_code* code; // NULL if the script is empty or already linked
+	int ref_count;
+	int* refs; // positions of C_NAME operands that refer to names created by the script
+	int label_count;
+	struct script_precompiled_label* labels;
+	int label_db_count;
+	int* label_db; // ids of the labels added to scriptlabel_db, in order
+	int name_count;
+	char* names; // names created by the script, in order of creation
+	struct script_precompiled* next;
+};
+
+/// Names of the main thread when the workers were started.
+static struct {
+	struct str_data_struct* data;
+	int num;
+	char* buf;
+	int pos;
+	int hash[SCRIPT_HASH_SIZE];
+	int tail[SCRIPT_HASH_SIZE]; // last node of each hash chain
+} precompile_base;
+
+/// Scripts of the file being parsed by the main thread.
+static struct script_precompiled* precompiled_list = NULL;
+static struct script_precompiled* precompiled_cursor = NULL;
+
+/// Takes a copy of the current names for the workers.
+/// Must be called by the main thread before the workers are started.
+void script_precompile_init(void)
+{
+	int i, j;
+
+	script_parse_init();
+	precompile_base.num = str_num;
+	CREATE_TAG(precompile_base.data, struct str_data_struct, str_num, MEMTAG_SCRIPT);
+	memcpy(precompile_base.data, str_data, str_num*sizeof(struct str_data_struct));
+	precompile_base.pos = str_pos;
+	CREATE_TAG(precompile_base.buf, char, str_pos + 1, MEMTAG_SCRIPT);
+	memcpy(precompile_base.buf, str_buf, str_pos);
+	memcpy(precompile_base.hash, str_hash, sizeof(str_hash));
+	for( i = 0; i < SCRIPT_HASH_SIZE; ++i )
+	{
+		for( j = str_hash[i]; j != 0 && str_data[j].next != 0; j = str_data[j].next )
+			;
+		precompile_base.tail[i] = j;
+	}
+}
+
+/// Releases the copy of the names.
+/// Must be called by the main thread after the workers finished and all
+/// precompiled scripts were linked or freed.
+void script_precompile_final(void)
+{
+	aFree(precompile_base.data);
+	aFree(precompile_base.buf);
+	memset(&precompile_base, 0, sizeof(precompile_base));
+}
+
+/// Sets up the parser of a worker thread.
+void script_precompile_threadinit(void)
+{
+	str_data_size = precompile_base.num;
+	CREATE_TAG(str_data, struct str_data_struct, str_data_size, MEMTAG_SCRIPT);
+	memcpy(str_data, precompile_base.data, str_data_size*sizeof(struct str_data_struct));
+	str_size = precompile_base.pos + 1;
+	CREATE_TAG(str_buf, char, str_size, MEMTAG_SCRIPT);
+	memcpy(str_buf, precompile_base.buf, precompile_base.pos);
+	str_num = precompile_base.num;
+	str_pos = precompile_base.pos;
+}
+
+/// Releases the parser of a worker thread.
+void script_precompile_threadfinal(void)
+{
+	aFree(str_data);
+	aFree(str_buf);
+	aFree(precompile.label_db);
+	str_data = NULL;
+	str_buf = NULL;
+	str_data_size = str_size = str_num = str_pos = 0;
+	memset(&precompile, 0, sizeof(precompile));
+}
+
+/// Compiles src on a worker thread and appends the result to list.
+/// parse_script uses it when the main thread asks for the same src and options.
+/// Scripts that produce messages are left for the main thread, so the messages
+/// are shown in the right order (the worker must discard them, see showmsg_discard).
+void script_precompile(struct script_precompiled** list, const char* src, int options)
+{
+	struct script_precompiled* pc;
+	struct script_code* code;
+	int i, messages;
+
+	// forget the names of the previous script
+	str_num = precompile_base.num;
+	str_pos = precompile_base.pos;
+	memcpy(str_hash, precompile_base.hash, sizeof(str_hash));
+	for( i = 0; i < SCRIPT_HASH_SIZE; ++i )
+		if( precompile_base.tail[i] != 0 )
+			str_data[precompile_base.tail[i]].next = 0;
+
+	CREATE_TAG(pc, struct script_precompiled, 1, MEMTAG_SCRIPT);
+	pc->src = src;
+	pc->options = options;
+	while( *list != NULL )
+		list = &(*list)->next;
+	*list = pc;
+
+	precompile.active = true;
+	precompile.failed = false;
+	precompile.label_db_count = 0;
+	messages = showmsg_discarded();
+	code = parse_script(src, NULL, 0, options);
+	precompile.active = false;
+	if( precompile.failed || messages != showmsg_discarded() )
+	{
+		if( code != NULL )
+			script_free_code(code);
+		pc->failed = true;
+		return;
+	}
+	pc->code = code;
+	if( code == NULL )
+		return;
+
+	// references to names created by the script
+	CREATE_TAG(pc->refs, int, code->script_size/4 + 1, MEMTAG_SCRIPT);
+	for( i = 0; i < code->script_size; )
+	{
+		switch( get_com(code->script_buf, &i) )
+		{
+		case C_INT:
+			get_num(code->script_buf, &i);
+			break;
+		case C_POS:
+		case C_USERFUNC_POS:
+			i += 3;
+			break;
+		case C_NAME:
+			if( GETVALUE(code->script_buf, i) >= precompile_base.num )
+				pc->refs[pc->ref_count++] = i;
+			i += 3;
+			break;
+		case C_STR:
+			while( code->script_buf[i++] );
+			break;
+		}
+	}
+
+	// labels
+	for( i = LABEL_START; i < str_num; ++i )
+	{
+		if( str_data[i].type != C_POS && str_data[i].type != C_USERFUNC_POS )
+			continue;
+		RECREATE_TAG(pc->labels, struct script_precompiled_label, pc->label_count + 1, MEMTAG_SCRIPT);
+		pc->labels[pc->label_count].id = i;
+		pc->labels[pc->label_count].type = str_data[i].type;
+		pc->labels[pc->label_count].pos = str_data[i].label;
+		pc->label_count++;
+	}
+	if( precompile.label_db_count > 0 )
+	{
+		pc->label_db_count = precompile.label_db_count;
+		CREATE_TAG(pc->label_db, int, pc->label_db_count, MEMTAG_SCRIPT);
+		memcpy(pc->label_db, precompile.label_db, pc->label_db_count*sizeof(int));
+	}
+
+	// new names
+	pc->name_count = str_num - precompile_base.num;
+	if( pc->name_count > 0 )
+	{
+		CREATE_TAG(pc->names, char, str_pos - precompile_base.pos, MEMTAG_SCRIPT);
+		memcpy(pc->names, str_buf + precompile_base.pos, str_pos - precompile_base.pos);
+	}
+}
+
+/// Frees a list of precompiled scripts.
+void script_precompiled_free(struct script_precompiled* list)
+{
+	struct script_precompiled* pc;
+
+	while( list != NULL )
+	{
+		pc = list;
+		list = list->next;
+		if( pc->code != NULL )
+			script_free_code(pc->code);
+		aFree(pc->refs);
+		aFree(pc->labels);
+		aFree(pc->label_db);
+		aFree(pc->names);
+		aFree(pc);
+	}
+}
+
+/// Links the precompiled code for src, leaving str_data and scriptlabel_db like parse_script would.
+/// Returns false if the script has to be parsed.
+static bool script_precompiled_fetch(const char* src, int options, struct script_code** code)
+{
+	struct script_precompiled* pc;
+	const char* name;
+	int* ids; // id in the worker - precompile_base.num -> id
+	int i, n;
+
+	if( precompiled_list == NULL )
+		return false;
+
+	// scripts are usually requested in the order they were compiled
+	for( pc = precompiled_cursor; pc != NULL && (pc->src != src || pc->options != options); pc = pc->next )
+		;
+	if( pc == NULL )
+	{
+		for( pc = precompiled_list; pc != precompiled_cursor && (pc->src != src || pc->options != options); pc = pc->next )
+			;
+		if( pc == precompiled_cursor )
+			return false;
+	}
+	precompiled_cursor = pc->next;
+	if( pc->failed )
+		return false;
+
+	*code = pc->code;
+	pc->code = NULL;
+	pc->src = NULL;
+	if( options&SCRIPT_USE_LABEL_DB )
+		scriptlabel_db->clear(scriptlabel_db, NULL);
+	if( *code == NULL )
+		return true;// empty script
+
+	// default references to variables
+	for( i = LABEL_START; i < str_num; ++i )
+	{
+		if( str_data[i].type == C_NOP || str_data[i].type == C_NAME || str_data[i].type == C_POS ||
+			str_data[i].type == C_USERFUNC || str_data[i].type == C_USERFUNC_POS )
+		{
+			str_data[i].type = C_NAME;
+			str_data[i].backpatch = -1;
+			str_data[i].label = i;
+		}
+	}
+
+	// add the new names in the order parse_script would
+	CREATE(ids, int, pc->name_count + 1);
+	for( i = 0, name = pc->names; i < pc->name_count; ++i, name += strlen(name) + 1 )
+	{
+		n = add_str(name);
+		if( str_data[n].type == C_NOP )
+		{
+			str_data[n].type = C_NAME;
+			str_data[n].label = n;
+		}
+		ids[i] = n;
+	}
+
+	for( i = 0; i < pc->ref_count; ++i )
+		SETVALUE((*code)->script_buf, pc->refs[i], ids[GETVALUE((*code)->script_buf, pc->refs[i]) - precompile_base.num]);
+
+	for( i = 0; i < pc->label_count; ++i )
+	{
+		n = pc->labels[i].id;
+		if( n >= precompile_base.num )
+			n = ids[n - precompile_base.num];
+		str_data[n].type = (enum c_op)pc->labels[i].type;
+		str_data[n].label = pc->labels[i].pos;
+	}
+	for( i = 0; i < pc->label_db_count; ++i )
+	{
+		n = pc->label_db[i];
+		if( n >= precompile_base.num )
+			n = ids[n - precompile_base.num];
+		strdb_put(scriptlabel_db, get_str(n), (void*)(intptr_t)str_data[n].label);
+	}
+
+	aFree(ids);
+	return true;
+}
+
+/// Starts using the precompiled scripts in list (takes ownership of the list).
+void script_precompiled_begin(struct script_precompiled* list)
+{
+	script_precompiled_end();
+	precompiled_list = precompiled_cursor = list;
+}
+
+/// Frees the precompiled scripts that were not used.
+void script_precompiled_end(void)
+{
+	script_precompiled_free(precompiled_list);
+	precompiled_list = precompiled_cursor = NULL;
+}
+
 /// Returns the player attached to this script, identified by the rid.
 /// If there is no player attached, the script is terminated.
 TBL_PC *script_rid2sd(struct script_state *st)
@@ -2796,13 +3672,13 @@ void script_free_code(struct script_code* code)
 struct script_state* script_alloc_state(struct script_code* script, int pos, int rid, int oid)
 {
 	struct script_state* st;
-	CREATE(st, struct script_state, 1);
-	st->stack = (struct script_stack*)aMalloc(sizeof(struct script_stack));
+	CREATE_TAG(st, struct script_state, 1, MEMTAG_SCRIPT);
+	st->stack = (struct script_stack*)aMallocTag(sizeof(struct script_stack), MEMTAG_SCRIPT);
 	st->stack->sp = 0;
 	st->stack->sp_max = 64;
-	CREATE(st->stack->stack_data, struct script_data, st->stack->sp_max);
+	CREATE_TAG(st->stack->stack_data, struct script_data, st->stack->sp_max, MEMTAG_SCRIPT);
 	st->stack->defsp = st->stack->sp;
-	CREATE(st->stack->var_function, struct linkdb_node*, 1);
+	CREATE_TAG(st->stack->var_function, struct linkdb_node*, 1, MEMTAG_SCRIPT);
 	st->state = RUN;
 	st->script = script;
 	//st->scriptroot = script;
@@ -2824,6 +3700,9 @@ void script_free_state(struct script_state* st)
 	}
 	if( st->sleep.timer != INVALID_TIMER )
 		delete_timer(st->sleep.timer, run_script_timer);
+#ifndef TXT_ONLY
+	script_sqlquery_cancel(st);
+#endif
 	script_free_vars(st->stack->var_function);
 	aFree(st->stack->var_function);
 	pop_stack(st, 0, st->stack->sp);
@@ -3329,6 +4208,39 @@ struct linkdb_node* script_erase_sleepdb(struct linkdb_node *n)
 	return retnode;		// ̃m[hԂ
 }
 
+/// Returns true if the state is running code, directly or through a
+/// callfunc/callsub that didn't return yet.
+bool script_state_usescode(struct script_state* st, struct script_code* code)
+{
+	int i;
+
+	if( st->script == code )
+		return true;
+	for( i = 0; i < st->stack->sp; ++i )
+		if( st->stack->stack_data[i].type == C_RETINFO && st->stack->stack_data[i].u.ri->script == code )
+			return true;
+	return false;
+}
+
+/// Stops the sleeping scripts that are running code.
+/// Used before freeing code that isn't owned by a npc (user functions).
+void script_stop_code_sleeptimers(struct script_code* code)
+{
+	struct linkdb_node* n = (struct linkdb_node*)sleep_db;
+
+	while( n != NULL )
+	{
+		struct script_state* st = (struct script_state*)n->data;
+		if( script_state_usescode(st, code) )
+		{
+			n = script_erase_sleepdb(n);
+			script_free_state(st);
+		}
+		else
+			n = n->next;
+	}
+}
+
 /*==========================================
  * sleepp^C}[֐
  *------------------------------------------*/
@@ -3603,6 +4515,27 @@ int script_config_read(char *cfgName)
 		else if(strcmpi(w1,"warn_func_mismatch_argtypes")==0) {
 			script_config.warn_func_mismatch_argtypes = config_switch(w2);
 		}
+		else if(strcmpi(w1,"async_query_sql")==0) {
+			script_config.async_query_sql = config_switch(w2);
+		}
+		else if(strcmpi(w1,"async_query_sql_workers")==0) {
+			script_config.async_query_sql_workers = cap_value(config_switch(w2), 1, 16);
+		}
+		else if(strcmpi(w1,"async_query_sql_timeout")==0) {
+			script_config.async_query_sql_timeout = max(config_switch(w2), 1);
+		}
+		else if(strcmpi(w1,"async_query_sql_max_per_npc")==0) {
+			script_config.async_query_sql_max_per_npc = max(config_switch(w2), 1);
+		}
+		else if(strcmpi(w1,"script_cache")==0) {
+			script_config.script_cache = config_switch(w2);
+		}
+		else if(strcmpi(w1,"script_cache_file")==0) {
+			safestrncpy(script_config.script_cache_file, w2, sizeof(script_config.script_cache_file));
+		}
+		else if(strcmpi(w1,"script_parse_threads")==0) {
+			script_config.script_parse_threads = cap_value(config_switch(w2), 0, 64);
+		}
 		else if(strcmpi(w1,"import")==0){
 			script_config_read(w2);
 		}
@@ -3788,6 +4721,7 @@ int do_final_script()
 	scriptlabel_db->destroy(scriptlabel_db,NULL);
 	userfunc_db->destroy(userfunc_db,do_final_userfunc_sub);
 	autobonus_db->destroy(autobonus_db, do_final_autobonus_sub);
+	script_cache_db->destroy(script_cache_db, script_cache_final_sub);
 	if(sleep_db) {
 		struct linkdb_node *n = (struct linkdb_node *)sleep_db;
 		while(n) {
@@ -3797,6 +4731,12 @@ int do_final_script()
 		}
 		linkdb_final(&sleep_db);
 	}
+#ifndef TXT_ONLY
+	sqlquery_db->destroy(sqlquery_db, script_sqlquery_final_sub);
+	sqlquery_db = NULL;
+	sqlquery_npc_db->destroy(sqlquery_npc_db, NULL);
+	sqlquery_npc_db = NULL;
+#endif
 
 	if (str_data)
 		aFree(str_data);
@@ -3813,6 +4753,14 @@ int do_init_script()
 	userfunc_db=strdb_alloc(DB_OPT_DUP_KEY,0);
 	scriptlabel_db=strdb_alloc((DBOptions)(DB_OPT_DUP_KEY|DB_OPT_ALLOW_NULL_DATA),50);
 	autobonus_db = strdb_alloc(DB_OPT_DUP_KEY,0);
+	script_cache_db = strdb_alloc(DB_OPT_DUP_KEY,0);
+#ifndef TXT_ONLY
+	sqlquery_db = idb_alloc(DB_OPT_BASE);
+	sqlquery_npc_db = idb_alloc(DB_OPT_ALLOW_NULL_DATA);
+	add_timer_func_list(script_sqlquery_timer, "script_sqlquery_timer");
+	if( mmysql_async_handle != NULL || logmysql_async_handle != NULL )
+		add_timer_interval(gettick()+SQLQUERY_POLL_INTERVAL, script_sqlquery_timer, 0, 0, SQLQUERY_POLL_INTERVAL);
+#endif
 
 	mapreg_init();
 	
@@ -4273,7 +5221,7 @@ BUILDIN_FUNC(callfunc)
 	st->script = scr;
 	st->stack->defsp = st->stack->sp;
 	st->state = GOTO;
-	st->stack->var_function = (struct linkdb_node**)aCalloc(1, sizeof(struct linkdb_node*));
+	st->stack->var_function = (struct linkdb_node**)aCallocTag(1, sizeof(struct linkdb_node*), MEMTAG_SCRIPT);
 
 	return 0;
 }
@@ -4316,7 +5264,7 @@ BUILDIN_FUNC(callsub)
 	st->pos = pos;
 	st->stack->defsp = st->stack->sp;
 	st->state = GOTO;
-	st->stack->var_function = (struct linkdb_node**)aCalloc(1, sizeof(struct linkdb_node*));
+	st->stack->var_function = (struct linkdb_node**)aCallocTag(1, sizeof(struct linkdb_node*), MEMTAG_SCRIPT);
 
 	return 0;
 }
@@ -9830,7 +10778,7 @@ BUILDIN_FUNC(pvpon)
 		sd->pvp_timer = add_timer(gettick()+200,pc_calc_pvprank_timer,sd->bl.id,0);
 		sd->pvp_rank = 0;
 		sd->pvp_lastusers = 0;
-		sd->pvp_point = 5;
+		pc_setpvppoint(sd, 5);
 		sd->pvp_won = 0;
 		sd->pvp_lost = 0;
 	}
@@ -13079,18 +14027,16 @@ BUILDIN_FUNC(setd)
 }
 
 #ifndef TXT_ONLY
-int buildin_query_sql_sub(struct script_state* st, Sql* handle)
+/// Checks the target variables of query_sql/query_logsql.
+/// Returns the number of variables, or -1 if the script should end.
+static int buildin_query_sql_vars(struct script_state* st, TBL_PC** out_sd, int* out_max_rows)
 {
-	int i, j;
+	int i;
 	TBL_PC* sd = NULL;
-	const char* query;
 	struct script_data* data;
 	const char* name;
 	int max_rows = SCRIPT_MAX_ARRAYSIZE;// maximum number of rows
-	int num_vars;
-	int num_cols;
 
-	// check target variables
 	for( i = 3; script_hasdata(st,i); ++i )
 	{
 		data = script_getdata(st, i);
@@ -13104,7 +14050,7 @@ int buildin_query_sql_sub(struct script_state* st, Sql* handle)
 				{// no player attached
 					script_reportdata(data);
 					st->state = END;
-					return 1;
+					return -1;
 				}
 			}
 			if( not_array_variable(*name) )
@@ -13115,10 +14061,54 @@ int buildin_query_sql_sub(struct script_state* st, Sql* handle)
 			ShowError("script:query_sql: not a variable\n");
 			script_reportdata(data);
 			st->state = END;
-			return 1;
+			return -1;
 		}
 	}
-	num_vars = i - 3;
+	*out_sd = sd;
+	*out_max_rows = max_rows;
+	return i - 3;
+}
+
+/// Warns about a mismatch between the number of columns and variables.
+static void buildin_query_sql_checkcols(struct script_state* st, int num_vars, int num_cols)
+{
+	if( num_vars < num_cols )
+	{
+		ShowWarning("script:query_sql: Too many columns, discarding last %u columns.\n", (unsigned int)(num_cols-num_vars));
+		script_reportsrc(st);
+	}
+	else if( num_vars > num_cols )
+	{
+		ShowWarning("script:query_sql: Too many variables (%u extra).\n", (unsigned int)(num_vars-num_cols));
+		script_reportsrc(st);
+	}
+}
+
+/// Stores a column of a row in the target variable.
+static void buildin_query_sql_store(struct script_state* st, TBL_PC* sd, int row, int var, const char* str)
+{
+	struct script_data* data = script_getdata(st, var+3);
+	const char* name = reference_getname(data);
+
+	if( is_string_variable(name) )
+		setd_sub(st, sd, name, row, (void *)(str?str:""), reference_getref(data));
+	else
+		setd_sub(st, sd, name, row, (void *)(str?atoi(str):0), reference_getref(data));
+}
+
+int buildin_query_sql_sub(struct script_state* st, Sql* handle)
+{
+	int i, j;
+	TBL_PC* sd = NULL;
+	const char* query;
+	int max_rows;
+	int num_vars;
+	int num_cols;
+
+	// check target variables
+	num_vars = buildin_query_sql_vars(st, &sd, &max_rows);
+	if( num_vars < 0 )
+		return 1;
 
 	// Execute the query
 	query = script_getstr(st,2);
@@ -13138,16 +14128,7 @@ int buildin_query_sql_sub(struct script_state* st, Sql* handle)
 
 	// Count the number of columns to store
 	num_cols = Sql_NumColumns(handle);
-	if( num_vars < num_cols )
-	{
-		ShowWarning("script:query_sql: Too many columns, discarding last %u columns.\n", (unsigned int)(num_cols-num_vars));
-		script_reportsrc(st);
-	}
-	else if( num_vars > num_cols )
-	{
-		ShowWarning("script:query_sql: Too many variables (%u extra).\n", (unsigned int)(num_vars-num_cols));
-		script_reportsrc(st);
-	}
+	buildin_query_sql_checkcols(st, num_vars, num_cols);
 
 	// Store data
 	for( i = 0; i < max_rows && SQL_SUCCESS == Sql_NextRow(handle); ++i )
@@ -13159,12 +14140,7 @@ int buildin_query_sql_sub(struct script_state* st, Sql* handle)
 			if( j < num_cols )
 				Sql_GetData(handle, j, &str, NULL);
 
-			data = script_getdata(st, j+3);
-			name = reference_getname(data);
-			if( is_string_variable(name) )
-				setd_sub(st, sd, name, i, (void *)(str?str:""), reference_getref(data));
-			else
-				setd_sub(st, sd, name, i, (void *)(str?atoi(str):0), reference_getref(data));
+			buildin_query_sql_store(st, sd, i, j, str);
 		}
 	}
 	if( i == max_rows && max_rows < Sql_NumRows(handle) )
@@ -13178,11 +14154,195 @@ int buildin_query_sql_sub(struct script_state* st, Sql* handle)
 	script_pushint(st, i);
 	return 0;
 }
+
+/// Releases a pending query that has finished and isn't being waited on.
+static void script_sqlquery_free(struct script_sqlquery* q)
+{
+	idb_remove(sqlquery_db, q->id);
+	SqlAsync_FreeResult(q->result);
+	aFree(q);
+}
+
+/// Collects the results of the asynchronous queries and wakes up the scripts waiting on them.
+static int script_sqlquery_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	SqlAsync* handles[2];
+	SqlAsyncResult* result;
+	struct script_sqlquery* q;
+	int i, n;
+
+	handles[0] = mmysql_async_handle;
+	handles[1] = logmysql_async_handle;
+	for( i = 0; i < ARRAYLENGTH(handles); ++i )
+	{
+		while( (result = SqlAsync_Poll(handles[i])) != NULL )
+		{
+			q = (struct script_sqlquery*)idb_get(sqlquery_db, result->id);
+			if( q == NULL )
+			{// not ours anymore
+				SqlAsync_FreeResult(result);
+				continue;
+			}
+			q->result = result;
+
+			n = (int)(intptr_t)idb_get(sqlquery_npc_db, q->oid);
+			if( n > 1 )
+				idb_put(sqlquery_npc_db, q->oid, (void*)(intptr_t)(n-1));
+			else
+				idb_remove(sqlquery_npc_db, q->oid);
+
+			if( q->st == NULL )
+			{// script timed out or was stopped
+				script_sqlquery_free(q);
+			}
+			else if( q->st->sleep.timer != INVALID_TIMER )
+			{// wake up the script (same as the sleep timer running out)
+				int sleep_tid = q->st->sleep.timer;
+				delete_timer(sleep_tid, run_script_timer);
+				run_script_timer(sleep_tid, tick, q->st->sleep.charid, (intptr_t)q->st);
+			}
+		}
+	}
+	return 0;
+}
+
+/// Stops waiting for the asynchronous query of the script state, if any.
+static void script_sqlquery_cancel(struct script_state* st)
+{
+	struct script_sqlquery* q;
+
+	if( st->sqlquery == 0 || sqlquery_db == NULL )
+		return;
+	q = (struct script_sqlquery*)idb_get(sqlquery_db, st->sqlquery);
+	st->sqlquery = 0;
+	if( q == NULL )
+		return;
+	if( q->result != NULL )
+		script_sqlquery_free(q);
+	else
+		q->st = NULL;// discard the result when it arrives
+}
+
+/// Executes query_sql/query_logsql in a worker thread.
+/// The script sleeps until the results arrive or the query times out.
+static int buildin_query_sql_async(struct script_state* st, SqlAsync* handle)
+{
+	int i, j;
+	TBL_PC* sd = NULL;
+	struct script_sqlquery* q;
+	SqlAsyncResult* result;
+	int max_rows;
+	int num_vars;
+	int num_cols;
+
+	num_vars = buildin_query_sql_vars(st, &sd, &max_rows);
+	if( num_vars < 0 )
+	{
+		script_sqlquery_cancel(st);
+		st->sleep.tick = 0;
+		return 1;
+	}
+
+	if( st->sqlquery == 0 )
+	{// start the query
+		if( (int)(intptr_t)idb_get(sqlquery_npc_db, st->oid) >= script_config.async_query_sql_max_per_npc )
+		{// too many executing queries for this npc, try again later
+			st->state = RERUNLINE;
+			st->sleep.tick = SQLQUERY_RETRY_INTERVAL;
+			return 0;
+		}
+
+		do
+		{
+			if( ++sqlquery_last_id <= 0 )
+				sqlquery_last_id = 1;
+		}
+		while( idb_exists(sqlquery_db, sqlquery_last_id) );
+
+		if( SQL_ERROR == SqlAsync_Query(handle, sqlquery_last_id, script_getstr(st,2), (size_t)max_rows) )
+		{
+			ShowError("script:query_sql: failed to queue the query.\n");
+			st->sleep.tick = 0;
+			script_pushint(st, 0);
+			return 1;
+		}
+
+		CREATE(q, struct script_sqlquery, 1);
+		q->id = sqlquery_last_id;
+		q->oid = st->oid;
+		q->st = st;
+		idb_put(sqlquery_db, q->id, q);
+		idb_put(sqlquery_npc_db, q->oid, (void*)(intptr_t)((int)(intptr_t)idb_get(sqlquery_npc_db, q->oid) + 1));
+
+		st->sqlquery = q->id;
+		st->state = RERUNLINE;
+		st->sleep.tick = script_config.async_query_sql_timeout;
+		return 0;
+	}
+
+	// woke up, either with the results or because of the timeout
+	q = (struct script_sqlquery*)idb_get(sqlquery_db, st->sqlquery);
+	st->sqlquery = 0;
+	st->sleep.tick = 0;
+	st->state = RUN;
+	if( q == NULL || q->result == NULL )
+	{
+		ShowError("script:query_sql: the query didn't finish in %d ms.\n", script_config.async_query_sql_timeout);
+		if( q )
+			q->st = NULL;// discard the result when it arrives
+		script_pushint(st, 0);
+		return 1;
+	}
+
+	result = q->result;
+	if( result->status != SQL_SUCCESS )
+	{
+		ShowSQL("DB error - %s\n", result->error);
+		ShowDebug("at %s:%d - %s\n", __FILE__, __LINE__, script_getstr(st,2));
+		script_sqlquery_free(q);
+		script_pushint(st, 0);
+		return 1;
+	}
+
+	if( result->num_rows == 0 )
+	{// No data received
+		script_sqlquery_free(q);
+		script_pushint(st, 0);
+		return 0;
+	}
+
+	num_cols = (int)result->num_cols;
+	buildin_query_sql_checkcols(st, num_vars, num_cols);
+
+	// Store data
+	for( i = 0; i < (int)result->num_rows; ++i )
+		for( j = 0; j < num_vars; ++j )
+			buildin_query_sql_store(st, sd, i, j, ( j < num_cols ? result->data[i*num_cols + j] : NULL ));
+	if( (uint64)i < result->total_rows )
+	{
+		ShowWarning("script:query_sql: Only %d/%u rows have been stored.\n", max_rows, (unsigned int)result->total_rows);
+		script_reportsrc(st);
+	}
+
+	script_sqlquery_free(q);
+	script_pushint(st, i);
+	return 0;
+}
+
+static int script_sqlquery_final_sub(DBKey key, void* data, va_list ap)
+{
+	struct script_sqlquery* q = (struct script_sqlquery*)data;
+	SqlAsync_FreeResult(q->result);
+	aFree(q);
+	return 0;
+}
 #endif
 
 BUILDIN_FUNC(query_sql)
 {
 #ifndef TXT_ONLY
+	if( mmysql_async_handle != NULL )
+		return buildin_query_sql_async(st, mmysql_async_handle);
 	return buildin_query_sql_sub(st, mmysql_handle);
 #else
 	//for TXT version, we always return -1
@@ -13201,6 +14361,8 @@ BUILDIN_FUNC(query_logsql)
 		return 1;
 	}
 
+	if( logmysql_async_handle != NULL )
+		return buildin_query_sql_async(st, logmysql_async_handle);
 	return buildin_query_sql_sub(st, logmysql_handle);
 #else
 	//for TXT version, we always return -1
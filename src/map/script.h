@@ -20,6 +20,19 @@ extern struct Script_Config {
 	int input_min_value;
 	int input_max_value;
 
+	// asynchronous query_sql/query_logsql (sql only)
+	unsigned async_query_sql : 1;
+	int async_query_sql_workers;
+	int async_query_sql_timeout;
+	int async_query_sql_max_per_npc;
+
+	// precompiled npc script cache
+	unsigned script_cache : 1;
+	char script_cache_file[256];
+
+	// parallel compilation of npc scripts (0 = one thread per cpu)
+	int script_parse_threads;
+
 	const char *die_event_name;
 	const char *kill_pc_event_name;
 	const char *kill_mob_event_name;
@@ -124,6 +137,7 @@ struct script_state {
 		int tick,timer,charid;
 	} sleep;
 	int instance_id;
+	int sqlquery;// id of the asynchronous sql query the script is waiting for (0 if none)
 	//For backing up purposes
 	struct script_state *bk_st;
 	int bk_npcid;
@@ -149,6 +163,19 @@ const char* skip_space(const char* p);
 void script_error(const char* src, const char* file, int start_line, const char* error_msg, const char* error_pos);
 
 struct script_code* parse_script(const char* src,const char* file,int line,int options);
+void script_cache_begin(const char* filepath, const char* buffer);
+void script_cache_end(void);
+void script_cache_save(void);
+
+struct script_precompiled;
+void script_precompile_init(void);
+void script_precompile_final(void);
+void script_precompile_threadinit(void);
+void script_precompile_threadfinal(void);
+void script_precompile(struct script_precompiled** list, const char* src, int options);
+void script_precompiled_free(struct script_precompiled* list);
+void script_precompiled_begin(struct script_precompiled* list);
+void script_precompiled_end(void);
 void run_script_sub(struct script_code *rootscript,int pos,int rid,int oid, char* file, int lineno);
 void run_script(struct script_code*,int,int,int);
 
@@ -160,6 +187,8 @@ void run_script_main(struct script_state *st);
 
 void script_stop_sleeptimers(int id);
 struct linkdb_node* script_erase_sleepdb(struct linkdb_node *n);
+bool script_state_usescode(struct script_state* st, struct script_code* code);
+void script_stop_code_sleeptimers(struct script_code* code);
 void script_free_code(struct script_code* code);
 void script_free_vars(struct linkdb_node **node);
 struct script_state* script_alloc_state(struct script_code* script, int pos, int rid, int oid);
@@ -2,6 +2,7 @@
 // For more information, see LICENCE in the main folder
 
 #include "../common/cbasetypes.h"
+#include "../common/db.h"  // DBMap, idb_*
 #include "../common/malloc.h"  // aMalloc, aRealloc, aFree
 #include "../common/showmsg.h"  // ShowError, ShowWarning
 #include "../common/strlib.h"  // safestrncpy
@@ -22,13 +23,6 @@ enum e_searchstore_failure
 };
 
 
-enum e_searchstore_searchtype
-{
-	SEARCHTYPE_VENDING      = 0,
-	SEARCHTYPE_BUYING_STORE = 1,
-};
-
-
 enum e_searchstore_effecttype
 {
 	EFFECTTYPE_NORMAL = 0,
@@ -37,6 +31,26 @@ enum e_searchstore_effecttype
 };
 
 
+/// store that sells (buys) an item, see searchstore_index
+struct s_search_store_index_entry
+{
+	int account_id;
+	unsigned int price;  // of the first slot with the item
+};
+
+
+/// stores of an item, sorted by price
+struct s_search_store_index
+{
+	struct s_search_store_index_entry* entries;
+	int count, max;
+};
+
+
+/// open stores by item name id, per search type
+static DBMap* searchstore_index_db[SEARCHTYPE_MAX];  // nameid -> struct s_search_store_index*
+
+
 /// type for shop search function
 typedef bool (*searchstore_search_t)(struct map_session_data* sd, unsigned short nameid);
 typedef bool (*searchstore_searchall_t)(struct map_session_data* sd, const struct s_search_store_search* s);
@@ -116,9 +130,9 @@ void searchstore_query(struct map_session_data* sd, unsigned char type, unsigned
 {
 	unsigned int i;
 	struct map_session_data* pl_sd;
-	struct s_mapiterator* iter;
 	struct s_search_store_search s;
 	searchstore_searchall_t store_searchall;
+	bool full = false;
 	time_t querytime;
 
 	if( !battle_config.feature_search_stores )
@@ -194,23 +208,46 @@ void searchstore_query(struct map_session_data* sd, unsigned char type, unsigned
 	s.card_count = card_count;
 	s.min_price  = min_price;
 	s.max_price  = max_price;
-	iter         = mapit_geteachpc();
+	s.item_count = 1;  // one item at a time, from the index
 
-	for( pl_sd = (struct map_session_data*)mapit_first(iter); mapit_exists(iter);  pl_sd = (struct map_session_data*)mapit_next(iter) )
+	for( i = 0; i < item_count && !full; i++ )
 	{
-		if( sd == pl_sd )
-		{// skip own shop, if any
+		struct s_search_store_index* index = (struct s_search_store_index*)idb_get(searchstore_index_db[type], itemlist[i]);
+		int lo, hi;
+
+		if( index == NULL )
+		{// nobody sells (buys) it
 			continue;
 		}
 
-		if( !store_searchall(pl_sd, &s) )
-		{// exceeded result size
-			clif_search_store_info_failed(sd, SSI_FAILED_OVER_MAXCOUNT);
-			break;
+		// first store in the price range
+		for( lo = 0, hi = index->count; lo < hi; )
+		{
+			int mid = (lo+hi)/2;
+
+			if( index->entries[mid].price < min_price )
+				lo = mid+1;
+			else
+				hi = mid;
 		}
-	}
 
-	mapit_free(iter);
+		s.itemlist = &itemlist[i];
+
+		for( ; lo < index->count && ( !max_price || index->entries[lo].price <= max_price ); lo++ )
+		{
+			if( ( pl_sd = map_id2sd(index->entries[lo].account_id) ) == NULL || sd == pl_sd )
+			{// skip own shop, if any
+				continue;
+			}
+
+			if( !store_searchall(pl_sd, &s) )
+			{// exceeded result size
+				clif_search_store_info_failed(sd, SSI_FAILED_OVER_MAXCOUNT);
+				full = true;
+				break;
+			}
+		}
+	}
 
 	if( sd->searchstore.count )
 	{
@@ -403,3 +440,96 @@ bool searchstore_result(struct map_session_data* sd, int store_id, int account_i
 
 	return true;
 }
+
+
+/// adds a store to the index of an item, or updates its price
+void searchstore_index(unsigned char type, int account_id, unsigned short nameid, unsigned int price)
+{
+	struct s_search_store_index* index;
+	int i;
+
+	searchstore_unindex(type, account_id, nameid);
+
+	if( ( index = (struct s_search_store_index*)idb_get(searchstore_index_db[type], nameid) ) == NULL )
+	{
+		CREATE(index, struct s_search_store_index, 1);
+		idb_put(searchstore_index_db[type], nameid, index);
+	}
+
+	if( index->count == index->max )
+	{
+		index->max += 16;
+		RECREATE(index->entries, struct s_search_store_index_entry, index->max);
+	}
+
+	// keep it sorted by price, after the stores with the same price
+	for( i = index->count; i > 0 && index->entries[i-1].price > price; i-- )
+	{
+		index->entries[i] = index->entries[i-1];
+	}
+	index->entries[i].account_id = account_id;
+	index->entries[i].price = price;
+	index->count++;
+}
+
+
+/// removes a store from the index of an item
+void searchstore_unindex(unsigned char type, int account_id, unsigned short nameid)
+{
+	struct s_search_store_index* index;
+	int i;
+
+	if( ( index = (struct s_search_store_index*)idb_get(searchstore_index_db[type], nameid) ) == NULL )
+	{
+		return;
+	}
+
+	ARR_FIND( 0, index->count, i, index->entries[i].account_id == account_id );
+	if( i == index->count )
+	{// not indexed
+		return;
+	}
+
+	index->count--;
+	memmove(&index->entries[i], &index->entries[i+1], (index->count-i)*sizeof(index->entries[0]));
+
+	if( index->count == 0 )
+	{
+		idb_remove(searchstore_index_db[type], nameid);
+		aFree(index->entries);
+		aFree(index);
+	}
+}
+
+
+static int searchstore_index_final(DBKey key, void* data, va_list ap)
+{
+	struct s_search_store_index* index = (struct s_search_store_index*)data;
+
+	aFree(index->entries);
+	aFree(index);
+
+	return 0;
+}
+
+
+void do_init_searchstore(void)
+{
+	int i;
+
+	for( i = 0; i < SEARCHTYPE_MAX; i++ )
+	{
+		searchstore_index_db[i] = idb_alloc(DB_OPT_BASE);
+	}
+}
+
+
+void do_final_searchstore(void)
+{
+	int i;
+
+	for( i = 0; i < SEARCHTYPE_MAX; i++ )
+	{
+		searchstore_index_db[i]->destroy(searchstore_index_db[i], searchstore_index_final);
+	}
+}
@@ -6,6 +6,13 @@
 
 #define SEARCHSTORE_RESULTS_PER_PAGE 10
 
+enum e_searchstore_searchtype
+{
+	SEARCHTYPE_VENDING      = 0,
+	SEARCHTYPE_BUYING_STORE = 1,
+	SEARCHTYPE_MAX
+};
+
 /// information about the search being performed
 struct s_search_store_search
 {
@@ -53,5 +60,9 @@ void searchstore_click(struct map_session_data* sd, int account_id, int store_id
 bool searchstore_queryremote(struct map_session_data* sd, int account_id);
 void searchstore_clearremote(struct map_session_data* sd);
 bool searchstore_result(struct map_session_data* sd, int store_id, int account_id, const char* store_name, unsigned short nameid, unsigned short amount, unsigned int price, const short* card, unsigned char refine);
+void searchstore_index(unsigned char type, int account_id, unsigned short nameid, unsigned int price);
+void searchstore_unindex(unsigned char type, int account_id, unsigned short nameid);
+void do_init_searchstore(void);
+void do_final_searchstore(void);
 
 #endif  // _SEARCHSTORE_H_
@@ -54,6 +54,69 @@ static struct eri *skill_timer_ers = NULL; //For handling skill_timerskills [Sko
 
 DBMap* skillunit_db = NULL; // int id -> struct skill_unit*
 
+/// skill_unit_timer doesn't visit every unit on each pass. Units are kept
+/// in a wheel of slots under the tick of their next work: the next pass
+/// while they have an effect over time, their expiry otherwise. Code that
+/// shortens a limit or otherwise needs the unit looked at calls
+/// skill_unit_recheck. Rescheduling only changes skill_unit.serial, stale
+/// entries are skipped. Units of hibernating maps are parked until the map
+/// wakes up (see skill_unit_wakeup).
+#define SKILLUNIT_WHEEL_STEP 128 // ticks per slot (power of 2)
+#define SKILLUNIT_WHEEL_SIZE 1024 // slots (power of 2)
+
+struct skillunit_entry {
+	int id;
+	int serial; // skill_unit.serial when scheduled
+};
+
+static struct skillunit_slot {
+	struct skillunit_entry* data;
+	int count, max;
+} skillunit_wheel[SKILLUNIT_WHEEL_SIZE], skillunit_batch, skillunit_parked;
+
+static int skillunit_serial = 0;
+static unsigned int skillunit_cursor; // first tick of the next slot to be processed
+
+static void skill_unit_entry_push(struct skillunit_slot* slot, int id, int serial)
+{
+	if( slot->count == slot->max )
+	{
+		slot->max += 32;
+		RECREATE(slot->data, struct skillunit_entry, slot->max);
+	}
+	slot->data[slot->count].id = id;
+	slot->data[slot->count].serial = serial;
+	slot->count++;
+}
+
+/// Schedules the next visit of a unit by skill_unit_timer.
+static void skill_unit_schedule(struct skill_unit* unit, unsigned int due)
+{
+	unsigned int tick = ( DIFF_TICK(due, skillunit_cursor) < 0 ) ? skillunit_cursor : due;
+
+	if( ++skillunit_serial <= 0 )
+		skillunit_serial = 1;
+	unit->serial = skillunit_serial;
+	unit->due = due;
+	skill_unit_entry_push(&skillunit_wheel[(tick/SKILLUNIT_WHEEL_STEP)%SKILLUNIT_WHEEL_SIZE], unit->bl.id, unit->serial);
+}
+
+/// Has the unit looked at on the next pass of skill_unit_timer.
+static void skill_unit_recheck(struct skill_unit* unit)
+{
+	if( unit->alive )
+		skill_unit_schedule(unit, gettick());
+}
+
+/// Has all units of the group looked at on the next pass of skill_unit_timer.
+static void skill_unit_group_recheck(struct skill_unit_group* group)
+{
+	int i;
+
+	for( i = 0; i < group->unit_count; ++i )
+		skill_unit_recheck(&group->unit[i]);
+}
+
 DBMap* skilldb_name2id = NULL;
 struct s_skill_db skill_db[MAX_SKILL_DB];
 struct s_skill_produce_db skill_produce_db[MAX_SKILL_PRODUCE_DB];
@@ -5110,6 +5173,7 @@ int skill_castend_nodamage_id (struct block_list *src, struct block_list *bl, in
 						clif_changetraplook(bl, UNT_USED_TRAPS);
 						su->group->limit=DIFF_TICK(tick+1500,su->group->tick);
 						su->limit=DIFF_TICK(tick+1500,su->group->tick);
+						skill_unit_group_recheck(su->group);
 				}
 			}
 		}
@@ -6187,7 +6251,10 @@ int skill_castend_pos2(struct block_list* src, int x, int y, int skillid, int sk
 				return 0; // not to consume items
 			}
 			else
+			{
 				sg->limit = 0; //Disable it.
+				skill_unit_group_recheck(sg);
+			}
 		}
 		skill_unitsetting(src,skillid,skilllv,x,y,0);
 		break;
@@ -7172,6 +7239,7 @@ static int skill_unit_onplace (struct skill_unit *src, struct block_list *bl, un
 			else
 				sec = 3000; //Couldn't trap it?
 			sg->limit = DIFF_TICK(tick,sg->tick)+sec;
+			skill_unit_group_recheck(sg);
 		}
 		break;
 	case UNT_SAFETYWALL:
@@ -7455,6 +7523,7 @@ int skill_unit_onplace_timer (struct skill_unit *src, struct block_list *bl, uns
 						else
 						{ //should end when out of sp.
 							sg->limit = DIFF_TICK(tick,sg->tick);
+							skill_unit_group_recheck(sg);
 							break;
 						}
 					} while( x == bl->x && y == bl->y &&
@@ -7489,6 +7558,7 @@ int skill_unit_onplace_timer (struct skill_unit *src, struct block_list *bl, uns
 				sg->unit_id = UNT_USED_TRAPS;
 				clif_changetraplook(&src->bl, UNT_USED_TRAPS);
 				sg->limit=DIFF_TICK(tick,sg->tick)+1500;
+				skill_unit_group_recheck(sg);
 			}
 			break;
 
@@ -7509,6 +7579,7 @@ int skill_unit_onplace_timer (struct skill_unit *src, struct block_list *bl, uns
 					sec = 3000; //Couldn't trap it?
 				clif_skillunit_update(&src->bl);
 				sg->limit = DIFF_TICK(tick,sg->tick)+sec;
+				skill_unit_group_recheck(sg);
 				sg->interval = -1;
 				src->range = 0;
 			}
@@ -7532,6 +7603,7 @@ int skill_unit_onplace_timer (struct skill_unit *src, struct block_list *bl, uns
 				clif_changetraplook(&src->bl, sg->unit_id==UNT_LANDMINE?UNT_FIREPILLAR_ACTIVE:UNT_USED_TRAPS);
 			src->range = -1; //Disable range so it does not invoke a for each in area again.
 			sg->limit=DIFF_TICK(tick,sg->tick)+1500;
+			skill_unit_group_recheck(sg);
 			break;
 
 		case UNT_TALKIEBOX:
@@ -7542,6 +7614,7 @@ int skill_unit_onplace_timer (struct skill_unit *src, struct block_list *bl, uns
 				sg->unit_id = UNT_USED_TRAPS;
 				clif_changetraplook(&src->bl, UNT_USED_TRAPS);
 				sg->limit = DIFF_TICK(tick, sg->tick) + 5000;
+				skill_unit_group_recheck(sg);
 				sg->val2 = -1;
 			}
 			break;
@@ -7707,6 +7780,7 @@ int skill_unit_onplace_timer (struct skill_unit *src, struct block_list *bl, uns
 			sg->unit_id = UNT_USED_TRAPS;
 			//clif_changetraplook(&src->bl, UNT_FIREPILLAR_ACTIVE);
 			sg->limit=DIFF_TICK(tick,sg->tick)+1500;
+			skill_unit_group_recheck(sg);
 			break;
 	}
 
@@ -7767,6 +7841,7 @@ int skill_unit_onout (struct skill_unit *src, struct block_list *bl, unsigned in
 				if (sce && sce->val3 == sg->group_id)
 					status_change_end(bl, type, INVALID_TIMER);
 				sg->limit = DIFF_TICK(tick,sg->tick)+1000;
+				skill_unit_group_recheck(sg);
 			}
 			break;
 		}
@@ -7934,6 +8009,7 @@ int skill_unit_ondamaged (struct skill_unit *src, struct block_list *bl, int dam
 	case UNT_ANKLESNARE:
 	case UNT_ICEWALL:
 		src->val1-=damage;
+		skill_unit_recheck(src); // traps are used up when out of hp
 		break;
 	case UNT_BLASTMINE:
 	case UNT_CLAYMORETRAP:
@@ -9951,6 +10027,12 @@ bool skill_check_cloaking(struct block_list *bl, struct status_change_entry *sce
 	return wall;
 }
 
+/// Updates the flag that tells skill_unit_move if there is a skill unit on the cell.
+static void skill_unit_updatecell(int m, int x, int y)
+{
+	map_setcell(m, x, y, CELL_SKILL, map_count_oncell(m, x, y, BL_SKILL) > 0);
+}
+
 /*==========================================
  *
  *------------------------------------------*/
@@ -9978,6 +10060,8 @@ struct skill_unit *skill_initunit (struct skill_unit_group *group, int idx, int
 	idb_put(skillunit_db, unit->bl.id, unit);
 	map_addiddb(&unit->bl);
 	map_addblock(&unit->bl);
+	map_setcell(unit->bl.m, unit->bl.x, unit->bl.y, CELL_SKILL, true);
+	skill_unit_schedule(unit, gettick());
 
 	// perform oninit actions
 	switch (group->skill_id) {
@@ -10048,6 +10132,7 @@ int skill_delunit (struct skill_unit* unit)
 
 	unit->group=NULL;
 	map_delblock(&unit->bl); // don't free yet
+	skill_unit_updatecell(unit->bl.m, unit->bl.x, unit->bl.y);
 	map_deliddb(&unit->bl);
 	idb_remove(skillunit_db, unit->bl.id);
 	if(--group->alive_count==0)
@@ -10321,11 +10406,9 @@ int skill_unit_timer_sub_onplace (struct block_list* bl, va_list ap)
 /*==========================================
  *
  *------------------------------------------*/
-static int skill_unit_timer_sub (DBKey key, void* data, va_list ap)
+static int skill_unit_timer_sub (struct skill_unit* unit, unsigned int tick)
 {
-	struct skill_unit* unit = (struct skill_unit*)data;
 	struct skill_unit_group* group = unit->group;
-	unsigned int tick = va_arg(ap,unsigned int);
   	bool dissonance;
 	struct block_list* bl = &unit->bl;
 
@@ -10472,22 +10555,93 @@ static int skill_unit_timer_sub (DBKey key, void* data, va_list ap)
 
   	if( dissonance ) skill_dance_switch(unit, 1);
 
+	if( !unit->alive )
+		return 0; // deleted by its own effect
+	group = unit->group;
+
+	// next pass while it has an effect over time, at its expiry otherwise
+	if( (unit->range >= 0 && group->interval != -1) || group->unit_id == UNT_ICEWALL )
+		skill_unit_schedule(unit, tick + SKILLUNITTIMER_INTERVAL);
+	else
+		skill_unit_schedule(unit, group->tick + min(group->limit, unit->limit));
+
 	return 0;
 }
 /*==========================================
- * Executes on all skill units every SKILLUNITTIMER_INTERVAL miliseconds.
+ * Executes every SKILLUNITTIMER_INTERVAL miliseconds on the skill units
+ * that are due (see skillunit_wheel).
  *------------------------------------------*/
 int skill_unit_timer(int tid, unsigned int tick, int id, intptr_t data)
 {
+	struct skill_unit* unit;
+	int i, n;
+
 	map_freeblock_lock();
 
-	skillunit_db->foreach(skillunit_db, skill_unit_timer_sub, tick);
+	// collect the due entries
+	skillunit_batch.count = 0;
+	for( n = 0; n < SKILLUNIT_WHEEL_SIZE; ++n )
+	{
+		struct skillunit_slot* slot = &skillunit_wheel[(skillunit_cursor/SKILLUNIT_WHEEL_STEP)%SKILLUNIT_WHEEL_SIZE];
+		int kept = 0;
+
+		for( i = 0; i < slot->count; ++i )
+		{
+			struct skillunit_entry* e = &slot->data[i];
+
+			unit = (struct skill_unit*)idb_get(skillunit_db, e->id);
+			if( unit == NULL || unit->serial != e->serial )
+				continue; // deleted or rescheduled
+			if( DIFF_TICK(unit->due, tick) > 0 )
+				slot->data[kept++] = *e; // later in this slot or a later turn of the wheel
+			else if( map[unit->bl.m].hibernate_tick )
+				skill_unit_entry_push(&skillunit_parked, e->id, e->serial);
+			else
+				skill_unit_entry_push(&skillunit_batch, e->id, e->serial);
+		}
+		slot->count = kept;
+
+		if( DIFF_TICK(skillunit_cursor + SKILLUNIT_WHEEL_STEP, tick) > 0 )
+			break; // slot of this tick, looked at again on the next pass
+		skillunit_cursor += SKILLUNIT_WHEEL_STEP;
+	}
+	if( n == SKILLUNIT_WHEEL_SIZE )
+		skillunit_cursor = tick&~(SKILLUNIT_WHEEL_STEP-1); // stalled for a whole turn, everything due was collected
+
+	for( i = 0; i < skillunit_batch.count; ++i )
+	{
+		unit = (struct skill_unit*)idb_get(skillunit_db, skillunit_batch.data[i].id);
+		if( unit != NULL && unit->serial == skillunit_batch.data[i].serial )
+			skill_unit_timer_sub(unit, tick);
+	}
 
 	map_freeblock_unlock();
 
 	return 0;
 }
 
+/*==========================================
+ * Puts the parked skill units of a map that woke up back into the wheel.
+ *------------------------------------------*/
+void skill_unit_wakeup(int m)
+{
+	int i, kept = 0;
+
+	for( i = 0; i < skillunit_parked.count; ++i )
+	{
+		struct skillunit_entry* e = &skillunit_parked.data[i];
+		struct skill_unit* unit = (struct skill_unit*)idb_get(skillunit_db, e->id);
+
+		if( unit == NULL || unit->serial != e->serial )
+			continue; // deleted or rescheduled
+		if( unit->bl.m == m )
+			skill_unit_schedule(unit, gettick());
+		else
+			skillunit_parked.data[kept++] = *e;
+	}
+	skillunit_parked.count = kept;
+}
+
 static int skill_unit_temp[20];  // temporary storage for tracking skill unit skill ids as players move in/out of them
 /*==========================================
  *
@@ -10616,7 +10770,8 @@ int skill_unit_move (struct block_list *bl, unsigned int tick, int flag)
 		memset(skill_unit_temp, 0, sizeof(skill_unit_temp));
 	}
 
-	map_foreachincell(skill_unit_move_sub,bl->m,bl->x,bl->y,BL_SKILL,bl,tick,flag);
+	if( map_getcell(bl->m,bl->x,bl->y,CELL_CHKSKILL) )
+		map_foreachincell(skill_unit_move_sub,bl->m,bl->x,bl->y,BL_SKILL,bl,tick,flag);
 
 	if( flag&2 && flag&1 )
 	{	//Onplace, check any skill units you have left.
@@ -10634,7 +10789,7 @@ int skill_unit_move (struct block_list *bl, unsigned int tick, int flag)
  *------------------------------------------*/
 int skill_unit_move_unit_group (struct skill_unit_group *group, int m, int dx, int dy)
 {
-	int i,j;
+	int i,j,x,y;
 	unsigned int tick = gettick();
 	int *m_flag;
 	struct skill_unit *unit1;
@@ -10685,6 +10840,8 @@ int skill_unit_move_unit_group (struct skill_unit_group *group, int m, int dx, i
 				skill_dance_overlap(unit1, 0);
 			map_foreachincell(skill_unit_effect,unit1->bl.m,unit1->bl.x,unit1->bl.y,group->bl_flag,&unit1->bl,tick,4);
 		}
+		x = unit1->bl.x;
+		y = unit1->bl.y;
 		//Move Cell using "smart" criteria (avoid useless moving around)
 		switch(m_flag[i])
 		{
@@ -10710,6 +10867,10 @@ int skill_unit_move_unit_group (struct skill_unit_group *group, int m, int dx, i
 			case 3:
 				break; //Don't move the cell as a cell will end on this tile anyway.
 		}
+		if (x != unit1->bl.x || y != unit1->bl.y) {
+			skill_unit_updatecell(unit1->bl.m, x, y);
+			map_setcell(unit1->bl.m, unit1->bl.x, unit1->bl.y, CELL_SKILL, true);
+		}
 		if (!(m_flag[i]&0x2)) { //We only moved the cell in 0-1
 			if (group->state.song_dance&0x1) //Check for dissonance effect.
 				skill_dance_overlap(unit1, 1);
@@ -11875,9 +12036,9 @@ int do_init_skill (void)
 	skill_readdb();
 
 	group_db = idb_alloc(DB_OPT_BASE);
-	skillunit_db = idb_alloc(DB_OPT_BASE);
-	skill_unit_ers = ers_new(sizeof(struct skill_unit_group));
-	skill_timer_ers  = ers_new(sizeof(struct skill_timerskill));
+	skillunit_db = idb_alloc(DB_OPT_OPEN_HASH);
+	skill_unit_ers = ers_new(sizeof(struct skill_unit_group), "skill_unit_group", MEMTAG_ERS);
+	skill_timer_ers  = ers_new(sizeof(struct skill_timerskill), "skill_timerskill", MEMTAG_ERS);
 
 	add_timer_func_list(skill_unit_timer,"skill_unit_timer");
 	add_timer_func_list(skill_castend_id,"skill_castend_id");
@@ -11885,6 +12046,7 @@ int do_init_skill (void)
 	add_timer_func_list(skill_timerskill,"skill_timerskill");
 	add_timer_func_list(skill_blockpc_end, "skill_blockpc_end");
 
+	skillunit_cursor = gettick()&~(SKILLUNIT_WHEEL_STEP-1);
 	add_timer_interval(gettick()+SKILLUNITTIMER_INTERVAL,skill_unit_timer,0,0,SKILLUNITTIMER_INTERVAL);
 
 	return 0;
@@ -11892,6 +12054,12 @@ int do_init_skill (void)
 
 int do_final_skill(void)
 {
+	int i;
+
+	for( i = 0; i < SKILLUNIT_WHEEL_SIZE; ++i )
+		aFree(skillunit_wheel[i].data);
+	aFree(skillunit_batch.data);
+	aFree(skillunit_parked.data);
 	db_destroy(skilldb_name2id);
 	db_destroy(group_db);
 	db_destroy(skillunit_db);
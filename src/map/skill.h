@@ -164,6 +164,8 @@ struct skill_unit {
 	int limit;
 	int val1,val2;
 	short alive,range;
+	int serial; // entry of the unit in the schedule of skill_unit_timer
+	unsigned int due; // tick of the next visit by skill_unit_timer
 };
 
 #define MAX_SKILLUNITGROUPTICKSET 25
@@ -281,6 +283,7 @@ struct skill_unit_group* skill_id2group(int group_id);
 struct skill_unit_group *skill_unitsetting(struct block_list* src, short skillid, short skilllv, short x, short y, int flag);
 struct skill_unit *skill_initunit (struct skill_unit_group *group, int idx, int x, int y, int val1, int val2);
 int skill_delunit(struct skill_unit *unit);
+void skill_unit_wakeup(int m);
 struct skill_unit_group *skill_initunitgroup(struct block_list* src, int count, short skillid, short skilllv, int unit_id, int limit, int interval);
 int skill_delunitgroup_(struct skill_unit_group *group, const char* file, int line, const char* func);
 #define skill_delunitgroup(group) skill_delunitgroup_(group,__FILE__,__LINE__,__func__)
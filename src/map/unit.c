@@ -53,7 +53,144 @@ struct unit_data* unit_bl2ud(struct block_list *bl)
 }
 
 static int unit_attack_timer(int tid, unsigned int tick, int id, intptr_t data);
-static int unit_walktoxy_timer(int tid, unsigned int tick, int id, intptr_t data);
+static int unit_walk_step(int id, unsigned int tick, int serial);
+
+/// Walking units don't have a timer each, the steps that are due are done
+/// in batches ordered by map and block (see unit_walk_batch_timer).
+/// Units are kept in a wheel of per-tick slots. Stopping only invalidates
+/// the serial in unit_data.walktimer, stale entries are skipped.
+#define WALK_WHEEL_SIZE 2048 // ticks, more than the longest step (diagonal at the slowest speed)
+
+struct walk_entry {
+	int id;
+	int serial; // unit_data.walktimer when scheduled
+	unsigned int tick; // unit_data.walk_tick, set when collected
+	int m, block; // sort key (map, block index)
+};
+
+static struct walk_slot {
+	struct walk_entry* data;
+	int count, max;
+} walk_wheel[WALK_WHEEL_SIZE];
+
+static struct walk_entry* walk_batch = NULL;
+static int walk_batch_max = 0;
+static int walk_serial = 0;
+static unsigned int walk_cursor; // next tick of the wheel to be processed
+static int walk_batch_tid = INVALID_TIMER;
+static unsigned int walk_batch_tick; // tick of walk_batch_tid
+
+static int unit_walk_batch_timer(int tid, unsigned int tick, int id, intptr_t data);
+
+/// Arms the batch timer for a step due at tick, unless it fires earlier already.
+static void unit_walk_arm(unsigned int tick)
+{
+	if( walk_batch_tid != INVALID_TIMER )
+	{
+		if( DIFF_TICK(walk_batch_tick, tick) <= 0 )
+			return;
+		delete_timer(walk_batch_tid, unit_walk_batch_timer);
+	}
+	walk_batch_tick = tick;
+	walk_batch_tid = add_timer(tick, unit_walk_batch_timer, 0, 0);
+}
+
+/// Schedules the next step of a unit after interval ms.
+static void unit_walk_schedule(struct block_list* bl, struct unit_data* ud, unsigned int tick, int interval)
+{
+	struct walk_slot* slot;
+	unsigned int due = tick + interval;
+
+	if( ++walk_serial <= 0 )
+		walk_serial = 1; // keep it apart from INVALID_TIMER and the -2 marker
+	ud->walktimer = walk_serial;
+	ud->walk_tick = due;
+	ud->walk_interval = interval;
+
+	slot = &walk_wheel[( DIFF_TICK(due, walk_cursor) < 0 ? walk_cursor : due )%WALK_WHEEL_SIZE];
+	if( slot->count == slot->max )
+	{
+		slot->max += 32;
+		RECREATE(slot->data, struct walk_entry, slot->max);
+	}
+	slot->data[slot->count].id = bl->id;
+	slot->data[slot->count].serial = walk_serial;
+	slot->count++;
+	unit_walk_arm(DIFF_TICK(due, walk_cursor) < 0 ? walk_cursor : due);
+}
+
+static int unit_walk_entry_cmp(const void* p1, const void* p2)
+{
+	const struct walk_entry* a = (const struct walk_entry*)p1;
+	const struct walk_entry* b = (const struct walk_entry*)p2;
+
+	if( a->m != b->m )
+		return a->m - b->m;
+	if( a->block != b->block )
+		return a->block - b->block;
+	return a->id - b->id;
+}
+
+/// Does the steps of all units that are due, grouped by map and block.
+static int unit_walk_batch_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	unsigned int now = gettick();
+	int count = 0;
+	int i, n;
+
+	walk_batch_tid = INVALID_TIMER;
+
+	// collect the due entries
+	for( n = 0; n < WALK_WHEEL_SIZE && DIFF_TICK(walk_cursor, now) <= 0; ++n, ++walk_cursor )
+	{
+		struct walk_slot* slot = &walk_wheel[walk_cursor%WALK_WHEEL_SIZE];
+		int kept = 0;
+
+		for( i = 0; i < slot->count; ++i )
+		{
+			struct walk_entry* e = &slot->data[i];
+			struct block_list* bl = map_id2bl(e->id);
+			struct unit_data* ud = unit_bl2ud(bl);
+
+			if( ud == NULL || ud->walktimer != e->serial )
+				continue; // stopped or rescheduled
+			if( DIFF_TICK(ud->walk_tick, now) > 0 )
+			{// a later turn of the wheel
+				slot->data[kept++] = *e;
+				continue;
+			}
+			if( count == walk_batch_max )
+			{
+				walk_batch_max += 256;
+				RECREATE(walk_batch, struct walk_entry, walk_batch_max);
+			}
+			e->tick = ud->walk_tick;
+			e->m = bl->m;
+			e->block = ( bl->m >= 0 ) ? bl->x/BLOCK_SIZE + (bl->y/BLOCK_SIZE)*map[bl->m].bxs : 0;
+			walk_batch[count++] = *e;
+		}
+		slot->count = kept;
+	}
+	if( n == WALK_WHEEL_SIZE )
+		walk_cursor = now + 1; // stalled for a whole turn, everything due was collected
+
+	// steps
+	if( count > 1 )
+		qsort(walk_batch, count, sizeof(struct walk_entry), unit_walk_entry_cmp);
+	for( i = 0; i < count; ++i )
+		unit_walk_step(walk_batch[i].id, walk_batch[i].tick, walk_batch[i].serial);
+
+	// next slot with units, the steps may have armed the timer at a later one
+	for( n = 0; n < WALK_WHEEL_SIZE; ++n )
+	{
+		if( walk_wheel[(walk_cursor + n)%WALK_WHEEL_SIZE].count )
+		{
+			unit_walk_arm(walk_cursor + n);
+			break;
+		}
+	}
+	return 0;
+}
 
 int unit_walktoxy_sub(struct block_list *bl)
 {
@@ -103,11 +240,13 @@ int unit_walktoxy_sub(struct block_list *bl)
 	else
 		i = status_get_speed(bl);
 	if( i > 0)
-		ud->walktimer = add_timer(gettick()+i,unit_walktoxy_timer,bl->id,i);
+		unit_walk_schedule(bl, ud, gettick(), i);
 	return 1;
 }
 
-static int unit_walktoxy_timer(int tid, unsigned int tick, int id, intptr_t data)
+/// Moves the unit one cell along its walkpath.
+/// serial is the one the step was scheduled with, INVALID_TIMER when invoked directly.
+static int unit_walk_step(int id, unsigned int tick, int serial)
 {
 	int i;
 	int x,y,dx,dy;
@@ -126,10 +265,8 @@ static int unit_walktoxy_timer(int tid, unsigned int tick, int id, intptr_t data
 	
 	if(ud == NULL) return 0;
 
-	if(ud->walktimer != tid){
-		ShowError("unit_walk_timer mismatch %d != %d\n",ud->walktimer,tid);
-		return 0;
-	}
+	if(ud->walktimer != serial && serial != INVALID_TIMER)
+		return 0; // stopped or rescheduled
 	ud->walktimer = INVALID_TIMER;
 	if( bl->prev == NULL ) return 0; // block_list 甲Ă̂ňړ~
 
@@ -206,7 +343,7 @@ static int unit_walktoxy_timer(int tid, unsigned int tick, int id, intptr_t data
 		if (md->min_chase > md->db->range3) md->min_chase--;
 		//Walk skills are triggered regardless of target due to the idle-walk mob state.
 		//But avoid triggering on stop-walk calls.
-		if(tid != INVALID_TIMER &&
+		if(serial != INVALID_TIMER &&
 			!(ud->walk_count%WALK_SKILL_INTERVAL) &&
 			mobskill_use(md, tick, -1))
 	  	{
@@ -220,7 +357,7 @@ static int unit_walktoxy_timer(int tid, unsigned int tick, int id, intptr_t data
 		}
 	}
 
-	if(tid == INVALID_TIMER) //A directly invoked timer is from battle_stop_walking, therefore the rest is irrelevant.
+	if(serial == INVALID_TIMER) //A directly invoked step is from unit_stop_walking, therefore the rest is irrelevant.
 		return 0;
 		
 	if(ud->state.change_walk_target)
@@ -235,7 +372,7 @@ static int unit_walktoxy_timer(int tid, unsigned int tick, int id, intptr_t data
 		i = status_get_speed(bl);
 
 	if(i > 0)
-		ud->walktimer = add_timer(tick+i,unit_walktoxy_timer,id,i);
+		unit_walk_schedule(bl, ud, tick, i);
 	else if(ud->state.running) {
 		//Keep trying to run.
 		if (!unit_run(bl))
@@ -732,26 +869,20 @@ int unit_warp(struct block_list *bl,short m,short x,short y,clr_type type)
 int unit_stop_walking(struct block_list *bl,int type)
 {
 	struct unit_data *ud;
-	const struct TimerData* td;
 	unsigned int tick;
 	nullpo_ret(bl);
 
 	ud = unit_bl2ud(bl);
 	if(!ud || ud->walktimer == INVALID_TIMER)
 		return 0;
-	//NOTE: We are using timer data after deleting it because we know the 
-	//delete_timer function does not messes with it. If the function's 
-	//behaviour changes in the future, this code could break!
-	td = get_timer(ud->walktimer);
-	delete_timer(ud->walktimer, unit_walktoxy_timer);
-	ud->walktimer = INVALID_TIMER;
+	ud->walktimer = INVALID_TIMER; // the entry in the walk wheel is skipped
 	ud->state.change_walk_target = 0;
 	tick = gettick();
 	if( (type&0x02 && !ud->walkpath.path_pos) //Force moving at least one cell.
-	||  (type&0x04 && td && DIFF_TICK(td->tick, tick) <= td->data/2) //Enough time has passed to cover half-cell
+	||  (type&0x04 && DIFF_TICK(ud->walk_tick, tick) <= ud->walk_interval/2) //Enough time has passed to cover half-cell
 	) {	
 		ud->walkpath.path_len = ud->walkpath.path_pos+1;
-		unit_walktoxy_timer(INVALID_TIMER, tick, bl->id, ud->walkpath.path_pos);
+		unit_walk_step(bl->id, tick, INVALID_TIMER);
 	}
 
 	if(type&0x01)
@@ -1921,6 +2052,7 @@ int unit_remove_map_(struct block_list *bl, clr_type clrtype, const char* file,
 			sd->pvp_timer = INVALID_TIMER;
 			sd->pvp_rank = 0;
 		}
+		pc_pvprank_leave(sd);
 		if(sd->duel_group > 0)
 			duel_leave(sd->duel_group, sd);
 
@@ -1951,8 +2083,11 @@ int unit_remove_map_(struct block_list *bl, clr_type clrtype, const char* file,
 				sd->debug_file, sd->debug_line, sd->debug_func, file, line, func);
 		}
 		else
-		if (--map[bl->m].users == 0 && battle_config.dynamic_mobs)	//[Skotlex]
-			map_removemobs(bl->m);
+		if (--map[bl->m].users == 0) {
+			map[bl->m].empty_tick = gettick();
+			if (battle_config.dynamic_mobs)	//[Skotlex]
+				map_removemobs(bl->m);
+		}
 		if( map[bl->m].instance_id )
 		{
 			instance[map[bl->m].instance_id].users--;
@@ -2213,6 +2348,7 @@ int unit_free(struct block_list *bl, clr_type clrtype)
 				{// permanently remove the mob
 					if( --md->spawn->num == 0 )
 					{// Last freed mob is responsible for deallocating the group's spawn data.
+						aFree(md->spawn->walkcell.xy);
 						aFree(md->spawn);
 						md->spawn = NULL;
 					}
@@ -2276,7 +2412,8 @@ int unit_free(struct block_list *bl, clr_type clrtype)
 int do_init_unit(void)
 {
 	add_timer_func_list(unit_attack_timer,  "unit_attack_timer");
-	add_timer_func_list(unit_walktoxy_timer,"unit_walktoxy_timer");
+	add_timer_func_list(unit_walk_batch_timer,"unit_walk_batch_timer");
+	walk_cursor = gettick();
 	add_timer_func_list(unit_walktobl_sub, "unit_walktobl_sub");
 	add_timer_func_list(unit_delay_walktoxy_timer,"unit_delay_walktoxy_timer");
 	return 0;
@@ -2284,6 +2421,12 @@ int do_init_unit(void)
 
 int do_final_unit(void)
 {
-	// nothing to do
+	int i;
+
+	for( i = 0; i < WALK_WHEEL_SIZE; ++i )
+		if( walk_wheel[i].data )
+			aFree(walk_wheel[i].data);
+	if( walk_batch )
+		aFree(walk_batch);
 	return 0;
 }
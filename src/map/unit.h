@@ -28,7 +28,9 @@ struct unit_data {
 	int   skilltimer;
 	int   target;
 	int   attacktimer;
-	int   walktimer;
+	int   walktimer; // serial of the scheduled step while walking (see unit_walk_schedule), INVALID_TIMER otherwise
+	unsigned int walk_tick; // tick the next step is due
+	int   walk_interval; // duration of the current step
 	int	chaserange;
 	unsigned int attackabletime;
 	unsigned int canact_tick;
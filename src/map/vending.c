@@ -15,6 +15,7 @@
 #include "skill.h"
 #include "battle.h"
 #include "log.h"
+#include "searchstore.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -27,15 +28,31 @@ static int vending_getuid(void)
 	return vending_nextid++;
 }
 
+/// Updates the search store index for an item of the shop.
+static void vending_index(struct map_session_data* sd, unsigned short nameid)
+{
+	int i;
+
+	ARR_FIND( 0, sd->vend_num, i, sd->status.cart[sd->vending[i].index].nameid == (short)nameid );
+	if( sd->state.vending && i < sd->vend_num )
+		searchstore_index(SEARCHTYPE_VENDING, sd->status.account_id, nameid, sd->vending[i].value);
+	else
+		searchstore_unindex(SEARCHTYPE_VENDING, sd->status.account_id, nameid);
+}
+
 /*==========================================
  * Close shop
  *------------------------------------------*/
 void vending_closevending(struct map_session_data* sd)
 {
+	int i;
+
 	nullpo_retv(sd);
 
 	if( sd->state.vending )
 	{
+		for( i = 0; i < sd->vend_num; i++ )
+			searchstore_unindex(SEARCHTYPE_VENDING, sd->status.account_id, sd->status.cart[sd->vending[i].index].nameid);
 		sd->state.vending = false;
 		clif_closevendingboard(&sd->bl, 0);
 	}
@@ -71,6 +88,7 @@ void vending_vendinglistreq(struct map_session_data* sd, int id)
 void vending_purchasereq(struct map_session_data* sd, int aid, int uid, const uint8* data, int count)
 {
 	int i, j, cursor, w, new_ = 0, blank, vend_list[MAX_VENDING];
+	unsigned short sold[MAX_VENDING]; // name ids, to update the search index
 	double z;
 	struct s_vending vending[MAX_VENDING]; // against duplicate packets
 	struct map_session_data* vsd = map_id2sd(aid);
@@ -186,6 +204,7 @@ void vending_purchasereq(struct map_session_data* sd, int aid, int uid, const ui
 		log_pick( &sd->bl, LOG_TYPE_VENDING, vsd->status.cart[idx].nameid,  amount, &vsd->status.cart[idx]);
 
 		// vending item
+		sold[i] = vsd->status.cart[idx].nameid;
 		pc_additem(sd, &vsd->status.cart[idx], amount);
 		vsd->vending[vend_list[i]].amount -= amount;
 		pc_cart_delitem(vsd, idx, amount, 0);
@@ -217,6 +236,10 @@ void vending_purchasereq(struct map_session_data* sd, int aid, int uid, const ui
 	}
 	vsd->vend_num = cursor;
 
+	// sold out items leave the search index
+	for( i = 0; i < count; i++ )
+		vending_index(vsd, sold[i]);
+
 	//Always save BOTH: buyer and customer
 	if( save_settings&2 )
 	{
@@ -309,6 +332,9 @@ void vending_openvending(struct map_session_data* sd, const char* message, bool
 	sd->vend_num = i;
 	safestrncpy(sd->message, message, MESSAGE_SIZE);
 
+	for( i = 0; i < sd->vend_num; i++ )
+		vending_index(sd, sd->status.cart[sd->vending[i].index].nameid);
+
 	pc_stop_walking(sd,1);
 	clif_openvending(sd,sd->bl.id,sd->vending);
 	clif_showvendingboard(&sd->bl,message,0);
@@ -0,0 +1,137 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "../common/cbasetypes.h"
+#include "../common/core.h"
+#include "../common/db.h"
+#include "../common/malloc.h"
+#include "../common/showmsg.h"
+#include "../common/timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compares the speed of the database engines with int keys.
+// Usage: dbbench [--count <entries>] [--rounds <lookups per entry>]
+
+int bench_count = 0; // 0 = 1000, 100000 and 1000000 entries
+int bench_rounds = 10;
+
+static uint32 bench_seed;
+
+/// Pseudo random keys, same sequence for every engine.
+static int bench_key(void)
+{
+	bench_seed = bench_seed*1103515245 + 12345;
+	return (int)(bench_seed&0x7fffffff);
+}
+
+/// Runs the benchmark on one database and prints the times in ms.
+/// Returns a checksum of the results, so engines can be compared.
+static uint32 bench_run(const char* name, DBOptions options, int count)
+{
+	DBMap* db = idb_alloc(options);
+	DBIterator* iter;
+	uint32 sum = 0;
+	unsigned int tick;
+	unsigned int t_put, t_get, t_miss, t_iter, t_remove;
+	int* keys;
+	int i, r;
+
+	CREATE(keys, int, count);
+	bench_seed = 42;
+	for( i = 0; i < count; ++i )
+		keys[i] = ( i%2 ) ? 2000000 + i : bench_key(); // half game object ids, half random ids
+
+	tick = gettick_nocache();
+	for( i = 0; i < count; ++i )
+		idb_put(db, keys[i], (void*)(intptr_t)(i+1));
+	t_put = gettick_nocache() - tick;
+
+	tick = gettick_nocache();
+	for( r = 0; r < bench_rounds; ++r )
+		for( i = 0; i < count; ++i )
+			sum += (uint32)(intptr_t)idb_get(db, keys[i]);
+	t_get = gettick_nocache() - tick;
+
+	tick = gettick_nocache();
+	for( r = 0; r < bench_rounds; ++r )
+		for( i = 0; i < count; ++i )
+			sum += ( idb_get(db, -1-keys[i]) != NULL );
+	t_miss = gettick_nocache() - tick;
+
+	tick = gettick_nocache();
+	iter = db_iterator(db);
+	for( r = (int)(intptr_t)dbi_first(iter); dbi_exists(iter); r = (int)(intptr_t)dbi_next(iter) )
+	{
+		sum += (uint32)r;
+		if( r%3 == 0 ) // removing while iterating
+			iter->remove(iter);
+	}
+	dbi_destroy(iter);
+	for( i = 0; i < count; ++i )
+		if( (i+1)%3 == 0 )
+			idb_put(db, keys[i], (void*)(intptr_t)(i+1));
+	t_iter = gettick_nocache() - tick;
+
+	tick = gettick_nocache();
+	for( i = 0; i < count; i += 2 )
+		sum += (uint32)(intptr_t)idb_remove(db, keys[i]);
+	for( i = 0; i < count; i += 2 )
+		idb_put(db, keys[i], (void*)(intptr_t)(i+1));
+	for( i = 0; i < count; ++i )
+		sum += (uint32)(intptr_t)idb_remove(db, keys[i]);
+	t_remove = gettick_nocache() - tick;
+
+	sum += db->size(db);
+	db_destroy(db);
+	aFree(keys);
+
+	ShowInfo("%-10s %8d entries: put %5u ms, get %5u ms, miss %5u ms, iterate %5u ms, remove %5u ms (checksum %08x)\n", name, count, t_put, t_get, t_miss, t_iter, t_remove, sum);
+	return sum;
+}
+
+static void bench(int count)
+{
+	uint32 sum_tree = bench_run("rb-tree", DB_OPT_BASE, count);
+	uint32 sum_open = bench_run("open-hash", DB_OPT_OPEN_HASH, count);
+
+	if( sum_tree != sum_open )
+		ShowError("Results of the database engines differ with %d entries!\n", count);
+}
+
+int do_init(int argc, char** argv)
+{
+	int i;
+
+	for( i = 1; i < argc; ++i )
+	{
+		if( strcmp(argv[i], "--count") == 0 && i+1 < argc )
+			bench_count = atoi(argv[++i]);
+		else if( strcmp(argv[i], "--rounds") == 0 && i+1 < argc )
+		{
+			bench_rounds = atoi(argv[++i]);
+			bench_rounds = max(1, bench_rounds);
+		}
+	}
+
+	ShowStatus("Comparing database engines (%d lookups per entry)\n", bench_rounds);
+	if( bench_count > 0 )
+		bench(bench_count);
+	else
+	{
+		bench(1000);
+		bench(100000);
+		bench(1000000);
+	}
+
+	runflag = SERVER_STATE_STOP; // MINICORE
+	return 0;
+}
+
+void do_final(void) { }
+int parse_console(const char* buf) { return 0; }
+void set_server_type(void) { }
+void do_shutdown(void) { }
+void do_abort(void) { }
@@ -0,0 +1,387 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "../common/cbasetypes.h"
+#include "../common/core.h"
+#include "../common/db.h" // ARR_FIND
+#include "../common/malloc.h"
+#include "../common/random.h"
+#include "../common/showmsg.h"
+#include "../common/timer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compares the item group picks and mob drop rolls of the alias tables and
+// precomputed drop tables with the way itemdb and mob_dead did them before.
+// The kills come in waves, like a Magnus Exorcismus over a dense spawn.
+// Usage: dropbench [--kills <mobs killed>] [--wave <mobs per cast>] [--picks <group picks>]
+
+#define BENCH_MOB_DB 1000
+#define BENCH_MOB_DROP 10 // MAX_MOB_DROP
+#define BENCH_MAX_ITEM 0x8000
+#define BENCH_MAX_RANDITEM 11000 // the old size of an item group
+
+int bench_kills = 2000000;
+int bench_wave = 120;
+int bench_picks = 20000000;
+
+// battle_config values of a typical high rate server
+int drop_rate0item = 0;
+int drops_by_luk = 0;
+int drops_by_luk2 = 10;
+int pk_mode = 0;
+
+static uint32 bench_seed = 42;
+
+static int bench_rand(int n)
+{
+	bench_seed = bench_seed*1103515245 + 12345;
+	return (int)((bench_seed>>8)%(uint32)n);
+}
+
+static bool bench_item_exists[BENCH_MAX_ITEM];
+
+/// itemdb_exists, an array lookup that the compiler can't see through.
+static bool bench_itemdb_exists(int nameid) __attribute__((noinline));
+static bool bench_itemdb_exists(int nameid)
+{
+	return ( nameid > 0 && nameid < BENCH_MAX_ITEM && bench_item_exists[nameid] );
+}
+
+/// status_get_luk
+static int bench_get_luk(const int* luk) __attribute__((noinline));
+static int bench_get_luk(const int* luk)
+{
+	return *luk;
+}
+
+/// Drop data of struct mob_db, before and after.
+struct bench_mob {
+	struct { int nameid,p; } dropitem[BENCH_MOB_DROP];
+	struct { short index; int rate[4]; } droptable[BENCH_MOB_DROP];
+	int droptable_count;
+};
+
+static struct bench_mob bench_mob_db[BENCH_MOB_DB];
+
+/// Mobs with a few empty slots, some unknown items and rates like the ones of mob_db.txt.
+static void bench_makemobs(void)
+{
+	static const int rates[] = { 1, 5, 10, 25, 50, 100, 300, 1000, 3000, 5000, 7000, 10000 };
+	int i, j;
+
+	for( i = 1; i < BENCH_MAX_ITEM; ++i )
+		bench_item_exists[i] = ( bench_rand(100) < 97 );
+	for( i = 0; i < BENCH_MOB_DB; ++i )
+	{
+		struct bench_mob* mob = &bench_mob_db[i];
+		int used = 4 + bench_rand(BENCH_MOB_DROP - 3);
+		for( j = 0; j < used; ++j )
+		{
+			mob->dropitem[j].nameid = 501 + bench_rand(BENCH_MAX_ITEM - 501);
+			mob->dropitem[j].p = ( bench_rand(50) == 0 ) ? 0 : rates[bench_rand(ARRAYLENGTH(rates))];
+		}
+	}
+}
+
+/// mob_build_droptables
+static void bench_buildtables(void)
+{
+	int i, j;
+
+	for( i = 0; i < BENCH_MOB_DB; ++i )
+	{
+		struct bench_mob* mob = &bench_mob_db[i];
+		mob->droptable_count = 0;
+		for( j = 0; j < BENCH_MOB_DROP; ++j )
+		{
+			int rate;
+			if( mob->dropitem[j].nameid <= 0 || !bench_itemdb_exists(mob->dropitem[j].nameid) )
+				continue;
+			rate = mob->dropitem[j].p;
+			if( rate <= 0 ) {
+				if( drop_rate0item )
+					continue;
+				rate = 1;
+			}
+			mob->droptable[mob->droptable_count].index = j;
+			mob->droptable[mob->droptable_count].rate[0] = rate;
+			mob->droptable[mob->droptable_count].rate[1] = ( rate >= 2 ) ? rate/2 : rate;
+			mob->droptable[mob->droptable_count].rate[2] = rate*2;
+			mob->droptable[mob->droptable_count].rate[3] = rate;
+			mob->droptable_count++;
+		}
+	}
+}
+
+/// The drop loop of mob_dead before the drop tables.
+static int bench_dead_old(const struct bench_mob* mob, int size, const int* luk)
+{
+	int i, drops = 0;
+
+	for( i = 0; i < BENCH_MOB_DROP; i++ )
+	{
+		int drop_rate;
+		if( mob->dropitem[i].nameid <= 0 )
+			continue;
+		if( !bench_itemdb_exists(mob->dropitem[i].nameid) )
+			continue;
+		drop_rate = mob->dropitem[i].p;
+		if( drop_rate <= 0 ) {
+			if( drop_rate0item )
+				continue;
+			drop_rate = 1;
+		}
+		if( size == 1 && drop_rate >= 2 )
+			drop_rate /= 2;
+		else if( size == 2 )
+			drop_rate *= 2;
+		if( drops_by_luk )
+			drop_rate += bench_get_luk(luk)*drops_by_luk/100;
+		if( drops_by_luk2 )
+			drop_rate += (int)(0.5+drop_rate*bench_get_luk(luk)*drops_by_luk2/10000.);
+		if( pk_mode )
+			drop_rate = (int)(drop_rate*1.25);
+		if( rand() % 10000 >= drop_rate )
+			continue;
+		drops++;
+	}
+	return drops;
+}
+
+/// The drop loop of mob_dead with the drop tables.
+static int bench_dead_new(const struct bench_mob* mob, int size, const int* luk)
+{
+	uint32 rolls[BENCH_MOB_DROP];
+	int i, drops = 0;
+	int l = 0;
+
+	if( drops_by_luk || drops_by_luk2 )
+		l = bench_get_luk(luk);
+	rnd_fast_rolls(rolls, mob->droptable_count, 10000);
+	for( i = 0; i < mob->droptable_count; i++ )
+	{
+		int drop_rate = mob->droptable[i].rate[size];
+		if( drops_by_luk )
+			drop_rate += l*drops_by_luk/100;
+		if( drops_by_luk2 )
+			drop_rate += (int)(0.5+drop_rate*l*drops_by_luk2/10000.);
+		if( pk_mode )
+			drop_rate = (int)(drop_rate*1.25);
+		if( (int)rolls[i] >= drop_rate )
+			continue;
+		drops++;
+	}
+	return drops;
+}
+
+/// Expected drops of a kill (sum of the chances).
+static double bench_expected(const struct bench_mob* mob, int size, int luk)
+{
+	double sum = 0;
+	int i;
+
+	for( i = 0; i < mob->droptable_count; i++ )
+	{
+		int drop_rate = mob->droptable[i].rate[size];
+		if( drops_by_luk )
+			drop_rate += luk*drops_by_luk/100;
+		if( drops_by_luk2 )
+			drop_rate += (int)(0.5+drop_rate*luk*drops_by_luk2/10000.);
+		if( pk_mode )
+			drop_rate = (int)(drop_rate*1.25);
+		sum += min(drop_rate, 10000)/10000.;
+	}
+	return sum;
+}
+
+static void bench_drops(void)
+{
+	int* wave;
+	int i, j, kills;
+	int luk = 80;
+	int64 drops_old = 0, drops_new = 0;
+	double expected = 0;
+	unsigned int tick, t_old, t_new;
+
+	bench_makemobs();
+	bench_buildtables();
+
+	// a spawn holds a few kinds of mobs, a cast kills a wave of them
+	CREATE(wave, int, bench_wave*2);
+	for( i = 0; i < bench_wave; ++i )
+	{
+		int kind = i%4;
+		wave[i*2] = (kind*251 + 17)%BENCH_MOB_DB;
+		wave[i*2+1] = ( bench_rand(20) == 0 ) ? 1 + bench_rand(2) : 0; // a few small/big ones
+	}
+	kills = bench_kills/bench_wave*bench_wave;
+	for( i = 0; i < bench_wave; ++i )
+		expected += bench_expected(&bench_mob_db[wave[i*2]], wave[i*2+1], luk);
+	expected *= kills/bench_wave;
+
+	srand(42);
+	tick = gettick_nocache();
+	for( i = 0; i < kills; i += bench_wave )
+		for( j = 0; j < bench_wave; ++j )
+			drops_old += bench_dead_old(&bench_mob_db[wave[j*2]], wave[j*2+1], &luk);
+	t_old = gettick_nocache() - tick;
+
+	tick = gettick_nocache();
+	for( i = 0; i < kills; i += bench_wave )
+		for( j = 0; j < bench_wave; ++j )
+			drops_new += bench_dead_new(&bench_mob_db[wave[j*2]], wave[j*2+1], &luk);
+	t_new = gettick_nocache() - tick;
+
+	ShowInfo("drops of %d kills (%d per cast): dropitem loop %5u ms, drop tables %5u ms\n", kills, bench_wave, t_old, t_new);
+	ShowInfo("  drops: dropitem loop %.0f, drop tables %.0f, expected %.0f\n", (double)drops_old, (double)drops_new, expected);
+	// both are sums of independent rolls, their deviation is below sqrt(expected)
+	if( drops_old < expected - 6*sqrt(expected) || drops_old > expected + 6*sqrt(expected)
+	||  drops_new < expected - 6*sqrt(expected) || drops_new > expected + 6*sqrt(expected) )
+		ShowError("Drops are too far from the expected amount!\n");
+
+	aFree(wave);
+}
+
+/// Item group before (one entry per listed item) and after (alias table).
+struct bench_group {
+	int* expanded;
+	int expanded_qty;
+	int* nameid;
+	uint32* weight;
+	int qty;
+	struct rnd_alias* alias;
+};
+
+static void bench_makegroup(struct bench_group* g, int qty)
+{
+	int i, j;
+
+	memset(g, 0, sizeof(*g));
+	CREATE(g->expanded, int, BENCH_MAX_RANDITEM);
+	CREATE(g->nameid, int, qty);
+	CREATE(g->weight, uint32, qty);
+	for( i = 0; i < qty; ++i )
+	{
+		int k = ( bench_rand(10) == 0 ) ? 1 + bench_rand(40) : 1 + bench_rand(3);
+		if( g->expanded_qty + k >= BENCH_MAX_RANDITEM )
+			break;
+		g->nameid[i] = 501 + i;
+		g->weight[i] = k;
+		for( j = 0; j < k; ++j )
+			g->expanded[g->expanded_qty++] = g->nameid[i];
+	}
+	g->qty = i;
+	g->alias = rnd_alias_create(g->weight, g->qty);
+}
+
+static void bench_freegroup(struct bench_group* g)
+{
+	aFree(g->expanded);
+	aFree(g->nameid);
+	aFree(g->weight);
+	rnd_alias_destroy(g->alias);
+}
+
+static void bench_groups(int qty)
+{
+	struct bench_group g;
+	int* count;
+	int i, j, bad = 0;
+	int64 sum = 0;
+	unsigned int tick, t_old, t_new, t_find_old, t_find_new;
+
+	bench_makegroup(&g, qty);
+
+	tick = gettick_nocache();
+	for( i = 0; i < bench_picks; ++i )
+		sum += g.expanded[rand()%g.expanded_qty];
+	t_old = gettick_nocache() - tick;
+
+	CREATE(count, int, g.qty);
+	tick = gettick_nocache();
+	for( i = 0; i < bench_picks; ++i )
+		count[rnd_alias_pick(g.alias)]++;
+	t_new = gettick_nocache() - tick;
+
+	// itemdb_group_bonus: is the item in the group?
+	tick = gettick_nocache();
+	for( i = 0; i < bench_picks/100; ++i )
+	{
+		int nameid = 501 + i%(2*g.qty);
+		ARR_FIND(0, g.expanded_qty, j, g.expanded[j] == nameid);
+		sum += ( j < g.expanded_qty );
+	}
+	t_find_old = gettick_nocache() - tick;
+	tick = gettick_nocache();
+	for( i = 0; i < bench_picks/100; ++i )
+	{
+		int nameid = 501 + i%(2*g.qty);
+		ARR_FIND(0, g.qty, j, g.nameid[j] == nameid);
+		sum += ( j < g.qty );
+	}
+	t_find_new = gettick_nocache() - tick;
+
+	// every item has to come up as often as it was listed
+	for( i = 0; i < g.qty; ++i )
+	{
+		double expected = (double)bench_picks*g.weight[i]/g.expanded_qty;
+		if( count[i] < expected - 6*sqrt(expected) - 1 || count[i] > expected + 6*sqrt(expected) + 1 )
+			bad++;
+	}
+
+	// the checksum of the picks and lookups is printed so the compiler can't drop the loops
+	ShowInfo("group of %4d items (%5d entries): pick %4u ms -> %4u ms, lookup %4u ms -> %4u ms, %u -> %u bytes (checksum %08x)\n",
+		g.qty, g.expanded_qty, t_old, t_new, t_find_old, t_find_new,
+		(unsigned int)(BENCH_MAX_RANDITEM*sizeof(int)), (unsigned int)(g.qty*(sizeof(int)*2 + sizeof(uint32)*2)), (uint32)sum);
+	if( bad )
+		ShowError("%d items were not picked as often as they should be!\n", bad);
+
+	aFree(count);
+	bench_freegroup(&g);
+}
+
+int do_init(int argc, char** argv)
+{
+	int i;
+
+	for( i = 1; i < argc; ++i )
+	{
+		if( strcmp(argv[i], "--kills") == 0 && i+1 < argc )
+		{
+			bench_kills = atoi(argv[++i]);
+			bench_kills = max(1, bench_kills);
+		}
+		else if( strcmp(argv[i], "--wave") == 0 && i+1 < argc )
+		{
+			bench_wave = atoi(argv[++i]);
+			bench_wave = max(1, bench_wave);
+		}
+		else if( strcmp(argv[i], "--picks") == 0 && i+1 < argc )
+		{
+			bench_picks = atoi(argv[++i]);
+			bench_picks = max(100, bench_picks);
+		}
+	}
+	bench_kills = max(bench_kills, bench_wave);
+
+	rnd_seed(42);
+	ShowStatus("Comparing item group picks (%d picks per group)\n", bench_picks);
+	bench_groups(10);
+	bench_groups(150);
+	bench_groups(1500);
+	ShowStatus("Comparing mob drops (%d kills)\n", bench_kills);
+	bench_drops();
+
+	runflag = SERVER_STATE_STOP; // MINICORE
+	return 0;
+}
+
+void do_final(void) { }
+int parse_console(const char* buf) { return 0; }
+void set_server_type(void) { }
+void do_shutdown(void) { }
+void do_abort(void) { }
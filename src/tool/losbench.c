@@ -0,0 +1,252 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "../common/cbasetypes.h"
+#include "../common/core.h"
+#include "../common/los.h"
+#include "../common/malloc.h"
+#include "../common/showmsg.h"
+#include "../common/timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compares the line of sight checks of the bitplanes (common/los.c)
+// with the per-cell walk that path_search_long used before.
+// Usage: losbench [--size <map width/height>] [--lines <lines per test>] [--range <max distance>]
+
+int bench_size = 300;
+int bench_lines = 2000000;
+int bench_range = 14; // a bit more than the usual attack/skill range
+
+static uint32 bench_seed;
+
+static int bench_rand(int n)
+{
+	bench_seed = bench_seed*1103515245 + 12345;
+	return (int)((bench_seed>>8)%(uint32)n);
+}
+
+/// Cell flags as in struct mapcell.
+struct bench_cell {
+	unsigned char walkable : 1, shootable : 1, water : 1;
+};
+
+struct bench_map {
+	int xs, ys;
+	struct bench_cell* cell;
+};
+
+/// map_getcellp(CELL_CHKWALL)
+static int bench_getcell(const struct bench_map* m, int x, int y)
+{
+	struct bench_cell cell;
+
+	//NOTE: this intentionally overrides the last row and column
+	if( x < 0 || x >= m->xs-1 || y < 0 || y >= m->ys-1 )
+		return 0;
+	cell = m->cell[x + y*m->xs];
+	return (!cell.walkable && !cell.shootable);
+}
+
+/// The per-cell walk of path_search_long (without the path output).
+static bool bench_search_long(const struct bench_map* m, int x0, int y0, int x1, int y1)
+{
+	int dx, dy;
+	int wx = 0, wy = 0;
+	int weight;
+
+	dx = (x1 - x0);
+	if (dx < 0) {
+		swap(x0, x1);
+		swap(y0, y1);
+		dx = -dx;
+	}
+	dy = (y1 - y0);
+
+	if (bench_getcell(m,x1,y1))
+		return false;
+
+	if (dx > abs(dy))
+		weight = dx;
+	else
+		weight = abs(y1 - y0);
+
+	while (x0 != x1 || y0 != y1)
+	{
+		if (bench_getcell(m,x0,y0))
+			return false;
+		wx += dx;
+		wy += dy;
+		if (wx >= weight) {
+			wx -= weight;
+			x0++;
+		}
+		if (wy >= weight) {
+			wy -= weight;
+			y0++;
+		} else if (wy < 0) {
+			wy += weight;
+			y0--;
+		}
+	}
+	return true;
+}
+
+/// Map with the given percentage of walls, some of them grouped in blocks like buildings.
+static void bench_makemap(struct bench_map* m, int walls)
+{
+	int i, n;
+
+	m->xs = m->ys = bench_size;
+	CREATE(m->cell, struct bench_cell, m->xs*m->ys);
+	for( i = 0; i < m->xs*m->ys; ++i )
+	{
+		m->cell[i].walkable = 1;
+		m->cell[i].shootable = 1;
+	}
+	n = m->xs*m->ys*walls/100;
+	for( i = 0; i < n; )
+	{
+		int x = bench_rand(m->xs), y = bench_rand(m->ys);
+		int w = ( bench_rand(4) == 0 ) ? 1 + bench_rand(12) : 1;
+		int h = ( w > 1 ) ? 1 + bench_rand(12) : 1;
+		int bx, by;
+
+		for( by = y; by < y + h && by < m->ys; ++by )
+			for( bx = x; bx < x + w && bx < m->xs; ++bx, ++i )
+			{
+				struct bench_cell* cell = &m->cell[bx + by*m->xs];
+				cell->walkable = 0;
+				cell->shootable = ( bench_rand(5) == 0 ); // some cliffs, they don't block
+			}
+	}
+}
+
+/// Random lines of up to bench_range cells, repeat% of them check again one of the last lines.
+static int* bench_makelines(int repeat)
+{
+	int* lines;
+	int i;
+
+	CREATE(lines, int, bench_lines*4);
+	for( i = 0; i < bench_lines; ++i )
+	{
+		int* l = &lines[i*4];
+		if( i > 0 && bench_rand(100) < repeat )
+		{
+			int* p = &lines[(i - 1 - bench_rand(min(i, 64)))*4]; // one of the last 64 lines
+			memcpy(l, p, 4*sizeof(int));
+			if( bench_rand(2) )
+			{// other direction
+				swap(l[0], l[2]);
+				swap(l[1], l[3]);
+			}
+			continue;
+		}
+		l[0] = bench_rand(bench_size);
+		l[1] = bench_rand(bench_size);
+		l[2] = l[0] + bench_rand(2*bench_range+1) - bench_range;
+		l[3] = l[1] + bench_rand(2*bench_range+1) - bench_range;
+		l[2] = max(0, min(l[2], bench_size-1));
+		l[3] = max(0, min(l[3], bench_size-1));
+	}
+	return lines;
+}
+
+static void bench(int walls, int repeat)
+{
+	struct bench_map m;
+	struct los_map* lm;
+	int* lines;
+	int i, x, y;
+	int visible = 0, visible_trace = 0, visible_check = 0;
+	int diff_trace = 0, diff_check = 0;
+	unsigned int tick, t_cell, t_trace, t_check;
+	unsigned int hits, misses;
+
+	bench_seed = 42 + walls;
+	bench_makemap(&m, walls);
+	lines = bench_makelines(repeat);
+
+	lm = los_create(m.xs, m.ys);
+	for( y = 0; y < m.ys; ++y )
+		for( x = 0; x < m.xs; ++x )
+			if( bench_getcell(&m, x, y) )
+				los_setwall(lm, x, y, true);
+
+	tick = gettick_nocache();
+	for( i = 0; i < bench_lines; ++i )
+		visible += bench_search_long(&m, lines[i*4], lines[i*4+1], lines[i*4+2], lines[i*4+3]);
+	t_cell = gettick_nocache() - tick;
+
+	tick = gettick_nocache();
+	for( i = 0; i < bench_lines; ++i )
+		visible_trace += los_trace(lm, lines[i*4], lines[i*4+1], lines[i*4+2], lines[i*4+3]);
+	t_trace = gettick_nocache() - tick;
+
+	tick = gettick_nocache();
+	for( i = 0; i < bench_lines; ++i )
+		visible_check += los_check(lm, lines[i*4], lines[i*4+1], lines[i*4+2], lines[i*4+3]);
+	t_check = gettick_nocache() - tick;
+
+	for( i = 0; i < bench_lines; ++i )
+	{
+		const int* l = &lines[i*4];
+		bool expected = bench_search_long(&m, l[0], l[1], l[2], l[3]);
+		diff_trace += ( los_trace(lm, l[0], l[1], l[2], l[3]) != expected );
+		diff_check += ( los_check(lm, l[0], l[1], l[2], l[3]) != expected );
+	}
+	los_stats(lm, &hits, &misses);
+
+	ShowInfo("walls %2d%%, repeated %2d%%: per cell %5u ms, bitplanes %5u ms, cached %5u ms (%u%% hits), %d%% visible\n",
+		walls, repeat, t_cell, t_trace, t_check, hits*100/max(hits+misses, 1), (int)((int64)visible*100/bench_lines));
+	if( diff_trace != 0 || diff_check != 0 || visible_trace != visible || visible_check != visible )
+		ShowError("Results differ from the per-cell walk (bitplanes %d, cached %d)!\n", diff_trace, diff_check);
+
+	los_destroy(lm);
+	aFree(lines);
+	aFree(m.cell);
+}
+
+int do_init(int argc, char** argv)
+{
+	int i;
+
+	for( i = 1; i < argc; ++i )
+	{
+		if( strcmp(argv[i], "--size") == 0 && i+1 < argc )
+		{
+			bench_size = atoi(argv[++i]);
+			bench_size = max(2, bench_size);
+		}
+		else if( strcmp(argv[i], "--lines") == 0 && i+1 < argc )
+		{
+			bench_lines = atoi(argv[++i]);
+			bench_lines = max(1, bench_lines);
+		}
+		else if( strcmp(argv[i], "--range") == 0 && i+1 < argc )
+		{
+			bench_range = atoi(argv[++i]);
+			bench_range = max(1, bench_range);
+		}
+	}
+
+	ShowStatus("Comparing line of sight checks (%dx%d map, %d lines of up to %d cells)\n", bench_size, bench_size, bench_lines, bench_range);
+	bench(0, 0);
+	bench(5, 0);
+	bench(20, 0);
+	bench(40, 0);
+	bench(20, 50);
+	bench(20, 90);
+
+	runflag = SERVER_STATE_STOP; // MINICORE
+	return 0;
+}
+
+void do_final(void) { }
+int parse_console(const char* buf) { return 0; }
+void set_server_type(void) { }
+void do_shutdown(void) { }
+void do_abort(void) { }
@@ -0,0 +1,193 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "../common/cbasetypes.h"
+#include "../common/core.h"
+#include "../common/malloc.h"
+#include "../common/showmsg.h"
+#include "../common/thread.h"
+#include "../common/timer.h"
+#include "../common/utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compares the built-in memory manager (aMalloc) with the system malloc.
+// Usage: mallocbench [--ops <operations per thread>] [--threads <worker threads>] [--report]
+
+int bench_ops = 4000000;
+int bench_threads = 4;// up to BENCH_THREADS
+bool bench_report = false;
+
+#define BENCH_SLOTS 4096
+#define BENCH_THREADS 64
+
+/// Size mix of the server: mostly small structures, some strings and buffers.
+static size_t bench_size(uint32* seed)
+{
+	*seed = *seed*1103515245 + 12345;
+	switch( (*seed >> 16)%16 )
+	{
+	case 0:  return 1024 + (*seed >> 8)%3072;
+	case 1:
+	case 2:  return 128 + (*seed >> 8)%512;
+	default: return 8 + (*seed >> 8)%120;
+	}
+}
+
+struct bench_job
+{
+	bool system;// use the system malloc instead of aMalloc
+	uint32 seed;
+	uint32 sum;
+};
+
+/// Replaces random allocations in a set of live allocations.
+static void* bench_churn(void* param)
+{
+	struct bench_job* job = (struct bench_job*)param;
+	void* slot[BENCH_SLOTS];
+	int i;
+
+	memset(slot, 0, sizeof(slot));
+	for( i = 0; i < bench_ops; ++i )
+	{
+		int n = (int)((job->seed >> 8)%BENCH_SLOTS);
+		size_t size = bench_size(&job->seed);
+
+		if( job->system )
+		{
+			free(slot[n]);
+			slot[n] = malloc(size);
+		}
+		else
+		{
+			aFree(slot[n]);
+			slot[n] = aMalloc(size);
+		}
+		memset(slot[n], i, 8);
+		job->sum += ((unsigned char*)slot[n])[0];
+	}
+	for( i = 0; i < BENCH_SLOTS; ++i )
+	{
+		if( job->system )
+			free(slot[i]);
+		else
+			aFree(slot[i]);
+	}
+	return NULL;
+}
+
+/// Runs the churn on count threads (0 = on this thread) and returns the time in ms.
+static unsigned int bench_run(bool system, int count)
+{
+	struct bench_job jobs[BENCH_THREADS];
+	Thread* threads[BENCH_THREADS];
+	unsigned int tick;
+	int i;
+
+	for( i = 0; i < max(count, 1); ++i )
+	{
+		jobs[i].system = system;
+		jobs[i].seed = 42 + i;
+		jobs[i].sum = 0;
+	}
+
+	tick = gettick_nocache();
+	if( count == 0 )
+		bench_churn(&jobs[0]);
+	else
+	{
+		if( !system )
+			malloc_set_threaded(true);
+		for( i = 0; i < count; ++i )
+			threads[i] = thread_create(bench_churn, &jobs[i]);
+		for( i = 0; i < count; ++i )
+			thread_wait(threads[i], NULL);
+		if( !system )
+			malloc_set_threaded(false);
+	}
+	return gettick_nocache() - tick;
+}
+
+/// Resident memory of the process in KB (assuming 4 KB pages), 0 if unknown.
+static unsigned long bench_resident(void)
+{
+	unsigned long size, resident;
+	FILE* fp = fopen("/proc/self/statm", "r");
+
+	if( fp == NULL )
+		return 0;
+	if( fscanf(fp, "%lu %lu", &size, &resident) != 2 )
+		resident = 0;
+	fclose(fp);
+	return resident*4;
+}
+
+/// Allocates many small objects, frees them and reports the resident memory.
+static void bench_release(void)
+{
+	void** list;
+	unsigned int tick;
+	unsigned long resident[3];
+	int i, count = 1000000;
+
+	list = (void**)malloc(count*sizeof(void*));
+	resident[0] = bench_resident();
+	tick = gettick_nocache();
+	for( i = 0; i < count; ++i )
+		list[i] = aMalloc(64 + i%64);
+	resident[1] = bench_resident();
+	for( i = 0; i < count; ++i )
+		aFree(list[i]);
+	tick = gettick_nocache() - tick;
+	resident[2] = bench_resident();
+	ShowInfo("release   : %d allocations of 64-127 bytes made and freed in %u ms, resident %lu KB -> %lu KB -> %lu KB\n", count, tick, resident[0], resident[1], resident[2]);
+	free(list);
+}
+
+int do_init(int argc, char** argv)
+{
+	unsigned int t_memmgr, t_system;
+	int i;
+
+	for( i = 1; i < argc; ++i )
+	{
+		if( strcmp(argv[i], "--ops") == 0 && i+1 < argc )
+		{
+			bench_ops = atoi(argv[++i]);
+			bench_ops = max(1, bench_ops);
+		}
+		else if( strcmp(argv[i], "--threads") == 0 && i+1 < argc )
+		{
+			bench_threads = atoi(argv[++i]);
+			bench_threads = cap_value(bench_threads, 1, BENCH_THREADS);
+		}
+		else if( strcmp(argv[i], "--report") == 0 )
+			bench_report = true;
+	}
+
+	ShowStatus("Comparing aMalloc with the system malloc (%d operations per thread)\n", bench_ops);
+
+	t_memmgr = bench_run(false, 0);
+	t_system = bench_run(true, 0);
+	ShowInfo("1 thread  : aMalloc %5u ms, malloc %5u ms\n", t_memmgr, t_system);
+
+	t_memmgr = bench_run(false, bench_threads);
+	t_system = bench_run(true, bench_threads);
+	ShowInfo("%d threads : aMalloc %5u ms, malloc %5u ms\n", bench_threads, t_memmgr, t_system);
+
+	bench_release();
+	if( bench_report )
+		malloc_report(10);
+
+	runflag = SERVER_STATE_STOP; // MINICORE
+	return 0;
+}
+
+void do_final(void) { }
+int parse_console(const char* buf) { return 0; }
+void set_server_type(void) { }
+void do_shutdown(void) { }
+void do_abort(void) { }
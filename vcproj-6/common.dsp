@@ -148,6 +148,14 @@ SOURCE=..\src\common\lock.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\src\common\los.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\src\common\los.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\src\common\malloc.c
 # End Source File
 # Begin Source File
@@ -228,10 +236,18 @@ SOURCE=..\src\common\strlib.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\src\common\thread.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\src\common\timer.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\src\common\thread.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\src\common\timer.h
 # End Source File
 # Begin Source File
@@ -98,10 +98,18 @@ SOURCE=..\src\map\battle.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\src\map\battlebench.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\src\map\battle.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\src\map\battlebench.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\src\map\battleground.c
 # End Source File
 # Begin Source File